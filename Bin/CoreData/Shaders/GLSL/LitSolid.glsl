@@ -13,6 +13,9 @@
 #endif
 varying vec3 vNormal;
 varying vec4 vWorldPos;
+#ifdef INSTANCECOLOR
+    varying vec4 vInstanceColor;
+#endif
 #ifdef PERPIXEL
     #ifdef SHADOW
         varying vec4 vShadowPos[NUMCASCADES];
@@ -42,6 +45,10 @@ void VS()
     vNormal = GetWorldNormal(modelMatrix);
     vWorldPos = vec4(worldPos, GetDepth(gl_Position));
 
+    #ifdef INSTANCECOLOR
+        vInstanceColor = GetInstanceData();
+    #endif
+
     #ifdef NORMALMAP
         vec3 tangent = GetWorldTangent(modelMatrix);
         vec3 bitangent = cross(tangent, vNormal) * iTangent.w;
@@ -106,6 +113,14 @@ void PS()
     #else
         vec4 diffColor = cMatDiffColor;
     #endif
+
+    // Get emissive color, per-instance color multiplies it and the diffuse alpha
+    #ifdef INSTANCECOLOR
+        diffColor.a *= vInstanceColor.a;
+        vec3 emissiveColor = cMatEmissiveColor * vInstanceColor.rgb;
+    #else
+        vec3 emissiveColor = cMatEmissiveColor;
+    #endif
     
     // Get material specular albedo
     #ifdef SPECMAP
@@ -158,7 +173,7 @@ void PS()
 
         #ifdef AMBIENT
             finalColor += cAmbientColor * diffColor.rgb;
-            finalColor += cMatEmissiveColor;
+            finalColor += emissiveColor;
             gl_FragColor = vec4(GetFog(finalColor, fogFactor), diffColor.a);
         #else
             gl_FragColor = vec4(GetLitFog(finalColor, fogFactor), diffColor.a);
@@ -187,9 +202,9 @@ void PS()
             finalColor += texture2D(sEmissiveMap, vTexCoord2).rgb * diffColor.rgb;
         #endif
         #ifdef EMISSIVEMAP
-            finalColor += cMatEmissiveColor * texture2D(sEmissiveMap, vTexCoord.xy).rgb;
+            finalColor += emissiveColor * texture2D(sEmissiveMap, vTexCoord.xy).rgb;
         #else
-            finalColor += cMatEmissiveColor;
+            finalColor += emissiveColor;
         #endif
 
         gl_FragData[0] = vec4(GetFog(finalColor, fogFactor), 1.0);
@@ -220,9 +235,9 @@ void PS()
             finalColor += texture2D(sEmissiveMap, vTexCoord2).rgb * diffColor.rgb;
         #endif
         #ifdef EMISSIVEMAP
-            finalColor += cMatEmissiveColor * texture2D(sEmissiveMap, vTexCoord.xy).rgb;
+            finalColor += emissiveColor * texture2D(sEmissiveMap, vTexCoord.xy).rgb;
         #else
-            finalColor += cMatEmissiveColor;
+            finalColor += emissiveColor;
         #endif
 
         gl_FragColor = vec4(GetFog(finalColor, fogFactor), diffColor.a);
@@ -0,0 +1,50 @@
+#include "Uniforms.glsl"
+#include "Samplers.glsl"
+#include "Transform.glsl"
+#include "Fog.glsl"
+
+// Camera facing quads expanded from one float4 per particle: world position
+// in xyz, and w holding rgba as 6 bit fields of an integer exact in a float
+
+varying vec2 vTexCoord;
+varying vec4 vWorldPos;
+varying vec4 vColor;
+
+#ifdef COMPILEVS
+uniform float cParticleSize;
+#endif
+
+void VS()
+{
+    vec3 worldPos = iInstanceData.xyz + cCameraRot * vec3(iPos.xy * cParticleSize, 0.0);
+    gl_Position = GetClipPos(worldPos);
+    vTexCoord = vec2(iPos.x, -iPos.y) * 0.5 + 0.5;
+    vWorldPos = vec4(worldPos, GetDepth(gl_Position));
+
+    // the divisions are by powers of two, so they stay exact
+    float packed = iInstanceData.w;
+    float a = floor(packed / 262144.0);
+    packed -= a * 262144.0;
+    float b = floor(packed / 4096.0);
+    packed -= b * 4096.0;
+    float g = floor(packed / 64.0);
+    float r = packed - g * 64.0;
+    vColor = vec4(r, g, b, a) * (1.0 / 63.0);
+}
+
+void PS()
+{
+    #ifdef DIFFMAP
+        vec4 diffColor = cMatDiffColor * texture2D(sDiffMap, vTexCoord) * vColor;
+    #else
+        vec4 diffColor = cMatDiffColor * vColor;
+    #endif
+
+    #ifdef HEIGHTFOG
+        float fogFactor = GetHeightFogFactor(vWorldPos.w, vWorldPos.y);
+    #else
+        float fogFactor = GetFogFactor(vWorldPos.w);
+    #endif
+
+    gl_FragColor = vec4(GetFog(diffColor.rgb, fogFactor), diffColor.a);
+}
@@ -13,6 +13,7 @@ attribute vec4 iCubeTexCoord2;
     attribute vec4 iInstanceMatrix1;
     attribute vec4 iInstanceMatrix2;
     attribute vec4 iInstanceMatrix3;
+    attribute vec4 iInstanceData;
 #endif
 
 #ifdef SKINNED
@@ -85,6 +86,12 @@ vec3 GetBillboardNormal()
     #define iModelMatrix cModel
 #endif
 
+#ifdef INSTANCED
+    #define GetInstanceData() iInstanceData
+#else
+    #define GetInstanceData() cInstanceData
+#endif
+
 vec3 GetWorldPos(mat4 modelMatrix)
 {
     #if defined(SKINNED) || defined(INSTANCED)
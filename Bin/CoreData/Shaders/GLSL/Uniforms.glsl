@@ -11,6 +11,7 @@ uniform vec3 cFrustumSize;
 uniform float cDeltaTime;
 uniform float cElapsedTime;
 uniform vec4 cGBufferOffsets;
+uniform vec4 cInstanceData;
 uniform vec3 cLightDir;
 uniform vec4 cLightPos;
 uniform mat4 cModel;
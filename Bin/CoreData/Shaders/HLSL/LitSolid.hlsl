@@ -25,6 +25,9 @@ void VS(float4 iPos : POSITION,
     #endif
     #ifdef INSTANCED
         float4x3 iModelInstance : TEXCOORD2,
+        #ifdef INSTANCECOLOR
+            float4 iInstanceData : TEXCOORD5,
+        #endif
     #endif
     #ifdef BILLBOARD
         float2 iSize : TEXCOORD1,
@@ -37,6 +40,9 @@ void VS(float4 iPos : POSITION,
     #endif
     out float3 oNormal : TEXCOORD1,
     out float4 oWorldPos : TEXCOORD2,
+    #ifdef INSTANCECOLOR
+        out float4 oInstanceColor : COLOR0,
+    #endif
     #ifdef PERPIXEL
         #ifdef SHADOW
             out float4 oShadowPos[NUMCASCADES] : TEXCOORD4,
@@ -65,6 +71,10 @@ void VS(float4 iPos : POSITION,
     oNormal = GetWorldNormal(modelMatrix);
     oWorldPos = float4(worldPos, GetDepth(oPos));
 
+    #ifdef INSTANCECOLOR
+        oInstanceColor = GetInstanceData();
+    #endif
+
     #ifdef NORMALMAP
         float3 tangent = GetWorldTangent(modelMatrix);
         float3 bitangent = cross(tangent, oNormal) * iTangent.w;
@@ -124,6 +134,9 @@ void PS(
     #endif
     float3 iNormal : TEXCOORD1,
     float4 iWorldPos : TEXCOORD2,
+    #ifdef INSTANCECOLOR
+        float4 iInstanceColor : COLOR0,
+    #endif
     #ifdef PERPIXEL
         #ifdef SHADOW
             float4 iShadowPos[NUMCASCADES] : TEXCOORD4,
@@ -166,6 +179,14 @@ void PS(
         float4 diffColor = cMatDiffColor;
     #endif
 
+    // Get emissive color, per-instance color multiplies it and the diffuse alpha
+    #ifdef INSTANCECOLOR
+        diffColor.a *= iInstanceColor.a;
+        float3 emissiveColor = cMatEmissiveColor * iInstanceColor.rgb;
+    #else
+        float3 emissiveColor = cMatEmissiveColor;
+    #endif
+
     // Get material specular albedo
     #ifdef SPECMAP
         float3 specColor = cMatSpecColor.rgb * tex2D(sSpecMap, iTexCoord.xy).rgb;
@@ -222,7 +243,7 @@ void PS(
 
         #ifdef AMBIENT
             finalColor += cAmbientColor * diffColor.rgb;
-            finalColor += cMatEmissiveColor;
+            finalColor += emissiveColor;
             oColor = float4(GetFog(finalColor, fogFactor), diffColor.a);
         #else
             oColor = float4(GetLitFog(finalColor, fogFactor), diffColor.a);
@@ -250,9 +271,9 @@ void PS(
             finalColor += tex2D(sEmissiveMap, iTexCoord2).rgb * diffColor.rgb;
         #endif
         #ifdef EMISSIVEMAP
-            finalColor += cMatEmissiveColor * tex2D(sEmissiveMap, iTexCoord.xy).rgb;
+            finalColor += emissiveColor * tex2D(sEmissiveMap, iTexCoord.xy).rgb;
         #else
-            finalColor += cMatEmissiveColor;
+            finalColor += emissiveColor;
         #endif
 
         oColor = float4(GetFog(finalColor, fogFactor), 1.0);
@@ -283,9 +304,9 @@ void PS(
             finalColor += tex2D(sEmissiveMap, iTexCoord2).rgb * diffColor.rgb;
         #endif
         #ifdef EMISSIVEMAP
-            finalColor += cMatEmissiveColor * tex2D(sEmissiveMap, iTexCoord.xy).rgb;
+            finalColor += emissiveColor * tex2D(sEmissiveMap, iTexCoord.xy).rgb;
         #else
-            finalColor += cMatEmissiveColor;
+            finalColor += emissiveColor;
         #endif
 
         oColor = float4(GetFog(finalColor, fogFactor), diffColor.a);
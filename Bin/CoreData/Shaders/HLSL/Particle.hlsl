@@ -0,0 +1,54 @@
+#include "Uniforms.hlsl"
+#include "Samplers.hlsl"
+#include "Transform.hlsl"
+#include "Fog.hlsl"
+
+// Camera facing quads expanded from one float4 per particle: world position
+// in xyz, and w holding rgba as 6 bit fields of an integer exact in a float
+
+#ifdef COMPILEVS
+uniform float cParticleSize;
+#endif
+
+void VS(float4 iPos : POSITION,
+    float4 iInstanceData : TEXCOORD5,
+    out float2 oTexCoord : TEXCOORD0,
+    out float4 oWorldPos : TEXCOORD2,
+    out float4 oColor : COLOR0,
+    out float4 oPos : POSITION)
+{
+    float3 worldPos = iInstanceData.xyz + mul(float3(iPos.xy * cParticleSize, 0.0), cCameraRot);
+    oPos = GetClipPos(worldPos);
+    oTexCoord = float2(iPos.x, -iPos.y) * 0.5 + 0.5;
+    oWorldPos = float4(worldPos, GetDepth(oPos));
+
+    // the divisions are by powers of two, so they stay exact
+    float packed = iInstanceData.w;
+    float a = floor(packed / 262144.0);
+    packed -= a * 262144.0;
+    float b = floor(packed / 4096.0);
+    packed -= b * 4096.0;
+    float g = floor(packed / 64.0);
+    float r = packed - g * 64.0;
+    oColor = float4(r, g, b, a) * (1.0 / 63.0);
+}
+
+void PS(float2 iTexCoord : TEXCOORD0,
+    float4 iWorldPos: TEXCOORD2,
+    float4 iColor : COLOR0,
+    out float4 oColor : COLOR0)
+{
+    #ifdef DIFFMAP
+        float4 diffColor = cMatDiffColor * tex2D(sDiffMap, iTexCoord) * iColor;
+    #else
+        float4 diffColor = cMatDiffColor * iColor;
+    #endif
+
+    #ifdef HEIGHTFOG
+        float fogFactor = GetHeightFogFactor(iWorldPos.w, iWorldPos.y);
+    #else
+        float fogFactor = GetFogFactor(iWorldPos.w);
+    #endif
+
+    oColor = float4(GetFog(diffColor.rgb, fogFactor), diffColor.a);
+}
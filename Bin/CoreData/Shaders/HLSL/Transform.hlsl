@@ -47,6 +47,12 @@ float3 GetBillboardNormal()
     #define iModelMatrix cModel
 #endif
 
+#ifdef INSTANCED
+    #define GetInstanceData() iInstanceData
+#else
+    #define GetInstanceData() cInstanceData
+#endif
+
 #ifdef BILLBOARD
     #define GetWorldPos(modelMatrix) GetBillboardPos(iPos, iSize, modelMatrix)
 #else
@@ -12,6 +12,7 @@ uniform float cDeltaTime;
 uniform float cElapsedTime;
 uniform float3 cFrustumSize;
 uniform float4 cGBufferOffsets;
+uniform float4 cInstanceData;
 uniform float3 cLightDir;
 uniform float4 cLightPos;
 uniform float4x3 cModel;
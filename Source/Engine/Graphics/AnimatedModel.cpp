@@ -544,6 +544,60 @@ void AnimatedModel::SetMorphWeight(StringHash nameHash, float weight)
     }
 }
 
+void AnimatedModel::SetMorphWeights(const unsigned* indices, const float* weights, unsigned count)
+{
+    bool anyWeight = false;
+    for (unsigned i = 0; i < count; ++i)
+    {
+        if (indices[i] < morphs_.Size() && weights[i] > 0.0f)
+            anyWeight = true;
+    }
+
+    // If morph vertex buffers have not been created yet, create now
+    if (anyWeight && morphVertexBuffers_.Empty())
+        CloneGeometries();
+
+    // For a master model, the same morph weights are set on non-master models
+    PODVector<AnimatedModel*> models;
+    if (isMaster_)
+        GetComponents<AnimatedModel>(models);
+
+    bool changed = false;
+
+    for (unsigned i = 0; i < morphs_.Size(); ++i)
+    {
+        float weight = 0.0f;
+        for (unsigned j = 0; j < count; ++j)
+        {
+            if (indices[j] == i)
+            {
+                weight = Clamp(weights[j], 0.0f, 1.0f);
+                break;
+            }
+        }
+
+        if (weight != morphs_[i].weight_)
+        {
+            morphs_[i].weight_ = weight;
+            changed = true;
+
+            // Indexing might not be the same, so use the name hash instead
+            for (unsigned j = 1; j < models.Size(); ++j)
+            {
+                if (!models[j]->isMaster_)
+                    models[j]->SetMorphWeight(morphs_[i].nameHash_, weight);
+            }
+        }
+    }
+
+    // Mark dirty only once for the whole set
+    if (changed)
+    {
+        MarkMorphsDirty();
+        MarkNetworkUpdate();
+    }
+}
+
 void AnimatedModel::ResetMorphWeights()
 {
     for (Vector<ModelMorph>::Iterator i = morphs_.Begin(); i != morphs_.End(); ++i)
@@ -92,6 +92,8 @@ public:
     void SetMorphWeight(const String& name, float weight);
     /// Set vertex morph weight by name hash.
     void SetMorphWeight(StringHash nameHash, float weight);
+    /// Set several vertex morph weights by index at once, morphs not listed are reset to zero. Marks the morphs dirty only once.
+    void SetMorphWeights(const unsigned* indices, const float* weights, unsigned count);
     /// Reset all vertex morphs to zero.
     void ResetMorphWeights();
 
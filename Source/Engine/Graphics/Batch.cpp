@@ -43,6 +43,15 @@
 namespace Urho3D
 {
 
+/// Instancing buffer vertex.
+struct InstanceVertex
+{
+    /// World transform.
+    Matrix3x4 worldTransform_;
+    /// Per-instance shader data.
+    Vector4 instanceData_;
+};
+
 inline bool CompareBatchesState(Batch* lhs, Batch* rhs)
 {
     if (lhs->sortKey_ != rhs->sortKey_)
@@ -72,6 +81,12 @@ inline bool CompareInstancesFrontToBack(const InstanceData& lhs, const InstanceD
     return lhs.distance_ < rhs.distance_;
 }
 
+inline void CopyInstance(InstanceVertex& dest, const InstanceData& src)
+{
+    dest.worldTransform_ = *src.worldTransform_;
+    dest.instanceData_ = src.instanceData_ ? *src.instanceData_ : Vector4::ONE;
+}
+
 void CalculateShadowMatrix(Matrix4& dest, LightBatchQueue* queue, unsigned split, Renderer* renderer, const Vector3& translation)
 {
     Camera* shadowCamera = queue->shadowSplits_[split].shadowCamera_;
@@ -256,6 +271,8 @@ void Batch::Prepare(View* view, bool setModelTransform) const
         else
             graphics->SetShaderParameter(VSP_MODEL, *worldTransform_);
         
+        graphics->SetShaderParameter(VSP_INSTANCEDATA, instanceData_ ? *instanceData_ : Vector4::ONE);
+        
         // Set the orientation for billboards, either from the object itself or from the camera
         if (geometryType_ == GEOM_BILLBOARD)
         {
@@ -621,11 +638,11 @@ void BatchGroup::SetTransforms(void* lockedData, unsigned& freeIndex)
         return;
     
     startIndex_ = freeIndex;
-    Matrix3x4* dest = (Matrix3x4*)lockedData;
+    InstanceVertex* dest = (InstanceVertex*)lockedData;
     dest += freeIndex;
     
     for (unsigned i = 0; i < instances_.Size(); ++i)
-        *dest++ = *instances_[i].worldTransform_;
+        CopyInstance(*dest++, instances_[i]);
     
     freeIndex += instances_.Size();
 }
@@ -649,7 +666,11 @@ void BatchGroup::Draw(View* view) const
             for (unsigned i = 0; i < instances_.Size(); ++i)
             {
                 if (graphics->NeedParameterUpdate(SP_OBJECTTRANSFORM, instances_[i].worldTransform_))
+                {
                     graphics->SetShaderParameter(VSP_MODEL, *instances_[i].worldTransform_);
+                    graphics->SetShaderParameter(VSP_INSTANCEDATA, instances_[i].instanceData_ ? *instances_[i].instanceData_ :
+                        Vector4::ONE);
+                }
                 
                 graphics->Draw(geometry_->GetPrimitiveType(), geometry_->GetIndexStart(), geometry_->GetIndexCount(),
                     geometry_->GetVertexStart(), geometry_->GetVertexCount());
@@ -677,12 +698,12 @@ void BatchGroup::Draw(View* view) const
                     if (instances > instanceBuffer->GetVertexCount())
                         instances = instanceBuffer->GetVertexCount();
                     
-                    // Copy the transforms
-                    Matrix3x4* dest = (Matrix3x4*)instanceBuffer->Lock(0, instances, true);
+                    // Copy the transforms and instance data
+                    InstanceVertex* dest = (InstanceVertex*)instanceBuffer->Lock(0, instances, true);
                     if (dest)
                     {
                         for (unsigned i = 0; i < instances; ++i)
-                            dest[i] = *instances_[i + startIndex].worldTransform_;
+                            CopyInstance(dest[i], instances_[i + startIndex]);
                         instanceBuffer->Unlock();
                         
                         graphics->SetIndexBuffer(geometry_->GetIndexBuffer());
@@ -50,6 +50,7 @@ struct Batch
 {
     /// Construct with defaults.
     Batch() :
+        instanceData_(0),
         lightQueue_(0),
         isBase_(false)
     {
@@ -62,6 +63,7 @@ struct Batch
         material_(rhs.material_),
         worldTransform_(rhs.worldTransform_),
         numWorldTransforms_(rhs.numWorldTransforms_),
+        instanceData_(rhs.instanceData_),
         lightQueue_(0),
         geometryType_(rhs.geometryType_),
         overrideView_(rhs.overrideView_),
@@ -88,6 +90,8 @@ struct Batch
     const Matrix3x4* worldTransform_;
     /// Number of world transforms.
     unsigned numWorldTransforms_;
+    /// Per-instance shader data, or null to use the default.
+    const Vector4* instanceData_;
     /// Camera.
     Camera* camera_;
     /// Zone.
@@ -121,12 +125,15 @@ struct InstanceData
     /// Construct with transform and distance.
     InstanceData(const Matrix3x4* worldTransform, float distance) :
         worldTransform_(worldTransform),
+        instanceData_(0),
         distance_(distance)
     {
     }
     
     /// World transform.
     const Matrix3x4* worldTransform_;
+    /// Per-instance shader data, or null to use the default.
+    const Vector4* instanceData_;
     /// Distance from camera.
     float distance_;
 };
@@ -157,6 +164,7 @@ struct BatchGroup : public Batch
     {
         InstanceData newInstance;
         newInstance.distance_ = batch.distance_;
+        newInstance.instanceData_ = batch.instanceData_;
         
         for (unsigned i = 0; i < batch.numWorldTransforms_; ++i)
         {
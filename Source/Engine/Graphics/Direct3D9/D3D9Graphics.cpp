@@ -858,7 +858,7 @@ void Graphics::DrawInstanced(PrimitiveType type, unsigned indexStart, unsigned i
         VertexBuffer* buffer = vertexBuffers_[i];
         if (buffer)
         {
-            if (buffer->GetElementMask() & MASK_INSTANCEMATRIX1)
+            if (buffer->GetElementMask() & (MASK_INSTANCEMATRIX1 | MASK_INSTANCEDATA))
                 SetStreamFrequency(i, D3DSTREAMSOURCE_INSTANCEDATA | 1);
             else
                 SetStreamFrequency(i, D3DSTREAMSOURCE_INDEXEDDATA | instanceCount);
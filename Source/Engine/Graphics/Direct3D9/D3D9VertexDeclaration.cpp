@@ -45,7 +45,8 @@ const BYTE d3dElementType[] =
     D3DDECLTYPE_UBYTE4, // Blendindices
     D3DDECLTYPE_FLOAT4, // Instancematrix1
     D3DDECLTYPE_FLOAT4, // Instancematrix2
-    D3DDECLTYPE_FLOAT4 // Instancematrix3
+    D3DDECLTYPE_FLOAT4, // Instancematrix3
+    D3DDECLTYPE_FLOAT4 // Instancedata
 };
 
 const BYTE d3dElementUsage[] =
@@ -62,7 +63,8 @@ const BYTE d3dElementUsage[] =
     D3DDECLUSAGE_BLENDINDICES, // Blendindices
     D3DDECLUSAGE_TEXCOORD, // Instancematrix1
     D3DDECLUSAGE_TEXCOORD, // Instancematrix2
-    D3DDECLUSAGE_TEXCOORD // Instancematrix3
+    D3DDECLUSAGE_TEXCOORD, // Instancematrix3
+    D3DDECLUSAGE_TEXCOORD // Instancedata
 };
 
 const BYTE d3dElementUsageIndex[] =
@@ -79,7 +81,8 @@ const BYTE d3dElementUsageIndex[] =
     0, // Blendindices
     2, // Instancematrix1
     3, // Instancematrix2
-    4 // Instancematrix3
+    4, // Instancematrix3
+    5 // Instancedata
 };
 
 VertexDeclaration::VertexDeclaration(Graphics* graphics, unsigned elementMask) :
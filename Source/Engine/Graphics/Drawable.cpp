@@ -45,6 +45,7 @@ SourceBatch::SourceBatch() :
     geometry_(0),
     worldTransform_(&Matrix3x4::IDENTITY),
     numWorldTransforms_(1),
+    instanceData_(0),
     geometryType_(GEOM_STATIC),
     overrideView_(false)
 {
@@ -80,7 +81,8 @@ Drawable::Drawable(Context* context, unsigned char drawableFlags) :
     octant_(0),
     firstLight_(0),
     zone_(0),
-    zoneDirty_(false)
+    zoneDirty_(false),
+    instanceData_(Vector4::ONE)
 {
 }
 
@@ -176,6 +178,14 @@ void Drawable::SetLodBias(float bias)
     MarkNetworkUpdate();
 }
 
+void Drawable::SetInstanceData(const Vector4& data)
+{
+    instanceData_ = data;
+    
+    for (unsigned i = 0; i < batches_.Size(); ++i)
+        batches_[i].instanceData_ = &instanceData_;
+}
+
 void Drawable::SetViewMask(unsigned mask)
 {
     viewMask_ = mask;
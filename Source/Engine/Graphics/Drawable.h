@@ -26,6 +26,7 @@
 #include "Component.h"
 #include "GraphicsDefs.h"
 #include "HashSet.h"
+#include "Vector4.h"
 
 namespace Urho3D
 {
@@ -92,6 +93,8 @@ struct SourceBatch
     const Matrix3x4* worldTransform_;
     /// Number of world transforms.
     unsigned numWorldTransforms_;
+    /// Per-instance shader data, or null to use the default.
+    const Vector4* instanceData_;
     /// %Geometry type.
     GeometryType geometryType_;
     /// Override view transform flag.
@@ -158,6 +161,8 @@ public:
     void SetOccluder(bool enable);
     /// Set occludee flag.
     void SetOccludee(bool enable);
+    /// Set per-instance shader data, read as iInstanceData when instanced and as cInstanceData otherwise. Lets drawables sharing a material differ without cloning it. Applies to the current batches, so set after the model.
+    void SetInstanceData(const Vector4& data);
     /// Mark for update and octree reinsertion. Update is automatically queued when the drawable's scene node moves or changes scale.
     void MarkForUpdate();
     
@@ -189,6 +194,8 @@ public:
     bool IsOccluder() const { return occluder_; }
     /// Return occludee flag.
     bool IsOccludee() const { return occludee_; }
+    /// Return per-instance shader data.
+    const Vector4& GetInstanceData() const { return instanceData_; }
     /// Return whether is in view this frame from any viewport camera. Excludes shadow map cameras.
     bool IsInView() const;
     /// Return whether is in view of a specific camera this frame. Pass in a null camera to allow any camera, including shadow map cameras.
@@ -340,6 +347,8 @@ protected:
     bool zoneDirty_;
     /// Set of cameras from which is seen on the current frame.
     HashSet<Camera*> viewCameras_;
+    /// Per-instance shader data.
+    Vector4 instanceData_;
 };
 
 inline bool CompareDrawables(Drawable* lhs, Drawable* rhs)
@@ -44,7 +44,8 @@ Geometry::Geometry(Context* context) :
     rawVertexSize_(0),
     rawElementMask_(0),
     rawIndexSize_(0),
-    lodDistance_(0.0f)
+    lodDistance_(0.0f),
+    instanceCount_(0)
 {
     SetNumVertexBuffers(1);
 }
@@ -170,6 +171,11 @@ void Geometry::SetLodDistance(float distance)
     lodDistance_ = distance;
 }
 
+void Geometry::SetInstanceCount(unsigned count)
+{
+    instanceCount_ = count;
+}
+
 void Geometry::SetRawVertexData(SharedArrayPtr<unsigned char> data, unsigned vertexSize, unsigned elementMask)
 {
     rawVertexData_ = data;
@@ -189,7 +195,10 @@ void Geometry::Draw(Graphics* graphics)
     {
         graphics->SetIndexBuffer(indexBuffer_);
         graphics->SetVertexBuffers(vertexBuffers_, elementMasks_);
-        graphics->Draw(primitiveType_, indexStart_, indexCount_, vertexStart_, vertexCount_);
+        if (instanceCount_)
+            graphics->DrawInstanced(primitiveType_, indexStart_, indexCount_, vertexStart_, vertexCount_, instanceCount_);
+        else
+            graphics->Draw(primitiveType_, indexStart_, indexCount_, vertexStart_, vertexCount_);
     }
     else if (vertexCount_ > 0)
     {
@@ -57,6 +57,8 @@ public:
     bool SetDrawRange(PrimitiveType type, unsigned indexStart, unsigned indexCount, unsigned vertexStart, unsigned vertexCount, bool checkIllegal = true);
     /// Set the LOD distance.
     void SetLodDistance(float distance);
+    /// Set number of instances to draw from the per-instance vertex elements, or 0 for a normal draw. Requires an index buffer.
+    void SetInstanceCount(unsigned count);
     /// Override raw vertex data to be returned for CPU-side operations.
     void SetRawVertexData(SharedArrayPtr<unsigned char> data, unsigned vertexSize, unsigned elementMask);
     /// Override raw index data to be returned for CPU-side operations.
@@ -88,6 +90,8 @@ public:
     unsigned GetVertexCount() const { return vertexCount_; }
     /// Return LOD distance.
     float GetLodDistance() const { return lodDistance_; }
+    /// Return number of instances, 0 if not drawn instanced.
+    unsigned GetInstanceCount() const { return instanceCount_; }
     /// Return buffers' combined hash value for state sorting.
     unsigned short GetBufferHash() const;
     /// Return raw vertex and index data for CPU operations, or null pointers if not available.
@@ -135,6 +139,8 @@ private:
     unsigned rawIndexSize_;
     /// LOD distance.
     float lodDistance_;
+    /// Number of instances.
+    unsigned instanceCount_;
 };
 
 }
@@ -41,6 +41,7 @@ StringHash VSP_DELTATIME("DeltaTime");
 StringHash VSP_ELAPSEDTIME("ElapsedTime");
 StringHash VSP_FRUSTUMSIZE("FrustumSize");
 StringHash VSP_GBUFFEROFFSETS("GBufferOffsets");
+StringHash VSP_INSTANCEDATA("InstanceData");
 StringHash VSP_LIGHTDIR("LightDir");
 StringHash VSP_LIGHTPOS("LightPos");
 StringHash VSP_MODEL("Model");
@@ -128,6 +128,7 @@ enum VertexElement
     ELEMENT_INSTANCEMATRIX1,
     ELEMENT_INSTANCEMATRIX2,
     ELEMENT_INSTANCEMATRIX3,
+    ELEMENT_INSTANCEDATA,
     MAX_VERTEX_ELEMENTS
 };
 
@@ -210,6 +211,7 @@ extern StringHash VSP_DELTATIME;
 extern StringHash VSP_ELAPSEDTIME;
 extern StringHash VSP_FRUSTUMSIZE;
 extern StringHash VSP_GBUFFEROFFSETS;
+extern StringHash VSP_INSTANCEDATA;
 extern StringHash VSP_LIGHTDIR;
 extern StringHash VSP_LIGHTPOS;
 extern StringHash VSP_MODEL;
@@ -324,6 +326,7 @@ static const unsigned MASK_BLENDINDICES = 0x200;
 static const unsigned MASK_INSTANCEMATRIX1 = 0x400;
 static const unsigned MASK_INSTANCEMATRIX2 = 0x800;
 static const unsigned MASK_INSTANCEMATRIX3 = 0x1000;
+static const unsigned MASK_INSTANCEDATA = 0x2000;
 static const unsigned MASK_DEFAULT = 0xffffffff;
 static const unsigned NO_ELEMENT = 0xffffffff;
 
@@ -163,7 +163,7 @@ static const unsigned glStencilOps[] =
 // This avoids a skinning bug on GLES2 devices which only support 8.
 static const unsigned glVertexAttrIndex[] =
 {
-    0, 1, 2, 3, 4, 8, 9, 5, 6, 7, 10, 11, 12
+    0, 1, 2, 3, 4, 8, 9, 5, 6, 7, 10, 11, 12, 13
 };
 
 static const unsigned MAX_FRAMEBUFFER_AGE = 2000;
@@ -469,6 +469,7 @@ bool Graphics::SetMode(int width, int height, bool fullscreen, bool borderless,
             glVertexAttribDivisorARB(ELEMENT_INSTANCEMATRIX1, 1);
             glVertexAttribDivisorARB(ELEMENT_INSTANCEMATRIX2, 1);
             glVertexAttribDivisorARB(ELEMENT_INSTANCEMATRIX3, 1);
+            glVertexAttribDivisorARB(ELEMENT_INSTANCEDATA, 1);
         }
         
         #else
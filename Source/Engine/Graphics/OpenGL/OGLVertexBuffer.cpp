@@ -47,7 +47,8 @@ const unsigned VertexBuffer::elementSize[] =
     4 * sizeof(unsigned char), // Blendindices
     4 * sizeof(float), // Instancematrix1
     4 * sizeof(float), // Instancematrix2
-    4 * sizeof(float) // Instancematrix3
+    4 * sizeof(float), // Instancematrix3
+    4 * sizeof(float) // Instancedata
 };
 
 const unsigned VertexBuffer::elementType[] =
@@ -64,7 +65,8 @@ const unsigned VertexBuffer::elementType[] =
     GL_UNSIGNED_BYTE, // Blendindices
     GL_FLOAT, // Instancematrix1
     GL_FLOAT, // Instancematrix2
-    GL_FLOAT // Instancematrix3
+    GL_FLOAT, // Instancematrix3
+    GL_FLOAT // Instancedata
 };
 
 const unsigned VertexBuffer::elementComponents[] =
@@ -81,7 +83,8 @@ const unsigned VertexBuffer::elementComponents[] =
     4, // Blendindices
     4, // Instancematrix1
     4, // Instancematrix2
-    4 // Instancematrix3
+    4, // Instancematrix3
+    4 // Instancedata
 };
 
 const unsigned VertexBuffer::elementNormalize[] =
@@ -98,7 +101,8 @@ const unsigned VertexBuffer::elementNormalize[] =
     GL_FALSE, // Blendindices
     GL_FALSE, // Instancematrix1
     GL_FALSE, // Instancematrix2
-    GL_FALSE // Instancematrix3
+    GL_FALSE, // Instancematrix3
+    GL_FALSE // Instancedata
 };
 
 VertexBuffer::VertexBuffer(Context* context) :
@@ -19,7 +19,8 @@ extern "C"
 
 DEFINE_APPLICATION_MAIN(TBEClientApp)
 
-TBEClientApp::TBEClientApp(Context* context) : TBEApp(context)
+TBEClientApp::TBEClientApp(Context* context) : TBEApp(context),
+    timedemoFrames_(0)
 {
 
 }
@@ -31,9 +32,23 @@ void TBEClientApp::Setup()
     engineParameters_["WindowTitle"] = "QuakeToon";
     engineParameters_["LogName"]     = "QuakeToon.log";
     engineParameters_["FullScreen"]  = false;
-    engineParameters_["Headless"]    = false;
     engineParameters_["WindowWidth"]    = 1280;
     engineParameters_["WindowHeight"]    = 720;
+
+    // -headless is already parsed into the parameters, only default it
+    if (!engineParameters_.Contains("Headless"))
+        engineParameters_["Headless"] = false;
+
+    // -timedemo <demo> plays the demo unthrottled and prints the frame times
+    const Vector<String>& arguments = GetArguments();
+    for (unsigned i = 0; i + 1 < arguments.Size(); i++)
+    {
+        if (arguments[i].ToLower() == "-timedemo")
+            timedemo_ = arguments[i + 1];
+    }
+
+    if (timedemo_.Length())
+        engineParameters_["FrameLimiter"] = false;
 }
 
 /// Setup after engine initialization. Creates the logo, console & debug HUD.
@@ -47,26 +62,62 @@ void TBEClientApp::Start()
     ResourceCache* cache = GetSubsystem<ResourceCache>();
     XMLFile* xmlFile = cache->GetResource<XMLFile>("UI/DefaultStyle.xml");
 
-    // Create console
+    // Console and debug HUD are null when headless
     Console* console = engine_->CreateConsole();
-    console->SetDefaultStyle(xmlFile);
-    console->GetBackground()->SetOpacity(0.8f);
+    if (console)
+    {
+        console->SetDefaultStyle(xmlFile);
+        console->GetBackground()->SetOpacity(0.8f);
+    }
 
-    // Create debug HUD.
-    DebugHud* debugHud = engine_->CreateDebugHud();
-    debugHud->SetDefaultStyle(xmlFile);
-    debugHud->Toggle(DEBUGHUD_SHOW_ALL);
+    // The debug HUD restarts the profiler interval every second, which would
+    // cut the timedemo breakdown short
+    if (!timedemo_.Length())
+    {
+        DebugHud* debugHud = engine_->CreateDebugHud();
+        if (debugHud)
+        {
+            debugHud->SetDefaultStyle(xmlFile);
+            debugHud->Toggle(DEBUGHUD_SHOW_ALL);
+        }
+    }
 
-    CreateLogo();
+    if (!engine_->IsHeadless())
+        CreateLogo();
 
     // todo, define argc and argv as Urho3D also wants command line args
     //int argc = 5;
     //const char *argv[] = {"quake", "+map", "demo1", "+notarget", "+god"};
 
-    int argc = 3;
-    const char *argv[] = {"quake", "+demomap", "q2demo1.dm2"};
+    PODVector<const char*> argv;
+    argv.Push("quake");
+
+    if (timedemo_.Length())
+    {
+        const char *timedemo[] = {"+set", "timedemo", "1", "+demomap", timedemo_.CString()};
+        argv.Insert(argv.End(), timedemo, timedemo + 5);
+    }
+    else
+    {
+        argv.Push("+demomap");
+        argv.Push("q2demo1.dm2");
+    }
+
+    // +commands on the command line go to quake after the demo,
+    // e.g. -headless -timedemo q2demo1.dm2 +soundtest 10
+    const Vector<String>& arguments = GetArguments();
+    for (unsigned i = 0; i < arguments.Size(); i++)
+    {
+        if (!arguments[i].StartsWith("+"))
+            continue;
+
+        argv.Push(arguments[i].CString());
+        for (i++; i < arguments.Size() && !arguments[i].StartsWith("+") && !arguments[i].StartsWith("-"); i++)
+            argv.Push(arguments[i].CString());
+        i--;
+    }
 
-    Qcommon_Init (argc, (char**) argv);
+    Qcommon_Init (argv.Size(), (char**) &argv[0]);
 
     // Finally subscribe to the update event. Note that by subscribing events at this point we have already missed some events
     // like the ScreenMode event sent by the Graphics subsystem when opening the application window. To catch those as well we
@@ -111,6 +162,28 @@ void TBEClientApp::CreateLogo()
    logoSprite_->SetPriority(-100);
 }
 
+void TBEClientApp::UpdateTimedemo()
+{
+    if (cls.state == ca_active)
+    {
+        timedemoFrames_ = cl.timedemo_frames;
+        return;
+    }
+
+    // the server is killed when the demo ends, the client has printed the
+    // report by then. a demo that never started fails the run
+    if (cls.state == ca_disconnected && !Com_ServerState())
+    {
+        if (!timedemoFrames_)
+        {
+            Com_Printf ("timedemo: %s played no frames\n", timedemo_.CString());
+            exitCode_ = EXIT_FAILURE;
+        }
+
+        engine_->Exit();
+    }
+}
+
 void TBEClientApp::SubscribeToEvents()
 {
     SubscribeToEvent(E_UPDATE, HANDLER(TBEClientApp, HandleUpdate));
@@ -257,5 +330,8 @@ void TBEClientApp::HandleUpdate(StringHash eventType, VariantMap& eventData)
     }
 
     Qcommon_Frame((int) timeStep);
+
+    if (timedemo_.Length())
+        UpdateTimedemo();
 }
 
@@ -20,10 +20,15 @@ class TBEClientApp : public TBEApp
 
      SharedPtr<Sprite> logoSprite_;
 
+    // demo given with -timedemo, played as fast as possible and then quit
+    String timedemo_;
+    int timedemoFrames_;
+
     void SubscribeToEvents();
     void HandleUpdate(StringHash eventType, VariantMap& eventData);
 
     void CreateLogo();
+    void UpdateTimedemo();
 
 public:
     /// Construct.
@@ -0,0 +1,203 @@
+
+#include "Context.h"
+#include "Timer.h"
+#include "Scene.h"
+#include "Node.h"
+#include "Model.h"
+#include "Geometry.h"
+#include "VertexBuffer.h"
+#include "AnimatedModel.h"
+#include "TBESystem.h"
+#include "TBEAliasModel.h"
+#include "TBEMD2Model.h"
+
+// aliasbench [model] [entities] [ticks]
+//
+// Drives a number of animated copies of an alias model with a frame change
+// every tick and reports the CPU cost per entity of the string morph path
+// the bridge used to take, the indexed AnimatedModel::SetMorphWeights path
+// and MD2Model
+
+extern refimport_t ri;
+
+static float r_avertexnormals[NUMVERTEXNORMALS][3] = {
+    #include "TBEAliasNormals.h"
+};
+
+// rebuilds the per frame morphs the bridge used before MD2Model
+static SharedPtr<Model> BuildMorphModel(Model* base, MD2FrameData* frameData)
+{
+    Context* context = TBESystem::GetGlobalContext();
+
+    Geometry* geom = base->GetGeometry(0, 0);
+    unsigned numVertices = frameData->GetNumVertices();
+
+    SharedPtr<Model> model(new Model(context));
+    model->SetNumGeometries(1);
+    model->SetNumGeometryLodLevels(0, 1);
+    model->SetGeometry(0, 0, geom);
+    model->SetBoundingBox(base->GetBoundingBox());
+
+    Vector<ModelMorph> morphs;
+    PODVector<unsigned> morphRangeStarts;
+    PODVector<unsigned> morphRangeCounts;
+
+    morphRangeStarts.Push(0);
+    morphRangeCounts.Push(numVertices);
+
+    for (unsigned frame = 0; frame < frameData->GetNumFrames(); frame++)
+    {
+        ModelMorph morph;
+        morph.name_ = String(frame);
+        morph.nameHash_ = morph.name_;
+        morph.weight_ = 0.0f;
+
+        VertexBufferMorph vmorph;
+        unsigned vertexSize = sizeof(unsigned) + sizeof(Vector3) * 2;
+        vmorph.elementMask_ = MASK_POSITION | MASK_NORMAL;
+        vmorph.vertexCount_ = numVertices;
+        vmorph.morphData_ = new unsigned char[numVertices * vertexSize];
+
+        const MD2FrameData::Frame& f = frameData->GetFrame(frame);
+        const unsigned char* verts = frameData->GetVertices(frame);
+        unsigned char* dest = vmorph.morphData_.Get();
+
+        for (unsigned i = 0; i < numVertices; i++, verts += 4)
+        {
+            *((unsigned*) dest) = i;
+            dest += sizeof(unsigned);
+
+            float* v = (float*) dest;
+            v[0] = f.translate_.x_ + verts[0] * f.scale_.x_;
+            v[1] = f.translate_.y_ + verts[1] * f.scale_.y_;
+            v[2] = f.translate_.z_ + verts[2] * f.scale_.z_;
+            v[3] = r_avertexnormals[verts[3]][0];
+            v[4] = r_avertexnormals[verts[3]][2];
+            v[5] = r_avertexnormals[verts[3]][1];
+            dest += sizeof(Vector3) * 2;
+        }
+
+        morph.buffers_[0] = vmorph;
+        morphs.Push(morph);
+    }
+
+    model->SetMorphs(morphs);
+
+    Vector<SharedPtr<VertexBuffer> > vertexBuffers;
+    vertexBuffers.Push(SharedPtr<VertexBuffer>(geom->GetVertexBuffer(0)));
+    model->SetVertexBuffers(vertexBuffers, morphRangeStarts, morphRangeCounts);
+
+    return model;
+}
+
+void R_AliasBench_f (void)
+{
+    const char* name = ri.Cmd_Argc() > 1 ? ri.Cmd_Argv(1) : "models/monsters/soldier/tris.md2";
+    int numEntities = ri.Cmd_Argc() > 2 ? atoi(ri.Cmd_Argv(2)) : 500;
+    int numTicks = ri.Cmd_Argc() > 3 ? atoi(ri.Cmd_Argv(3)) : 100;
+
+    if (numEntities < 1 || numTicks < 1)
+    {
+        ri.Con_Printf (PRINT_ALL, "usage: aliasbench [model] [entities] [ticks]\n");
+        return;
+    }
+
+    model_t* mod = R_RegisterModel((char*) name);
+    if (!mod || mod->type != mod_alias)
+    {
+        ri.Con_Printf (PRINT_ALL, "aliasbench: %s is not an alias model\n", name);
+        return;
+    }
+
+    Model* base = GetAliasModel(mod);
+    MD2FrameData* frameData = GetAliasFrameData(mod);
+    if (!frameData)
+    {
+        ri.Con_Printf (PRINT_ALL, "aliasbench: %s has a single frame\n", name);
+        return;
+    }
+
+    Context* context = TBESystem::GetGlobalContext();
+    SharedPtr<Model> morphModel = BuildMorphModel(base, frameData);
+
+    // not attached to a viewport, only the CPU side of the update is measured
+    SharedPtr<Scene> scene(new Scene(context));
+
+    PODVector<AnimatedModel*> morphModels;
+    PODVector<MD2Model*> md2Models;
+
+    for (int i = 0; i < numEntities; i++)
+    {
+        AnimatedModel* animated = scene->CreateChild()->CreateComponent<AnimatedModel>();
+        animated->SetModel(morphModel);
+        morphModels.Push(animated);
+
+        MD2Model* md2 = scene->CreateChild()->CreateComponent<MD2Model>();
+        md2->SetAliasModel(base, frameData);
+        md2Models.Push(md2);
+    }
+
+    int numFrames = (int) frameData->GetNumFrames();
+    FrameInfo frameInfo;
+    frameInfo.frameNumber_ = 0;
+    frameInfo.timeStep_ = 0.0f;
+    frameInfo.camera_ = NULL;
+
+    HiresTimer timer;
+    long long usec[3] = { 0, 0, 0 };
+
+    for (int tick = 0; tick < numTicks; tick++)
+    {
+        float backlerp = 0.5f;
+
+        // string morph names, as the bridge did before MD2Model
+        timer.Reset();
+        for (int i = 0; i < numEntities; i++)
+        {
+            int frame = (tick + i + 1) % numFrames;
+            int oldframe = (tick + i) % numFrames;
+
+            AnimatedModel* animated = morphModels[i];
+            animated->ResetMorphWeights();
+            animated->SetMorphWeight(String(frame), 1.0f - backlerp);
+            animated->SetMorphWeight(String(oldframe), backlerp);
+            animated->UpdateGeometry(frameInfo);
+        }
+        usec[0] += timer.GetUSec(false);
+
+        // indexed bulk morph weights
+        timer.Reset();
+        for (int i = 0; i < numEntities; i++)
+        {
+            unsigned indices[2];
+            float weights[2];
+            indices[0] = (tick + i + 1) % numFrames;
+            indices[1] = (tick + i) % numFrames;
+            weights[0] = 1.0f - backlerp;
+            weights[1] = backlerp;
+
+            AnimatedModel* animated = morphModels[i];
+            animated->SetMorphWeights(indices, weights, 2);
+            animated->UpdateGeometry(frameInfo);
+        }
+        usec[1] += timer.GetUSec(false);
+
+        // quantized two frame lerp
+        timer.Reset();
+        for (int i = 0; i < numEntities; i++)
+        {
+            MD2Model* md2 = md2Models[i];
+            md2->SetFrames((tick + i + 1) % numFrames, (tick + i) % numFrames, backlerp);
+            md2->UpdateGeometry(frameInfo);
+        }
+        usec[2] += timer.GetUSec(false);
+    }
+
+    double scale = 1000.0 / ((double) numEntities * numTicks);
+
+    ri.Con_Printf (PRINT_ALL, "aliasbench: %s, %i verts, %i frames, %i entities, %i ticks\n",
+                   name, frameData->GetNumVertices(), numFrames, numEntities, numTicks);
+    ri.Con_Printf (PRINT_ALL, "  string morph weights  : %8.0f ns/entity\n", usec[0] * scale);
+    ri.Con_Printf (PRINT_ALL, "  indexed morph weights : %8.0f ns/entity\n", usec[1] * scale);
+    ri.Con_Printf (PRINT_ALL, "  MD2Model frame lerp   : %8.0f ns/entity\n", usec[2] * scale);
+}
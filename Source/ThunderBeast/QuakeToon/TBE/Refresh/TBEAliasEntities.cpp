@@ -0,0 +1,144 @@
+
+#include "Scene.h"
+#include "Node.h"
+#include "StaticModel.h"
+#include "TBEAliasModel.h"
+#include "TBEMD2Model.h"
+#include "TBEAliasEntities.h"
+
+// unused slots are looked for every this many frames
+static const unsigned PURGE_INTERVAL = 16;
+
+AliasEntityCache::AliasEntityCache() :
+    scene_(NULL),
+    frameNumber_(0),
+    maxUnusedFrames_(120),
+    castShadows_(true),
+    numCreated_(0),
+    numRemoved_(0)
+{
+}
+
+void AliasEntityCache::Clear()
+{
+    for (HashMap<Key, Slot>::Iterator i = slots_.Begin(); i != slots_.End(); ++i)
+        i->second_.node_->Remove();
+
+    slots_.Clear();
+    drawn_.Clear();
+    lastDrawn_.Clear();
+    unnumbered_.Clear();
+    lastKey_ = Key();
+
+    numCreated_ = 0;
+    numRemoved_ = 0;
+}
+
+void AliasEntityCache::BeginFrame()
+{
+    frameNumber_++;
+
+    lastDrawn_ = drawn_;
+    drawn_.Clear();
+
+    unnumbered_.Clear();
+    lastKey_ = Key();
+
+    numCreated_ = 0;
+    numRemoved_ = 0;
+}
+
+AliasEntityCache::Slot* AliasEntityCache::CreateSlot(const Key& key, const entity_t* ent)
+{
+    model_t* model = key.model_;
+
+    Slot slot;
+    slot.node_ = scene_->CreateChild("AliasModel");
+    slot.lastFrame_ = 0;
+
+    bool castShadows = castShadows_ && !(ent->flags & (RF_WEAPONMODEL | RF_VIEWERMODEL));
+
+    MD2FrameData* frameData = GetAliasFrameData(model);
+    if (!frameData)
+    {
+        slot.drawable_ = slot.node_->CreateComponent<StaticModel>();
+        slot.drawable_->SetModel(GetAliasModel(model));
+        slot.md2Model_ = NULL;
+    }
+    else
+    {
+        slot.md2Model_ = slot.node_->CreateComponent<MD2Model>();
+        slot.md2Model_->SetAliasModel(GetAliasModel(model), frameData);
+        slot.drawable_ = slot.md2Model_;
+    }
+
+    slot.drawable_->SetCastShadows(castShadows);
+
+    numCreated_++;
+
+    return &slots_.Insert(MakePair(key, slot))->second_;
+}
+
+AliasEntityCache::Slot* AliasEntityCache::GetSlot(const entity_t* ent)
+{
+    model_t* model = (model_t*) ent->model;
+
+    Key key(ent->entnum, model, 0);
+
+    if (!ent->entnum)
+    {
+        HashMap<model_t*, unsigned>::Iterator i = unnumbered_.Find(model);
+        if (i == unnumbered_.End())
+            unnumbered_.Insert(MakePair(model, 1u));
+        else
+            key.index_ = i->second_++;
+    }
+    else if (lastKey_.entnum_ == key.entnum_ && lastKey_.model_ == model)
+        key.index_ = lastKey_.index_ + 1;
+
+    lastKey_ = key;
+
+    Slot* slot;
+    HashMap<Key, Slot>::Iterator i = slots_.Find(key);
+    if (i == slots_.End())
+        slot = CreateSlot(key, ent);
+    else
+        slot = &i->second_;
+
+    // a slot may be returned twice if the client adds an entity twice
+    if (slot->lastFrame_ != frameNumber_)
+    {
+        slot->lastFrame_ = frameNumber_;
+        drawn_.Push(slot);
+
+        if (!slot->node_->IsEnabled())
+            slot->node_->SetEnabled(true);
+    }
+
+    return slot;
+}
+
+void AliasEntityCache::EndFrame()
+{
+    for (unsigned i = 0; i < lastDrawn_.Size(); i++)
+    {
+        Slot* slot = lastDrawn_[i];
+        if (slot->lastFrame_ != frameNumber_)
+            slot->node_->SetEnabled(false);
+    }
+
+    if (frameNumber_ % PURGE_INTERVAL)
+        return;
+
+    for (HashMap<Key, Slot>::Iterator i = slots_.Begin(); i != slots_.End();)
+    {
+        if (frameNumber_ - i->second_.lastFrame_ > maxUnusedFrames_)
+        {
+            i->second_.node_->Remove();
+            i = slots_.Erase(i);
+            numRemoved_++;
+        }
+        else
+            ++i;
+    }
+}
@@ -0,0 +1,122 @@
+
+#pragma once
+
+#include "TBEModelLoad.h"
+
+namespace Urho3D
+{
+    class Scene;
+    class Node;
+    class StaticModel;
+}
+
+using namespace Urho3D;
+
+class MD2Model;
+
+// Scene nodes of the alias entities, kept across frames per entity.
+// A slot is keyed by the client entity number and model, the shell and
+// linked model copies an entity adds are told apart by the order they are
+// added in. Entities without a number, temp entities and the view weapon,
+// are keyed by their order within the model. Only slots which stop being
+// drawn are disabled, and a slot unused for a number of frames has its
+// node removed. The slot is also where per entity state lives between frames
+class AliasEntityCache
+{
+public:
+
+    struct Slot
+    {
+        SharedPtr<Node> node_;
+        // the entity model, StaticModel or the MD2Model for animated models
+        StaticModel* drawable_;
+        MD2Model* md2Model_;
+        // frame the slot was last drawn in
+        unsigned lastFrame_;
+    };
+
+private:
+
+    struct Key
+    {
+        Key() :
+            entnum_(0),
+            model_(NULL),
+            index_(0)
+        {
+        }
+
+        Key(int entnum, model_t* model, unsigned index) :
+            entnum_(entnum),
+            model_(model),
+            index_(index)
+        {
+        }
+
+        bool operator == (const Key& rhs) const { return entnum_ == rhs.entnum_ && model_ == rhs.model_ && index_ == rhs.index_; }
+        bool operator != (const Key& rhs) const { return !(*this == rhs); }
+
+        unsigned ToHash() const { return (entnum_ * 31 + index_) * 31 + MakeHash(model_); }
+
+        int entnum_;
+        model_t* model_;
+        unsigned index_;
+    };
+
+    Scene* scene_;
+
+    HashMap<Key, Slot> slots_;
+
+    // slots drawn in the previous and the current frame, slot pointers
+    // stay valid as the map only removes slots unused for several frames
+    PODVector<Slot*> drawn_;
+    PODVector<Slot*> lastDrawn_;
+
+    // key of the previous entity, to number the copies of one entity
+    Key lastKey_;
+    // copies of each unnumbered model this frame
+    HashMap<model_t*, unsigned> unnumbered_;
+
+    unsigned frameNumber_;
+    unsigned maxUnusedFrames_;
+    bool castShadows_;
+
+    unsigned numCreated_;
+    unsigned numRemoved_;
+
+    Slot* CreateSlot(const Key& key, const entity_t* ent);
+
+public:
+
+    AliasEntityCache();
+
+    /// Remove all slots, the nodes are removed from their scene.
+    void Clear();
+
+    /// Set the scene new nodes are created in.
+    void SetScene(Scene* scene) { scene_ = scene; }
+    /// Set whether new nodes cast shadows, the view weapon and the viewer model never do.
+    void SetCastShadows(bool enable) { castShadows_ = enable; }
+
+    /// Set the number of frames after which an unused slot is removed.
+    void SetMaxUnusedFrames(unsigned frames) { maxUnusedFrames_ = frames; }
+    /// Return the number of frames after which an unused slot is removed.
+    unsigned GetMaxUnusedFrames() const { return maxUnusedFrames_; }
+
+    /// Start a frame of entities.
+    void BeginFrame();
+    /// Return the enabled slot of an alias entity, creating its node if needed. Entities must be added in refdef order.
+    Slot* GetSlot(const entity_t* ent);
+    /// Disable the slots not drawn this frame and remove the ones unused for too long.
+    void EndFrame();
+
+    /// Return number of slots.
+    unsigned GetNumSlots() const { return slots_.Size(); }
+    /// Return number of slots drawn this frame.
+    unsigned GetNumDrawn() const { return drawn_.Size(); }
+    /// Return number of nodes created by the last frame.
+    unsigned GetNumCreated() const { return numCreated_; }
+    /// Return number of nodes removed by the last frame.
+    unsigned GetNumRemoved() const { return numRemoved_; }
+
+};
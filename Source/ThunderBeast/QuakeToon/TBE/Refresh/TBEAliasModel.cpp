@@ -11,6 +11,7 @@
 #include "Model.h"
 #include "BoundingBox.h"
 #include "TBEAliasModel.h"
+#include "TBEMD2Model.h"
 #include "TBESystem.h"
 
 static float r_avertexnormals[NUMVERTEXNORMALS][3] = {
@@ -18,11 +19,15 @@ static float r_avertexnormals[NUMVERTEXNORMALS][3] = {
 };
 
 
+extern refimport_t ri;
+
 // should match the one in TBEMapModel.cpp
 static float _scale = .1f;
 static HashMap<model_t*, Model* > modelMap;
+static HashMap<model_t*, SharedPtr<MD2FrameData> > frameDataMap;
 
 static HashMap<String, SharedPtr<Material> > materialLookup;
+static HashMap<model_t*, Vector<SharedPtr<Material> > > skinMaterialMap;
 
 static Material* GetAliasMaterial(model_t* model, int skinnum)
 {
@@ -45,11 +50,11 @@ static Material* GetAliasMaterial(model_t* model, int skinnum)
         textureFile.Find("smoke") != String::NPOS ||
         textureFile.Find("flash") != String::NPOS)
     {
-        technique = cache->GetResource<Technique>("Techniques/DiffEmissiveAlpha.xml");
+        technique = cache->GetResource<Technique>("Techniques/DiffEmissiveInstanceColorAlpha.xml");
     }
     else
     {
-        technique = cache->GetResource<Technique>("Techniques/DiffEmissive.xml");
+        technique = cache->GetResource<Technique>("Techniques/DiffEmissiveInstanceColor.xml");
     }
 
     material->SetNumTechniques(1);
@@ -85,6 +90,37 @@ Model* GetAliasModel(model_t* model)
     int frame = 0;
     daliasframe_t *pFRAME = (daliasframe_t *)(pheader + palias->ofs_frames + frame * palias->framesize);
 
+    // weld the triangle soup, md2 triangles share vertices through their (xyz, st) index pairs
+    PODVector<unsigned short> weldXYZ;
+    PODVector<unsigned short> weldST;
+    PODVector<unsigned short> indices;
+    HashMap<unsigned, unsigned short> weldLookup;
+
+    for (int i = 0; i < palias->num_tris; i++)
+    {
+        dtriangle_t* tri = pTRI + i;
+
+        for (int j = 0; j < 3; j++)
+        {
+            unsigned key = ((unsigned) (unsigned short) tri->index_xyz[j] << 16) | (unsigned short) tri->index_st[j];
+
+            HashMap<unsigned, unsigned short>::Iterator witr = weldLookup.Find(key);
+            if (witr == weldLookup.End())
+            {
+                witr = weldLookup.Insert(MakePair(key, (unsigned short) weldXYZ.Size()));
+                weldXYZ.Push(tri->index_xyz[j]);
+                weldST.Push(tri->index_st[j]);
+            }
+
+            indices.Push(witr->second_);
+        }
+    }
+
+    int numVertices = weldXYZ.Size();
+    int numIndices = indices.Size();
+
+    ri.Con_Printf (PRINT_ALL, "%s: %i soup verts, %i welded\n", model->name, palias->num_tris * 3, numVertices);
+
     SharedPtr<IndexBuffer> ib;
     SharedPtr<VertexBuffer> vb;
 
@@ -102,21 +138,9 @@ Model* GetAliasModel(model_t* model)
     // going to need normal
     unsigned elementMask = MASK_POSITION  | MASK_NORMAL| MASK_TEXCOORD1;
 
-    int numVertices = palias->num_tris * 3;
     vb->SetSize(numVertices, elementMask);
-    ib->SetSize(palias->num_tris * 3, false);
-
-    // setup index data
-    unsigned short* indexData = (unsigned short*) ib->Lock(0, palias->num_tris * 3);
-
-    for (int i = 0; i < palias->num_tris; i++)
-    {
-        *indexData++ = i * 3;
-        *indexData++ = i * 3 + 1;
-        *indexData++ = i * 3 + 2;
-    }
-
-    ib->Unlock();
+    ib->SetSize(numIndices, false);
+    ib->SetData(&indices[0]);
 
     float* vertexData = (float *) vb->Lock(0, numVertices);
     Vector3 center = Vector3::ZERO;
@@ -124,57 +148,42 @@ Model* GetAliasModel(model_t* model)
     // this is what Q2 sets, safely covers model, we should tighten it
     BoundingBox bbox(-32.0f * _scale, 32.0f * _scale);
 
-    for (int i = 0; i < palias->num_tris; i++)
+    for (int i = 0; i < numVertices; i++)
     {
-        dtriangle_t* tri = pTRI + i;
+        int vidx = weldXYZ[i];
 
-        for (int j = 0; j < 3; j++)
-        {
-            int vidx = tri->index_xyz[j];
-
-            float x = float(pFRAME->verts[vidx].v[0]) * pFRAME->scale[0];
-            float y = float(pFRAME->verts[vidx].v[2]) * pFRAME->scale[2];
-            float z = float(pFRAME->verts[vidx].v[1]) * pFRAME->scale[1];
-
-            x += pFRAME->translate[0];
-            y += pFRAME->translate[2];
-            z += pFRAME->translate[1];
-
-            x *= _scale;
-            y *= _scale;
-            z *= _scale;
+        float x = float(pFRAME->verts[vidx].v[0]) * pFRAME->scale[0];
+        float y = float(pFRAME->verts[vidx].v[2]) * pFRAME->scale[2];
+        float z = float(pFRAME->verts[vidx].v[1]) * pFRAME->scale[1];
 
-            float nx = r_avertexnormals[pFRAME->verts[vidx].lightnormalindex][0];
-            float ny = r_avertexnormals[pFRAME->verts[vidx].lightnormalindex][2];
-            float nz = r_avertexnormals[pFRAME->verts[vidx].lightnormalindex][1];
+        x += pFRAME->translate[0];
+        y += pFRAME->translate[2];
+        z += pFRAME->translate[1];
 
-            float s = float(pST[tri->index_st[j]].s) / float(palias->skinwidth);
-            float t = float(pST[tri->index_st[j]].t) / float(palias->skinheight);
+        x *= _scale;
+        y *= _scale;
+        z *= _scale;
 
-            // this works for everything other than gun model
-            // otherwise scales are off... why?
-            if (palias->num_frames > 1)
-            {
-                x = y = z = 0.0f;
-                //nx = ny = nz = 0.0f;
-            }
+        float nx = r_avertexnormals[pFRAME->verts[vidx].lightnormalindex][0];
+        float ny = r_avertexnormals[pFRAME->verts[vidx].lightnormalindex][2];
+        float nz = r_avertexnormals[pFRAME->verts[vidx].lightnormalindex][1];
 
+        float s = float(pST[weldST[i]].s) / float(palias->skinwidth);
+        float t = float(pST[weldST[i]].t) / float(palias->skinheight);
 
-            *vertexData++ = x;
-            *vertexData++ = y;
-            *vertexData++ = z;
+        *vertexData++ = x;
+        *vertexData++ = y;
+        *vertexData++ = z;
 
-            *vertexData++ = nx;
-            *vertexData++ = ny;
-            *vertexData++ = nz;
+        *vertexData++ = nx;
+        *vertexData++ = ny;
+        *vertexData++ = nz;
 
-            *vertexData++ = s;
-            *vertexData++ = t;
+        *vertexData++ = s;
+        *vertexData++ = t;
 
-            //center += Vector3(x, y, z);
-            //bbox.Merge(Vector3(x, y, z));
-
-        }
+        //center += Vector3(x, y, z);
+        //bbox.Merge(Vector3(x, y, z));
 
     }
 
@@ -188,7 +197,7 @@ Model* GetAliasModel(model_t* model)
 
     geom->SetIndexBuffer(ib);
     geom->SetVertexBuffer(0, vb, elementMask);
-    geom->SetDrawRange(TRIANGLE_LIST, 0, palias->num_tris * 3, false);
+    geom->SetDrawRange(TRIANGLE_LIST, 0, numIndices, false);
 
 
     Model* nmodel = new Model(context);
@@ -202,97 +211,52 @@ Model* GetAliasModel(model_t* model)
 
     model->material = GetAliasMaterial(model, 0);
 
-    // generate morphs if any
+    // animated models keep their frames quantized, MD2Model lerps them per instance
     if (palias->num_frames > 1)
     {
-        Vector<ModelMorph> morphs;
+        SharedPtr<MD2FrameData> frameData(new MD2FrameData(palias, weldXYZ, _scale));
+        frameDataMap.Insert(MakePair(model, frameData));
 
-        PODVector<unsigned> morphRangeStarts;
-        PODVector<unsigned> morphRangeCounts;
-
-
-        for (frame = 0; frame < palias->num_frames; frame++)
-        {
-            morphRangeStarts.Push(0);
-            morphRangeCounts.Push(numVertices);
-            ModelMorph morph;
-            morph.name_ = String(frame);
-            morph.nameHash_ = morph.name_;
-            morph.weight_ = 0.0f;
-
-            VertexBufferMorph vmorph;
-
-            unsigned vertexSize = sizeof(unsigned);
-            vertexSize += sizeof(Vector3) * 2;
-            vmorph.elementMask_ = MASK_POSITION | MASK_NORMAL;
-            vmorph.vertexCount_ = numVertices;
-            vmorph.morphData_ = new unsigned char[numVertices * vertexSize];
-
-            morph.buffers_[0] = vmorph;
-
-            float *morphVertex = (float*) vmorph.morphData_.Get();
-
-            pFRAME = (daliasframe_t *)(pheader + palias->ofs_frames + frame * palias->framesize);
-
-            unsigned vcount = 0;
-            for (int i = 0; i < palias->num_tris; i++)
-            {
-                dtriangle_t* tri = pTRI + i;
-
-                for (int j = 0; j < 3; j++)
-                {
-                    int vidx = tri->index_xyz[j];
-
-                    float x = float(pFRAME->verts[vidx].v[0]) * pFRAME->scale[0];
-                    float y = float(pFRAME->verts[vidx].v[2]) * pFRAME->scale[2];
-                    float z = float(pFRAME->verts[vidx].v[1]) * pFRAME->scale[1];
-
-                    x += pFRAME->translate[0];
-                    y += pFRAME->translate[2];
-                    z += pFRAME->translate[1];
-
-                    x *= _scale;
-                    y *= _scale;
-                    z *= _scale;
-
-                    float nx = r_avertexnormals[pFRAME->verts[vidx].lightnormalindex][0];
-                    float ny = r_avertexnormals[pFRAME->verts[vidx].lightnormalindex][2];
-                    float nz = r_avertexnormals[pFRAME->verts[vidx].lightnormalindex][1];
-
-                    //float s = float(pST[tri->index_st[j]].s) / float(palias->skinwidth);
-                    //float t = float(pST[tri->index_st[j]].t) / float(palias->skinheight);
-
-                    unsigned* _vidx = (unsigned*) morphVertex;
-                    *_vidx++ = vcount++;
-
-                    morphVertex = (float*) _vidx;
-
-                    *morphVertex++ = x;
-                    *morphVertex++ = y;
-                    *morphVertex++ = z;
+        ri.Con_Printf (PRINT_ALL, "%s: %i frames, %i frame bytes\n", model->name, palias->num_frames, frameData->GetMemoryUse());
+    }
 
-                    *morphVertex++ = nx;
-                    *morphVertex++ = ny;
-                    *morphVertex++ = nz;
+    modelMap.Insert(MakePair(model, nmodel));
 
-                }
+    return nmodel;
 
-            }
+}
 
-            morphs.Push(morph);
+Material* GetAliasSkinMaterial(model_t* model, int skinnum)
+{
+    // same as ref_gl, bad skins draw the first skin
+    if (skinnum < 0 || skinnum >= MAX_MD2SKINS || !model->skins[skinnum])
+        skinnum = 0;
 
-        }
-        nmodel->SetMorphs(morphs);
+    HashMap<model_t*, Vector<SharedPtr<Material> > >::Iterator itr = skinMaterialMap.Find(model);
+    if (itr == skinMaterialMap.End())
+        itr = skinMaterialMap.Insert(MakePair(model, Vector<SharedPtr<Material> >(MAX_MD2SKINS)));
 
-        Vector<SharedPtr<VertexBuffer> > vertexBuffers;
-        vertexBuffers.Push(SharedPtr<VertexBuffer>(vb));
-        nmodel->SetVertexBuffers(vertexBuffers, morphRangeStarts, morphRangeCounts);
+    SharedPtr<Material>& material = itr->second_[skinnum];
+    if (material)
+        return material;
 
+    image_t* skin = model->skins[skinnum];
 
-    }
+    // the entity light and alpha multiply these through the instance color
+    material = model->material->Clone();
+    material->SetTexture(TU_DIFFUSE, skin ? skin->texture : NULL);
+    material->SetTexture(TU_EMISSIVE, skin ? skin->texture : NULL);
+    material->SetShaderParameter("MatDiffColor", Vector4(1, 1, 1, 1));
+    material->SetShaderParameter("MatEmissiveColor", Vector4(1, 1, 1, 1));
 
-    modelMap.Insert(MakePair(model, nmodel));
+    return material;
+}
 
-    return nmodel;
+MD2FrameData* GetAliasFrameData(model_t* model)
+{
+    HashMap<model_t*, SharedPtr<MD2FrameData> >::Iterator itr = frameDataMap.Find(model);
+    if (itr != frameDataMap.End())
+        return itr->second_;
 
+    return NULL;
 }
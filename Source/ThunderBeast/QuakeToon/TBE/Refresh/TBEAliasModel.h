@@ -6,11 +6,21 @@
 namespace Urho3D
 {
     class Model;
+    class Material;
 }
 
 using namespace Urho3D;
 
+class MD2FrameData;
+
 Model* GetAliasModel(model_t* model);
 
+// material shared by every entity using the skin, entity light and alpha
+// are set per drawable with SetInstanceData
+Material* GetAliasSkinMaterial(model_t* model, int skinnum);
+
+// returns NULL for single frame models
+MD2FrameData* GetAliasFrameData(model_t* model);
+
 
 
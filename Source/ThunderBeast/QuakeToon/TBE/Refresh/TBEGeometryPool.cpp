@@ -0,0 +1,125 @@
+
+#include "Context.h"
+#include "Geometry.h"
+#include "VertexBuffer.h"
+#include "IndexBuffer.h"
+#include "TBESystem.h"
+#include "TBEGeometryPool.h"
+
+GeometryPool::GeometryPool(unsigned elementMask) :
+    elementMask_(elementMask),
+    vertexSize_(VertexBuffer::GetVertexSize(elementMask)),
+    numBuffersCreated_(0),
+    bytesUploaded_(0)
+{
+}
+
+void GeometryPool::Clear()
+{
+    vertexData_.Clear();
+    indexData_.Clear();
+    pending_.Clear();
+
+    vertexBuffer_.Reset();
+    indexBuffer_.Reset();
+
+    numBuffersCreated_ = 0;
+    bytesUploaded_ = 0;
+}
+
+unsigned GeometryPool::GetNumVertices() const
+{
+    return vertexData_.Size() * sizeof(float) / vertexSize_;
+}
+
+float* GeometryPool::AllocVertices(unsigned count)
+{
+    unsigned start = vertexData_.Size();
+    vertexData_.Resize(start + count * vertexSize_ / sizeof(float));
+    return &vertexData_[start];
+}
+
+unsigned* GeometryPool::AllocIndices(unsigned count)
+{
+    unsigned start = indexData_.Size();
+    indexData_.Resize(start + count);
+    return &indexData_[start];
+}
+
+Geometry* GeometryPool::CreateGeometry(unsigned indexStart, unsigned indexCount, unsigned vertexStart, unsigned vertexCount)
+{
+    Geometry* geom = new Geometry(TBESystem::GetGlobalContext());
+
+    PendingGeometry pending;
+    pending.geometry_ = geom;
+    pending.indexStart_ = indexStart;
+    pending.indexCount_ = indexCount;
+    pending.vertexStart_ = vertexStart;
+    pending.vertexCount_ = vertexCount;
+    pending_.Push(pending);
+
+    return geom;
+}
+
+bool GeometryPool::HasLargeIndices() const
+{
+    if (indexBuffer_)
+        return indexBuffer_->GetIndexSize() > sizeof(unsigned short);
+
+    return GetNumVertices() > 65535;
+}
+
+void GeometryPool::Commit()
+{
+    Context* context = TBESystem::GetGlobalContext();
+
+    unsigned numVertices = GetNumVertices();
+    unsigned numIndices = indexData_.Size();
+
+    if (!numVertices || !numIndices)
+        return;
+
+    vertexBuffer_ = new VertexBuffer(context);
+    vertexBuffer_->SetSize(numVertices, elementMask_);
+    vertexBuffer_->SetData(&vertexData_[0]);
+    numBuffersCreated_++;
+    bytesUploaded_ += numVertices * vertexSize_;
+
+    bool largeIndices = numVertices > 65535;
+
+    indexBuffer_ = new IndexBuffer(context);
+    indexBuffer_->SetSize(numIndices, largeIndices);
+
+    if (largeIndices)
+    {
+        indexBuffer_->SetData(&indexData_[0]);
+        bytesUploaded_ += numIndices * sizeof(unsigned);
+    }
+    else
+    {
+        PODVector<unsigned short> shortIndices(numIndices);
+        for (unsigned i = 0; i < numIndices; i++)
+            shortIndices[i] = (unsigned short) indexData_[i];
+
+        indexBuffer_->SetData(&shortIndices[0]);
+        bytesUploaded_ += numIndices * sizeof(unsigned short);
+    }
+
+    numBuffersCreated_++;
+
+    for (unsigned i = 0; i < pending_.Size(); i++)
+    {
+        const PendingGeometry& pending = pending_[i];
+        Geometry* geom = pending.geometry_;
+
+        geom->SetIndexBuffer(indexBuffer_);
+        geom->SetVertexBuffer(0, vertexBuffer_, elementMask_);
+        geom->SetDrawRange(TRIANGLE_LIST, pending.indexStart_, pending.indexCount_,
+                           pending.vertexStart_, pending.vertexCount_);
+    }
+
+    // the GPU copies are all that's needed from here on
+    vertexData_.Clear();
+    indexData_.Clear();
+    pending_.Clear();
+}
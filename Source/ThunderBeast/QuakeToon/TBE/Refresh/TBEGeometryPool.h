@@ -0,0 +1,73 @@
+
+#pragma once
+
+#include "Vector.h"
+#include "Ptr.h"
+
+namespace Urho3D
+{
+    class Geometry;
+    class VertexBuffer;
+    class IndexBuffer;
+}
+
+using namespace Urho3D;
+
+// Collects the vertices and indices of every world and inline brush submesh
+// into one vertex buffer and one index buffer for the whole map, the
+// submesh geometries then only differ by draw range
+class GeometryPool
+{
+    struct PendingGeometry
+    {
+        Geometry* geometry_;
+        unsigned indexStart_;
+        unsigned indexCount_;
+        unsigned vertexStart_;
+        unsigned vertexCount_;
+    };
+
+    unsigned elementMask_;
+    unsigned vertexSize_;
+
+    PODVector<float> vertexData_;
+    PODVector<unsigned> indexData_;
+    PODVector<PendingGeometry> pending_;
+
+    SharedPtr<VertexBuffer> vertexBuffer_;
+    SharedPtr<IndexBuffer> indexBuffer_;
+
+    unsigned numBuffersCreated_;
+    unsigned bytesUploaded_;
+
+public:
+
+    GeometryPool(unsigned elementMask);
+
+    /// Release the buffers and any pending data.
+    void Clear();
+
+    /// Return the index the next allocated vertex will have.
+    unsigned GetNumVertices() const;
+    /// Return the position the next allocated index will have.
+    unsigned GetNumIndices() const { return indexData_.Size(); }
+
+    /// Allocate vertices, the returned pointer is valid until the next allocation.
+    float* AllocVertices(unsigned count);
+    /// Allocate indices, these index the whole pool so add GetNumVertices() from before the vertex allocation.
+    unsigned* AllocIndices(unsigned count);
+
+    /// Create a triangle list geometry, its buffers are assigned by Commit.
+    Geometry* CreateGeometry(unsigned indexStart, unsigned indexCount, unsigned vertexStart, unsigned vertexCount);
+
+    /// Create and fill the shared buffers and assign them to the pending geometries.
+    void Commit();
+
+    /// Return number of GPU buffers created.
+    unsigned GetNumBuffersCreated() const { return numBuffersCreated_; }
+    /// Return number of bytes uploaded to the GPU buffers.
+    unsigned GetBytesUploaded() const { return bytesUploaded_; }
+    /// Return whether 32-bit indices are in use.
+    bool HasLargeIndices() const;
+
+};
@@ -157,7 +157,7 @@ static void GL_GetWalSize (char *name, int& width, int &height)
 {
     miptex_t	*mt;
 
-    ri.FS_LoadFile (name, (void **)&mt);
+    ri.FS_LoadFileReadOnly (name, (void **)&mt);
     if (!mt)
     {
         ri.Con_Printf (PRINT_ALL, "GL_GetWalSize: can't load %s\n", name);
@@ -0,0 +1,351 @@
+
+#include "Context.h"
+#include "Timer.h"
+#include "WorkQueue.h"
+#include "Texture2D.h"
+#include "TBESystem.h"
+#include "TBELightmaps.h"
+
+void R_BuildLightMapBlock (msurface_t *surf, byte *dest, int stride, float *blocklights);
+void R_SetCacheState( msurface_t *surf );
+
+static const int LIGHTMAP_BYTES = 4;
+
+// floats of blocklights R_BuildLightMapBlock needs, LIGHTMAP_BLOCKLIGHTS in TBESurface.cpp
+static const int LIGHTMAP_BLOCKLIGHTS = 34*34*3;
+
+// below this many surfaces the work items cost more than they save
+static const unsigned MIN_SURFACES_PER_WORK_ITEM = 16;
+
+// lightmaps of the switchable styles and the base style are rebuilt in place,
+// the animated styles 1-31 are left alone as before
+static inline bool StyleRebuildsLightmap(int style)
+{
+    return style >= 32 || style == 0;
+}
+
+static inline bool SurfaceHasLightmap(msurface_t* surf)
+{
+    if (surf->texinfo->flags & (SURF_SKY|SURF_TRANS33|SURF_TRANS66|SURF_WARP))
+        return false;
+
+    // R_BuildLightMapBlock would drop to the console, which must not happen on a worker thread
+    int size = ((surf->extents[0]>>4)+1) * ((surf->extents[1]>>4)+1);
+    return size <= (int) ((LIGHTMAP_BLOCKLIGHTS * sizeof(float))>>4);
+}
+
+void BuildLightmapsWork(const WorkItem* item, unsigned threadIndex)
+{
+    LightmapUpdater* updater = reinterpret_cast<LightmapUpdater*>(item->aux_);
+    const unsigned* start = reinterpret_cast<const unsigned*>(item->start_);
+    const unsigned* end = reinterpret_cast<const unsigned*>(item->end_);
+
+    updater->BuildSurfaces(start, end, threadIndex);
+}
+
+LightmapUpdater::LightmapUpdater() :
+    surfaces_(NULL),
+    frameNumber_(0),
+    parallel_(true),
+    numSurfacesRebuilt_(0),
+    numPagesUploaded_(0),
+    bytesUploaded_(0),
+    numWorkItems_(0)
+{
+    for (int i = 0; i < MAX_LIGHTSTYLES; i++)
+        styleWhite_[i] = -1.0f;
+}
+
+void LightmapUpdater::Clear()
+{
+    pages_.Clear();
+
+    surfaces_ = NULL;
+    styleSurfaceStart_.Clear();
+    styleSurfaces_.Clear();
+    surfaceVisit_.Clear();
+    litSurfaces_.Clear();
+    rebuildSurfaces_.Clear();
+
+    for (int i = 0; i < MAX_LIGHTSTYLES; i++)
+        styleWhite_[i] = -1.0f;
+
+    numSurfacesRebuilt_ = 0;
+    numPagesUploaded_ = 0;
+    bytesUploaded_ = 0;
+    numWorkItems_ = 0;
+}
+
+void LightmapUpdater::AddPage(Texture2D* texture, int width, int height, const unsigned char* data)
+{
+    Page page;
+    page.texture_ = texture;
+    page.width_ = width;
+    page.height_ = height;
+    page.dirtyMin_ = height;
+    page.dirtyMax_ = -1;
+
+    page.data_.Resize(width * height * LIGHTMAP_BYTES);
+    memcpy(&page.data_[0], data, page.data_.Size());
+
+    pages_.Push(page);
+}
+
+Texture2D* LightmapUpdater::GetPageTexture(unsigned index) const
+{
+    return index < pages_.Size() ? pages_[index].texture_ : (Texture2D*) NULL;
+}
+
+void LightmapUpdater::Build(model_t* worldmodel)
+{
+    styleSurfaceStart_.Clear();
+    styleSurfaces_.Clear();
+    litSurfaces_.Clear();
+
+    surfaces_ = worldmodel->surfaces;
+    surfaceVisit_.Resize(worldmodel->numsurfaces);
+    for (unsigned i = 0; i < surfaceVisit_.Size(); i++)
+        surfaceVisit_[i] = 0;
+
+    frameNumber_ = 0;
+
+    for (int i = 0; i < MAX_LIGHTSTYLES; i++)
+        styleWhite_[i] = -1.0f;
+
+    // count per style, then fill
+    PODVector<unsigned> counts(MAX_LIGHTSTYLES);
+    for (int i = 0; i < MAX_LIGHTSTYLES; i++)
+        counts[i] = 0;
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        if (pass == 1)
+        {
+            styleSurfaceStart_.Resize(MAX_LIGHTSTYLES + 1);
+            unsigned start = 0;
+            for (int i = 0; i < MAX_LIGHTSTYLES; i++)
+            {
+                styleSurfaceStart_[i] = start;
+                start += counts[i];
+                counts[i] = 0;
+            }
+            styleSurfaceStart_[MAX_LIGHTSTYLES] = start;
+            styleSurfaces_.Resize(start);
+        }
+
+        msurface_t* surf = worldmodel->surfaces + worldmodel->firstmodelsurface;
+        for (int j = 0; j < worldmodel->nummodelsurfaces; j++, surf++)
+        {
+            if (!SurfaceHasLightmap(surf) || surf->lightmaptexturenum >= (int) pages_.Size())
+                continue;
+
+            if (pass == 1)
+                litSurfaces_.Push((unsigned) (surf - surfaces_));
+
+            for (int maps = 0; maps < MAXLIGHTMAPS && surf->styles[maps] != 255; maps++)
+            {
+                int style = surf->styles[maps];
+
+                if (!StyleRebuildsLightmap(style))
+                    continue;
+
+                if (pass == 1)
+                    styleSurfaces_[styleSurfaceStart_[style] + counts[style]] = (unsigned) (surf - surfaces_);
+
+                counts[style]++;
+            }
+        }
+    }
+}
+
+void LightmapUpdater::MarkDirty(msurface_t* surf)
+{
+    Page& page = pages_[surf->lightmaptexturenum];
+
+    int tmax = (surf->extents[1]>>4)+1;
+
+    if (surf->light_t < page.dirtyMin_)
+        page.dirtyMin_ = surf->light_t;
+    if (surf->light_t + tmax - 1 > page.dirtyMax_)
+        page.dirtyMax_ = surf->light_t + tmax - 1;
+}
+
+void LightmapUpdater::BuildSurfaces(const unsigned* start, const unsigned* end, unsigned threadIndex)
+{
+    float* blocklights = &blocklights_[threadIndex * LIGHTMAP_BLOCKLIGHTS];
+
+    for (const unsigned* i = start; i < end; i++)
+    {
+        msurface_t* surf = surfaces_ + *i;
+        int width = pages_[surf->lightmaptexturenum].width_;
+
+        unsigned char* dest = buildPages_[surf->lightmaptexturenum] + (surf->light_t * width + surf->light_s) * LIGHTMAP_BYTES;
+
+        R_BuildLightMapBlock(surf, dest, width * LIGHTMAP_BYTES, blocklights);
+    }
+}
+
+void LightmapUpdater::BuildSurfaces(const PODVector<unsigned>& surfaces, bool parallel)
+{
+    WorkQueue* queue = TBESystem::GetGlobalContext()->GetSubsystem<WorkQueue>();
+    unsigned numThreads = queue ? queue->GetNumThreads() : 0;
+
+    numWorkItems_ = 0;
+
+    if (surfaces.Empty())
+        return;
+
+    blocklights_.Resize((numThreads + 1) * LIGHTMAP_BLOCKLIGHTS);
+
+    const unsigned* start = &surfaces[0];
+    const unsigned* end = start + surfaces.Size();
+
+    if (!parallel || !numThreads || surfaces.Size() < MIN_SURFACES_PER_WORK_ITEM * 2)
+    {
+        BuildSurfaces(start, end, 0);
+        return;
+    }
+
+    // one item per thread, worker threads + main thread
+    unsigned numItems = numThreads + 1;
+    if (numItems > surfaces.Size() / MIN_SURFACES_PER_WORK_ITEM)
+        numItems = surfaces.Size() / MIN_SURFACES_PER_WORK_ITEM;
+    unsigned surfacesPerItem = (surfaces.Size() + numItems - 1) / numItems;
+
+    while (start < end)
+    {
+        SharedPtr<WorkItem> item = queue->GetFreeItem();
+        item->priority_ = M_MAX_UNSIGNED;
+        item->workFunction_ = BuildLightmapsWork;
+        item->aux_ = this;
+        item->start_ = (void*) start;
+        start = (unsigned) (end - start) > surfacesPerItem ? start + surfacesPerItem : end;
+        item->end_ = (void*) start;
+        queue->AddWorkItem(item);
+
+        numWorkItems_++;
+    }
+
+    queue->Complete(M_MAX_UNSIGNED);
+}
+
+void LightmapUpdater::Update(const lightstyle_t* lightstyles)
+{
+    numSurfacesRebuilt_ = 0;
+    numPagesUploaded_ = 0;
+    bytesUploaded_ = 0;
+    numWorkItems_ = 0;
+
+    if (!surfaces_ || !styleSurfaceStart_.Size())
+        return;
+
+    frameNumber_++;
+
+    rebuildSurfaces_.Clear();
+
+    for (int style = 0; style < MAX_LIGHTSTYLES; style++)
+    {
+        float white = lightstyles[style].white;
+        if (white == styleWhite_[style])
+            continue;
+
+        styleWhite_[style] = white;
+
+        for (unsigned i = styleSurfaceStart_[style]; i < styleSurfaceStart_[style + 1]; i++)
+        {
+            unsigned index = styleSurfaces_[i];
+            if (surfaceVisit_[index] == frameNumber_)
+                continue;
+
+            surfaceVisit_[index] = frameNumber_;
+
+            msurface_t* surf = surfaces_ + index;
+
+            // the surface may already be lit for this value, R_SetCacheState keeps the per map values
+            for (int maps = 0; maps < MAXLIGHTMAPS && surf->styles[maps] != 255; maps++)
+            {
+                if (StyleRebuildsLightmap(surf->styles[maps]) &&
+                    lightstyles[surf->styles[maps]].white != surf->cached_light[maps])
+                {
+                    R_SetCacheState(surf);
+                    MarkDirty(surf);
+                    rebuildSurfaces_.Push(index);
+                    break;
+                }
+            }
+        }
+    }
+
+    if (rebuildSurfaces_.Empty())
+        return;
+
+    buildPages_.Resize(pages_.Size());
+    for (unsigned i = 0; i < pages_.Size(); i++)
+        buildPages_[i] = &pages_[i].data_[0];
+
+    BuildSurfaces(rebuildSurfaces_, parallel_);
+
+    numSurfacesRebuilt_ = rebuildSurfaces_.Size();
+
+    // one upload per dirty page once every item is done, rows are contiguous in the page copy
+    for (unsigned i = 0; i < pages_.Size(); i++)
+    {
+        Page& page = pages_[i];
+        if (page.dirtyMin_ > page.dirtyMax_)
+            continue;
+
+        int rows = page.dirtyMax_ - page.dirtyMin_ + 1;
+        unsigned char* data = &page.data_[page.dirtyMin_ * page.width_ * LIGHTMAP_BYTES];
+
+        page.texture_->SetData(0, 0, page.dirtyMin_, page.width_, rows, data);
+
+        numPagesUploaded_++;
+        bytesUploaded_ += rows * page.width_ * LIGHTMAP_BYTES;
+
+        page.dirtyMin_ = page.height_;
+        page.dirtyMax_ = -1;
+    }
+}
+
+bool LightmapUpdater::Verify(unsigned& numSurfaces, long long& serialUSec, long long& parallelUSec)
+{
+    numSurfaces = litSurfaces_.Size();
+    serialUSec = 0;
+    parallelUSec = 0;
+
+    if (!surfaces_ || litSurfaces_.Empty())
+        return true;
+
+    // both copies start from the pages so texels no surface owns compare equal
+    Vector<PODVector<unsigned char> > serial(pages_.Size());
+    Vector<PODVector<unsigned char> > parallel(pages_.Size());
+    for (unsigned i = 0; i < pages_.Size(); i++)
+    {
+        serial[i] = pages_[i].data_;
+        parallel[i] = pages_[i].data_;
+    }
+
+    HiresTimer timer;
+
+    buildPages_.Resize(pages_.Size());
+
+    for (unsigned i = 0; i < pages_.Size(); i++)
+        buildPages_[i] = &serial[i][0];
+    timer.Reset();
+    BuildSurfaces(litSurfaces_, false);
+    serialUSec = timer.GetUSec(false);
+
+    for (unsigned i = 0; i < pages_.Size(); i++)
+        buildPages_[i] = &parallel[i][0];
+    timer.Reset();
+    BuildSurfaces(litSurfaces_, true);
+    parallelUSec = timer.GetUSec(false);
+
+    for (unsigned i = 0; i < pages_.Size(); i++)
+    {
+        if (memcmp(&serial[i][0], &parallel[i][0], serial[i].Size()))
+            return false;
+    }
+
+    return true;
+}
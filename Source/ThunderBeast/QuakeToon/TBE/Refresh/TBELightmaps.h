@@ -0,0 +1,114 @@
+
+#pragma once
+
+#include "TBEModelLoad.h"
+
+namespace Urho3D
+{
+    class Texture2D;
+    struct WorkItem;
+}
+
+using namespace Urho3D;
+
+// Rebuilds the world lightmaps affected by lightstyle changes.
+// Surfaces are indexed by lightstyle at load, so a frame only visits the
+// surfaces of styles whose value changed. Rebuilt texels go to a CPU copy
+// of their page and each dirty page is uploaded once per frame, as a
+// single band of rows covering every surface rebuilt on it.
+// Surfaces own disjoint rectangles of their page, so the rebuilds are split
+// into work items on the WorkQueue, each with its own blocklights, and the
+// pages are uploaded once the queue completes
+class LightmapUpdater
+{
+    friend void BuildLightmapsWork(const WorkItem* item, unsigned threadIndex);
+
+    struct Page
+    {
+        SharedPtr<Texture2D> texture_;
+        PODVector<unsigned char> data_;
+        int width_;
+        int height_;
+        // dirty rows this frame, dirtyMin_ > dirtyMax_ when clean
+        int dirtyMin_;
+        int dirtyMax_;
+    };
+
+    Vector<Page> pages_;
+
+    // world surfaces, the index below holds offsets from this
+    msurface_t* surfaces_;
+
+    // surfaces lit by style s are
+    // styleSurfaces_[styleSurfaceStart_[s]] .. styleSurfaces_[styleSurfaceStart_[s + 1] - 1]
+    PODVector<unsigned> styleSurfaceStart_;
+    PODVector<unsigned> styleSurfaces_;
+
+    // style values the surfaces were last checked against
+    float styleWhite_[MAX_LIGHTSTYLES];
+
+    // frame a surface was last visited, so surfaces with several changed styles are rebuilt once
+    PODVector<unsigned> surfaceVisit_;
+    unsigned frameNumber_;
+
+    // every surface with a lightmap, for Verify
+    PODVector<unsigned> litSurfaces_;
+
+    // surfaces to rebuild this frame
+    PODVector<unsigned> rebuildSurfaces_;
+
+    // page data the current build writes to, the pages or the Verify copies
+    PODVector<unsigned char*> buildPages_;
+
+    // blocklights per thread, the main thread is 0
+    PODVector<float> blocklights_;
+
+    bool parallel_;
+
+    unsigned numSurfacesRebuilt_;
+    unsigned numPagesUploaded_;
+    unsigned bytesUploaded_;
+    unsigned numWorkItems_;
+
+    void MarkDirty(msurface_t* surf);
+    void BuildSurfaces(const PODVector<unsigned>& surfaces, bool parallel);
+    void BuildSurfaces(const unsigned* start, const unsigned* end, unsigned threadIndex);
+
+public:
+
+    LightmapUpdater();
+
+    /// Remove all pages and the style index.
+    void Clear();
+
+    /// Add the next lightmap page, data is copied and kept for the partial rebuilds.
+    void AddPage(Texture2D* texture, int width, int height, const unsigned char* data);
+    /// Return the page texture.
+    Texture2D* GetPageTexture(unsigned index) const;
+    /// Return number of pages.
+    unsigned GetNumPages() const { return pages_.Size(); }
+
+    /// Index the world surfaces by the lightstyles they use.
+    void Build(model_t* worldmodel);
+
+    /// Rebuild the surfaces whose styles changed and upload the dirty pages.
+    void Update(const lightstyle_t* lightstyles);
+
+    /// Set whether surfaces are rebuilt on the work queue.
+    void SetParallel(bool enable) { parallel_ = enable; }
+    /// Return whether surfaces are rebuilt on the work queue.
+    bool GetParallel() const { return parallel_; }
+
+    /// Build every lit surface with the current r_newrefdef lightstyles into two copies of the pages, serially and on the work queue, and return whether the copies are byte identical. The pages and the surface cache state are not touched.
+    bool Verify(unsigned& numSurfaces, long long& serialUSec, long long& parallelUSec);
+
+    /// Return number of surfaces rebuilt by the last update.
+    unsigned GetNumSurfacesRebuilt() const { return numSurfacesRebuilt_; }
+    /// Return number of pages uploaded by the last update.
+    unsigned GetNumPagesUploaded() const { return numPagesUploaded_; }
+    /// Return number of bytes uploaded by the last update.
+    unsigned GetBytesUploaded() const { return bytesUploaded_; }
+    /// Return number of work items the last update or verify was split into, 0 when built on the main thread.
+    unsigned GetNumWorkItems() const { return numWorkItems_; }
+
+};
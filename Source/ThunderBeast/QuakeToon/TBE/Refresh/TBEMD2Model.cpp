@@ -0,0 +1,198 @@
+
+#include "Context.h"
+#include "Geometry.h"
+#include "VertexBuffer.h"
+#include "IndexBuffer.h"
+#include "Model.h"
+#include "Graphics.h"
+#include "Renderer.h"
+#include "TBEMD2Model.h"
+
+static float r_avertexnormals[NUMVERTEXNORMALS][3] = {
+    #include "TBEAliasNormals.h"
+};
+
+static const unsigned LERP_ELEMENT_MASK = MASK_POSITION | MASK_NORMAL;
+
+MD2FrameData::MD2FrameData(dmdl_t* palias, const PODVector<unsigned short>& weldXYZ, float scale) :
+    numVertices_(weldXYZ.Size())
+{
+    byte* pheader = (byte*) palias;
+
+    frames_.Resize(palias->num_frames);
+    verts_.Resize(palias->num_frames * numVertices_ * 4);
+
+    unsigned char* dest = verts_.Size() ? &verts_[0] : NULL;
+
+    for (int i = 0; i < palias->num_frames; i++)
+    {
+        daliasframe_t* pFRAME = (daliasframe_t *)(pheader + palias->ofs_frames + i * palias->framesize);
+
+        Frame& frame = frames_[i];
+        frame.scale_ = Vector3(pFRAME->scale[0], pFRAME->scale[2], pFRAME->scale[1]) * scale;
+        frame.translate_ = Vector3(pFRAME->translate[0], pFRAME->translate[2], pFRAME->translate[1]) * scale;
+
+        for (unsigned j = 0; j < numVertices_; j++)
+        {
+            const dtrivertx_t& vert = pFRAME->verts[weldXYZ[j]];
+
+            *dest++ = vert.v[0];
+            *dest++ = vert.v[2];
+            *dest++ = vert.v[1];
+            *dest++ = vert.lightnormalindex;
+        }
+    }
+}
+
+MD2Model::MD2Model(Context* context) : StaticModel(context),
+    frame_(0),
+    oldFrame_(0),
+    backLerp_(0.0f),
+    framesDirty_(false),
+    headless_(!context->GetSubsystem<Renderer>())
+{
+}
+
+MD2Model::~MD2Model()
+{
+}
+
+void MD2Model::RegisterObject(Context* context)
+{
+    context->RegisterFactory<MD2Model>();
+}
+
+void MD2Model::SetAliasModel(Model* model, MD2FrameData* frameData)
+{
+    SetModel(model);
+
+    frameData_ = frameData;
+
+    if (!model || !frameData || !geometries_.Size())
+        return;
+
+    Geometry* original = geometries_[0][0];
+
+    // positions and normals come from our own stream, everything else from the shared buffer
+    vertexBuffer_ = new VertexBuffer(context_);
+    // without a GPU the lerp still has to land somewhere
+    vertexBuffer_->SetShadowed(!GetSubsystem<Graphics>());
+    vertexBuffer_->SetSize(frameData->GetNumVertices(), LERP_ELEMENT_MASK, true);
+
+    SharedPtr<Geometry> geom(new Geometry(context_));
+    geom->SetNumVertexBuffers(2);
+    geom->SetVertexBuffer(0, original->GetVertexBuffer(0), original->GetVertexElementMask(0) & ~LERP_ELEMENT_MASK);
+    geom->SetVertexBuffer(1, vertexBuffer_, LERP_ELEMENT_MASK);
+    geom->SetIndexBuffer(original->GetIndexBuffer());
+    geom->SetDrawRange(original->GetPrimitiveType(), original->GetIndexStart(), original->GetIndexCount(),
+                       original->GetVertexStart(), original->GetVertexCount());
+
+    geometries_[0][0] = geom;
+    ResetLodLevels();
+
+    frame_ = oldFrame_ = 0;
+    backLerp_ = 0.0f;
+    framesDirty_ = true;
+
+    if (headless_)
+        LerpFrames();
+}
+
+void MD2Model::SetFrames(int frame, int oldframe, float backlerp)
+{
+    if (!frameData_)
+        return;
+
+    int numFrames = (int) frameData_->GetNumFrames();
+
+    // same as ref_gl, bad frames draw the first frame
+    if (frame >= numFrames || frame < 0)
+        frame = 0;
+    if (oldframe >= numFrames || oldframe < 0)
+        oldframe = 0;
+
+    if (frame == oldframe)
+        backlerp = 0.0f;
+
+    if (frame == frame_ && oldframe == oldFrame_ && backlerp == backLerp_)
+        return;
+
+    frame_ = frame;
+    oldFrame_ = oldframe;
+    backLerp_ = backlerp;
+    framesDirty_ = true;
+
+    // nothing calls UpdateGeometry without a renderer, lerp now so a
+    // headless timedemo still pays for it
+    if (headless_)
+        LerpFrames();
+}
+
+void MD2Model::UpdateGeometry(const FrameInfo& frame)
+{
+    if (framesDirty_)
+        LerpFrames();
+}
+
+UpdateGeometryType MD2Model::GetUpdateGeometryType()
+{
+    return framesDirty_ ? UPDATE_MAIN_THREAD : UPDATE_NONE;
+}
+
+void MD2Model::LerpFrames()
+{
+    framesDirty_ = false;
+
+    unsigned numVertices = frameData_->GetNumVertices();
+
+    float* dest = (float*) vertexBuffer_->Lock(0, numVertices, true);
+    if (!dest)
+        return;
+
+    const MD2FrameData::Frame& curFrame = frameData_->GetFrame(frame_);
+    const MD2FrameData::Frame& oldFrame = frameData_->GetFrame(oldFrame_);
+    const unsigned char* verts = frameData_->GetVertices(frame_);
+    const unsigned char* oldVerts = frameData_->GetVertices(oldFrame_);
+
+    float frontLerp = 1.0f - backLerp_;
+    float backLerp = backLerp_;
+
+    // fold the frame scales and translations into the lerp, as GL_LerpVerts does
+    Vector3 move = oldFrame.translate_ * backLerp + curFrame.translate_ * frontLerp;
+    Vector3 frontScale = curFrame.scale_ * frontLerp;
+    Vector3 backScale = oldFrame.scale_ * backLerp;
+
+    if (backLerp == 0.0f)
+    {
+        for (unsigned i = 0; i < numVertices; i++, verts += 4, dest += 6)
+        {
+            const float* normal = r_avertexnormals[verts[3]];
+
+            dest[0] = move.x_ + verts[0] * frontScale.x_;
+            dest[1] = move.y_ + verts[1] * frontScale.y_;
+            dest[2] = move.z_ + verts[2] * frontScale.z_;
+
+            dest[3] = normal[0];
+            dest[4] = normal[2];
+            dest[5] = normal[1];
+        }
+    }
+    else
+    {
+        for (unsigned i = 0; i < numVertices; i++, verts += 4, oldVerts += 4, dest += 6)
+        {
+            const float* normal = r_avertexnormals[verts[3]];
+            const float* oldNormal = r_avertexnormals[oldVerts[3]];
+
+            dest[0] = move.x_ + verts[0] * frontScale.x_ + oldVerts[0] * backScale.x_;
+            dest[1] = move.y_ + verts[1] * frontScale.y_ + oldVerts[1] * backScale.y_;
+            dest[2] = move.z_ + verts[2] * frontScale.z_ + oldVerts[2] * backScale.z_;
+
+            dest[3] = normal[0] * frontLerp + oldNormal[0] * backLerp;
+            dest[4] = normal[2] * frontLerp + oldNormal[2] * backLerp;
+            dest[5] = normal[1] * frontLerp + oldNormal[1] * backLerp;
+        }
+    }
+
+    vertexBuffer_->Unlock();
+}
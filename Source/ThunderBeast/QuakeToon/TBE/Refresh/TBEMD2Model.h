@@ -0,0 +1,84 @@
+
+#pragma once
+
+#include "StaticModel.h"
+#include "TBEModelLoad.h"
+
+namespace Urho3D
+{
+    class VertexBuffer;
+}
+
+using namespace Urho3D;
+
+// MD2 frames kept in the native quantized form, 4 bytes per vertex per frame.
+// Vertices are in welded order and the axes are already swapped to Urho3D's
+class MD2FrameData : public RefCounted
+{
+public:
+
+    struct Frame
+    {
+        Vector3 scale_;
+        Vector3 translate_;
+    };
+
+    /// Construct from the md2 header, weldXYZ maps each welded vertex to its md2 vertex.
+    MD2FrameData(dmdl_t* palias, const PODVector<unsigned short>& weldXYZ, float scale);
+
+    /// Return number of frames.
+    unsigned GetNumFrames() const { return frames_.Size(); }
+    /// Return number of vertices per frame.
+    unsigned GetNumVertices() const { return numVertices_; }
+    /// Return frame scale and translation.
+    const Frame& GetFrame(unsigned frame) const { return frames_[frame]; }
+    /// Return the x, y, z, normal index bytes of a frame.
+    const unsigned char* GetVertices(unsigned frame) const { return &verts_[frame * numVertices_ * 4]; }
+    /// Return memory used by the frames.
+    unsigned GetMemoryUse() const { return verts_.Size() + frames_.Size() * sizeof(Frame); }
+
+private:
+
+    unsigned numVertices_;
+    PODVector<Frame> frames_;
+    PODVector<unsigned char> verts_;
+};
+
+// Static model which lerps the two active MD2 frames into its own
+// position/normal vertex stream, texture coordinates come from the shared model
+class MD2Model : public StaticModel
+{
+    OBJECT(MD2Model);
+
+public:
+
+    /// Construct.
+    MD2Model(Context* context);
+    /// Destruct.
+    virtual ~MD2Model();
+    /// Register object factory.
+    static void RegisterObject(Context* context);
+
+    /// Lerp the active frames if they changed.
+    virtual void UpdateGeometry(const FrameInfo& frame);
+    /// Return whether a geometry update is necessary.
+    virtual UpdateGeometryType GetUpdateGeometryType();
+
+    /// Set the shared model and its frames.
+    void SetAliasModel(Model* model, MD2FrameData* frameData);
+    /// Set the current and previous frame, backlerp is the weight of the previous frame as in entity_t.
+    void SetFrames(int frame, int oldframe, float backlerp);
+
+private:
+
+    void LerpFrames();
+
+    SharedPtr<MD2FrameData> frameData_;
+    SharedPtr<VertexBuffer> vertexBuffer_;
+
+    int frame_;
+    int oldFrame_;
+    float backLerp_;
+    bool framesDirty_;
+    bool headless_;
+};
@@ -14,6 +14,7 @@
 #include "StaticModel.h"
 #include "Material.h"
 #include "AnimatedModel.h"
+#include "WorkQueue.h"
 #include "TBESystem.h"
 // move me
 #include "Scene.h"
@@ -25,15 +26,23 @@
 #include "RenderPath.h"
 #include "XMLFile.h"
 #include "DebugRenderer.h"
-#include "BillboardSet.h"
 #include "SkyBox.h"
 
 #include "TBEMapModel.h"
 #include "TBEAliasModel.h"
+#include "TBEVisibility.h"
+#include "TBEGeometryPool.h"
+#include "TBEMD2Model.h"
+#include "TBELightmaps.h"
+#include "TBETextureAnimation.h"
+#include "TBEAliasEntities.h"
+#include "TBEParticles.h"
 
 void R_LightPoint (vec3_t p, vec3_t color);
 
 extern model_t *r_worldmodel;
+extern refimport_t ri;
+extern cvar_t *r_speeds;
 
 SharedPtr<Scene> scene_;
 SharedPtr<Node> cameraNode_;
@@ -43,28 +52,35 @@ SharedPtr<Node> cameraNode_;
 struct RenderCluster
 {
     PODVector<msurface_t*> surfaces;
+    PODVector<int> areas;
 };
 
-static PODVector<Node*> worldNodes;
+static WorldVisibility worldVisibility;
 
 static PODVector<Node*> dynamicLights;
 
-static HashMap<msurface_t*, PODVector<Node*> > surfaceNodes;
-
 static HashMap<model_t*, Node* > brushNodes;
 
-static HashMap<model_t*, PODVector<Node*> > aliasNodes;
+static AliasEntityCache aliasEntities;
 
 static Vector<RenderCluster> renderClusters;
-PODVector<Texture2D*> lightmapTextures;
+static LightmapUpdater lightmapUpdater;
+
+// world and inline brush models share one vertex and index buffer
+static GeometryPool worldGeometry(MASK_POSITION | MASK_NORMAL | MASK_TEXCOORD1 | MASK_TEXCOORD2);
 
 static HashMap<String, SharedPtr<Material> > materialLookup;
 
+// animated surfaces get their own copy of the material per model, as the
+// world and each inline brush model animate separately
+static HashMap<String, SharedPtr<Material> > animatedMaterialLookup;
+static TextureAnimations textureAnimations;
+
 static HashMap<Material*, PODVector<msurface_t*> > surfaceMap;
 
 static float _scale = .1f;
 
-static BillboardSet* billboardObject;
+static ParticleStream* particleStream;
 
 static bool _castShadows = true;
 
@@ -124,8 +140,8 @@ static Material* LoadMaterial(int lightmap, const String& name, msurface_t* surf
             material->SetName(name);
             material->SetTexture(TU_DIFFUSE, texture);
 
-            if (lightmap != -1 && lightmap < lightmapTextures.Size())
-                material->SetTexture(TU_EMISSIVE, lightmapTextures[lightmap]);
+            if (lightmap != -1 && lightmapUpdater.GetPageTexture(lightmap))
+                material->SetTexture(TU_EMISSIVE, lightmapUpdater.GetPageTexture(lightmap));
             else
             {
 
@@ -145,7 +161,7 @@ static Material* LoadMaterial(int lightmap, const String& name, msurface_t* surf
 
 }
 
-static Node* EmitBrushModel(const HashMap<Material*, PODVector<msurface_t*> >& materialMap, bool isWorld = true)
+static Node* EmitBrushModel(const HashMap<Material*, PODVector<msurface_t*> >& materialMap)
 {
     Context* context = TBESystem::GetGlobalContext();
     Vector<Geometry*> submeshes;
@@ -177,22 +193,13 @@ static Node* EmitBrushModel(const HashMap<Material*, PODVector<msurface_t*> >& m
             }
         }
 
-        SharedPtr<IndexBuffer> ib;
-        SharedPtr<VertexBuffer> vb;
-
-        // TODO: share vertex buffers
-        vb = new VertexBuffer(context);
-        ib = new IndexBuffer(context);
-
-        // going to need normal
-        unsigned elementMask = MASK_POSITION  | MASK_NORMAL| MASK_TEXCOORD1  | MASK_TEXCOORD2;// | MASK_TANGENT;//;
+        // vertices and indices go into the shared map buffers, indices are absolute into the pool
+        unsigned vertexStart = worldGeometry.GetNumVertices();
+        unsigned indexStart = worldGeometry.GetNumIndices();
 
-        vb->SetSize(numvertices, elementMask);
-        ib->SetSize(numpolys * 3, false);
-
-        int vcount = 0;
-        float* vertexData = (float *) vb->Lock(0, numvertices);
-        unsigned short* indexData = (unsigned short*) ib->Lock(0, numpolys * 3);
+        int vcount = vertexStart;
+        float* vertexData = worldGeometry.AllocVertices(numvertices);
+        unsigned* indexData = worldGeometry.AllocIndices(numpolys * 3);
 
         Vector3 center = Vector3::ZERO;
 
@@ -246,18 +253,11 @@ static Node* EmitBrushModel(const HashMap<Material*, PODVector<msurface_t*> >& m
                 poly = poly->next;            }
             }
 
-        vb->Unlock();
-        ib->Unlock();
-
         center /= numpolys * 3;
 
         centers.Push(center);
 
-        Geometry* geom = new Geometry(context);
-
-        geom->SetIndexBuffer(ib);
-        geom->SetVertexBuffer(0, vb, elementMask);
-        geom->SetDrawRange(TRIANGLE_LIST, 0, numpolys * 3, false);
+        Geometry* geom = worldGeometry.CreateGeometry(indexStart, numpolys * 3, vertexStart, numvertices);
         submeshes.Push(geom);
     }
 
@@ -283,16 +283,13 @@ static Node* EmitBrushModel(const HashMap<Material*, PODVector<msurface_t*> >& m
         worldObject->SetMaterial(i, materials[i]);
     }
 
-    if (isWorld)
-        worldNodes.Push(worldNode);
-
     // clear for next model
     surfaceMap.Clear();
 
     return worldNode;
 }
 
-static void MapSurface(msurface_t* surface)
+static void MapSurface(model_t* model, msurface_t* surface)
 {
     String name(surface->texinfo->image->texture->GetName());
 
@@ -308,7 +305,13 @@ static void MapSurface(msurface_t* surface)
 
     if (surface->texinfo->numframes > 1)
     {
-        material = material->Clone();
+        String animatedName = name + "_" + String(model->name);
+        HashMap<String, SharedPtr<Material> >::Iterator i = animatedMaterialLookup.Find(animatedName);
+        if (i == animatedMaterialLookup.End())
+            i = animatedMaterialLookup.Insert(MakePair(animatedName, material->Clone()));
+
+        material = i->second_;
+        textureAnimations.AddMaterial(model, material, surface->texinfo);
     }
 
     surface->material = material;
@@ -327,6 +330,17 @@ void MapModel::Initialize()
 {
     int maxcluster = -1;
 
+    // the previous map's nodes went away with its scene, drop everything
+    // that points at them and force a full rebuild on the first frame
+    worldVisibility.Clear();
+    renderClusters.Clear();
+    brushNodes.Clear();
+
+    worldGeometry.Clear();
+
+    animatedMaterialLookup.Clear();
+    textureAnimations.Clear();
+
     for (int i = 0; i < r_worldmodel->numleafs; i++)
     {
         if (r_worldmodel->leafs[i].cluster > maxcluster)
@@ -345,6 +359,9 @@ void MapModel::Initialize()
 
         RenderCluster& cluster = renderClusters[leaf->cluster];
 
+        if (!cluster.areas.Contains(leaf->area))
+            cluster.areas.Push(leaf->area);
+
         for (int j = 0; j < leaf->nummarksurfaces; j++)
         {
             msurface_t* surface = leaf->firstmarksurface[j];
@@ -391,23 +408,32 @@ void MapModel::Initialize()
 
             for (unsigned j = 0; j < emitted.Size(); j++)
             {
-                MapSurface(emitted.At(j));
+                MapSurface(r_worldmodel, emitted.At(j));
             }
 
             Node* node = EmitBrushModel(surfaceMap);
+            unsigned nodeIndex = worldVisibility.AddNode(node);
 
             for (unsigned j = 0; j < emitted.Size(); j++)
-            {
-                if (!surfaceNodes.Contains(emitted[j]))
-                {
-                    surfaceNodes.Insert(MakePair(emitted[j], PODVector<Node*>()));
-                }
+                emitted[j]->worldnode = nodeIndex;
 
-                PODVector<Node*>& nodes = surfaceNodes.Find(emitted[j])->second_;
-                nodes.Push(node);
-            }
+        }
+    }
 
+    // flatten the cluster -> world node lists
+    for (unsigned i = 0; i < renderClusters.Size(); i++)
+    {
+        RenderCluster& cluster = renderClusters[i];
+        PODVector<unsigned> nodeIndices;
+
+        for (unsigned j = 0; j < cluster.surfaces.Size(); j++)
+        {
+            int nodeIndex = cluster.surfaces[j]->worldnode;
+            if (nodeIndex >= 0 && !nodeIndices.Contains(nodeIndex))
+                nodeIndices.Push(nodeIndex);
         }
+
+        worldVisibility.AddCluster(nodeIndices, cluster.areas);
     }
 
     for (int i = 1; i < r_worldmodel->numsubmodels;i++)
@@ -424,13 +450,23 @@ void MapModel::Initialize()
                 ErrorExit("inline brush model already emitted");
             }
 
-            MapSurface(surf);
+            MapSurface(model, surf);
         }
 
-        Node* node = EmitBrushModel(surfaceMap, false);
+        Node* node = EmitBrushModel(surfaceMap);
         brushNodes.Insert(MakePair(model, node));
 
     }
+
+    worldGeometry.Commit();
+
+    ri.Con_Printf (PRINT_ALL, "World geometry: %i buffers, %i bytes uploaded%s\n",
+                   worldGeometry.GetNumBuffersCreated(), worldGeometry.GetBytesUploaded(),
+                   worldGeometry.HasLargeIndices() ? ", 32 bit indices" : "");
+
+    lightmapUpdater.Build(r_worldmodel);
+
+    ri.Con_Printf (PRINT_ALL, "%i animated texture materials\n", textureAnimations.GetNumAnimations());
 }
 
 static void CreateScene()
@@ -472,7 +508,7 @@ static void CreateScene()
     camera->SetFarClip(4096.0f);
     camera->SetFov(85);
 
-    //static PODVector<Node*> dynamicLights;
+    dynamicLights.Clear();
 
     for (int i = 0; i < 32; i++)
     {
@@ -506,24 +542,11 @@ static void CreateScene()
 
 
 
-    Node* smokeNode = scene_->CreateChild("Particles");
-    smokeNode->SetPosition(Vector3(0, 0, 0));
-
-    billboardObject = smokeNode->CreateComponent<BillboardSet>();
-    billboardObject->SetNumBillboards(MAX_PARTICLES);
-    billboardObject->SetMaterial(cache->GetResource<Material>("Materials/Smoke.xml"));
-    billboardObject->SetSorted(false);
-
-    for (unsigned j = 0; j < MAX_PARTICLES; ++j)
-    {
-        Billboard* bb = billboardObject->GetBillboard(j);
-        bb->size_ = Vector2(0.2f, 0.2f);
-        bb->rotation_ = Random() * 360.0f;
-        bb->enabled_ = false;
-    }
+    Node* particleNode = scene_->CreateChild("Particles");
+    particleNode->SetPosition(Vector3(0, 0, 0));
 
-    // After modifying the billboards, they need to be "commited" so that the BillboardSet updates its internals
-    billboardObject->Commit();
+    particleStream = particleNode->CreateComponent<ParticleStream>();
+    particleStream->SetMaterial(cache->GetResource<Material>("Materials/Particles.xml"));
 
 
     //cameraNode_->SetPosition(Vector3(0, 0, -2000));
@@ -546,7 +569,9 @@ static void CreateScene()
     viewport->SetRenderPath(effectRenderPath);
     */
 
-    renderer->SetViewport(0, viewport);
+    // headless runs have no renderer, the scene is still built and updated
+    if (renderer)
+        renderer->SetViewport(0, viewport);
 
 }
 
@@ -563,39 +588,21 @@ void R_CreateLightmap(int id, int width, int height, unsigned char* data)
 
     Context* context = TBESystem::GetGlobalContext();
 
+    // pages are numbered from 0 again for each map
+    if (id == 0)
+        lightmapUpdater.Clear();
+
     Texture2D* texture = new Texture2D(context);
     texture->SetNumLevels(1);
     texture->SetSize(width, height, Graphics::GetRGBAFormat());
     texture->SetData(0, 0, 0, width, height, data);
-    lightmapTextures.Push(texture);
+    lightmapUpdater.AddPage(texture, width, height, data);
 
 }
 
-static image_t *R_TextureAnimation (int frame, mtexinfo_t *tex)
-{
-    int		c;
-
-    if (!tex->next)
-        return tex->image;
-
-    c = frame % tex->numframes;
-    while (c)
-    {
-        tex = tex->next;
-        c--;
-    }
-
-    return tex->image;
-}
-
 
 refdef_t r_newrefdef;
 
-void R_BuildLightMap (msurface_t *surf, byte *dest, int stride);
-void R_SetCacheState( msurface_t *surf );
-
-extern unsigned	d_8to24table[];
-
 extern "C"
 {
 void	R_RenderFrame (refdef_t *fd)
@@ -605,23 +612,16 @@ void	R_RenderFrame (refdef_t *fd)
 
     r_newrefdef = *fd;
 
-    // optimize this, probably doing too much work
-    for (unsigned i = 0; i < worldNodes.Size(); i++)
-        worldNodes[i]->SetEnabled(false);
-
     //printf("%f %f %f\n", fd->vieworg[0], fd->vieworg[1], fd->vieworg[2]);
 
     mleaf_t* leaf = Mod_PointInLeaf (fd->vieworg, r_worldmodel);
 
+    // only toggles the world nodes whose visibility changed since the last view cluster/areas
+    worldVisibility.Update(r_worldmodel, leaf->cluster, fd->areabits);
+
     if (leaf->cluster < 0)
         return;
 
-    // TODO: factor in areas?
-    //if (fd->areabits)
-    //{
-    //
-    //}
-
     for (HashMap<model_t*, Node *>::Iterator i = brushNodes.Begin(); i != brushNodes.End(); ++i)
     {
         i->second_->SetEnabled(false);
@@ -650,64 +650,20 @@ void	R_RenderFrame (refdef_t *fd)
 
     }
 
-    // turn off all alias nodes
-    HashMap<model_t*, PODVector<Node*> >::Iterator aliasItr;
-    for (aliasItr = aliasNodes.Begin(); aliasItr != aliasNodes.End(); aliasItr++)
-    {
-        PODVector<Node*>& nodes = aliasItr->second_;
-        for (unsigned i = 0; i < nodes.Size(); i++)
-            nodes[i]->SetEnabled(false);
-    }
-
     // world animated lights, this only does animation on the world model
-    // and not inline brush models
-    // and it is currenly animating all textures whether they are in visible
-    // or not
-    msurface_t* surf = r_worldmodel->surfaces + r_worldmodel->firstmodelsurface;
-    for (int j = 0; j < r_worldmodel->nummodelsurfaces; j++)
-    {
-        if ( !(surf->texinfo->flags & (SURF_SKY|SURF_TRANS33|SURF_TRANS66|SURF_WARP ) ) )
-        {
-            for ( int maps = 0; maps < MAXLIGHTMAPS && surf->styles[maps] != 255; maps++ )
-            {
-                if ( fd->lightstyles[surf->styles[maps]].white != surf->cached_light[maps] )
-                {
-                    unsigned	temp[128*128];
-                    int			smax, tmax;
-
-                    if ( surf->styles[maps] >= 32 || surf->styles[maps] == 0 )
-                    {
-                        smax = (surf->extents[0]>>4)+1;
-                        tmax = (surf->extents[1]>>4)+1;
-
-                        R_BuildLightMap( surf, (byte *)temp, smax*4 );
-                        R_SetCacheState( surf );
-
-                        Texture2D* lightmap = lightmapTextures[surf->lightmaptexturenum];
-
-                        lightmap->SetData(0, surf->light_s, surf->light_t, smax, tmax, temp);
-
-                        //static int update = 0;
-                        //printf("%i Updating Lightmap %i\n", update++, surf->lightmaptexturenum);
-
-                    }
-                }
-            }
-        }
+    // and not inline brush models, only surfaces using a style whose value
+    // changed are visited
+    lightmapUpdater.Update(fd->lightstyles);
 
-        if (surf->material && surf->texinfo->numframes)
-        {
-            image_t* image = R_TextureAnimation(int(TBESystem::GetMilliseconds()/1000.0f), surf->texinfo);
-            if (image->texture)
-                surf->material->SetTexture(TU_DIFFUSE, image->texture);
-        }
+    // world animated textures step once per material whether visible or not,
+    // only materials whose frame changed are touched
+    textureAnimations.ResetCounters();
+    textureAnimations.Update(r_worldmodel, int(TBESystem::GetMilliseconds()/1000.0f));
 
-        surf++;
-
-    }
 
 
 
+    aliasEntities.BeginFrame();
 
     for (int i = 0; i < fd->num_entities; i++)
     {
@@ -723,53 +679,8 @@ void	R_RenderFrame (refdef_t *fd)
 
         if (model->type == mod_alias)
         {
-            aliasItr = aliasNodes.Find(model);
-            if (aliasItr == aliasNodes.End())
-            {
-                aliasNodes.Insert(MakePair(model, PODVector<Node*>()));
-                aliasItr = aliasNodes.Find(model);
-            }
-
-            PODVector<Node*>& nodes = aliasItr->second_;
-
-            Node* node = NULL;
-            for (unsigned j = 0; j < nodes.Size(); j++)
-            {
-                if (!nodes.At(j)->IsEnabled())
-                {
-                    node = nodes.At(j);
-                    break;
-                }
-            }
-            if (!node)
-            {
-                Model* amodel = GetAliasModel(model);
-                node = scene_->CreateChild("AliasModel");
-                nodes.Push(node);
-                if (!amodel->GetNumMorphs())
-                {
-                    StaticModel* aliasModel = node->CreateComponent<StaticModel>();
-                    if (ent->flags & RF_WEAPONMODEL || ent->flags & RF_VIEWERMODEL)
-                        aliasModel->SetCastShadows(false);
-                    else
-                        aliasModel->SetCastShadows(_castShadows);
-
-                    aliasModel->SetModel(amodel);
-                    aliasModel->SetMaterial(0, model->material->Clone());
-                }
-                else
-                {
-                    AnimatedModel* aliasModel = node->CreateComponent<AnimatedModel>();
-                    if (ent->flags & RF_WEAPONMODEL || ent->flags & RF_VIEWERMODEL)
-                        aliasModel->SetCastShadows(false);
-                    else
-                        aliasModel->SetCastShadows(_castShadows);
-
-                    aliasModel->SetModel(amodel);
-                    aliasModel->SetMaterial(0, model->material->Clone());
-                }
-
-            }
+            // the entity keeps its node from frame to frame
+            AliasEntityCache::Slot* slot = aliasEntities.GetSlot(ent);
 
             vec3_t color;
             color[0] = 1.0f;
@@ -820,66 +731,35 @@ void	R_RenderFrame (refdef_t *fd)
                 alpha = ent->alpha;
             }
 
-            StaticModel* aliasModel = node->GetComponent<StaticModel>();
-            if (aliasModel)
+            StaticModel* aliasModel = slot->drawable_;
+            if (slot->md2Model_)
             {
-                Material* material = aliasModel->GetMaterial(0);
-                material->SetTexture(TU_DIFFUSE, model->skins[ent->skinnum]->texture);
-                material->SetTexture(TU_EMISSIVE, model->skins[ent->skinnum]->texture);
-                material->SetShaderParameter("MatDiffColor", Vector4(1, 1, 1, alpha));
-                material->SetShaderParameter("MatEmissiveColor", Vector4(color[0], color[1], color[2], alpha));
+                // only the two active frames are decoded, when the model is next drawn
+                slot->md2Model_->SetFrames(ent->frame, ent->oldframe, ent->backlerp);
             }
-            else
-            {
-                AnimatedModel* amodel = node->GetComponent<AnimatedModel>();
-
-                amodel->ResetMorphWeights();
-
-                if (ent->frame != ent->oldframe && ent->backlerp)
-                {
-                    amodel->SetMorphWeight(String(ent->frame), 1.0f - ent->backlerp);
-                    amodel->SetMorphWeight(String(ent->oldframe), ent->backlerp);
-                }
-                else
-                {
-                    amodel->SetMorphWeight(String(ent->frame), 1.0f);
 
-                }
+            // entities drawing the same skin share its material so they can batch,
+            // light and alpha ride along in the instance data
+            Material* material = GetAliasSkinMaterial(model, ent->skinnum);
+            if (aliasModel->GetMaterial(0) != material)
+                aliasModel->SetMaterial(0, material);
 
-                Material* material = amodel->GetMaterial(0);
-                material->SetTexture(TU_DIFFUSE, model->skins[ent->skinnum]->texture);
-                material->SetTexture(TU_EMISSIVE, model->skins[ent->skinnum]->texture);
-                material->SetShaderParameter("MatDiffColor", Vector4(1, 1, 1, alpha));
-                material->SetShaderParameter("MatEmissiveColor", Vector4(color[0], color[1], color[2], alpha));
-            }
+            aliasModel->SetInstanceData(Vector4(color[0], color[1], color[2], alpha));
 
             // I am not sure on the pitch and roll signs here, yaw is correct
             Quaternion q(-ent->angles[2], -ent->angles[1], -ent->angles[0]);
-            node->SetRotation(q);
+            slot->node_->SetRotation(q);
 
             Vector3 curPos(ent->origin[0] * _scale, ent->origin[2] * _scale, ent->origin[1] * _scale);
             Vector3 prevPos(ent->oldorigin[0] * _scale, ent->oldorigin[2] * _scale, ent->oldorigin[1] * _scale);
             curPos = prevPos.Lerp(curPos, 1.0f - ent->backlerp);
-            node->SetPosition(curPos);
-
-            node->SetEnabled(true);
+            slot->node_->SetPosition(curPos);
 
         }
 
         if (model->type == mod_brush)
         {
-            msurface_t* surf = model->surfaces + model->firstmodelsurface;
-            for (int j = 0; j < model->nummodelsurfaces; j++)
-            {
-                if (surf->material && surf->texinfo->numframes)
-                {
-                    image_t* image = R_TextureAnimation(ent->frame, surf->texinfo);
-                    surf->material->SetTexture(TU_DIFFUSE, image->texture);
-                }
-
-                surf++;
-
-            }
+            textureAnimations.Update(model, ent->frame);
 
             Node* node = brushNodes.Find(model)->second_;
             node->SetEnabled(true);
@@ -895,74 +775,153 @@ void	R_RenderFrame (refdef_t *fd)
         }
     }
 
-    byte* vis = Mod_ClusterPVS (leaf->cluster, r_worldmodel);
+    // disables the entities which went away, removes the ones gone for long
+    aliasEntities.EndFrame();
 
-    for (unsigned i = 0; i < renderClusters.Size(); i++)
+    Quaternion q(fd->viewangles[0], -fd->viewangles[1] + 90, fd->viewangles[2]);
+
+    cameraNode_->SetPosition(Vector3(fd->vieworg[0] *_scale, fd->vieworg[2] *_scale, fd->vieworg[1] *_scale));
+    cameraNode_->SetRotation(q);
+
+    // only the live particles are written, straight from the refdef
+    particleStream->SetParticles(fd->particles, fd->num_particles, _scale);
+
+    if (r_speeds->value)
     {
-        if (leaf->cluster == i || vis[i>>3] & (1<<(i&7)))
-        {
-            RenderCluster& cluster = renderClusters.At(i);
+        ri.Con_Printf (PRINT_ALL, "%4i world toggles (%i nodes)\n",
+                       worldVisibility.GetNumToggles(), worldVisibility.GetNumNodes());
 
-            for (unsigned j = 0; j < cluster.surfaces.Size(); j++)
-            {
-                PODVector<Node*>& nodes = surfaceNodes.Find(cluster.surfaces[j])->second_;
-                for (unsigned k = 0; k < nodes.Size(); k++)
-                {
-                    if (!nodes[k]->IsEnabled())
-                        nodes[k]->SetEnabled(true);
-                }
+        ri.Con_Printf (PRINT_ALL, "%4i lightmap surfaces rebuilt in %i work items, %i pages, %i bytes uploaded\n",
+                       lightmapUpdater.GetNumSurfacesRebuilt(), lightmapUpdater.GetNumWorkItems(),
+                       lightmapUpdater.GetNumPagesUploaded(), lightmapUpdater.GetBytesUploaded());
 
-            }
-        }
-    }
+        ri.Con_Printf (PRINT_ALL, "%4i animated materials changed (%i animated)\n",
+                       textureAnimations.GetNumMaterialsChanged(), textureAnimations.GetNumAnimations());
 
-    Quaternion q(fd->viewangles[0], -fd->viewangles[1] + 90, fd->viewangles[2]);
+        // batch counts are from the last rendered frame, the same ones DebugHud shows
+        Graphics* graphics = TBESystem::GetGlobalContext()->GetSubsystem<Graphics>();
+        Renderer* renderer = TBESystem::GetGlobalContext()->GetSubsystem<Renderer>();
+        ri.Con_Printf (PRINT_ALL, "%4i alias entities, %i draw calls, %i renderer batches\n",
+                       aliasEntities.GetNumDrawn(), graphics ? graphics->GetNumBatches() : 0,
+                       renderer ? renderer->GetNumBatches() : 0);
 
-    cameraNode_->SetPosition(Vector3(fd->vieworg[0] *_scale, fd->vieworg[2] *_scale, fd->vieworg[1] *_scale));
-    cameraNode_->SetRotation(q);
+        ri.Con_Printf (PRINT_ALL, "%4i alias entity nodes, %i created, %i removed\n",
+                       aliasEntities.GetNumSlots(), aliasEntities.GetNumCreated(), aliasEntities.GetNumRemoved());
+
+        ri.Con_Printf (PRINT_ALL, "%4i particles, %i stream bytes\n", particleStream->GetNumParticles(),
+                       particleStream->GetNumParticles() * particleStream->GetStreamBytesPerParticle());
+    }
 
-    for (int j = 0; j < MAX_PARTICLES; j++)
+}
+}
+
+// lightmaptest [frames]
+//
+// Runs the world lightmaps through a deterministic sequence of animated
+// style values and checks the work queue build is byte identical to the
+// serial one for every frame
+void R_LightmapTest_f (void)
+{
+    // the animated patterns worldspawn sets up in g_spawn.c
+    static const char* patterns[] = {
+        "m",
+        "mmnmmommommnonmmonqnmmo",
+        "abcdefghijklmnopqrstuvwxyzyxwvutsrqponmlkjihgfedcba",
+        "mmmmmaaaaammmmmaaaaaabcdefgabcdefg",
+        "mamamamamama",
+        "jklmnopqrstuvwxyzyxwvutsrqponmlkj",
+        "nmonqnmomnmomomno",
+        "mmmaaaabcdefgmmmmaaaammmaamm",
+        "mmmaaammmaaammmabcdefaaaammmmabcdefmmmaaaa",
+        "aaaaaaaazzzzzzzz",
+        "mmamammmmammamamaaamammma",
+        "abcdefghijklmnopqrrqponmlkjihgfedcba"
+    };
+    static const int numPatterns = sizeof(patterns) / sizeof(patterns[0]);
+
+    int numFrames = ri.Cmd_Argc() > 1 ? atoi(ri.Cmd_Argv(1)) : 32;
+
+    if (numFrames < 1)
     {
+        ri.Con_Printf (PRINT_ALL, "usage: lightmaptest [frames]\n");
+        return;
+    }
 
+    if (!r_worldmodel || !lightmapUpdater.GetNumPages())
+    {
+        ri.Con_Printf (PRINT_ALL, "lightmaptest: no map loaded\n");
+        return;
     }
 
-    bool anychanged = false;    
-    for (int j = 0; j < MAX_PARTICLES; j++)
+    // with no worker threads the parallel build would be checked against itself
+    WorkQueue* queue = TBESystem::GetGlobalContext()->GetSubsystem<WorkQueue>();
+    unsigned numThreads = queue ? queue->GetNumThreads() : 0;
+
+    if (!numThreads)
     {
-        Billboard* bb = billboardObject->GetBillboard(j);
+        ri.Con_Printf (PRINT_ALL, "lightmaptest: skipped, the WorkQueue has no worker threads\n");
+        return;
+    }
+
+    lightstyle_t lightstyles[MAX_LIGHTSTYLES];
+    lightstyle_t* oldLightstyles = r_newrefdef.lightstyles;
+    r_newrefdef.lightstyles = lightstyles;
+
+    unsigned numSurfaces = 0;
+    unsigned numWorkItems = 0;
+    unsigned maxWorkItems = 0;
+    long long serialUSec = 0;
+    long long parallelUSec = 0;
+    int badFrame = -1;
+    int frame;
 
-        if (j >= fd->num_particles)
+    for (frame = 0; frame < numFrames && badFrame < 0; frame++)
+    {
+        // styles are offset from each other and tinted so the scaled paths are taken
+        for (int style = 0; style < MAX_LIGHTSTYLES; style++)
         {
-            if (bb->enabled_)
-            {
-                bb->enabled_ = false;
-                anychanged = true;
-            }
+            const char* pattern = patterns[style % numPatterns];
+            float value = (pattern[(frame + style) % strlen(pattern)] - 'a') / (float) ('m' - 'a');
 
-            continue;
+            lightstyles[style].rgb[0] = value;
+            lightstyles[style].rgb[1] = value * (style & 1 ? 0.5f : 1.0f);
+            lightstyles[style].rgb[2] = value * (style & 2 ? 0.5f : 1.0f);
+            lightstyles[style].white = lightstyles[style].rgb[0] + lightstyles[style].rgb[1] + lightstyles[style].rgb[2];
         }
 
-        particle_t* p = &fd->particles[j];
-        bb->position_ = Vector3(p->origin[0] * _scale, p->origin[2] * _scale, p->origin[1] * _scale);
-        unsigned char color[4];
-        *(int *)color = d_8to24table[p->color];
-        bb->color_ = Color(float(color[0]) / 255.0f, float(color[1]) / 255.0f, float(color[2]) / 255.0f, p->alpha * .8f);
-        bb->enabled_ = true;
-        anychanged = true;
+        long long serial, parallel;
+        if (!lightmapUpdater.Verify(numSurfaces, serial, parallel))
+            badFrame = frame;
+
+        serialUSec += serial;
+        parallelUSec += parallel;
+        numWorkItems = lightmapUpdater.GetNumWorkItems();
+        if (numWorkItems > maxWorkItems)
+            maxWorkItems = numWorkItems;
     }
 
-    if (anychanged)
-        billboardObject->Commit();
+    r_newrefdef.lightstyles = oldLightstyles;
 
+    if (badFrame >= 0)
+        ri.Con_Printf (PRINT_ALL, "lightmaptest: FAILED, parallel build differs at frame %i\n", badFrame);
+    else if (maxWorkItems < 2)
+        ri.Con_Printf (PRINT_ALL, "lightmaptest: skipped, no frame rebuilt enough surfaces to split over work items\n");
+    else
+        ri.Con_Printf (PRINT_ALL, "lightmaptest: %i frames, %i surfaces, %i work items on %i worker threads, "
+                       "parallel build identical\n", numFrames, numSurfaces, numWorkItems, numThreads);
 
+    ri.Con_Printf (PRINT_ALL, "  serial   : %8.0f us/frame\n", (double) serialUSec / frame);
+    ri.Con_Printf (PRINT_ALL, "  parallel : %8.0f us/frame\n", (double) parallelUSec / frame);
 }
-}
-
-
 
 void R_InitMapModel()
 {
+    // entity nodes belong to the previous map's scene
+    aliasEntities.Clear();
+
     CreateScene();
+    aliasEntities.SetScene(scene_);
+    aliasEntities.SetCastShadows(_castShadows);
     MapModel::Generate();
 }
 
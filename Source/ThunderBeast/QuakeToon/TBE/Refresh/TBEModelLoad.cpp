@@ -213,7 +213,8 @@ model_t *Mod_ForName (char *name, qboolean crash)
     //
     // load the file
     //
-    modfilelen = ri.FS_LoadFile (mod->name, (void**) &buf);
+    // the loaders copy everything they keep, so the file can be a view of the pak
+    modfilelen = ri.FS_LoadFileReadOnly (mod->name, (void**) &buf);
     if (!buf)
     {
         if (crash)
@@ -569,6 +570,7 @@ void Mod_LoadFaces (lump_t *l)
         out->flags = 0;
         out->polys = NULL;
         out->emitted = 0;
+        out->worldnode = -1;
         out->material = NULL;
         out->lightmaptexturenum = -1;
 
@@ -848,6 +850,7 @@ Mod_LoadBrushModel
 void Mod_LoadBrushModel (model_t *mod, void *buffer)
 {
     int			i;
+    dheader_t	headerdata;
     dheader_t	*header;
     mmodel_t 	*bm;
 
@@ -855,14 +858,15 @@ void Mod_LoadBrushModel (model_t *mod, void *buffer)
     if (loadmodel != mod_known)
         ri.Sys_Error (ERR_DROP, "Loaded a brush model after the world");
 
-    header = (dheader_t *)buffer;
-
-    i = LittleLong (header->version);
+    i = LittleLong (((dheader_t *)buffer)->version);
     if (i != BSPVERSION)
         ri.Sys_Error (ERR_DROP, "Mod_LoadBrushModel: %s has wrong version number (%i should be %i)", mod->name, i, BSPVERSION);
 
-// swap all the lumps
-    mod_base = (byte *)header;
+// swap all the lumps, into a copy as the buffer is read only
+    mod_base = (byte *)buffer;
+
+    headerdata = *(dheader_t *)buffer;
+    header = &headerdata;
 
     for (i=0 ; i<sizeof(dheader_t)/4 ; i++)
         ((int *)header)[i] = LittleLong ( ((int *)header)[i]);
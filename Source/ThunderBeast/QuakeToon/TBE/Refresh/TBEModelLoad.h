@@ -90,6 +90,7 @@ typedef struct msurface_s
     byte		*samples;		// [numstyles*surfsize]
 
     int emitted;
+    int worldnode;      // world visibility node index, -1 if not emitted
 
     SharedPtr<Urho3D::Material> material;
 
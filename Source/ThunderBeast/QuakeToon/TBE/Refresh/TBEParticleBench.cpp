@@ -0,0 +1,149 @@
+
+#include "Context.h"
+#include "Timer.h"
+#include "Scene.h"
+#include "Node.h"
+#include "BillboardSet.h"
+#include "TBESystem.h"
+#include "TBEParticles.h"
+
+// particlebench [particles] [frames]
+//
+// Moves a set of live particles every frame and reports the CPU cost of
+// handing them to the refresh: the per billboard updates, Commit and vertex
+// rebuild of the BillboardSet the bridge used before, against ParticleStream
+
+extern refimport_t ri;
+extern unsigned	d_8to24table[];
+
+static float _scale = .1f;
+
+// live particles the bridge had billboards for, and the default count
+static const int BRIDGE_PARTICLES = 4096;
+
+void R_ParticleBench_f (void)
+{
+    int numParticles = ri.Cmd_Argc() > 1 ? atoi(ri.Cmd_Argv(1)) : BRIDGE_PARTICLES;
+    int numFrames = ri.Cmd_Argc() > 2 ? atoi(ri.Cmd_Argv(2)) : 200;
+
+    if (numParticles < 1 || numParticles > MAX_PARTICLES || numFrames < 1)
+    {
+        ri.Con_Printf (PRINT_ALL, "usage: particlebench [particles 1-%i] [frames]\n", MAX_PARTICLES);
+        return;
+    }
+
+    // the bridge walked all of its billboards every frame, more are only
+    // added when the run asks for more particles than it had
+    int numBillboards = numParticles > BRIDGE_PARTICLES ? numParticles : BRIDGE_PARTICLES;
+
+    Context* context = TBESystem::GetGlobalContext();
+
+    // not attached to a viewport, only the CPU side of the update is measured
+    SharedPtr<Scene> scene(new Scene(context));
+
+    BillboardSet* billboardObject = scene->CreateChild("Billboards")->CreateComponent<BillboardSet>();
+    billboardObject->SetNumBillboards(numBillboards);
+    billboardObject->SetSorted(false);
+
+    for (int j = 0; j < numBillboards; ++j)
+    {
+        Billboard* bb = billboardObject->GetBillboard(j);
+        bb->size_ = Vector2(0.2f, 0.2f);
+        bb->rotation_ = Random() * 360.0f;
+        bb->enabled_ = false;
+    }
+
+    billboardObject->Commit();
+
+    ParticleStream* particleStream = scene->CreateChild("Particles")->CreateComponent<ParticleStream>();
+
+    PODVector<particle_t> particles(numParticles);
+    PODVector<Vector3> velocities(numParticles);
+
+    SetRandomSeed(1);
+    for (int i = 0; i < numParticles; i++)
+    {
+        particle_t* p = &particles[i];
+        p->origin[0] = Random(-512.0f, 512.0f);
+        p->origin[1] = Random(-512.0f, 512.0f);
+        p->origin[2] = Random(-128.0f, 128.0f);
+        p->color = 0xe0 + Rand() % 8;
+        p->alpha = 1.0f;
+        velocities[i] = Vector3(Random(-8.0f, 8.0f), Random(-8.0f, 8.0f), Random(-8.0f, 8.0f));
+    }
+
+    FrameInfo frameInfo;
+    frameInfo.frameNumber_ = 0;
+    frameInfo.timeStep_ = 0.0f;
+    frameInfo.camera_ = NULL;
+
+    HiresTimer timer;
+    long long usec[2] = { 0, 0 };
+
+    for (int frame = 0; frame < numFrames; frame++)
+    {
+        for (int i = 0; i < numParticles; i++)
+        {
+            particle_t* p = &particles[i];
+            p->origin[0] += velocities[i].x_;
+            p->origin[1] += velocities[i].y_;
+            p->origin[2] += velocities[i].z_;
+            p->alpha = 1.0f - (float) ((frame + i) % 64) / 64.0f;
+        }
+
+        refdef_t fd;
+        fd.num_particles = numParticles;
+        fd.particles = &particles[0];
+
+        // the loop the bridge ran at the end of R_RenderFrame
+        timer.Reset();
+        bool anychanged = false;
+        for (int j = 0; j < numBillboards; j++)
+        {
+            Billboard* bb = billboardObject->GetBillboard(j);
+
+            if (j >= fd.num_particles)
+            {
+                if (bb->enabled_)
+                {
+                    bb->enabled_ = false;
+                    anychanged = true;
+                }
+
+                continue;
+            }
+
+            particle_t* p = &fd.particles[j];
+            bb->position_ = Vector3(p->origin[0] * _scale, p->origin[2] * _scale, p->origin[1] * _scale);
+            unsigned char color[4];
+            *(int *)color = d_8to24table[p->color];
+            bb->color_ = Color(float(color[0]) / 255.0f, float(color[1]) / 255.0f, float(color[2]) / 255.0f, p->alpha * .8f);
+            bb->enabled_ = true;
+            anychanged = true;
+        }
+
+        if (anychanged)
+            billboardObject->Commit();
+
+        // what the view does with it before drawing
+        billboardObject->GetWorldBoundingBox();
+        billboardObject->UpdateGeometry(frameInfo);
+        usec[0] += timer.GetUSec(false);
+
+        timer.Reset();
+        particleStream->SetParticles(fd.particles, fd.num_particles, _scale);
+        particleStream->GetWorldBoundingBox();
+        particleStream->UpdateGeometry(frameInfo);
+        usec[1] += timer.GetUSec(false);
+    }
+
+    double perFrame = 1.0 / numFrames;
+    double perParticle = 1000.0 / ((double) numParticles * numFrames);
+
+    ri.Con_Printf (PRINT_ALL, "particlebench: %i particles, %i frames, %s stream\n", numParticles, numFrames,
+                   particleStream->IsInstanced() ? "instanced" : "4 corner");
+    ri.Con_Printf (PRINT_ALL, "  BillboardSet   : %8.1f us/frame %6.1f ns/particle %7i bytes/frame\n",
+                   usec[0] * perFrame, usec[0] * perParticle, numParticles * 4 * 32);
+    ri.Con_Printf (PRINT_ALL, "  ParticleStream : %8.1f us/frame %6.1f ns/particle %7i bytes/frame\n",
+                   usec[1] * perFrame, usec[1] * perParticle, numParticles * particleStream->GetStreamBytesPerParticle());
+}
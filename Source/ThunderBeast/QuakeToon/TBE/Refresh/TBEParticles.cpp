@@ -0,0 +1,189 @@
+
+#include "Context.h"
+#include "Node.h"
+#include "Graphics.h"
+#include "Geometry.h"
+#include "VertexBuffer.h"
+#include "IndexBuffer.h"
+#include "Material.h"
+#include "TBEParticles.h"
+
+extern unsigned	d_8to24table[];
+
+// the 6 bit fields of the packed colour, alpha is the top one
+static const unsigned ALPHA_SHIFT = 18;
+
+ParticleStream::ParticleStream(Context* context) : Drawable(context, DRAWABLE_GEOMETRY),
+    geometry_(new Geometry(context)),
+    cornerBuffer_(new VertexBuffer(context)),
+    indexBuffer_(new IndexBuffer(context)),
+    instanceBuffer_(new VertexBuffer(context)),
+    numParticles_(0)
+{
+    for (unsigned i = 0; i < 256; i++)
+    {
+        const unsigned char* color = (const unsigned char*) &d_8to24table[i];
+        packedPalette_[i] = (color[0] >> 2) | ((color[1] >> 2) << 6) | ((color[2] >> 2) << 12);
+    }
+
+    Graphics* graphics = GetSubsystem<Graphics>();
+    instanced_ = graphics && graphics->GetInstancingSupport();
+
+    unsigned numQuads = instanced_ ? 1 : MAX_PARTICLES;
+
+    cornerBuffer_->SetSize(numQuads * 4, MASK_POSITION);
+    indexBuffer_->SetSize(numQuads * 6, numQuads * 4 > 65536);
+    // headless, the packing still runs into the shadow copy
+    instanceBuffer_->SetShadowed(!graphics);
+    instanceBuffer_->SetSize(numQuads == 1 ? MAX_PARTICLES : MAX_PARTICLES * 4, MASK_INSTANCEDATA, true);
+
+    geometry_->SetNumVertexBuffers(2);
+    geometry_->SetVertexBuffer(0, cornerBuffer_, MASK_POSITION);
+    geometry_->SetVertexBuffer(1, instanceBuffer_, MASK_INSTANCEDATA);
+    geometry_->SetIndexBuffer(indexBuffer_);
+    if (instanced_)
+        geometry_->SetDrawRange(TRIANGLE_LIST, 0, 6, 0, 4);
+
+    WriteQuads();
+
+    // the stream is one drawable already, keep the renderer from grouping it
+    batches_.Resize(1);
+    batches_[0].geometryType_ = GEOM_STATIC_NOINSTANCING;
+}
+
+ParticleStream::~ParticleStream()
+{
+}
+
+void ParticleStream::RegisterObject(Context* context)
+{
+    context->RegisterFactory<ParticleStream>();
+}
+
+void ParticleStream::SetMaterial(Material* material)
+{
+    batches_[0].material_ = material;
+}
+
+void ParticleStream::WriteQuads()
+{
+    static const float corners[4][3] = { { -1.0f, 1.0f, 0.0f }, { 1.0f, 1.0f, 0.0f }, { 1.0f, -1.0f, 0.0f }, { -1.0f, -1.0f, 0.0f } };
+
+    unsigned numQuads = cornerBuffer_->GetVertexCount() / 4;
+
+    float* dest = (float*) cornerBuffer_->Lock(0, numQuads * 4, true);
+    if (dest)
+    {
+        for (unsigned i = 0; i < numQuads; i++, dest += 12)
+            memcpy(dest, corners, sizeof(corners));
+
+        cornerBuffer_->Unlock();
+        cornerBuffer_->ClearDataLost();
+    }
+
+    void* indices = indexBuffer_->Lock(0, numQuads * 6, true);
+    if (indices)
+    {
+        bool large = indexBuffer_->GetIndexSize() == sizeof(unsigned);
+
+        for (unsigned i = 0; i < numQuads; i++)
+        {
+            unsigned vertex = i * 4;
+            unsigned quad[6] = { vertex, vertex + 1, vertex + 2, vertex + 2, vertex + 3, vertex };
+
+            for (unsigned j = 0; j < 6; j++)
+            {
+                if (large)
+                    ((unsigned*) indices)[i * 6 + j] = quad[j];
+                else
+                    ((unsigned short*) indices)[i * 6 + j] = (unsigned short) quad[j];
+            }
+        }
+
+        indexBuffer_->Unlock();
+        indexBuffer_->ClearDataLost();
+    }
+}
+
+void ParticleStream::SetParticles(const particle_t* particles, int numParticles, float scale)
+{
+    if (numParticles > MAX_PARTICLES)
+        numParticles = MAX_PARTICLES;
+    if (numParticles < 0 || !particles)
+        numParticles = 0;
+
+    numParticles_ = numParticles;
+
+    if (cornerBuffer_->IsDataLost() || indexBuffer_->IsDataLost())
+        WriteQuads();
+
+    unsigned copies = instanced_ ? 1 : 4;
+    float* dest = numParticles ? (float*) instanceBuffer_->Lock(0, numParticles * copies, true) : 0;
+
+    if (!dest)
+    {
+        numParticles_ = 0;
+        batches_[0].geometry_ = 0;
+        return;
+    }
+
+    Vector3 minPos(M_INFINITY, M_INFINITY, M_INFINITY);
+    Vector3 maxPos(-M_INFINITY, -M_INFINITY, -M_INFINITY);
+
+    for (int i = 0; i < numParticles; i++)
+    {
+        const particle_t* p = &particles[i];
+
+        float x = p->origin[0] * scale;
+        float y = p->origin[2] * scale;
+        float z = p->origin[1] * scale;
+
+        // the bridge drew particles at 0.8 of their alpha
+        int alpha = (int) (p->alpha * (0.8f * 63.0f) + 0.5f);
+        if (alpha < 0)
+            alpha = 0;
+        else if (alpha > 63)
+            alpha = 63;
+
+        dest[0] = x;
+        dest[1] = y;
+        dest[2] = z;
+        dest[3] = (float) (packedPalette_[p->color & 255] | (alpha << ALPHA_SHIFT));
+
+        if (copies == 1)
+            dest += 4;
+        else
+        {
+            memcpy(dest + 4, dest, 4 * sizeof(float));
+            memcpy(dest + 8, dest, 8 * sizeof(float));
+            dest += 16;
+        }
+
+        if (x < minPos.x_) minPos.x_ = x;
+        if (y < minPos.y_) minPos.y_ = y;
+        if (z < minPos.z_) minPos.z_ = z;
+        if (x > maxPos.x_) maxPos.x_ = x;
+        if (y > maxPos.y_) maxPos.y_ = y;
+        if (z > maxPos.z_) maxPos.z_ = z;
+    }
+
+    instanceBuffer_->Unlock();
+    instanceBuffer_->ClearDataLost();
+
+    if (instanced_)
+        geometry_->SetInstanceCount(numParticles);
+    else
+        geometry_->SetDrawRange(TRIANGLE_LIST, 0, numParticles * 6, 0, numParticles * 4);
+
+    batches_[0].geometry_ = geometry_;
+
+    // pad by a quad, the particle size is a material parameter
+    boundingBox_ = BoundingBox(minPos - Vector3::ONE, maxPos + Vector3::ONE);
+    if (node_)
+        OnMarkedDirty(node_);
+}
+
+void ParticleStream::OnWorldBoundingBoxUpdate()
+{
+    worldBoundingBox_ = boundingBox_.Transformed(node_->GetWorldTransform());
+}
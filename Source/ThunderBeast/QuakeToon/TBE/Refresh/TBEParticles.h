@@ -0,0 +1,64 @@
+#pragma once
+
+#include "Drawable.h"
+#include "TBEImage.h"
+
+namespace Urho3D
+{
+    class Geometry;
+    class VertexBuffer;
+    class IndexBuffer;
+}
+
+using namespace Urho3D;
+
+// Draws the refdef particles as camera facing quads. Every live particle is
+// one float4 in an instance stream, the position and its palette colour and
+// alpha packed as 6 bit fields into an integer the float holds exactly. The
+// stream is written in a single pass over the live particles only. Without
+// hardware instancing each particle is written to its 4 corners instead,
+// the shader reads the same stream either way
+class ParticleStream : public Drawable
+{
+    OBJECT(ParticleStream);
+
+public:
+
+    /// Construct.
+    ParticleStream(Context* context);
+    /// Destruct.
+    virtual ~ParticleStream();
+    /// Register object factory.
+    static void RegisterObject(Context* context);
+
+    /// Write the particles to the instance stream, positions are scaled and swapped to Urho3D axes.
+    void SetParticles(const particle_t* particles, int numParticles, float scale);
+    /// Set material.
+    void SetMaterial(Material* material);
+
+    /// Return number of particles written by the last SetParticles.
+    unsigned GetNumParticles() const { return numParticles_; }
+    /// Return whether the quads are drawn instanced.
+    bool IsInstanced() const { return instanced_; }
+    /// Return bytes written to the instance stream per particle.
+    unsigned GetStreamBytesPerParticle() const { return instanced_ ? 16 : 64; }
+
+protected:
+
+    /// Recalculate the world-space bounding box.
+    virtual void OnWorldBoundingBoxUpdate();
+
+private:
+
+    void WriteQuads();
+
+    SharedPtr<Geometry> geometry_;
+    SharedPtr<VertexBuffer> cornerBuffer_;
+    SharedPtr<IndexBuffer> indexBuffer_;
+    SharedPtr<VertexBuffer> instanceBuffer_;
+
+    // d_8to24table as 6 bit rgb fields
+    unsigned packedPalette_[256];
+    unsigned numParticles_;
+    bool instanced_;
+};
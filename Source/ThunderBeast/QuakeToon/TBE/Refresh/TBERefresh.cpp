@@ -1,8 +1,17 @@
 
 #include "TBEModelLoad.h"
+#include "TBEMD2Model.h"
+#include "TBEParticles.h"
+#include "TBESystem.h"
 
 refimport_t	ri;
 
+cvar_t	*r_speeds;
+
+void R_AliasBench_f (void);
+void R_LightmapTest_f (void);
+void R_ParticleBench_f (void);
+
 extern "C"
 {
 
@@ -10,6 +19,15 @@ extern "C"
 
 qboolean R_Init( void *hinstance, void *hWnd )
 {
+    r_speeds = ri.Cvar_Get ("r_speeds", "0", 0);
+
+    MD2Model::RegisterObject(TBESystem::GetGlobalContext());
+    ParticleStream::RegisterObject(TBESystem::GetGlobalContext());
+
+    ri.Cmd_AddCommand ("aliasbench", R_AliasBench_f);
+    ri.Cmd_AddCommand ("lightmaptest", R_LightmapTest_f);
+    ri.Cmd_AddCommand ("particlebench", R_ParticleBench_f);
+
     GL_InitImages ();
     Mod_Init ();
 
@@ -76,6 +94,8 @@ void    Draw_StretchRaw (int x, int y, int w, int h, int cols, int rows, byte *d
 
 void R_Shutdown (void)
 {
+    ri.Cmd_RemoveCommand ("aliasbench");
+    ri.Cmd_RemoveCommand ("lightmaptest");
 
 }
 
@@ -13,6 +13,8 @@ msurface_t	*r_alpha_surfaces;
 
 #define LIGHTMAP_BYTES 4
 
+#define LIGHTMAP_BLOCKLIGHTS (34*34*3)
+
 #define	BLOCK_WIDTH		128
 #define	BLOCK_HEIGHT	128
 
@@ -36,7 +38,7 @@ typedef struct
 
 } gllightmapstate_t;
 
-static float s_blocklights[34*34*3];
+static float s_blocklights[LIGHTMAP_BLOCKLIGHTS];
 static gllightmapstate_t gl_lms;
 
 static void		LM_InitBlock( void );
@@ -62,10 +64,13 @@ void R_SetCacheState( msurface_t *surf )
 ===============
 R_BuildLightMap
 
-Combine and scale multiple lightmaps into the floating format in blocklights
+Combine and scale multiple lightmaps into the floating format in blocklights,
+blocklights must hold LIGHTMAP_BLOCKLIGHTS floats. Only reads the surface and
+r_newrefdef.lightstyles, so surfaces can be built from several threads each
+with its own blocklights
 ===============
 */
-void R_BuildLightMap (msurface_t *surf, byte *dest, int stride)
+void R_BuildLightMapBlock (msurface_t *surf, byte *dest, int stride, float *blocklights)
 {
     int			smax, tmax;
     int			r, g, b, a, max;
@@ -87,8 +92,8 @@ void R_BuildLightMap (msurface_t *surf, byte *dest, int stride)
     smax = (surf->extents[0]>>4)+1;
     tmax = (surf->extents[1]>>4)+1;
     size = smax*tmax;
-    if (size > (sizeof(s_blocklights)>>4) )
-        ri.Sys_Error (ERR_DROP, "Bad s_blocklights size");
+    if (size > ((LIGHTMAP_BLOCKLIGHTS*sizeof(float))>>4) )
+        ri.Sys_Error (ERR_DROP, "Bad blocklights size");
 
 // set to full bright if no light data
     if (!surf->samples)
@@ -96,7 +101,7 @@ void R_BuildLightMap (msurface_t *surf, byte *dest, int stride)
         int maps;
 
         for (i=0 ; i<size*3 ; i++)
-            s_blocklights[i] = 255;
+            blocklights[i] = 255;
         for (maps = 0 ; maps < MAXLIGHTMAPS && surf->styles[maps] != 255 ;
              maps++)
         {
@@ -122,7 +127,7 @@ void R_BuildLightMap (msurface_t *surf, byte *dest, int stride)
         for (maps = 0 ; maps < MAXLIGHTMAPS && surf->styles[maps] != 255 ;
              maps++)
         {
-            bl = s_blocklights;
+            bl = blocklights;
 
             for (i=0 ; i<3 ; i++)
                 scale[i] = lightscale * r_newrefdef.lightstyles[surf->styles[maps]].rgb[i];
@@ -154,12 +159,12 @@ void R_BuildLightMap (msurface_t *surf, byte *dest, int stride)
     {
         int maps;
 
-        memset( s_blocklights, 0, sizeof( s_blocklights[0] ) * size * 3 );
+        memset( blocklights, 0, sizeof( blocklights[0] ) * size * 3 );
 
         for (maps = 0 ; maps < MAXLIGHTMAPS && surf->styles[maps] != 255 ;
              maps++)
         {
-            bl = s_blocklights;
+            bl = blocklights;
 
             for (i=0 ; i<3 ; i++)
                 scale[i] = lightscale * r_newrefdef.lightstyles[surf->styles[maps]].rgb[i];
@@ -191,7 +196,7 @@ void R_BuildLightMap (msurface_t *surf, byte *dest, int stride)
 // put into texture format
 store:
     stride -= (smax<<2);
-    bl = s_blocklights;
+    bl = blocklights;
 
     //monolightmap = gl_monolightmap->string[0];
 
@@ -342,6 +347,11 @@ store:
     }
 }
 
+void R_BuildLightMap (msurface_t *surf, byte *dest, int stride)
+{
+    R_BuildLightMapBlock (surf, dest, stride, s_blocklights);
+}
+
 
 /*
 =============================================================================
@@ -0,0 +1,70 @@
+
+#include "Material.h"
+#include "Texture2D.h"
+#include "TBETextureAnimation.h"
+
+TextureAnimations::TextureAnimations() :
+    numMaterialsChanged_(0)
+{
+}
+
+void TextureAnimations::Clear()
+{
+    animations_.Clear();
+    materialAnimations_.Clear();
+    modelAnimations_.Clear();
+    numMaterialsChanged_ = 0;
+}
+
+void TextureAnimations::AddMaterial(model_t* model, Material* material, mtexinfo_t* texinfo)
+{
+    if (!material || texinfo->numframes < 2 || materialAnimations_.Contains(material))
+        return;
+
+    Animation animation;
+    animation.material_ = material;
+    animation.frame_ = -1;
+
+    // frame n is n steps along the chain from the surface texinfo
+    mtexinfo_t* tex = texinfo;
+    for (int i = 0; i < texinfo->numframes; i++)
+    {
+        animation.frames_.Push(tex->image->texture);
+        if (tex->next)
+            tex = tex->next;
+    }
+
+    unsigned index = animations_.Size();
+    animations_.Push(animation);
+    materialAnimations_.Insert(MakePair(material, index));
+
+    HashMap<model_t*, PODVector<unsigned> >::Iterator i = modelAnimations_.Find(model);
+    if (i == modelAnimations_.End())
+        i = modelAnimations_.Insert(MakePair(model, PODVector<unsigned>()));
+
+    i->second_.Push(index);
+}
+
+void TextureAnimations::Update(model_t* model, int frame)
+{
+    HashMap<model_t*, PODVector<unsigned> >::Iterator i = modelAnimations_.Find(model);
+    if (i == modelAnimations_.End())
+        return;
+
+    const PODVector<unsigned>& indices = i->second_;
+    for (unsigned j = 0; j < indices.Size(); j++)
+    {
+        Animation& animation = animations_[indices[j]];
+
+        int index = frame % (int) animation.frames_.Size();
+        if (index == animation.frame_)
+            continue;
+
+        animation.frame_ = index;
+
+        if (animation.frames_[index])
+            animation.material_->SetTexture(TU_DIFFUSE, animation.frames_[index]);
+
+        numMaterialsChanged_++;
+    }
+}
@@ -0,0 +1,62 @@
+
+#pragma once
+
+#include "TBEModelLoad.h"
+
+namespace Urho3D
+{
+    class Material;
+    class Texture;
+}
+
+using namespace Urho3D;
+
+// Animated texinfo chains of the map materials.
+// Surfaces with an animated texinfo share one material per texture, lightmap
+// page and model, the chain of each material is flattened to its frame
+// textures at load. A frame steps each material of a model once and only
+// materials whose frame changed have their diffuse texture set.
+// The world animates by time, inline brush models by their entity frame
+class TextureAnimations
+{
+    struct Animation
+    {
+        SharedPtr<Material> material_;
+        // diffuse texture for each frame of the chain
+        PODVector<Texture*> frames_;
+        // frame currently set on the material, -1 before the first update
+        int frame_;
+    };
+
+    Vector<Animation> animations_;
+
+    // animation of each material, so surfaces sharing one add it once
+    HashMap<Material*, unsigned> materialAnimations_;
+
+    // animations of the world and of each inline brush model
+    HashMap<model_t*, PODVector<unsigned> > modelAnimations_;
+
+    unsigned numMaterialsChanged_;
+
+public:
+
+    TextureAnimations();
+
+    /// Remove all animations.
+    void Clear();
+
+    /// Add the animation of a surface material to a model, a material already added is ignored.
+    void AddMaterial(model_t* model, Material* material, mtexinfo_t* texinfo);
+
+    /// Set the frame of every animated material of the model.
+    void Update(model_t* model, int frame);
+
+    /// Reset the changed material count, call once per frame before the updates.
+    void ResetCounters() { numMaterialsChanged_ = 0; }
+
+    /// Return number of animated materials.
+    unsigned GetNumAnimations() const { return animations_.Size(); }
+    /// Return number of materials whose texture changed since the counters were reset.
+    unsigned GetNumMaterialsChanged() const { return numMaterialsChanged_; }
+
+};
@@ -98,6 +98,7 @@ void	VID_Init (void)
     ri.Sys_Error = VID_Error;
     ri.FS_LoadFile = FS_LoadFile;
     ri.FS_FreeFile = FS_FreeFile;
+    ri.FS_LoadFileReadOnly = FS_LoadFileReadOnly;
     ri.FS_Gamedir = FS_Gamedir;
     ri.Vid_NewWindow = VID_NewWindow;
     ri.Cvar_Get = Cvar_Get;
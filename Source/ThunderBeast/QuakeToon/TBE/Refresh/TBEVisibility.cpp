@@ -0,0 +1,129 @@
+
+#include "Node.h"
+#include "TBEVisibility.h"
+
+WorldVisibility::WorldVisibility() :
+    viewCluster_(-1),
+    hasAreaBits_(false),
+    valid_(false),
+    numToggles_(0)
+{
+    memset(areaBits_, 0, sizeof(areaBits_));
+}
+
+void WorldVisibility::Clear()
+{
+    nodes_.Clear();
+    nodeEnabled_.Clear();
+    nodeWanted_.Clear();
+    clusterNodeStart_.Clear();
+    clusterNodes_.Clear();
+    clusterAreaStart_.Clear();
+    clusterAreas_.Clear();
+
+    viewCluster_ = -1;
+    hasAreaBits_ = false;
+    valid_ = false;
+    numToggles_ = 0;
+}
+
+unsigned WorldVisibility::AddNode(Node* node)
+{
+    nodes_.Push(node);
+    nodeEnabled_.Push(node->IsEnabled() ? 1 : 0);
+    nodeWanted_.Push(0);
+
+    valid_ = false;
+
+    return nodes_.Size() - 1;
+}
+
+void WorldVisibility::AddCluster(const PODVector<unsigned>& nodeIndices, const PODVector<int>& areas)
+{
+    if (clusterNodeStart_.Empty())
+        clusterNodeStart_.Push(0);
+    if (clusterAreaStart_.Empty())
+        clusterAreaStart_.Push(0);
+
+    clusterNodes_.Push(nodeIndices);
+    clusterNodeStart_.Push(clusterNodes_.Size());
+
+    clusterAreas_.Push(areas);
+    clusterAreaStart_.Push(clusterAreas_.Size());
+
+    valid_ = false;
+}
+
+bool WorldVisibility::ClusterInOpenArea(unsigned cluster, const byte* areabits) const
+{
+    unsigned start = clusterAreaStart_[cluster];
+    unsigned end = clusterAreaStart_[cluster + 1];
+
+    // no leafs to say otherwise
+    if (start == end)
+        return true;
+
+    for (unsigned i = start; i < end; i++)
+    {
+        int area = clusterAreas_[i];
+        if (areabits[area>>3] & (1<<(area&7)))
+            return true;
+    }
+
+    return false;
+}
+
+void WorldVisibility::Update(model_t* worldmodel, int viewCluster, const byte* areabits)
+{
+    numToggles_ = 0;
+
+    bool areasChanged;
+    if (areabits)
+        areasChanged = !hasAreaBits_ || memcmp(areaBits_, areabits, sizeof(areaBits_));
+    else
+        areasChanged = hasAreaBits_;
+
+    if (valid_ && viewCluster == viewCluster_ && !areasChanged)
+        return;
+
+    viewCluster_ = viewCluster;
+    hasAreaBits_ = areabits != NULL;
+    if (areabits)
+        memcpy(areaBits_, areabits, sizeof(areaBits_));
+
+    valid_ = true;
+
+    unsigned numNodes = nodes_.Size();
+
+    if (numNodes)
+        memset(&nodeWanted_[0], 0, numNodes);
+
+    unsigned numClusters = clusterNodeStart_.Size() ? clusterNodeStart_.Size() - 1 : 0;
+
+    if (viewCluster >= 0 && (unsigned) viewCluster < numClusters)
+    {
+        byte* vis = Mod_ClusterPVS(viewCluster, worldmodel);
+
+        for (unsigned i = 0; i < numClusters; i++)
+        {
+            if (i != viewCluster && !(vis[i>>3] & (1<<(i&7))))
+                continue;
+
+            if (areabits && !ClusterInOpenArea(i, areabits))
+                continue;
+
+            for (unsigned j = clusterNodeStart_[i]; j < clusterNodeStart_[i + 1]; j++)
+                nodeWanted_[clusterNodes_[j]] = 1;
+        }
+    }
+
+    for (unsigned i = 0; i < numNodes; i++)
+    {
+        if (nodeWanted_[i] != nodeEnabled_[i])
+        {
+            nodeEnabled_[i] = nodeWanted_[i];
+            nodes_[i]->SetEnabled(nodeWanted_[i] != 0);
+            numToggles_++;
+        }
+    }
+}
@@ -0,0 +1,64 @@
+
+#pragma once
+
+#include "TBEModelLoad.h"
+
+namespace Urho3D
+{
+    class Node;
+}
+
+using namespace Urho3D;
+
+// Keeps the world cluster nodes in sync with the PVS of the view cluster.
+// The last view cluster and area bits are cached and only nodes whose
+// visibility actually changed are toggled, so the Octree isn't dirtied
+// every frame while the camera stays in the same cluster
+class WorldVisibility
+{
+    // world nodes, clusterNodes_ holds indices into this
+    PODVector<Node*> nodes_;
+    // enabled state we last gave each node
+    PODVector<unsigned char> nodeEnabled_;
+    // scratch, nodes wanted by the current view
+    PODVector<unsigned char> nodeWanted_;
+
+    // nodes holding surfaces of cluster c are
+    // clusterNodes_[clusterNodeStart_[c]] .. clusterNodes_[clusterNodeStart_[c + 1] - 1]
+    PODVector<unsigned> clusterNodeStart_;
+    PODVector<unsigned> clusterNodes_;
+
+    // areas of the leafs in cluster c, same layout as above
+    PODVector<unsigned> clusterAreaStart_;
+    PODVector<int> clusterAreas_;
+
+    int viewCluster_;
+    byte areaBits_[MAX_MAP_AREAS/8];
+    bool hasAreaBits_;
+    bool valid_;
+
+    unsigned numToggles_;
+
+    bool ClusterInOpenArea(unsigned cluster, const byte* areabits) const;
+
+public:
+
+    WorldVisibility();
+
+    /// Remove all nodes and clusters.
+    void Clear();
+
+    /// Add a world node, returns the index used when adding clusters.
+    unsigned AddNode(Node* node);
+    /// Add the next cluster, clusters must be added in order starting at 0.
+    void AddCluster(const PODVector<unsigned>& nodeIndices, const PODVector<int>& areas);
+
+    /// Enable the nodes visible from the view cluster, a negative cluster disables all nodes.
+    void Update(model_t* worldmodel, int viewCluster, const byte* areabits);
+
+    /// Return number of nodes toggled by the last update.
+    unsigned GetNumToggles() const { return numToggles_; }
+    /// Return number of world nodes.
+    unsigned GetNumNodes() const { return nodes_.Size(); }
+
+};
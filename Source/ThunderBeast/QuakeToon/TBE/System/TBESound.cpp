@@ -0,0 +1,154 @@
+
+#include "Context.h"
+#include "Scene.h"
+#include "Audio.h"
+#include "SoundSource.h"
+#include "SoundStream.h"
+#include "TBESystem.h"
+
+extern "C"
+{
+#include "../../client/client.h"
+#include "../../client/snd_loc.h"
+}
+
+using namespace Urho3D;
+
+// The Quake2 DMA buffer played as an Urho3D sound stream. Audio::MixOutput
+// pulls the stream on the SDL audio thread, which mixes each part of the
+// ring through S_DeviceMix just before it copies it out. The game side only
+// reads the play position, published with a release store, and takes the
+// sound lock while it changes channels and playsounds
+//
+// Without an audio device (headless, -nosound) a null device plays the ring
+// by the clock and S_Update mixes on the game side as it always did
+
+// mono samples in the ring, a power of 2
+static const int DMA_SAMPLES = 32768;
+
+class DMASoundStream : public SoundStream
+{
+public:
+
+    DMASoundStream() : position_(0)
+    {
+        SetFormat(dma.speed, true, true);
+    }
+
+    virtual unsigned GetData(signed char* dest, unsigned numBytes)
+    {
+        int frames = numBytes >> 2;
+        int ringFrames = dma.samples >> 1;
+        if (frames > ringFrames)
+            frames = ringFrames;
+
+        // only this thread moves the position
+        int start = position_;
+
+        S_DeviceMix(start, start + frames);
+
+        const int* ring = (const int*) dma.buffer;
+        int first = start & (ringFrames - 1);
+        int tail = Min(frames, ringFrames - first);
+
+        memcpy(dest, ring + first, tail * 4);
+        memcpy(dest + tail * 4, ring, (frames - tail) * 4);
+
+        Sys_AtomicStore(&position_, start + frames);
+
+        return frames << 2;
+    }
+
+    /// Return sample pairs played since the stream started.
+    int GetPosition() { return Sys_AtomicLoad(&position_); }
+
+private:
+
+    volatile int position_;
+};
+
+static SharedPtr<Scene> soundScene;
+static SharedPtr<DMASoundStream> soundStream;
+static int nullDeviceStart;
+
+qboolean SNDDMA_Init(void)
+{
+    Context* context = TBESystem::GetGlobalContext();
+    Audio* audio = context->GetSubsystem<Audio>();
+
+    memset(&dma, 0, sizeof(dma));
+
+    if (s_khz->value >= 44)
+        dma.speed = 44100;
+    else if (s_khz->value >= 22)
+        dma.speed = 22050;
+    else
+        dma.speed = 11025;
+
+    dma.channels = 2;
+    dma.samplebits = 16;
+    dma.samples = DMA_SAMPLES;
+    dma.submission_chunk = 1;
+    dma.buffer = new byte[DMA_SAMPLES * 2];
+    memset(dma.buffer, 0, DMA_SAMPLES * 2);
+
+    snd_devicemix = audio && audio->IsInitialized() ? qtrue : qfalse;
+
+    if (snd_devicemix)
+    {
+        // the source needs an enabled node to be mixed
+        soundScene = new Scene(context);
+        soundStream = new DMASoundStream();
+
+        SoundSource* source = soundScene->CreateComponent<SoundSource>();
+        source->Play(soundStream);
+    }
+    else
+    {
+        nullDeviceStart = Sys_Milliseconds();
+        Com_Printf("no audio device, mixing to a null device\n");
+    }
+
+    return qtrue;
+}
+
+int	SNDDMA_GetDMAPos(void)
+{
+    int pairs;
+
+    if (soundStream)
+        pairs = soundStream->GetPosition();
+    else
+        pairs = (int) ((double) (Sys_Milliseconds() - nullDeviceStart) * dma.speed / 1000.0);
+
+    dma.samplepos = (pairs * dma.channels) & (dma.samples - 1);
+
+    return dma.samplepos;
+}
+
+void SNDDMA_Shutdown(void)
+{
+    // stopping takes the audio mutex, so the device is out of GetData
+    // before the buffer goes
+    if (soundScene)
+    {
+        SoundSource* source = soundScene->GetComponent<SoundSource>();
+        if (source)
+            source->Stop();
+    }
+
+    soundScene.Reset();
+    soundStream.Reset();
+    snd_devicemix = qfalse;
+
+    delete [] dma.buffer;
+    dma.buffer = NULL;
+}
+
+void SNDDMA_BeginPainting (void)
+{
+}
+
+void SNDDMA_Submit(void)
+{
+}
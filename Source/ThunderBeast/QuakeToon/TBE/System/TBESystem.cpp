@@ -3,12 +3,257 @@
 #include "Context.h"
 #include "Engine.h"
 #include "FileSystem.h"
+#include "WorkQueue.h"
+#include "Thread.h"
+#include "Mutex.h"
+#include "Profiler.h"
+#include "DebugHud.h"
 #include "TBESystem.h"
 
+#include <setjmp.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+extern "C"
+{
+#include "../../qcommon/qcommon.h"
+}
+
 using namespace Urho3D;
 
 TBESystem* TBESystem::sInstance_ = NULL;
 
+#ifdef WIN32
+static DWORD mainThreadID_;
+#else
+static pthread_t mainThreadID_;
+#endif
+
+/// Auto reset event that remembers a Set() made before the Wait().
+class SysEvent
+{
+public:
+    SysEvent()
+    {
+#ifdef WIN32
+        event_ = CreateEvent(0, FALSE, FALSE, 0);
+#else
+        signaled_ = false;
+        pthread_mutex_init(&mutex_, 0);
+        pthread_cond_init(&cond_, 0);
+#endif
+    }
+
+    ~SysEvent()
+    {
+#ifdef WIN32
+        CloseHandle(event_);
+#else
+        pthread_cond_destroy(&cond_);
+        pthread_mutex_destroy(&mutex_);
+#endif
+    }
+
+    void Set()
+    {
+#ifdef WIN32
+        SetEvent(event_);
+#else
+        pthread_mutex_lock(&mutex_);
+        signaled_ = true;
+        pthread_cond_signal(&cond_);
+        pthread_mutex_unlock(&mutex_);
+#endif
+    }
+
+    void Wait()
+    {
+#ifdef WIN32
+        WaitForSingleObject(event_, INFINITE);
+#else
+        pthread_mutex_lock(&mutex_);
+        while (!signaled_)
+            pthread_cond_wait(&cond_, &mutex_);
+        signaled_ = false;
+        pthread_mutex_unlock(&mutex_);
+#endif
+    }
+
+private:
+#ifdef WIN32
+    HANDLE event_;
+#else
+    pthread_mutex_t mutex_;
+    pthread_cond_t cond_;
+    bool signaled_;
+#endif
+};
+
+/// A Sys_RunJobs batch and the first error raised by its jobs.
+struct SysJobBatch
+{
+    sysjob_t job_;
+    void* data_;
+    volatile int failed_;
+    int errorCode_;
+    char errorMsg_[1024];
+};
+
+/// Where Sys_JobError returns to on a thread running part of a batch.
+struct SysJobFrame
+{
+    SysJobBatch* batch_;
+    jmp_buf abort_;
+};
+
+static THREADLOCAL SysJobFrame* jobFrame_;
+static Mutex jobErrorLock_;
+
+/// Run jobs [start, end) of the batch, stopping once any of them has failed.
+static void RunJobRange(SysJobBatch* batch, int start, int end, int thread)
+{
+    SysJobFrame frame;
+    SysJobFrame* outer = jobFrame_;
+
+    frame.batch_ = batch;
+    jobFrame_ = &frame;
+
+    // only C frames lie between here and Sys_JobError
+    if (!setjmp(frame.abort_))
+    {
+        for (int i = start; i < end && !Sys_AtomicLoad(&batch->failed_); i++)
+            batch->job_(batch->data_, i, thread);
+    }
+
+    jobFrame_ = outer;
+}
+
+/// Raise a job's error on the thread that ran the batch, once every job thread is done with it.
+static void RaiseJobError(SysJobBatch& batch)
+{
+    if (batch.failed_)
+        Com_Error(batch.errorCode_, "%s", batch.errorMsg_);
+}
+
+/// Job thread for batches run off the main thread, which can't use the WorkQueue.
+class SysJobWorker : public Thread
+{
+public:
+    SysJobWorker(int index) :
+        index_(index),
+        batch_(0),
+        start_(0),
+        end_(0)
+    {
+    }
+
+    /// Run the batch over [start, end) on this thread.
+    void Start(SysJobBatch* batch, int start, int end)
+    {
+        batch_ = batch;
+        start_ = start;
+        end_ = end;
+        wake_.Set();
+    }
+
+    /// Wait for the range given to Start() to finish.
+    void Finish()
+    {
+        done_.Wait();
+    }
+
+    /// Tell the thread to return and join it.
+    void Quit()
+    {
+        shouldRun_ = false;
+        wake_.Set();
+        Stop();
+    }
+
+    virtual void ThreadFunction()
+    {
+        for (;;)
+        {
+            wake_.Wait();
+
+            if (!shouldRun_)
+                return;
+
+            RunJobRange(batch_, start_, end_, index_);
+
+            done_.Set();
+        }
+    }
+
+private:
+    int index_;
+    SysJobBatch* batch_;
+    int start_;
+    int end_;
+    SysEvent wake_;
+    SysEvent done_;
+};
+
+/// Started on first use, thread indices 1 and up like the WorkQueue's.
+static PODVector<SysJobWorker*> jobWorkers_;
+/// One batch at a time, whichever thread it comes from.
+static Mutex jobWorkersLock_;
+
+static void RunWorkerJobs(SysJobBatch* batch, int count, int maxthreads)
+{
+    MutexLock lock(jobWorkersLock_);
+
+    while ((int) jobWorkers_.Size() < maxthreads - 1)
+    {
+        SysJobWorker* worker = new SysJobWorker(jobWorkers_.Size() + 1);
+
+        if (!worker->Run())
+        {
+            delete worker;
+            break;
+        }
+
+        jobWorkers_.Push(worker);
+    }
+
+    if ((int) jobWorkers_.Size() < maxthreads - 1)
+        maxthreads = jobWorkers_.Size() + 1;
+
+    // one range per thread, the caller takes the first as thread 0
+    int perItem = (count + maxthreads - 1) / maxthreads;
+    unsigned started = 0;
+
+    for (int start = perItem; start < count; start += perItem)
+        jobWorkers_[started++]->Start(batch, start, count - start > perItem ? start + perItem : count);
+
+    RunJobRange(batch, 0, perItem < count ? perItem : count, 0);
+
+    for (unsigned i = 0; i < started; i++)
+        jobWorkers_[i]->Finish();
+}
+
+/// Profiler for the blocks of the server thread, Urho3D's is main thread only.
+static Profiler* threadProfiler_;
+/// Taken around every use of the thread profiler.
+static Mutex threadProfilerLock_;
+
+static void ShutdownJobWorkers()
+{
+    MutexLock lock(jobWorkersLock_);
+
+    for (unsigned i = 0; i < jobWorkers_.Size(); i++)
+    {
+        jobWorkers_[i]->Quit();
+        delete jobWorkers_[i];
+    }
+
+    jobWorkers_.Clear();
+}
+
 /// Construct.
 TBESystem::TBESystem(Context* context) : Object(context)
 {
@@ -21,12 +266,21 @@ TBESystem::TBESystem(Context* context) : Object(context)
 
     timer_.Reset();
 
+#ifdef WIN32
+    mainThreadID_ = GetCurrentThreadId();
+#else
+    mainThreadID_ = pthread_self();
+#endif
+
 }
 
 /// Destruct.
 TBESystem::~TBESystem()
 {
+    ShutdownJobWorkers();
 
+    delete threadProfiler_;
+    threadProfiler_ = 0;
 }
 
 Context* TBESystem::GetGlobalContext()
@@ -73,11 +327,20 @@ unsigned TBESystem::GetMilliseconds()
     return sInstance_->timer_.GetMSec(false);
 }
 
+unsigned TBESystem::GetMicroseconds()
 
-extern "C"
 {
+    if (!sInstance_)
+    {
+        ErrorExit("TBESystem not initialized");
+    }
+
+    return (unsigned) sInstance_->hiresTimer_.GetUSec(false);
+}
 
-#include "../../qcommon/qcommon.h"
+
+extern "C"
+{
 
 int	curtime;
 unsigned sys_frame_time;
@@ -140,6 +403,11 @@ int Sys_Milliseconds (void)
     return (int) TBESystem::GetMilliseconds();
 }
 
+unsigned Sys_Microseconds (void)
+{
+    return TBESystem::GetMicroseconds();
+}
+
 void Sys_ConsoleOutput (char *string)
 {
     printf("%s", string);
@@ -155,4 +423,307 @@ void *Sys_GetGameAPI (void *parms)
     return GetGameAPI(parms);
 }
 
+static void SysJobsWork(const WorkItem* item, unsigned threadIndex)
+{
+    SysJobBatch* batch = reinterpret_cast<SysJobBatch*>(item->aux_);
+    int start = (int) (size_t) item->start_;
+    int end = (int) (size_t) item->end_;
+
+    RunJobRange(batch, start, end, (int) threadIndex);
+}
+
+void Sys_JobError (int code, char *msg)
+{
+    SysJobFrame* frame = jobFrame_;
+
+    if (!frame)
+        return;
+
+    SysJobBatch* batch = frame->batch_;
+
+    jobErrorLock_.Acquire();
+    if (!batch->failed_)
+    {
+        batch->errorCode_ = code;
+        strncpy(batch->errorMsg_, msg, sizeof(batch->errorMsg_) - 1);
+        batch->errorMsg_[sizeof(batch->errorMsg_) - 1] = 0;
+        Sys_AtomicStore(&batch->failed_, 1);
+    }
+    jobErrorLock_.Release();
+
+    longjmp(frame->abort_, 1);
+}
+
+int Sys_NumJobThreads (void)
+{
+    WorkQueue* queue = TBESystem::GetGlobalContext()->GetSubsystem<WorkQueue>();
+
+    // worker threads + main thread
+    return queue ? (int) queue->GetNumThreads() + 1 : 1;
+}
+
+void Sys_RunJobs (sysjob_t job, void *data, int count, int maxthreads)
+{
+    WorkQueue* queue = TBESystem::GetGlobalContext()->GetSubsystem<WorkQueue>();
+    int numThreads = Sys_NumJobThreads();
+
+    if (maxthreads > numThreads)
+        maxthreads = numThreads;
+    if (maxthreads > count)
+        maxthreads = count;
+
+    if (!queue || maxthreads <= 1)
+    {
+        for (int i = 0; i < count; i++)
+            job(data, i, 0);
+        return;
+    }
+
+    SysJobBatch batch;
+    batch.job_ = job;
+    batch.data_ = data;
+    batch.failed_ = 0;
+
+    // the work queue only takes items from the main thread, the server
+    // thread runs its batches on threads of its own
+    if (!Sys_IsMainThread())
+    {
+        RunWorkerJobs(&batch, count, maxthreads);
+        RaiseJobError(batch);
+        return;
+    }
+
+    // one item per thread, so no more than maxthreads run at once
+    int perItem = (count + maxthreads - 1) / maxthreads;
+
+    for (int start = 0; start < count; start += perItem)
+    {
+        SharedPtr<WorkItem> item = queue->GetFreeItem();
+        item->priority_ = M_MAX_UNSIGNED;
+        item->workFunction_ = SysJobsWork;
+        item->aux_ = &batch;
+        item->start_ = (void*) (size_t) start;
+        item->end_ = (void*) (size_t) (count - start > perItem ? start + perItem : count);
+        queue->AddWorkItem(item);
+    }
+
+    queue->Complete(M_MAX_UNSIGNED);
+
+    RaiseJobError(batch);
+}
+
+class SysThread : public Thread
+{
+public:
+    SysThread(systhread_t func, void* data) :
+        func_(func),
+        data_(data)
+    {
+    }
+
+    virtual void ThreadFunction()
+    {
+        func_(data_);
+    }
+
+private:
+    systhread_t func_;
+    void* data_;
+};
+
+void *Sys_StartThread (systhread_t func, void *data)
+{
+    SysThread* thread = new SysThread(func, data);
+
+    if (!thread->Run())
+    {
+        delete thread;
+        return NULL;
+    }
+
+    return thread;
+}
+
+void Sys_JoinThread (void *thread)
+{
+    // the thread function is expected to have been told to return
+    delete static_cast<SysThread*>(thread);
+}
+
+qboolean Sys_IsMainThread (void)
+{
+#ifdef WIN32
+    return GetCurrentThreadId() == mainThreadID_ ? qtrue : qfalse;
+#else
+    return pthread_equal(pthread_self(), mainThreadID_) ? qtrue : qfalse;
+#endif
+}
+
+int Sys_ThreadId (void)
+{
+    static THREADLOCAL int id;
+
+    if (!id)
+    {
+#ifdef WIN32
+        static volatile LONG lastId;
+        id = (int) InterlockedIncrement(&lastId);
+#else
+        static volatile int lastId;
+        id = __atomic_add_fetch(&lastId, 1, __ATOMIC_RELAXED);
+#endif
+    }
+
+    return id;
+}
+
+void Sys_Sleep (int msec)
+{
+    Time::Sleep(msec > 0 ? (unsigned) msec : 0);
+}
+
+void *Sys_CreateMutex (void)
+{
+    return new Mutex();
+}
+
+void Sys_DestroyMutex (void *mutex)
+{
+    delete static_cast<Mutex*>(mutex);
+}
+
+void Sys_LockMutex (void *mutex)
+{
+    if (mutex)
+        static_cast<Mutex*>(mutex)->Acquire();
+}
+
+void Sys_UnlockMutex (void *mutex)
+{
+    if (mutex)
+        static_cast<Mutex*>(mutex)->Release();
+}
+
+int Sys_AtomicLoad (volatile int *p)
+{
+#ifdef _MSC_VER
+    // volatile reads have acquire semantics on MSVC
+    int value = *p;
+    _ReadWriteBarrier();
+    return value;
+#else
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#endif
+}
+
+void Sys_AtomicStore (volatile int *p, int value)
+{
+#ifdef _MSC_VER
+    _ReadWriteBarrier();
+    *p = value;
+#else
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+#endif
+}
+
+void Sys_BeginProfile (const char *name)
+{
+    Profiler* profiler = TBESystem::GetGlobalContext()->GetSubsystem<Profiler>();
+
+    if (!profiler)
+        return;
+
+    if (Sys_IsMainThread())
+    {
+        profiler->BeginBlock(name);
+        return;
+    }
+
+    MutexLock lock(threadProfilerLock_);
+
+    if (!threadProfiler_)
+        threadProfiler_ = new Profiler(TBESystem::GetGlobalContext());
+
+    threadProfiler_->BeginBlock(name);
+}
+
+void Sys_EndProfile (void)
+{
+    Profiler* profiler = TBESystem::GetGlobalContext()->GetSubsystem<Profiler>();
+
+    if (!profiler)
+        return;
+
+    if (Sys_IsMainThread())
+    {
+        profiler->EndBlock();
+        return;
+    }
+
+    MutexLock lock(threadProfilerLock_);
+
+    if (!threadProfiler_)
+        return;
+
+    // the thread has no frame events, each outermost block is a frame
+    const ProfilerBlock* block = threadProfiler_->GetCurrentBlock();
+    if (block->parent_ && !block->parent_->parent_)
+        threadProfiler_->EndFrame();
+    else
+        threadProfiler_->EndBlock();
+}
+
+void Sys_ResetProfile (void)
+{
+    Profiler* profiler = TBESystem::GetGlobalContext()->GetSubsystem<Profiler>();
+
+    if (profiler)
+        profiler->BeginInterval();
+
+    MutexLock lock(threadProfilerLock_);
+
+    if (threadProfiler_)
+        threadProfiler_->BeginInterval();
+}
+
+static void PrintProfileData(const String& data)
+{
+    // one line at a time, the whole breakdown won't fit a single Com_Printf
+    Vector<String> lines = data.Split('\n');
+    for (unsigned i = 0; i < lines.Size(); i++)
+        Com_Printf("%s\n", lines[i].CString());
+}
+
+void Sys_PrintProfile (void)
+{
+    Profiler* profiler = TBESystem::GetGlobalContext()->GetSubsystem<Profiler>();
+
+    if (!profiler)
+        return;
+
+    PrintProfileData(profiler->GetData(false, false));
+
+    String threadData;
+    {
+        MutexLock lock(threadProfilerLock_);
+
+        if (threadProfiler_)
+            threadData = threadProfiler_->GetData(false, false);
+    }
+
+    if (threadData.Length())
+    {
+        Com_Printf("Server thread, one frame per ServerTick\n");
+        PrintProfileData(threadData);
+    }
+}
+
+void Sys_SetStat (const char *label, const char *value)
+{
+    DebugHud* debugHud = TBESystem::GetGlobalContext()->GetSubsystem<DebugHud>();
+
+    if (debugHud)
+        debugHud->SetAppStats(label, String(value));
+}
+
 }
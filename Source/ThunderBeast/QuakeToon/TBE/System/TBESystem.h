@@ -19,6 +19,7 @@ class TBESystem : public Object
 
     static TBESystem* sInstance_;
     Timer timer_;
+    HiresTimer hiresTimer_;
 
 public:
 
@@ -33,4 +34,5 @@ public:
     static Context* GetGlobalContext();
     static TBESystem* GetSystem();
     static unsigned GetMilliseconds();
+    static unsigned GetMicroseconds();
 };
@@ -9,28 +9,6 @@ extern "C"
 
 cvar_t	*in_joystick = NULL;
 
-qboolean SNDDMA_Init(void)
-{
-    return qfalse;
-}
-
-int	SNDDMA_GetDMAPos(void)
-{
-    return 0;
-}
-
-void SNDDMA_Shutdown(void)
-{
-}
-
-void SNDDMA_BeginPainting (void)
-{
-}
-
-void SNDDMA_Submit(void)
-{
-}
-
 
 void CDAudio_Play(int track, qboolean looping)
 {
@@ -865,8 +865,6 @@ PARTICLE MANAGEMENT
 // THIS HAS BEEN RELOCATED TO CLIENT.H
 typedef struct particle_s
 {
-	struct particle_s	*next;
-
 	float		time;
 
 	vec3_t		org;
@@ -882,10 +880,34 @@ typedef struct particle_s
 #define	PARTICLE_GRAVITY	40
 */
 
-cparticle_t	*active_particles, *free_particles;
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define	CL_SSE	1
+#include <emmintrin.h>
+#else
+#define	CL_SSE	0
+#endif
+
+// the live particles as structure of arrays, contiguous from 0 to count
+// so the update runs 4 wide. dead ones are swap removed
+typedef struct
+{
+	int			count;
+	float		time[MAX_PARTICLES];
+	float		org[3][MAX_PARTICLES];
+	float		vel[3][MAX_PARTICLES];
+	float		accel[3][MAX_PARTICLES];
+	float		color[MAX_PARTICLES];
+	float		alpha[MAX_PARTICLES];
+	float		alphavel[MAX_PARTICLES];
+} cparticles_t;
 
-cparticle_t	particles[MAX_PARTICLES];
-int			cl_numparticles = MAX_PARTICLES;
+static cparticles_t	cl_particles;
+
+// emitted since the last CL_AddParticles
+static cparticle_t	cl_newparticles[MAX_PARTICLES];
+static int			cl_numnewparticles;
+
+int			cl_freeparticles = MAX_PARTICLES;
 
 
 /*
@@ -895,17 +917,222 @@ CL_ClearParticles
 */
 void CL_ClearParticles (void)
 {
-	int		i;
-	
-	free_particles = &particles[0];
-	active_particles = NULL;
+	cl_particles.count = 0;
+	cl_numnewparticles = 0;
+	cl_freeparticles = MAX_PARTICLES;
+}
+
+/*
+===============
+CL_NewParticle
+
+The caller has checked cl_freeparticles and fills in every field
+===============
+*/
+cparticle_t *CL_NewParticle (void)
+{
+	cl_freeparticles--;
+	return &cl_newparticles[cl_numnewparticles++];
+}
+
+/*
+===============
+CL_CommitParticles
+
+Moves the new particles into the store
+===============
+*/
+static void CL_CommitParticles (void)
+{
+	int			i, j, n;
+	cparticle_t	*p;
+
+	n = cl_particles.count;
+	for (i=0, p=cl_newparticles ; i<cl_numnewparticles ; i++, p++, n++)
+	{
+		cl_particles.time[n] = p->time;
+		for (j=0 ; j<3 ; j++)
+		{
+			cl_particles.org[j][n] = p->org[j];
+			cl_particles.vel[j][n] = p->vel[j];
+			cl_particles.accel[j][n] = p->accel[j];
+		}
+		cl_particles.color[n] = p->color;
+		cl_particles.alpha[n] = p->alpha;
+		cl_particles.alphavel[n] = p->alphavel;
+	}
+
+	cl_particles.count = n;
+	cl_numnewparticles = 0;
+}
+
+/*
+===============
+CL_RemoveParticles
+
+Swap removes the dead particles, which are in ascending order. Going from
+the last one down the particle moved in is always a live one
+===============
+*/
+static void CL_RemoveParticles (int *dead, int numdead)
+{
+	int		i, j, d, last;
+
+	for (i=numdead-1 ; i>=0 ; i--)
+	{
+		d = dead[i];
+		last = --cl_particles.count;
+		if (d == last)
+			continue;
+
+		cl_particles.time[d] = cl_particles.time[last];
+		for (j=0 ; j<3 ; j++)
+		{
+			cl_particles.org[j][d] = cl_particles.org[j][last];
+			cl_particles.vel[j][d] = cl_particles.vel[j][last];
+			cl_particles.accel[j][d] = cl_particles.accel[j][last];
+		}
+		cl_particles.color[d] = cl_particles.color[last];
+		cl_particles.alpha[d] = cl_particles.alpha[last];
+		cl_particles.alphavel[d] = cl_particles.alphavel[last];
+	}
+}
+
+/*
+===============
+CL_UpdateParticles
+
+Moves the particles to time, removes the faded ones and writes the rest
+to out, up to max of them. Returns how many were written
+===============
+*/
+static int CL_UpdateParticles (float time, particle_t *out, int max)
+{
+	static int	dead[MAX_PARTICLES];
+	int			numdead, numout;
+	int			i, n;
+	float		t, t2, alpha;
+	particle_t	*o;
+	cparticles_t	*ps;
+
+	ps = &cl_particles;
+	n = ps->count;
+	numdead = 0;
+	numout = 0;
+	i = 0;
+
+#if CL_SSE
+	{
+		__m128	now, msec, one, zero, instant;
+		__m128	vt, vt2, va, vav, vx, vy, vz, vi, alive;
+		float	ox[4], oy[4], oz[4], oa[4];
+		int		oc[4];
+		int		mask, lane;
+
+		now = _mm_set1_ps (time);
+		msec = _mm_set1_ps (0.001f);
+		one = _mm_set1_ps (1.0f);
+		zero = _mm_setzero_ps ();
+		instant = _mm_set1_ps ((float)INSTANT_PARTICLE);
+
+		for ( ; i+4<=n ; i+=4)
+		{
+			vt = _mm_mul_ps (_mm_sub_ps (now, _mm_loadu_ps (ps->time+i)), msec);
+			vt2 = _mm_mul_ps (vt, vt);
+
+			// PMM - INSTANT_PARTICLE is drawn once at its alpha
+			va = _mm_loadu_ps (ps->alpha+i);
+			vav = _mm_loadu_ps (ps->alphavel+i);
+			vi = _mm_cmpeq_ps (vav, instant);
+
+			va = _mm_or_ps (_mm_and_ps (vi, va),
+				_mm_andnot_ps (vi, _mm_add_ps (va, _mm_mul_ps (vt, vav))));
+			alive = _mm_or_ps (vi, _mm_cmpgt_ps (va, zero));
+			va = _mm_min_ps (va, one);
+
+			vx = _mm_add_ps (_mm_add_ps (_mm_loadu_ps (ps->org[0]+i), _mm_mul_ps (_mm_loadu_ps (ps->vel[0]+i), vt)),
+				_mm_mul_ps (_mm_loadu_ps (ps->accel[0]+i), vt2));
+			vy = _mm_add_ps (_mm_add_ps (_mm_loadu_ps (ps->org[1]+i), _mm_mul_ps (_mm_loadu_ps (ps->vel[1]+i), vt)),
+				_mm_mul_ps (_mm_loadu_ps (ps->accel[1]+i), vt2));
+			vz = _mm_add_ps (_mm_add_ps (_mm_loadu_ps (ps->org[2]+i), _mm_mul_ps (_mm_loadu_ps (ps->vel[2]+i), vt)),
+				_mm_mul_ps (_mm_loadu_ps (ps->accel[2]+i), vt2));
+
+			// and fades out the next frame
+			_mm_storeu_ps (ps->alpha+i, _mm_andnot_ps (vi, _mm_loadu_ps (ps->alpha+i)));
+			_mm_storeu_ps (ps->alphavel+i, _mm_andnot_ps (vi, vav));
+
+			_mm_storeu_ps (ox, vx);
+			_mm_storeu_ps (oy, vy);
+			_mm_storeu_ps (oz, vz);
+			_mm_storeu_ps (oa, va);
+			_mm_storeu_si128 ((__m128i *)oc, _mm_cvttps_epi32 (_mm_loadu_ps (ps->color+i)));
+
+			mask = _mm_movemask_ps (alive);
+			for (lane=0 ; lane<4 ; lane++)
+			{
+				if (!(mask & (1<<lane)))
+				{
+					dead[numdead++] = i+lane;
+					continue;
+				}
+				if (numout == max)
+					continue;
+
+				o = &out[numout++];
+				o->origin[0] = ox[lane];
+				o->origin[1] = oy[lane];
+				o->origin[2] = oz[lane];
+				o->color = oc[lane];
+				o->alpha = oa[lane];
+			}
+		}
+	}
+#endif
+
+	for ( ; i<n ; i++)
+	{
+		t = (time - ps->time[i])*0.001f;
+
+		if (ps->alphavel[i] != INSTANT_PARTICLE)
+		{
+			alpha = ps->alpha[i] + t*ps->alphavel[i];
+			if (alpha <= 0)
+			{	// faded out
+				dead[numdead++] = i;
+				continue;
+			}
+		}
+		else
+		{
+			alpha = ps->alpha[i];
+			ps->alphavel[i] = 0;
+			ps->alpha[i] = 0;
+		}
+
+		if (numout == max)
+			continue;
 
-	for (i=0 ;i<cl_numparticles ; i++)
-		particles[i].next = &particles[i+1];
-	particles[cl_numparticles-1].next = NULL;
+		if (alpha > 1.0)
+			alpha = 1;
+
+		t2 = t*t;
+
+		o = &out[numout++];
+		o->origin[0] = ps->org[0][i] + ps->vel[0][i]*t + ps->accel[0][i]*t2;
+		o->origin[1] = ps->org[1][i] + ps->vel[1][i]*t + ps->accel[1][i]*t2;
+		o->origin[2] = ps->org[2][i] + ps->vel[2][i]*t + ps->accel[2][i]*t2;
+		o->color = ps->color[i];
+		o->alpha = alpha;
+	}
+
+	CL_RemoveParticles (dead, numdead);
+	cl_freeparticles = MAX_PARTICLES - cl_particles.count;
+
+	return numout;
 }
 
 
+
 /*
 ===============
 CL_ParticleEffect
@@ -921,12 +1148,9 @@ void CL_ParticleEffect (vec3_t org, vec3_t dir, int color, int count)
 
 	for (i=0 ; i<count ; i++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 
 		p->time = cl.time;
 		p->color = color + (rand()&7);
@@ -960,12 +1184,9 @@ void CL_ParticleEffect2 (vec3_t org, vec3_t dir, int color, int count)
 
 	for (i=0 ; i<count ; i++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 
 		p->time = cl.time;
 		p->color = color;
@@ -1000,12 +1221,9 @@ void CL_ParticleEffect3 (vec3_t org, vec3_t dir, int color, int count)
 
 	for (i=0 ; i<count ; i++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 
 		p->time = cl.time;
 		p->color = color;
@@ -1037,12 +1255,9 @@ void CL_TeleporterParticles (entity_state_t *ent)
 
 	for (i=0 ; i<8 ; i++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 
 		p->time = cl.time;
 		p->color = 0xdb;
@@ -1078,12 +1293,9 @@ void CL_LogoutEffect (vec3_t org, int type)
 
 	for (i=0 ; i<500 ; i++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 
 		p->time = cl.time;
 
@@ -1123,12 +1335,9 @@ void CL_ItemRespawnParticles (vec3_t org)
 
 	for (i=0 ; i<64 ; i++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 
 		p->time = cl.time;
 
@@ -1162,12 +1371,9 @@ void CL_ExplosionParticles (vec3_t org)
 
 	for (i=0 ; i<256 ; i++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 
 		p->time = cl.time;
 		p->color = 0xe0 + (rand()&7);
@@ -1201,12 +1407,9 @@ void CL_BigTeleportParticles (vec3_t org)
 
 	for (i=0 ; i<4096 ; i++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 
 		p->time = cl.time;
 
@@ -1249,12 +1452,9 @@ void CL_BlasterParticles (vec3_t org, vec3_t dir)
 	count = 40;
 	for (i=0 ; i<count ; i++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 
 		p->time = cl.time;
 		p->color = 0xe0 + (rand()&7);
@@ -1302,12 +1502,9 @@ void CL_BlasterTrail (vec3_t start, vec3_t end)
 	{
 		len -= dec;
 
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -1352,12 +1549,9 @@ void CL_QuadTrail (vec3_t start, vec3_t end)
 	{
 		len -= dec;
 
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -1402,12 +1596,9 @@ void CL_FlagTrail (vec3_t start, vec3_t end, float color)
 	{
 		len -= dec;
 
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -1470,16 +1661,13 @@ void CL_DiminishingTrail (vec3_t start, vec3_t end, centity_t *old, int flags)
 	{
 		len -= dec;
 
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
 
 		// drop less particles as it flies
 		if ((rand()&1023) < old->trailcount)
 		{
-			p = free_particles;
-			free_particles = p->next;
-			p->next = active_particles;
-			active_particles = p;
+			p = CL_NewParticle ();
 			VectorClear (p->accel);
 		
 			p->time = cl.time;
@@ -1577,15 +1765,12 @@ void CL_RocketTrail (vec3_t start, vec3_t end, centity_t *old)
 	{
 		len -= dec;
 
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
 
 		if ( (rand()&7) == 0)
 		{
-			p = free_particles;
-			free_particles = p->next;
-			p->next = active_particles;
-			active_particles = p;
+			p = CL_NewParticle ();
 			
 			VectorClear (p->accel);
 			p->time = cl.time;
@@ -1632,13 +1817,10 @@ void CL_RailTrail (vec3_t start, vec3_t end)
 
 	for (i=0 ; i<len ; i++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
 
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 		
 		p->time = cl.time;
 		VectorClear (p->accel);
@@ -1670,12 +1852,9 @@ void CL_RailTrail (vec3_t start, vec3_t end)
 	{
 		len -= dec;
 
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 
 		p->time = cl.time;
 		VectorClear (p->accel);
@@ -1722,12 +1901,9 @@ void CL_IonripperTrail (vec3_t start, vec3_t ent)
 	{
 		len -= dec;
 
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 		VectorClear (p->accel);
 
 		p->time = cl.time;
@@ -1783,13 +1959,10 @@ void CL_BubbleTrail (vec3_t start, vec3_t end)
 
 	for (i=0 ; i<len ; i+=dec)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
 
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 
 		VectorClear (p->accel);
 		p->time = cl.time;
@@ -1854,12 +2027,9 @@ void CL_FlyParticles (vec3_t origin, int count)
 		forward[1] = cp*sy;
 		forward[2] = -sp;
 
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 
 		p->time = cl.time;
 
@@ -1953,12 +2123,9 @@ void CL_BfgParticles (entity_t *ent)
 		forward[1] = cp*sy;
 		forward[2] = -sp;
 
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 
 		p->time = cl.time;
 
@@ -2014,12 +2181,9 @@ void CL_TrapParticles (entity_t *ent)
 	{
 		len -= dec;
 
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -2056,12 +2220,9 @@ void CL_TrapParticles (entity_t *ent)
 		for (j=-2 ; j<=2 ; j+=4)
 			for (k=-2 ; k<=4 ; k+=4)
 			{
-				if (!free_particles)
+				if (!cl_freeparticles)
 					return;
-				p = free_particles;
-				free_particles = p->next;
-				p->next = active_particles;
-				active_particles = p;
+				p = CL_NewParticle ();
 
 				p->time = cl.time;
 				p->color = 0xe0 + (rand()&3);
@@ -2101,12 +2262,9 @@ void CL_BFGExplosionParticles (vec3_t org)
 
 	for (i=0 ; i<256 ; i++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 
 		p->time = cl.time;
 		p->color = 0xd0 + (rand()&7);
@@ -2143,12 +2301,9 @@ void CL_TeleportParticles (vec3_t org)
 		for (j=-16 ; j<=16 ; j+=4)
 			for (k=-16 ; k<=32 ; k+=4)
 			{
-				if (!free_particles)
+				if (!cl_freeparticles)
 					return;
-				p = free_particles;
-				free_particles = p->next;
-				p->next = active_particles;
-				active_particles = p;
+				p = CL_NewParticle ();
 
 				p->time = cl.time;
 				p->color = 7 + (rand()&7);
@@ -2181,66 +2336,167 @@ CL_AddParticles
 */
 void CL_AddParticles (void)
 {
-	cparticle_t		*p, *next;
-	float			alpha;
-	float			time, time2;
+	particle_t	*out;
+	int			max;
+
+	CL_CommitParticles ();
+
+	out = V_BeginParticles (&max);
+	V_EndParticles (CL_UpdateParticles (cl.time, out, max));
+}
+
+/*
+===============
+CL_FXBench_f
+
+fxbench [particles] [frames]
+
+Keeps the given number of particles alive, emitting as many as faded out
+each frame, and times the emit and the update of the linked list client
+particles this replaced against the store. The live particles are cleared
+===============
+*/
+typedef struct benchparticle_s
+{
+	struct benchparticle_s	*next;
+	cparticle_t		p;
+} benchparticle_t;
+
+static int	bench_numout;
+
+static void CL_BenchAddParticle (particle_t *out, vec3_t org, int color, float alpha)
+{
+	particle_t	*p;
+
+	p = &out[bench_numout++];
+	VectorCopy (org, p->origin);
+	p->color = color;
+	p->alpha = alpha;
+}
+
+static void CL_BenchEmit (cparticle_t *p, float time, unsigned *seed)
+{
+	int		j;
+
+	p->time = time;
+	p->color = 0xe0 + (*seed & 7);
+	for (j=0 ; j<3 ; j++)
+	{
+		*seed = *seed * 1664525 + 1013904223;
+		p->org[j] = (int)(*seed >> 16) - 32768;
+		p->vel[j] = (int)((*seed >> 8) & 63) - 32;
+		p->accel[j] = 0;
+	}
+	p->accel[2] = -PARTICLE_GRAVITY;
+	p->alpha = 1.0;
+	p->alphavel = -1.0 / (0.5 + (*seed & 1023) * (1.5/1024));
+}
+
+void CL_FXBench_f (void)
+{
+	int				count, frames;
+	int				i, frame, emitted;
+	float			time, t, t2, alpha;
+	unsigned		seed, start;
+	unsigned		usec[2][2];
+	int				drawn[2];
 	vec3_t			org;
-	int				color;
-	cparticle_t		*active, *tail;
+	benchparticle_t	*list, *active, *freelist, *b, *next, **prev;
+	particle_t		*out;
+
+	count = Cmd_Argc() > 1 ? atoi (Cmd_Argv(1)) : MAX_PARTICLES;
+	frames = Cmd_Argc() > 2 ? atoi (Cmd_Argv(2)) : 100;
+	if (count < 1 || count > MAX_PARTICLES || frames < 1)
+	{
+		Com_Printf ("usage: fxbench [particles 1-%i] [frames]\n", MAX_PARTICLES);
+		return;
+	}
+
+	list = Z_Malloc (count * sizeof(*list));
+	out = Z_Malloc (count * sizeof(*out));
+	memset (usec, 0, sizeof(usec));
 
+	// the linked list, emitted the way every effect did and updated
+	// through one call per particle
+	for (i=0 ; i<count-1 ; i++)
+		list[i].next = &list[i+1];
+	freelist = list;
 	active = NULL;
-	tail = NULL;
+	seed = 1;
 
-	for (p=active_particles ; p ; p=next)
+	for (frame=0, time=0 ; frame<frames ; frame++, time+=16)
 	{
-		next = p->next;
+		start = Sys_Microseconds ();
+		for (emitted=0 ; freelist ; emitted++)
+		{
+			b = freelist;
+			freelist = b->next;
+			b->next = active;
+			active = b;
+			CL_BenchEmit (&b->p, time, &seed);
+		}
+		usec[0][0] += Sys_Microseconds () - start;
 
-		// PMM - added INSTANT_PARTICLE handling for heat beam
-		if (p->alphavel != INSTANT_PARTICLE)
+		start = Sys_Microseconds ();
+		bench_numout = 0;
+		for (prev=&active, b=active ; b ; b=next)
 		{
-			time = (cl.time - p->time)*0.001;
-			alpha = p->alpha + time*p->alphavel;
+			next = b->next;
+
+			t = (time - b->p.time)*0.001;
+			alpha = b->p.alpha + t*b->p.alphavel;
 			if (alpha <= 0)
-			{	// faded out
-				p->next = free_particles;
-				free_particles = p;
+			{
+				*prev = next;
+				b->next = freelist;
+				freelist = b;
 				continue;
 			}
-		}
-		else
-		{
-			alpha = p->alpha;
-		}
+			prev = &b->next;
 
-		p->next = NULL;
-		if (!tail)
-			active = tail = p;
-		else
-		{
-			tail->next = p;
-			tail = p;
-		}
+			if (alpha > 1.0)
+				alpha = 1;
 
-		if (alpha > 1.0)
-			alpha = 1;
-		color = p->color;
+			t2 = t*t;
+			org[0] = b->p.org[0] + b->p.vel[0]*t + b->p.accel[0]*t2;
+			org[1] = b->p.org[1] + b->p.vel[1]*t + b->p.accel[1]*t2;
+			org[2] = b->p.org[2] + b->p.vel[2]*t + b->p.accel[2]*t2;
 
-		time2 = time*time;
+			CL_BenchAddParticle (out, org, b->p.color, alpha);
+		}
+		usec[0][1] += Sys_Microseconds () - start;
+	}
+	drawn[0] = bench_numout;
 
-		org[0] = p->org[0] + p->vel[0]*time + p->accel[0]*time2;
-		org[1] = p->org[1] + p->vel[1]*time + p->accel[1]*time2;
-		org[2] = p->org[2] + p->vel[2]*time + p->accel[2]*time2;
+	// the store
+	CL_ClearParticles ();
+	seed = 1;
 
-		V_AddParticle (org, color, alpha);
-		// PMM
-		if (p->alphavel == INSTANT_PARTICLE)
-		{
-			p->alphavel = 0.0;
-			p->alpha = 0.0;
-		}
+	for (frame=0, time=0 ; frame<frames ; frame++, time+=16)
+	{
+		start = Sys_Microseconds ();
+		for (emitted=0 ; cl_freeparticles > MAX_PARTICLES - count ; emitted++)
+			CL_BenchEmit (CL_NewParticle (), time, &seed);
+		CL_CommitParticles ();
+		usec[1][0] += Sys_Microseconds () - start;
+
+		start = Sys_Microseconds ();
+		drawn[1] = CL_UpdateParticles (time, out, count);
+		usec[1][1] += Sys_Microseconds () - start;
 	}
 
-	active_particles = active;
+	CL_ClearParticles ();
+
+	Com_Printf ("fxbench: %i particles, %i frames, %i drawn in the last\n", count, frames, drawn[1]);
+	Com_Printf ("  linked list : emit %7.1f us/frame, update %7.1f us/frame\n",
+		(float)usec[0][0] / frames, (float)usec[0][1] / frames);
+	Com_Printf ("  %-11s : emit %7.1f us/frame, update %7.1f us/frame\n", CL_SSE ? "sse store" : "store",
+		(float)usec[1][0] / frames, (float)usec[1][1] / frames);
+	if (drawn[0] != drawn[1])
+		Com_Printf ("  drew %i particles with the list, %i with the store\n", drawn[0], drawn[1]);
+
+	Z_Free (list);
+	Z_Free (out);
 }
 
 
@@ -434,8 +434,9 @@ void CL_SendConnectPacket (void)
 	port = Cvar_VariableValue ("qport");
 	userinfo_modified = false;
 
-	Netchan_OutOfBandPrint (NS_CLIENT, adr, "connect %i %i %i \"%s\"\n",
-		PROTOCOL_VERSION, port, cls.challenge, Cvar_Userinfo() );
+	// the compression asked for is ignored by servers that don't know it
+	Netchan_OutOfBandPrint (NS_CLIENT, adr, "connect %i %i %i \"%s\" %i\n",
+		PROTOCOL_VERSION, port, cls.challenge, Cvar_Userinfo(), (int)Cvar_VariableValue ("net_compress") );
 }
 
 /*
@@ -603,6 +604,42 @@ void CL_ClearState (void)
 
 }
 
+/*
+=====================
+CL_TimedemoReport
+
+Frame time percentiles from the timedemo histogram, then the profiler
+blocks accumulated since the first timed frame
+=====================
+*/
+static void CL_TimedemoReport (int time)
+{
+	static const int	percent[] = {50, 90, 99};
+	int		i, p, count, total;
+
+	count = 0;
+	for (i=0 ; i<TIMEDEMO_BUCKETS ; i++)
+		count += cl.timedemo_hist[i];
+	if (!count)
+		return;
+
+	Com_Printf ("frame times: avg %3.2f ms", (float)time / cl.timedemo_frames);
+	p = 0;
+	total = 0;
+	for (i=0 ; i<TIMEDEMO_BUCKETS && p<3 ; i++)
+	{
+		total += cl.timedemo_hist[i];
+		while (p < 3 && total * 100.0 >= (float)count * percent[p])
+		{
+			Com_Printf (", %i%% %i.%i ms", percent[p], i / 10, i % 10);
+			p++;
+		}
+	}
+	Com_Printf (", max %i.%i ms\n", cl.timedemo_maxusec / 1000, (cl.timedemo_maxusec / 100) % 10);
+
+	Sys_PrintProfile ();
+}
+
 /*
 =====================
 CL_Disconnect
@@ -625,8 +662,11 @@ void CL_Disconnect (void)
 		
 		time = Sys_Milliseconds () - cl.timedemo_start;
 		if (time > 0)
+		{
 			Com_Printf ("%i frames, %3.1f seconds: %3.1f fps\n", cl.timedemo_frames,
 			time/1000.0, cl.timedemo_frames*1000.0 / time);
+			CL_TimedemoReport (time);
+		}
 	}
 
 	VectorClear (cl.refdef.blend);
@@ -902,6 +942,10 @@ void CL_ConnectionlessPacket (void)
 			return;
 		}
 		Netchan_Setup (NS_CLIENT, &cls.netchan, net_from, cls.quakePort);
+		// a server that compresses says which mode it picked
+		cls.netchan.compress = atoi (Cmd_Argv(1));
+		if (cls.netchan.compress < NETCOMPRESS_NONE || cls.netchan.compress > Cvar_VariableValue ("net_compress"))
+			cls.netchan.compress = NETCOMPRESS_NONE;
 		MSG_WriteChar (&cls.netchan.message, clc_stringcmd);
 		MSG_WriteString (&cls.netchan.message, "new");	
 		cls.state = ca_connected;
@@ -994,7 +1038,10 @@ void CL_ReadPackets (void)
 		//
 		if (*(int *)net_message.data == -1)
 		{
+			// tokenizes, and can run commands
+			SV_Lock ();
 			CL_ConnectionlessPacket ();
+			SV_Unlock ();
 			continue;
 		}
 
@@ -1310,7 +1357,9 @@ void CL_RequestNextDownload (void)
 	if (precache_check == ENV_CNT) {
 		precache_check = ENV_CNT + 1;
 
+		SV_Lock ();
 		CM_LoadMap (cl.configstrings[CS_MODELS+1], true, &map_checksum);
+		SV_Unlock ();
 
 		if (map_checksum != atoi(cl.configstrings[CS_MAPCHECKSUM])) {
 			Com_Error (ERR_DROP, "Local map version differs from server: %i != '%s'\n",
@@ -1365,7 +1414,15 @@ void CL_RequestNextDownload (void)
 	CL_PrepRefresh ();
 
 	MSG_WriteByte (&cls.netchan.message, clc_stringcmd);
-	MSG_WriteString (&cls.netchan.message, va("begin %i\n", precache_spawncount) );
+
+	// the baselines are all in, the server checks it has the same dictionary
+	if (cls.netchan.compress == NETCOMPRESS_DICT)
+	{
+		Netchan_SetDictionary (NS_CLIENT, &cl_entities[0].baseline, sizeof(centity_t));
+		MSG_WriteString (&cls.netchan.message, va("begin %i %u\n", precache_spawncount, Netchan_DictionaryChecksum (NS_CLIENT)) );
+	}
+	else
+		MSG_WriteString (&cls.netchan.message, va("begin %i\n", precache_spawncount) );
 }
 
 /*
@@ -1517,6 +1574,8 @@ void CL_InitLocal (void)
 
 	Cmd_AddCommand ("download", CL_Download_f);
 
+	Cmd_AddCommand ("fxbench", CL_FXBench_f);
+
 	//
 	// forward to server commands
 	//
@@ -1714,7 +1773,9 @@ void CL_Frame (int msec)
 		cls.netchan.last_received = Sys_Milliseconds ();
 
 	// fetch results from server
+	Sys_BeginProfile ("ClientParse");
 	CL_ReadPackets ();
+	Sys_EndProfile ();
 
 	// send a new command message to the server
 	CL_SendCommand ();
@@ -1730,7 +1791,9 @@ void CL_Frame (int msec)
 	// update the screen
 	if (host_speeds->value)
 		time_before_ref = Sys_Milliseconds ();
+	Sys_BeginProfile ("Refresh");
 	SCR_UpdateScreen ();
+	Sys_EndProfile ();
 	if (host_speeds->value)
 		time_after_ref = Sys_Milliseconds ();
 
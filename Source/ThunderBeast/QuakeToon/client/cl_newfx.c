@@ -21,9 +21,6 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "client.h"
 
-extern cparticle_t	*active_particles, *free_particles;
-extern cparticle_t	particles[MAX_PARTICLES];
-extern int			cl_numparticles;
 extern cvar_t		*vid_ref;
 
 extern void MakeNormalVectors (vec3_t forward, vec3_t right, vec3_t up);
@@ -151,12 +148,9 @@ void CL_DebugTrail (vec3_t start, vec3_t end)
 	{
 		len -= dec;
 
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 
 		p->time = cl.time;
 		VectorClear (p->accel);
@@ -203,12 +197,9 @@ void CL_SmokeTrail (vec3_t start, vec3_t end, int colorStart, int colorRun, int
 	{
 		len -= spacing;
 
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -246,15 +237,12 @@ void CL_ForceWall (vec3_t start, vec3_t end, int color)
 	{
 		len -= 4;
 
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
 		
 		if (frand() > 0.3)
 		{
-			p = free_particles;
-			free_particles = p->next;
-			p->next = active_particles;
-			active_particles = p;
+			p = CL_NewParticle ();
 			VectorClear (p->accel);
 			
 			p->time = cl.time;
@@ -286,13 +274,10 @@ void CL_FlameEffects (centity_t *ent, vec3_t origin)
 
 	for(n=0;n<count;n++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
 			
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 		
 		VectorClear (p->accel);
 		p->time = cl.time;
@@ -313,12 +298,9 @@ void CL_FlameEffects (centity_t *ent, vec3_t origin)
 
 	for(n=0;n<count;n++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -349,12 +331,9 @@ void CL_GenericParticleEffect (vec3_t org, vec3_t dir, int color, int count, int
 
 	for (i=0 ; i<count ; i++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 
 		p->time = cl.time;
 		if (numcolors > 1)
@@ -403,13 +382,10 @@ void CL_BubbleTrail2 (vec3_t start, vec3_t end, int dist)
 
 	for (i=0 ; i<len ; i+=dec)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
 
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 
 		VectorClear (p->accel);
 		p->time = cl.time;
@@ -475,13 +451,10 @@ void CL_Heatbeam (vec3_t start, vec3_t end)
 #else
 		k=1;
 #endif
-			if (!free_particles)
+			if (!cl_freeparticles)
 				return;
 
-			p = free_particles;
-			free_particles = p->next;
-			p->next = active_particles;
-			active_particles = p;
+			p = CL_NewParticle ();
 			
 			p->time = cl.time;
 			VectorClear (p->accel);
@@ -573,13 +546,10 @@ void CL_Heatbeam (vec3_t start, vec3_t forward)
 		for (rot = 0; rot < M_PI*2; rot += rstep)
 		{
 
-			if (!free_particles)
+			if (!cl_freeparticles)
 				return;
 
-			p = free_particles;
-			free_particles = p->next;
-			p->next = active_particles;
-			active_particles = p;
+			p = CL_NewParticle ();
 			
 			p->time = cl.time;
 			VectorClear (p->accel);
@@ -649,13 +619,10 @@ void CL_Heatbeam (vec3_t start, vec3_t end)
 
 	for (i=0; i<8; i++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
 
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 		
 		p->time = cl.time;
 		VectorClear (p->accel);
@@ -693,13 +660,10 @@ void CL_Heatbeam (vec3_t start, vec3_t end)
 
 		for (rot = 0; rot < M_PI*2; rot += rstep)
 		{
-			if (!free_particles)
+			if (!cl_freeparticles)
 				return;
 
-			p = free_particles;
-			free_particles = p->next;
-			p->next = active_particles;
-			active_particles = p;
+			p = CL_NewParticle ();
 			
 			p->time = cl.time;
 			VectorClear (p->accel);
@@ -760,12 +724,9 @@ void CL_ParticleSteamEffect (vec3_t org, vec3_t dir, int color, int count, int m
 
 	for (i=0 ; i<count ; i++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 
 		p->time = cl.time;
 		p->color = color + (rand()&7);
@@ -806,12 +767,9 @@ void CL_ParticleSteamEffect2 (cl_sustain_t *self)
 
 	for (i=0 ; i<self->count ; i++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 
 		p->time = cl.time;
 		p->color = self->color + (rand()&7);
@@ -868,12 +826,9 @@ void CL_TrackerTrail (vec3_t start, vec3_t end, int particleColor)
 	{
 		len -= dec;
 
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -903,12 +858,9 @@ void CL_Tracker_Shell(vec3_t origin)
 
 	for(i=0;i<300;i++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -934,12 +886,9 @@ void CL_MonsterPlasma_Shell(vec3_t origin)
 
 	for(i=0;i<40;i++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -970,12 +919,9 @@ void CL_Widowbeamout (cl_sustain_t *self)
 
 	for(i=0;i<300;i++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -1006,12 +952,9 @@ void CL_Nukeblast (cl_sustain_t *self)
 
 	for(i=0;i<700;i++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -1039,12 +982,9 @@ void CL_WidowSplash (vec3_t org)
 
 	for (i=0 ; i<256 ; i++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 
 		p->time = cl.time;
 		p->color = colortable[rand()&3];
@@ -1072,12 +1012,9 @@ void CL_Tracker_Explode(vec3_t	origin)
 
 	for(i=0;i<300;i++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -1124,12 +1061,9 @@ void CL_TagTrail (vec3_t start, vec3_t end, float color)
 	{
 		len -= dec;
 
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
@@ -1160,12 +1094,9 @@ void CL_ColorExplosionParticles (vec3_t org, int color, int run)
 
 	for (i=0 ; i<128 ; i++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 
 		p->time = cl.time;
 		p->color = color + (rand() % run);
@@ -1200,12 +1131,9 @@ void CL_ParticleSmokeEffect (vec3_t org, vec3_t dir, int color, int count, int m
 
 	for (i=0 ; i<count ; i++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 
 		p->time = cl.time;
 		p->color = color + (rand()&7);
@@ -1245,12 +1173,9 @@ void CL_BlasterParticles2 (vec3_t org, vec3_t dir, unsigned int color)
 	count = 40;
 	for (i=0 ; i<count ; i++)
 	{
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 
 		p->time = cl.time;
 		p->color = color + (rand()&7);
@@ -1298,12 +1223,9 @@ void CL_BlasterTrail2 (vec3_t start, vec3_t end)
 	{
 		len -= dec;
 
-		if (!free_particles)
+		if (!cl_freeparticles)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
+		p = CL_NewParticle ();
 		VectorClear (p->accel);
 		
 		p->time = cl.time;
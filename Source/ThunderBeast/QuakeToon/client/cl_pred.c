@@ -20,6 +20,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "client.h"
 
+static tracecontext_t	*cl_trace;		// prediction's own, see CL_PMTrace
+
 
 /*
 ===================
@@ -111,14 +113,14 @@ void CL_ClipMoveToEntities ( vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end,
 			bmins[2] = -zd;
 			bmaxs[2] = zu;
 
-			headnode = CM_HeadnodeForBox (bmins, bmaxs);
+			headnode = CM_HeadnodeForBoxHull (bmins, bmaxs, BOXHULL_CLIENT);
 			angles = vec3_origin;	// boxes don't rotate
 		}
 
 		if (tr->allsolid)
 			return;
 
-		trace = CM_TransformedBoxTrace (start, end,
+		trace = CM_ContextTransformedBoxTrace (cl_trace, start, end,
 			mins, maxs, headnode,  MASK_PLAYERSOLID,
 			ent->origin, angles);
 
@@ -149,8 +151,12 @@ trace_t		CL_PMTrace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end)
 {
 	trace_t	t;
 
+	// the server may be tracing on its own thread
+	if (!cl_trace)
+		cl_trace = CM_AllocTraceContext ();
+
 	// check against world
-	t = CM_BoxTrace (start, end, mins, maxs, 0, MASK_PLAYERSOLID);
+	t = CM_ContextBoxTrace (cl_trace, start, end, mins, maxs, 0, MASK_PLAYERSOLID);
 	if (t.fraction < 1.0)
 		t.ent = (struct edict_s *)1;
 
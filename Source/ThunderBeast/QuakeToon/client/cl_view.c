@@ -100,6 +100,26 @@ void V_AddParticle (vec3_t org, int color, float alpha)
 	p->alpha = alpha;
 }
 
+/*
+=====================
+V_BeginParticles
+
+Returns the free end of the particle list for callers that write their
+particles in place, max is set to how many fit. V_EndParticles adds the
+ones that were written
+=====================
+*/
+particle_t *V_BeginParticles (int *max)
+{
+	*max = MAX_PARTICLES - r_numparticles;
+	return &r_particles[r_numparticles];
+}
+
+void V_EndParticles (int count)
+{
+	r_numparticles += count;
+}
+
 /*
 =====================
 V_AddLight
@@ -252,6 +272,8 @@ void CL_PrepRefresh (void)
 	char		name[MAX_QPATH];
 	float		rotate;
 	vec3_t		axis;
+	int			start;
+	int			files, copied, mapped;
 
 	if (!cl.configstrings[CS_MODELS+1][0])
 		return;		// no map loaded
@@ -266,6 +288,8 @@ void CL_PrepRefresh (void)
 	// register models, pics, and skins
 	Com_Printf ("Map: %s\r", mapname); 
 	SCR_UpdateScreen ();
+	FS_LoadStats (&files, &copied, &mapped);
+	start = Sys_Milliseconds ();
 	re.BeginRegistration (mapname);
 	Com_Printf ("                                     \r");
 
@@ -344,6 +368,10 @@ void CL_PrepRefresh (void)
 	// the renderer can now free unneeded stuff
 	re.EndRegistration ();
 
+	FS_LoadStats (&files, &copied, &mapped);
+	Com_Printf ("Registration: %i ms, %i files, %i KB copied, %i KB mapped\n",
+		Sys_Milliseconds () - start, files, copied >> 10, mapped >> 10);
+
 	// clear any lines of console text
 	Con_ClearNotify ();
 
@@ -451,8 +479,26 @@ void V_RenderView( float stereo_separation )
 
 	if (cl_timedemo->value)
 	{
+		unsigned	now, usec;
+		int			bucket;
+
+		now = Sys_Microseconds ();
 		if (!cl.timedemo_start)
+		{
 			cl.timedemo_start = Sys_Milliseconds ();
+			Sys_ResetProfile ();	// leave the level load out of the breakdown
+		}
+		else
+		{
+			usec = now - cl.timedemo_lastusec;
+			if (usec > cl.timedemo_maxusec)
+				cl.timedemo_maxusec = usec;
+			bucket = usec / 100;
+			if (bucket >= TIMEDEMO_BUCKETS)
+				bucket = TIMEDEMO_BUCKETS - 1;
+			cl.timedemo_hist[bucket]++;
+		}
+		cl.timedemo_lastusec = now;
 		cl.timedemo_frames++;
 	}
 
@@ -83,6 +83,8 @@ extern int num_cl_weaponmodels;
 
 #define	CMD_BACKUP		64	// allow a lot of command backups for very fast systems
 
+#define	TIMEDEMO_BUCKETS	1000	// 0.1 ms each, the last one takes everything slower
+
 //
 // the client_state_t structure is wiped completely at every
 // server map change
@@ -93,6 +95,9 @@ typedef struct
 
 	int			timedemo_frames;
 	int			timedemo_start;
+	unsigned	timedemo_lastusec;
+	unsigned	timedemo_maxusec;
+	int			timedemo_hist[TIMEDEMO_BUCKETS];	// frame time histogram
 
 	qboolean	refresh_prepped;	// false if on new level or new ref dll
 	qboolean	sound_prepped;		// ambient sounds can start
@@ -355,8 +360,6 @@ void CL_ParticleEffect3 (vec3_t org, vec3_t dir, int color, int count);
 // PGM
 typedef struct particle_s
 {
-	struct particle_s	*next;
-
 	float		time;
 
 	vec3_t		org;
@@ -373,6 +376,11 @@ typedef struct particle_s
 #define BLASTER_PARTICLE_COLOR		0xe0
 // PMM
 #define INSTANT_PARTICLE	-10000.0
+
+// new particles are staged here and moved into the structure of arrays
+// store by the next CL_AddParticles, check cl_freeparticles first
+extern	int	cl_freeparticles;
+cparticle_t *CL_NewParticle (void);
 // PGM
 // ========
 
@@ -522,6 +530,8 @@ void V_Init (void);
 void V_RenderView( float stereo_separation );
 void V_AddEntity (entity_t *ent);
 void V_AddParticle (vec3_t org, int color, float alpha);
+particle_t *V_BeginParticles (int *max);
+void V_EndParticles (int count);
 void V_AddLight (vec3_t org, float intensity, float r, float g, float b);
 void V_AddLightStyle (int style, float r, float g, float b);
 
@@ -550,6 +560,7 @@ void CL_DiminishingTrail (vec3_t start, vec3_t end, centity_t *old, int flags);
 void CL_FlyEffect (centity_t *ent, vec3_t origin);
 void CL_BfgParticles (entity_t *ent);
 void CL_AddParticles (void);
+void CL_FXBench_f (void);
 void CL_EntityEvent (entity_state_t *ent);
 // RAFAEL
 void CL_TrapParticles (entity_t *ent);
@@ -24,7 +24,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #define	MAX_DLIGHTS		32
 #define	MAX_ENTITIES	128
-#define	MAX_PARTICLES	4096
+#define	MAX_PARTICLES	32768
 #define	MAX_LIGHTSTYLES	256
 
 #define POWERSUIT_SCALE		4.0F
@@ -75,6 +75,8 @@ typedef struct entity_s
 	struct image_s	*skin;			// NULL for inline skin
 	int		flags;
 
+	int		entnum;					// client entity number, 0 for temp entities and the view weapon
+
 } entity_t;
 
 #define ENTITY_FLAGS  68
@@ -207,6 +209,8 @@ typedef struct
 	// NULL can be passed for buf to just determine existance
 	int		(*FS_LoadFile) (char *name, void **buf);
 	void	(*FS_FreeFile) (void *buf);
+	// as FS_LoadFile, but buf must not be written to
+	int		(*FS_LoadFileReadOnly) (char *name, void **buf);
 
 	// gamedir will be the current directory that generated
 	// files should be stored to, ie: "f:\quake\id1"
@@ -78,6 +78,12 @@ cvar_t		*s_khz;
 cvar_t		*s_show;
 cvar_t		*s_mixahead;
 cvar_t		*s_primary;
+cvar_t		*s_simd;
+
+qboolean	snd_devicemix;
+
+// held by the device thread while it mixes
+static void	*s_mutex;
 
 
 int		s_rawend;
@@ -88,6 +94,16 @@ portable_samplepair_t	s_rawsamples[MAX_RAW_SAMPLES];
 // User-setable variables
 // ====================================================================
 
+void S_LockSound (void)
+{
+	Sys_LockMutex (s_mutex);
+}
+
+void S_UnlockSound (void)
+{
+	Sys_UnlockMutex (s_mutex);
+}
+
 
 void S_SoundInfo_f(void)
 {
@@ -131,15 +147,24 @@ void S_Init (void)
 		s_show = Cvar_Get ("s_show", "0", 0);
 		s_testsound = Cvar_Get ("s_testsound", "0", 0);
 		s_primary = Cvar_Get ("s_primary", "0", CVAR_ARCHIVE);	// win32 specific
+		s_simd = Cvar_Get ("s_simd", "1", 0);
 
 		Cmd_AddCommand("play", S_Play);
 		Cmd_AddCommand("stopsound", S_StopAllSounds);
 		Cmd_AddCommand("soundlist", S_SoundList);
 		Cmd_AddCommand("soundinfo", S_SoundInfo_f);
+		Cmd_AddCommand("soundtest", S_SoundTest_f);
 
+		if (!s_mutex)
+			s_mutex = Sys_CreateMutex ();
+
+		// the device may start pulling as soon as it is open, it
+		// gets silence until sound_started is set
 		if (!SNDDMA_Init())
 			return;
 
+		S_LockSound ();
+
 		S_InitScaletable ();
 
 		sound_started = 1;
@@ -148,7 +173,9 @@ void S_Init (void)
 		soundtime = 0;
 		paintedtime = 0;
 
-		Com_Printf ("sound sampling rate: %i\n", dma.speed);
+		S_UnlockSound ();
+
+		Com_Printf ("sound sampling rate: %i%s\n", dma.speed, snd_devicemix ? ", mixed by the device" : "");
 
 		S_StopAllSounds ();
 	}
@@ -169,6 +196,9 @@ void S_Shutdown(void)
 	if (!sound_started)
 		return;
 
+	S_SoundTestUpdate (true);
+
+	// stops the device thread before the buffer goes away
 	SNDDMA_Shutdown();
 
 	sound_started = 0;
@@ -177,6 +207,7 @@ void S_Shutdown(void)
 	Cmd_RemoveCommand("stopsound");
 	Cmd_RemoveCommand("soundlist");
 	Cmd_RemoveCommand("soundinfo");
+	Cmd_RemoveCommand("soundtest");
 
 	// free all sounds
 	for (i=0, sfx=known_sfx ; i < num_sfx ; i++,sfx++)
@@ -331,6 +362,8 @@ void S_EndRegistration (void)
 	sfx_t	*sfx;
 	int		size;
 
+	S_LockSound ();
+
 	// free any sounds not from this registration sequence
 	for (i=0, sfx=known_sfx ; i < num_sfx ; i++,sfx++)
 	{
@@ -353,6 +386,8 @@ void S_EndRegistration (void)
 
 	}
 
+	S_UnlockSound ();
+
 	// load everything in
 	for (i=0, sfx=known_sfx ; i < num_sfx ; i++,sfx++)
 	{
@@ -576,8 +611,17 @@ void S_IssuePlaysound (playsound_t *ps)
 
 	S_Spatialize(ch);
 
+	// S_StartSound loaded it, this can run on the device thread
+	// and must not go to disk
+	sc = ch->sfx->cache;
+	if (!sc)
+	{
+		ch->sfx = NULL;
+		S_FreePlaysound (ps);
+		return;
+	}
+
 	ch->pos = 0;
-	sc = S_LoadSound (ch->sfx);
     ch->end = paintedtime + sc->length;
 
 	// free the playsound
@@ -675,10 +719,15 @@ void S_StartSound(vec3_t origin, int entnum, int entchannel, sfx_t *sfx, float f
 
 	vol = fvol*255;
 
+	S_LockSound ();
+
 	// make the playsound_t
 	ps = S_AllocPlaysound ();
 	if (!ps)
+	{
+		S_UnlockSound ();
 		return;
+	}
 
 	if (origin)
 	{
@@ -727,6 +776,8 @@ void S_StartSound(vec3_t origin, int entnum, int entchannel, sfx_t *sfx, float f
 
 	ps->next->prev = ps;
 	ps->prev->next = ps;
+
+	S_UnlockSound ();
 }
 
 
@@ -764,17 +815,26 @@ void S_ClearBuffer (void)
 	if (!sound_started)
 		return;
 
+	S_LockSound ();
+
 	s_rawend = 0;
 
-	if (dma.samplebits == 8)
-		clear = 0x80;
-	else
-		clear = 0;
+	// the device mixes each part of its buffer just before it
+	// plays it, there is nothing stale to clear
+	if (!snd_devicemix)
+	{
+		if (dma.samplebits == 8)
+			clear = 0x80;
+		else
+			clear = 0;
 
-	SNDDMA_BeginPainting ();
-	if (dma.buffer)
-		memset(dma.buffer, clear, dma.samples * dma.samplebits/8);
-	SNDDMA_Submit ();
+		SNDDMA_BeginPainting ();
+		if (dma.buffer)
+			memset(dma.buffer, clear, dma.samples * dma.samplebits/8);
+		SNDDMA_Submit ();
+	}
+
+	S_UnlockSound ();
 }
 
 /*
@@ -789,6 +849,11 @@ void S_StopAllSounds(void)
 	if (!sound_started)
 		return;
 
+	// a demo ending finishes a soundtest early
+	S_SoundTestUpdate (true);
+
+	S_LockSound ();
+
 	// clear all the playsounds
 	memset(s_playsounds, 0, sizeof(s_playsounds));
 	s_freeplays.next = s_freeplays.prev = &s_freeplays;
@@ -806,6 +871,8 @@ void S_StopAllSounds(void)
 	memset(channels, 0, sizeof(channels));
 
 	S_ClearBuffer ();
+
+	S_UnlockSound ();
 }
 
 /*
@@ -916,6 +983,8 @@ void S_RawSamples (int samples, int rate, int width, int channels, byte *data)
 	if (!sound_started)
 		return;
 
+	S_LockSound ();
+
 	if (s_rawend < paintedtime)
 		s_rawend = paintedtime;
 	scale = (float)rate / dma.speed;
@@ -995,6 +1064,8 @@ void S_RawSamples (int samples, int rate, int width, int channels, byte *data)
 			s_rawsamples[dst].right = (((byte *)data)[src]-128) << 16;
 		}
 	}
+
+	S_UnlockSound ();
 }
 
 //=============================================================================
@@ -1016,6 +1087,8 @@ void S_Update(vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 	if (!sound_started)
 		return;
 
+	S_SoundTestUpdate (false);
+
 	// if the laoding plaque is up, clear everything
 	// out to make sure we aren't looping a dirty
 	// dma buffer while loading
@@ -1025,6 +1098,8 @@ void S_Update(vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 		return;
 	}
 
+	S_LockSound ();
+
 	// rebuild scale tables if volume is modified
 	if (s_volume->modified)
 		S_InitScaletable ();
@@ -1075,6 +1150,8 @@ void S_Update(vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 		Com_Printf ("----(%i)---- painted: %i\n", total, paintedtime);
 	}
 
+	S_UnlockSound ();
+
 // mix some sound
 	S_Update_();
 }
@@ -1117,6 +1194,10 @@ void S_Update_(void)
 	if (!sound_started)
 		return;
 
+	// the device thread does its own mixing
+	if (snd_devicemix)
+		return;
+
 	SNDDMA_BeginPainting ();
 
 	if (!dma.buffer)
@@ -1143,11 +1224,56 @@ void S_Update_(void)
 	if (endtime - soundtime > samps)
 		endtime = soundtime + samps;
 
+	S_LockSound ();
 	S_PaintChannels (endtime);
+	S_UnlockSound ();
 
 	SNDDMA_Submit ();
 }
 
+/*
+============
+S_DeviceMix
+
+Called from the device thread before it plays soundtime up to endtime.
+Only what is about to be played gets mixed, so a new sound is heard
+on the next device period instead of after s_mixahead
+============
+*/
+void S_DeviceMix (int start, int endtime)
+{
+	int		i;
+	int		*out;
+	int		mask;
+
+	S_LockSound ();
+
+	if (!sound_started || !dma.buffer)
+	{
+		S_UnlockSound ();
+		return;
+	}
+
+	soundtime = start;
+	if (paintedtime < soundtime)
+		paintedtime = soundtime;
+
+	if (cls.disable_screen)
+	{
+		// play silence while the loading plaque is up
+		out = (int *)dma.buffer;
+		mask = (dma.samples>>1)-1;
+		for (i=paintedtime ; i<endtime ; i++)
+			out[i & mask] = 0;
+		if (paintedtime < endtime)
+			paintedtime = endtime;
+	}
+	else if (paintedtime < endtime)
+		S_PaintChannels (endtime);
+
+	S_UnlockSound ();
+}
+
 /*
 ===============================================================================
 
@@ -121,6 +121,19 @@ void	SNDDMA_BeginPainting (void);
 
 void	SNDDMA_Submit(void);
 
+// set by SNDDMA_Init when the device pulls samples from its own thread.
+// the device then mixes through S_DeviceMix and S_Update only updates
+// the channels
+extern	qboolean	snd_devicemix;
+
+// mixes up to endtime for a device that has played up to soundtime,
+// called from the device thread
+void	S_DeviceMix (int soundtime, int endtime);
+
+// the game side holds this while it changes channels or playsounds
+void	S_LockSound (void);
+void	S_UnlockSound (void);
+
 //====================================================================
 
 #define	MAX_CHANNELS			32
@@ -146,6 +159,7 @@ extern cvar_t	*s_show;
 extern cvar_t	*s_mixahead;
 extern cvar_t	*s_testsound;
 extern cvar_t	*s_primary;
+extern cvar_t	*s_simd;
 
 wavinfo_t GetWavinfo (char *name, byte *wav, int wavlength);
 
@@ -157,6 +171,10 @@ void S_IssuePlaysound (playsound_t *ps);
 
 void S_PaintChannels(int endtime);
 
+// soundtest, mixes with both the scalar and the SIMD paths and compares
+void S_SoundTest_f (void);
+void S_SoundTestUpdate (qboolean finish);
+
 // picks a channel based on priorities, empty slots, number of channels
 channel_t *S_PickChannel(int entnum, int entchannel);
 
@@ -22,13 +22,168 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "client.h"
 #include "snd_loc.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define	SND_SSE2	1
+#include <emmintrin.h>
+#else
+#define	SND_SSE2	0
+#endif
+
 #define	PAINTBUFFER_SIZE	2048
 portable_samplepair_t paintbuffer[PAINTBUFFER_SIZE];
 int		snd_scaletable[32][256];
 int 	*snd_p, snd_linear_count, snd_vol;
 short	*snd_out;
 
+// set from s_simd for each S_PaintChannels
+static qboolean	snd_simd;
+
+extern int	sound_started;
+
 void S_WriteLinearBlastStereo16 (void);
+void S_PaintChannelFrom8 (channel_t *ch, sfxcache_t *sc, int endtime, int offset);
+void S_PaintChannelFrom16 (channel_t *ch, sfxcache_t *sc, int endtime, int offset);
+
+/*
+===============================================================================
+
+SSE2 MIXING
+
+Same results as the scalar mixer, bit for bit. The volume is multiplied
+in instead of looked up in snd_scaletable, the rows of which are just
+multiples of their entry for 1
+
+===============================================================================
+*/
+
+#if SND_SSE2
+
+// low 32 bits of a * b in each lane, SSE2 has no pmulld
+static __m128i S_MulLo32 (__m128i a, __m128i b)
+{
+	__m128i	even, odd;
+
+	even = _mm_mul_epu32 (a, b);
+	odd = _mm_mul_epu32 (_mm_srli_epi64 (a, 32), _mm_srli_epi64 (b, 32));
+
+	return _mm_unpacklo_epi32 (_mm_shuffle_epi32 (even, _MM_SHUFFLE(0,0,2,0)),
+		_mm_shuffle_epi32 (odd, _MM_SHUFFLE(0,0,2,0)));
+}
+
+// adds (sample * vol) >> shift to 4 sample pairs, the samples are the
+// low 4 16 bit lanes of s and vol is left, right, left, right
+static void S_MixPairs (portable_samplepair_t *samp, __m128i s, __m128i vol, __m128i shift)
+{
+	__m128i	lo, hi;
+
+	s = _mm_unpacklo_epi16 (s, s);
+	lo = _mm_srai_epi32 (_mm_unpacklo_epi16 (s, s), 16);
+	hi = _mm_srai_epi32 (_mm_unpackhi_epi16 (s, s), 16);
+
+	lo = _mm_sra_epi32 (S_MulLo32 (lo, vol), shift);
+	hi = _mm_sra_epi32 (S_MulLo32 (hi, vol), shift);
+
+	_mm_storeu_si128 ((__m128i *)samp, _mm_add_epi32 (_mm_loadu_si128 ((__m128i *)samp), lo));
+	_mm_storeu_si128 ((__m128i *)(samp+2), _mm_add_epi32 (_mm_loadu_si128 ((__m128i *)(samp+2)), hi));
+}
+
+static void S_WriteLinearBlastStereo16_SSE2 (void)
+{
+	int		i;
+	int		val;
+	__m128i	a, b;
+
+	// packs saturates exactly like the clamp below
+	for (i=0 ; i+8<=snd_linear_count ; i+=8)
+	{
+		a = _mm_srai_epi32 (_mm_loadu_si128 ((__m128i *)(snd_p+i)), 8);
+		b = _mm_srai_epi32 (_mm_loadu_si128 ((__m128i *)(snd_p+i+4)), 8);
+		_mm_storeu_si128 ((__m128i *)(snd_out+i), _mm_packs_epi32 (a, b));
+	}
+
+	for ( ; i<snd_linear_count ; i++)
+	{
+		val = snd_p[i]>>8;
+		if (val > 0x7fff)
+			snd_out[i] = 0x7fff;
+		else if (val < (short)0x8000)
+			snd_out[i] = (short)0x8000;
+		else
+			snd_out[i] = val;
+	}
+}
+
+static void S_PaintChannelFrom8_SSE2 (channel_t *ch, sfxcache_t *sc, int count, int offset)
+{
+	int		*lscale, *rscale;
+	signed char *sfx;
+	int		i;
+	portable_samplepair_t	*samp;
+	__m128i	vol, s, shift;
+
+	if (ch->leftvol > 255)
+		ch->leftvol = 255;
+	if (ch->rightvol > 255)
+		ch->rightvol = 255;
+
+	lscale = snd_scaletable[ ch->leftvol >> 3];
+	rscale = snd_scaletable[ ch->rightvol >> 3];
+	sfx = (signed char *)sc->data + ch->pos;
+
+	samp = &paintbuffer[offset];
+
+	vol = _mm_set_epi32 (rscale[1], lscale[1], rscale[1], lscale[1]);
+	shift = _mm_cvtsi32_si128 (0);
+
+	for (i=0 ; i+8<=count ; i+=8, samp+=8)
+	{
+		s = _mm_loadl_epi64 ((__m128i *)(sfx+i));
+		s = _mm_srai_epi16 (_mm_unpacklo_epi8 (s, s), 8);
+		S_MixPairs (samp, s, vol, shift);
+		S_MixPairs (samp+4, _mm_unpackhi_epi64 (s, s), vol, shift);
+	}
+
+	for ( ; i<count ; i++, samp++)
+	{
+		samp->left += lscale[(unsigned char)sfx[i]];
+		samp->right += rscale[(unsigned char)sfx[i]];
+	}
+
+	ch->pos += count;
+}
+
+static void S_PaintChannelFrom16_SSE2 (channel_t *ch, sfxcache_t *sc, int count, int offset)
+{
+	int		data;
+	int		leftvol, rightvol;
+	signed short *sfx;
+	int		i;
+	portable_samplepair_t	*samp;
+	__m128i	vol, shift;
+
+	leftvol = ch->leftvol*snd_vol;
+	rightvol = ch->rightvol*snd_vol;
+	sfx = (signed short *)sc->data + ch->pos;
+
+	samp = &paintbuffer[offset];
+
+	vol = _mm_set_epi32 (rightvol, leftvol, rightvol, leftvol);
+	shift = _mm_cvtsi32_si128 (8);
+
+	for (i=0 ; i+4<=count ; i+=4, samp+=4)
+		S_MixPairs (samp, _mm_loadl_epi64 ((__m128i *)(sfx+i)), vol, shift);
+
+	for ( ; i<count ; i++, samp++)
+	{
+		data = sfx[i];
+		samp->left += (data * leftvol)>>8;
+		samp->right += (data * rightvol)>>8;
+	}
+
+	ch->pos += count;
+}
+
+#endif
 
 #if !(defined __linux__ && defined __i386__)
 #if	!id386
@@ -127,6 +282,11 @@ void S_TransferStereo16 (unsigned long *pbuf, int endtime)
 		snd_linear_count <<= 1;
 
 	// write a linear blast of samples
+#if SND_SSE2
+		if (snd_simd)
+			S_WriteLinearBlastStereo16_SSE2 ();
+		else
+#endif
 		S_WriteLinearBlastStereo16 ();
 
 		snd_p += snd_linear_count;
@@ -218,19 +378,166 @@ CHANNEL MIXING
 ===============================================================================
 */
 
-void S_PaintChannelFrom8 (channel_t *ch, sfxcache_t *sc, int endtime, int offset);
-void S_PaintChannelFrom16 (channel_t *ch, sfxcache_t *sc, int endtime, int offset);
+typedef struct
+{
+	qboolean	active;
+	int			total;			// sample pairs to capture
+	int			captured;
+	short		*scalar;		// output of each mixer, stereo 16 bit
+	short		*simd;
+	unsigned	usec[2];		// time spent painting with each
+	channel_t	channels[MAX_CHANNELS];
+	char		name[MAX_QPATH];
+} soundtest_t;
+
+static soundtest_t	s_test;
 
-void S_PaintChannels(int endtime)
+/*
+===================
+S_PaintChunk
+
+Mixes the channels into the paint buffer from paintedtime to end
+===================
+*/
+static void S_PaintChunk (int end, qboolean simd)
 {
 	int 	i;
-	int 	end;
 	channel_t *ch;
 	sfxcache_t	*sc;
 	int		ltime, count;
+
+	// clear the paint buffer
+	if (s_rawend < paintedtime)
+	{
+//		Com_Printf ("clear\n");
+		memset(paintbuffer, 0, (end - paintedtime) * sizeof(portable_samplepair_t));
+	}
+	else
+	{	// copy from the streaming sound source
+		int		s;
+		int		stop;
+
+		stop = (end < s_rawend) ? end : s_rawend;
+
+		for (i=paintedtime ; i<stop ; i++)
+		{
+			s = i&(MAX_RAW_SAMPLES-1);
+			paintbuffer[i-paintedtime] = s_rawsamples[s];
+		}
+//	if (i != end)
+//		Com_Printf ("partial stream\n");
+//	else
+//		Com_Printf ("full stream\n");
+		for ( ; i<end ; i++)
+		{
+			paintbuffer[i-paintedtime].left =
+			paintbuffer[i-paintedtime].right = 0;
+		}
+	}
+
+
+	// paint in the channels.
+	ch = channels;
+	for (i=0; i<MAX_CHANNELS ; i++, ch++)
+	{
+		ltime = paintedtime;
+	
+		while (ltime < end)
+		{
+			if (!ch->sfx || (!ch->leftvol && !ch->rightvol) )
+				break;
+
+			// max painting is to the end of the buffer
+			count = end - ltime;
+
+			// might be stopped by running out of data
+			if (ch->end - ltime < count)
+				count = ch->end - ltime;
+
+			// this can run on the device thread, only mix what is loaded
+			sc = ch->sfx->cache;
+			if (!sc)
+				break;
+
+			if (count > 0 && ch->sfx)
+			{	
+#if SND_SSE2
+				if (simd)
+				{
+					if (sc->width == 1)
+						S_PaintChannelFrom8_SSE2(ch, sc, count,  ltime - paintedtime);
+					else
+						S_PaintChannelFrom16_SSE2(ch, sc, count, ltime - paintedtime);
+				}
+				else
+#endif
+				if (sc->width == 1)// FIXME; 8 bit asm is wrong now
+					S_PaintChannelFrom8(ch, sc, count,  ltime - paintedtime);
+				else
+					S_PaintChannelFrom16(ch, sc, count, ltime - paintedtime);
+
+				ltime += count;
+			}
+
+		// if at end of loop, restart
+			if (ltime >= ch->end)
+			{
+				if (ch->autosound)
+				{	// autolooping sounds always go back to start
+					ch->pos = 0;
+					ch->end = ltime + sc->length;
+				}
+				else if (sc->loopstart >= 0)
+				{
+					ch->pos = sc->loopstart;
+					ch->end = ltime + sc->length - ch->pos;
+				}
+				else				
+				{	// channel just stopped
+					ch->sfx = NULL;
+				}
+			}
+		}
+														  
+	}
+}
+
+/*
+===================
+S_TestCapture
+
+Appends the paint buffer to a soundtest output through one of the
+transfer paths
+===================
+*/
+static void S_TestCapture (short *out, int end, qboolean simd)
+{
+	int		count;
+
+	count = end - paintedtime;
+	if (count > s_test.total - s_test.captured)
+		count = s_test.total - s_test.captured;
+
+	snd_p = (int *) paintbuffer;
+	snd_out = out + s_test.captured*2;
+	snd_linear_count = count*2;
+
+#if SND_SSE2
+	if (simd)
+		S_WriteLinearBlastStereo16_SSE2 ();
+	else
+#endif
+	S_WriteLinearBlastStereo16 ();
+}
+
+void S_PaintChannels(int endtime)
+{
+	int 	end;
 	playsound_t	*ps;
+	unsigned	start;
 
 	snd_vol = s_volume->value*256;
+	snd_simd = SND_SSE2 && s_simd->value;
 
 //Com_Printf ("%i to %i\n", paintedtime, endtime);
 	while (paintedtime < endtime)
@@ -257,89 +564,30 @@ void S_PaintChannels(int endtime)
 			break;
 		}
 
-	// clear the paint buffer
-		if (s_rawend < paintedtime)
+		if (s_test.active && s_test.captured < s_test.total && cls.state == ca_active)
 		{
-//			Com_Printf ("clear\n");
-			memset(paintbuffer, 0, (end - paintedtime) * sizeof(portable_samplepair_t));
-		}
-		else
-		{	// copy from the streaming sound source
-			int		s;
-			int		stop;
+			// mix the chunk with both mixers from the same channel state,
+			// the second one is what gets played
+			memcpy (s_test.channels, channels, sizeof(channels));
 
-			stop = (end < s_rawend) ? end : s_rawend;
+			start = Sys_Microseconds ();
+			S_PaintChunk (end, false);
+			s_test.usec[0] += Sys_Microseconds () - start;
+			S_TestCapture (s_test.scalar, end, false);
 
-			for (i=paintedtime ; i<stop ; i++)
-			{
-				s = i&(MAX_RAW_SAMPLES-1);
-				paintbuffer[i-paintedtime] = s_rawsamples[s];
-			}
-//		if (i != end)
-//			Com_Printf ("partial stream\n");
-//		else
-//			Com_Printf ("full stream\n");
-			for ( ; i<end ; i++)
-			{
-				paintbuffer[i-paintedtime].left =
-				paintbuffer[i-paintedtime].right = 0;
-			}
-		}
+			memcpy (channels, s_test.channels, sizeof(channels));
 
+			start = Sys_Microseconds ();
+			S_PaintChunk (end, true);
+			s_test.usec[1] += Sys_Microseconds () - start;
+			S_TestCapture (s_test.simd, end, true);
 
-	// paint in the channels.
-		ch = channels;
-		for (i=0; i<MAX_CHANNELS ; i++, ch++)
-		{
-			ltime = paintedtime;
-		
-			while (ltime < end)
-			{
-				if (!ch->sfx || (!ch->leftvol && !ch->rightvol) )
-					break;
-
-				// max painting is to the end of the buffer
-				count = end - ltime;
-
-				// might be stopped by running out of data
-				if (ch->end - ltime < count)
-					count = ch->end - ltime;
-		
-				sc = S_LoadSound (ch->sfx);
-				if (!sc)
-					break;
-
-				if (count > 0 && ch->sfx)
-				{	
-					if (sc->width == 1)// FIXME; 8 bit asm is wrong now
-						S_PaintChannelFrom8(ch, sc, count,  ltime - paintedtime);
-					else
-						S_PaintChannelFrom16(ch, sc, count, ltime - paintedtime);
-	
-					ltime += count;
-				}
-
-			// if at end of loop, restart
-				if (ltime >= ch->end)
-				{
-					if (ch->autosound)
-					{	// autolooping sounds always go back to start
-						ch->pos = 0;
-						ch->end = ltime + sc->length;
-					}
-					else if (sc->loopstart >= 0)
-					{
-						ch->pos = sc->loopstart;
-						ch->end = ltime + sc->length - ch->pos;
-					}
-					else				
-					{	// channel just stopped
-						ch->sfx = NULL;
-					}
-				}
-			}
-															  
+			s_test.captured += end - paintedtime;
+			if (s_test.captured > s_test.total)
+				s_test.captured = s_test.total;
 		}
+		else
+			S_PaintChunk (end, snd_simd);
 
 	// transfer out according to DMA format
 		S_TransferPaintBuffer(end);
@@ -497,3 +745,164 @@ void S_PaintChannelFrom16 (channel_t *ch, sfxcache_t *sc, int count, int offset)
 	ch->pos += count;
 }
 
+/*
+===============================================================================
+
+SOUNDTEST
+
+===============================================================================
+*/
+
+static void S_PutLong (byte *p, int l)
+{
+	p[0] = l & 255;
+	p[1] = (l >> 8) & 255;
+	p[2] = (l >> 16) & 255;
+	p[3] = (l >> 24) & 255;
+}
+
+static qboolean S_WriteWav (char *name, short *data, int pairs, int rate)
+{
+	FILE	*f;
+	byte	header[44];
+	int		i;
+	int		size;
+
+	f = fopen (name, "wb");
+	if (!f)
+		return false;
+
+	size = pairs * 4;
+
+	memcpy (header, "RIFF\0\0\0\0WAVEfmt \0\0\0\0\1\0\2\0\0\0\0\0\0\0\0\0\4\0\20\0data", 40);
+	S_PutLong (header+4, 36 + size);
+	S_PutLong (header+16, 16);
+	S_PutLong (header+24, rate);
+	S_PutLong (header+28, rate * 4);
+	S_PutLong (header+40, size);
+	fwrite (header, 1, sizeof(header), f);
+
+	for (i=0 ; i<pairs*2 ; i++)
+		data[i] = LittleShort (data[i]);
+	fwrite (data, 1, size, f);
+
+	fclose (f);
+	return true;
+}
+
+/*
+===================
+S_SoundTest_f
+
+soundtest <seconds> [name]
+
+Mixes the next seconds of sound with both the scalar and the SIMD mixer
+from the same channel state, then writes both to wav files in the game
+directory and compares them. Runs headless with the null device, e.g.
+-headless -timedemo q2demo1.dm2 +soundtest 10
+===================
+*/
+void S_SoundTest_f (void)
+{
+	float	seconds;
+
+	if (Cmd_Argc() < 2 || (seconds = atof (Cmd_Argv(1))) <= 0)
+	{
+		Com_Printf ("usage: soundtest <seconds> [name]\n");
+		return;
+	}
+
+	if (!sound_started)
+	{
+		Com_Printf ("sound system not started\n");
+		return;
+	}
+
+	if (s_test.active)
+	{
+		Com_Printf ("soundtest already running\n");
+		return;
+	}
+
+	if (!SND_SSE2)
+		Com_Printf ("soundtest: no SIMD mixer in this build, comparing the scalar mixer with itself\n");
+
+	S_LockSound ();
+
+	s_test.total = seconds * dma.speed;
+	if (s_test.total < 1)
+		s_test.total = 1;
+	s_test.captured = 0;
+	s_test.usec[0] = s_test.usec[1] = 0;
+	s_test.scalar = Z_Malloc (s_test.total * 2 * sizeof(short));
+	s_test.simd = Z_Malloc (s_test.total * 2 * sizeof(short));
+	strncpy (s_test.name, Cmd_Argc() > 2 ? Cmd_Argv(2) : "soundtest", sizeof(s_test.name)-1);
+	s_test.active = true;
+
+	S_UnlockSound ();
+
+	Com_Printf ("soundtest: capturing %g seconds at %i Hz\n", seconds, dma.speed);
+}
+
+/*
+===================
+S_SoundTestUpdate
+
+Reports a soundtest once it has captured everything, or on finish once it
+has captured anything at all. Called from the game side, the file writes
+stay off the device thread
+===================
+*/
+void S_SoundTestUpdate (qboolean finish)
+{
+	int		i;
+	int		diff, maxdiff, mismatches;
+	char	name[MAX_OSPATH], refname[MAX_OSPATH];
+
+	if (!s_test.active)
+		return;
+
+	S_LockSound ();
+
+	if (!s_test.captured || (!finish && s_test.captured < s_test.total))
+	{
+		S_UnlockSound ();
+		return;
+	}
+
+	s_test.active = false;
+
+	S_UnlockSound ();
+
+	maxdiff = 0;
+	mismatches = 0;
+	for (i=0 ; i<s_test.captured*2 ; i++)
+	{
+		diff = abs (s_test.simd[i] - s_test.scalar[i]);
+		if (diff)
+			mismatches++;
+		if (diff > maxdiff)
+			maxdiff = diff;
+	}
+
+	Com_Printf ("soundtest: %i sample pairs, %.1f seconds at %i Hz\n",
+		s_test.captured, (float)s_test.captured / dma.speed, dma.speed);
+	Com_Printf ("  scalar mix : %8u us\n", s_test.usec[0]);
+	Com_Printf ("  %-10s : %8u us\n", SND_SSE2 ? "sse2 mix" : "scalar mix", s_test.usec[1]);
+	Com_Printf ("  %i mismatched samples, max difference %i: %s\n",
+		mismatches, maxdiff, mismatches ? "FAILED" : "ok");
+
+	Com_sprintf (name, sizeof(name), "%s/%s.wav", FS_Gamedir(), s_test.name);
+	Com_sprintf (refname, sizeof(refname), "%s/%s_ref.wav", FS_Gamedir(), s_test.name);
+	FS_CreatePath (name);
+
+	if (S_WriteWav (name, s_test.simd, s_test.captured, dma.speed)
+		&& S_WriteWav (refname, s_test.scalar, s_test.captured, dma.speed))
+		Com_Printf ("  wrote %s and %s\n", name, refname);
+	else
+		Com_Printf ("  couldn't write %s\n", name);
+
+	Z_Free (s_test.scalar);
+	Z_Free (s_test.simd);
+	s_test.scalar = s_test.simd = NULL;
+}
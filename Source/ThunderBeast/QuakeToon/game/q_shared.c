@@ -1045,13 +1045,19 @@ va
 does a varargs printf into a temp buffer, so I don't need to have
 varargs versions of all text functions.
 FIXME: make this buffer size safe someday
+
+The server thread calls this too, so each thread gets its own ring
+and never hands out a slot the other is still using.
 ============
 */
 char	*va(char *format, ...)
 {
 	va_list		argptr;
-	static char		string[1024];
+	static THREADLOCAL char	strings[8][1024];	// a few in flight per thread
+	static THREADLOCAL int	index;
+	char	*string;
 	
+	string = strings[index++ & 7];
 	va_start (argptr, format);
 	vsprintf (string, format,argptr);
 	va_end (argptr);
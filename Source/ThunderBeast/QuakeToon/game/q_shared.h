@@ -51,6 +51,14 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define idaxp	0
 #endif
 
+// one copy per thread, for static buffers the server thread shares with
+// the main thread
+#ifdef _MSC_VER
+#define THREADLOCAL	__declspec(thread)
+#else
+#define THREADLOCAL	__thread
+#endif
+
 typedef unsigned char 		byte;
 #ifdef __cplusplus
 typedef enum {qfalse, qtrue} qboolean;
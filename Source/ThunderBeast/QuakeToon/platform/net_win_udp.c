@@ -23,7 +23,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "wsipx.h"
 #include "../qcommon/qcommon.h"
 
-#define MAX_LOOPBACK    4
+#define MAX_LOOPBACK    16      // power of two
+#define LOOP_LINE       64      // keep the two ends off each other's cache line
 
 typedef struct
 {
@@ -31,10 +32,21 @@ typedef struct
     int     datalen;
 } loopmsg_t;
 
+// one direction of the loopback. the sender only writes send, the
+// reader only writes get, and each keeps a stale copy of the other
+// end's index so it touches the shared line only when that runs out
 typedef struct
 {
     loopmsg_t   msgs[MAX_LOOPBACK];
-    int         get, send;
+
+    volatile int    send;
+    int         getcache;   // the sender's last look at get
+    byte        sendpad[LOOP_LINE - 2*sizeof(int)];
+
+    volatile int    get;
+    int         sendcache;  // the reader's last look at send
+    qboolean    held;       // the reader's sizebuf points into msgs[get]
+    byte        *base;      // and this is its own buffer
 } loopback_t;
 
 
@@ -284,27 +296,82 @@ qboolean    NET_IsLocalAddress (netadr_t adr)
 
 LOOPBACK BUFFERS FOR LOCAL PLAYER
 
+The client and the server can be on different threads. Each direction
+has one reader and one writer, so no lock is needed. The sender copies
+the datagram into a slot once and the reader parses it in place, the
+slot goes back to the sender on the reader's next NET_GetPacket
+
 =============================================================================
 */
 
+static qboolean NET_LoopWrite (loopback_t *loop, void *data, int length)
+{
+    int     send;
+    loopmsg_t   *msg;
+
+    send = loop->send;
+    if (send - loop->getcache >= MAX_LOOPBACK)
+    {
+        loop->getcache = Sys_AtomicLoad (&loop->get);
+        if (send - loop->getcache >= MAX_LOOPBACK)
+            return false;
+    }
+
+    msg = &loop->msgs[send & (MAX_LOOPBACK-1)];
+    memcpy (msg->data, data, length);
+    msg->datalen = length;
+    Sys_AtomicStore (&loop->send, send + 1);
+    return true;
+}
+
+// the oldest unread slot, valid until NET_LoopRelease
+static byte *NET_LoopPeek (loopback_t *loop, int *length)
+{
+    int     get;
+    loopmsg_t   *msg;
+
+    get = loop->get;
+    if (get == loop->sendcache)
+    {
+        loop->sendcache = Sys_AtomicLoad (&loop->send);
+        if (get == loop->sendcache)
+            return NULL;
+    }
+
+    msg = &loop->msgs[get & (MAX_LOOPBACK-1)];
+    *length = msg->datalen;
+    return msg->data;
+}
+
+static void NET_LoopRelease (loopback_t *loop)
+{
+    Sys_AtomicStore (&loop->get, loop->get + 1);
+}
+
 qboolean    NET_GetLoopPacket (netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message)
 {
-    int     i;
     loopback_t  *loop;
+    byte        *data;
+    int         length;
 
     loop = &loopbacks[sock];
 
-    if (loop->send - loop->get > MAX_LOOPBACK)
-        loop->get = loop->send - MAX_LOOPBACK;
+    // hand back the slot the last packet was parsed from
+    if (loop->held)
+    {
+        net_message->data = loop->base;
+        loop->held = false;
+        NET_LoopRelease (loop);
+    }
 
-    if (loop->get >= loop->send)
+    data = NET_LoopPeek (loop, &length);
+    if (!data)
         return false;
 
-    i = loop->get & (MAX_LOOPBACK-1);
-    loop->get++;
-
-    memcpy (net_message->data, loop->msgs[i].data, loop->msgs[i].datalen);
-    net_message->cursize = loop->msgs[i].datalen;
+    loop->base = net_message->data;
+    loop->held = true;
+    net_message->data = data;
+    net_message->cursize = length;
     memset (net_from, 0, sizeof(*net_from));
     net_from->type = NA_LOOPBACK;
     return true;
@@ -314,16 +381,120 @@ qboolean    NET_GetLoopPacket (netsrc_t sock, netadr_t *net_from, sizebuf_t *net
 
 void NET_SendLoopPacket (netsrc_t sock, int length, void *data, netadr_t to)
 {
-    int     i;
+    // when the reader is behind, drop it like a lost datagram
+    NET_LoopWrite (&loopbacks[sock^1], data, length);
+}
+
+/*
+====================
+NET_LoopBench_f
+
+Pushes packets through a private loopback from a second thread and
+checks each one arrives whole and in order. The reader parses in place
+the way NET_GetLoopPacket does, then again copying every packet out to
+compare with a second copy per datagram
+====================
+*/
+#define LOOPBENCH_LENGTH(i) (64 + ((i) * 97) % (MAX_MSGLEN - 64))
+
+typedef struct
+{
     loopback_t  *loop;
+    int         count;
+    int         waits;      // sends that found the ring full
+} loopbench_t;
 
-    loop = &loopbacks[sock^1];
+static void NET_LoopBenchSend (void *data)
+{
+    loopbench_t *bench = data;
+    byte        packet[MAX_MSGLEN];
+    int         i, length;
+
+    memset (packet, 0, sizeof(packet));
+    for (i=0 ; i<bench->count ; i++)
+    {
+        length = LOOPBENCH_LENGTH(i);
+        *(int *)packet = i;
+        packet[length-1] = i;
+        while (!NET_LoopWrite (bench->loop, packet, length))
+        {
+            if (!(++bench->waits & 63))
+                Sys_Sleep (0);
+        }
+    }
+}
 
-    i = loop->send & (MAX_LOOPBACK-1);
-    loop->send++;
+static void NET_LoopBench_f (void)
+{
+    static const char   *modes[2] = {"in place", "copy out"};
+    loopbench_t bench;
+    void        *thread;
+    byte        copy[MAX_MSGLEN];
+    byte        *data;
+    int         mode, received, length, errors, spins, start, time;
+    double      bytes;
+
+    bench.count = 1000000;
+    if (Cmd_Argc() > 1)
+        bench.count = atoi (Cmd_Argv(1));
+    if (bench.count < 1)
+        bench.count = 1;
+
+    for (mode=0 ; mode<2 ; mode++)
+    {
+        bench.loop = Z_Malloc (sizeof(loopback_t));
+        bench.waits = 0;
+        errors = 0;
+        spins = 0;
+        bytes = 0;
+
+        start = Sys_Milliseconds ();
+        thread = Sys_StartThread (NET_LoopBenchSend, &bench);
+        if (!thread)
+        {
+            Com_Printf ("loopbench: couldn't start the sending thread\n");
+            Z_Free (bench.loop);
+            return;
+        }
 
-    memcpy (loop->msgs[i].data, data, length);
-    loop->msgs[i].datalen = length;
+        for (received=0 ; received<bench.count ; )
+        {
+            data = NET_LoopPeek (bench.loop, &length);
+            if (!data)
+            {
+                if (!(++spins & 63))
+                    Sys_Sleep (0);
+                continue;
+            }
+
+            if (mode)
+            {
+                memcpy (copy, data, length);
+                data = copy;
+            }
+
+            if (length != LOOPBENCH_LENGTH(received) || *(int *)data != received
+                || data[length-1] != (byte)received)
+                errors++;
+            bytes += length;
+
+            NET_LoopRelease (bench.loop);
+            received++;
+        }
+
+        Sys_JoinThread (thread);
+        time = Sys_Milliseconds () - start;
+        if (time < 1)
+            time = 1;
+
+        Com_Printf ("%s: %i packets, %3.1f MB in %i ms, %3.2f M packets/s, %3.1f MB/s\n",
+            modes[mode], bench.count, bytes / (1024*1024), time,
+            bench.count / (time * 1000.0), bytes / (1024*1024) * 1000.0 / time);
+        Com_Printf ("  %i sender waits, %i reader waits, %i errors\n",
+            bench.waits, spins, errors);
+
+        Z_Free (bench.loop);
+    }
 }
 
 //=============================================================================
@@ -777,6 +948,8 @@ void NET_Init (void)
     noipx = Cvar_Get ("noipx", "0", CVAR_NOSET);
 
     net_shownet = Cvar_Get ("net_shownet", "0", 0);
+
+    Cmd_AddCommand ("loopbench", NET_LoopBench_f);
 }
 
 
@@ -20,6 +20,7 @@
  * =======================================================================
  *
  * This file implements the low level part of the Hunk_* memory system
+ * and the read only file mappings used for pak files
  *
  * =======================================================================
  */
@@ -30,7 +31,9 @@
 #endif
 
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/time.h>
 #include <unistd.h>
 
@@ -172,3 +175,48 @@ Hunk_Free(void *base)
         }
     }
 }
+
+byte *
+Sys_MapFile(char *path, int *length)
+{
+    struct stat st;
+    void *base;
+    int fd;
+
+    *length = 0;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        return NULL;
+    }
+
+    if ((fstat(fd, &st) == -1) || (st.st_size <= 0))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    base = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    /* the mapping keeps the file referenced */
+    close(fd);
+
+    if (base == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    *length = (int)st.st_size;
+
+    return (byte *)base;
+}
+
+void
+Sys_UnmapFile(byte *base, int length)
+{
+    if (base)
+    {
+        munmap(base, length);
+    }
+}
@@ -19,7 +19,8 @@
  *
  * =======================================================================
  *
- * Memory handling functions.
+ * Memory handling functions and the read only file mappings used for
+ * pak files.
  *
  * =======================================================================
  */
@@ -96,3 +97,61 @@ Hunk_Free(void *base)
 
     hunkcount--;
 }
+
+byte *
+Sys_MapFile(char *path, int *length)
+{
+    HANDLE file;
+    HANDLE mapping;
+    DWORD size;
+    void *base;
+
+    *length = 0;
+
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return NULL;
+    }
+
+    size = GetFileSize(file, NULL);
+
+    if ((size == INVALID_FILE_SIZE) || (size == 0))
+    {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+
+    if (!mapping)
+    {
+        return NULL;
+    }
+
+    base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+    /* the view keeps the mapping referenced */
+    CloseHandle(mapping);
+
+    if (!base)
+    {
+        return NULL;
+    }
+
+    *length = (int)size;
+
+    return (byte *)base;
+}
+
+void
+Sys_UnmapFile(byte *base, int length)
+{
+    if (base)
+    {
+        UnmapViewOfFile(base);
+    }
+}
@@ -90,6 +90,12 @@ Adds command text at the end of the buffer
 void Cbuf_AddText (char *text)
 {
 	int		l;
+
+	if (!Sys_IsMainThread ())
+	{
+		Com_DeferCommand (text);
+		return;
+	}
 	
 	l = strlen (text);
 
@@ -200,6 +206,12 @@ void Cbuf_Execute (void)
 
 	alias_count = 0;		// don't allow infinite alias loops
 
+	if (!cmd_text.cursize)
+		return;
+
+	// commands can start and stop the server, keep its thread out
+	SV_Lock ();
+
 	while (cmd_text.cursize)
 	{
 // find a \n or ; line break
@@ -244,6 +256,8 @@ void Cbuf_Execute (void)
 			break;
 		}
 	}
+
+	SV_Unlock ();
 }
 
 
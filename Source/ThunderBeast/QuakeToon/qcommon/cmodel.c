@@ -47,7 +47,6 @@ typedef struct
 	int			contents;
 	int			numsides;
 	int			firstbrushside;
-	int			checkcount;		// to avoid repeated testings
 } cbrush_t;
 
 typedef struct
@@ -58,8 +57,6 @@ typedef struct
 	int		floodvalid;
 } carea_t;
 
-int			checkcount;
-
 char		map_name[MAX_QPATH];
 
 int			numbrushsides;
@@ -69,10 +66,10 @@ int			numtexinfo;
 mapsurface_t	map_surfaces[MAX_MAP_TEXINFO];
 
 int			numplanes;
-cplane_t	map_planes[MAX_MAP_PLANES+6];		// extra for box hull
+cplane_t	map_planes[MAX_MAP_PLANES+12*NUM_BOXHULLS];	// extra for box hulls
 
 int			numnodes;
-cnode_t		map_nodes[MAX_MAP_NODES+6];		// extra for box hull
+cnode_t		map_nodes[MAX_MAP_NODES+6*NUM_BOXHULLS];	// extra for box hulls
 
 int			numleafs = 1;	// allow leaf funcs to be called without a map
 cleaf_t		map_leafs[MAX_MAP_LEAFS];
@@ -110,13 +107,15 @@ qboolean	portalopen[MAX_MAP_AREAPORTALS];
 
 
 cvar_t		*map_noareas;
+cvar_t		*cm_vismatrix;
+cvar_t		*cm_tracecache;
 
 void	CM_InitBoxHull (void);
 void	FloodAreaConnections (void);
 
 
 int		c_pointcontents;
-int		c_traces, c_brush_traces;
+int		c_traces;
 
 
 /*
@@ -545,6 +544,8 @@ CM_LoadMap
 Loads in the map and all submodels
 ==================
 */
+void CM_BuildVisCache (void);
+
 cmodel_t *CM_LoadMap (char *name, qboolean clientload, unsigned *checksum)
 {
 	unsigned		*buf;
@@ -554,6 +555,8 @@ cmodel_t *CM_LoadMap (char *name, qboolean clientload, unsigned *checksum)
 	static unsigned	last_checksum;
 
 	map_noareas = Cvar_Get ("map_noareas", "0", 0);
+	cm_vismatrix = Cvar_Get ("cm_vismatrix", "32768", 0);
+	cm_tracecache = Cvar_Get ("cm_tracecache", "0", 0);
 
 	if (  !strcmp (map_name, name) && (clientload || !Cvar_VariableValue ("flushmap")) )
 	{
@@ -567,6 +570,8 @@ cmodel_t *CM_LoadMap (char *name, qboolean clientload, unsigned *checksum)
 	}
 
 	// free old stuff
+	CM_ClearTraceCache ();
+
 	numplanes = 0;
 	numnodes = 0;
 	numleafs = 0;
@@ -582,13 +587,14 @@ cmodel_t *CM_LoadMap (char *name, qboolean clientload, unsigned *checksum)
 		numclusters = 1;
 		numareas = 1;
 		*checksum = 0;
+		CM_BuildVisCache ();
 		return &map_cmodels[0];			// cinematic servers won't have anything at all
 	}
 
 	//
 	// load the file
 	//
-	length = FS_LoadFile (name, (void **)&buf);
+	length = FS_LoadFileReadOnly (name, (void **)&buf);
 	if (!buf)
 		Com_Error (ERR_DROP, "Couldn't load %s", name);
 
@@ -621,6 +627,8 @@ cmodel_t *CM_LoadMap (char *name, qboolean clientload, unsigned *checksum)
 
 	FS_FreeFile (buf);
 
+	CM_BuildVisCache ();
+
 	CM_InitBoxHull ();
 
 	memset (portalopen, 0, sizeof(portalopen));
@@ -688,79 +696,95 @@ int		CM_LeafArea (int leafnum)
 //=======================================================================
 
 
-cplane_t	*box_planes;
-int			box_headnode;
+cplane_t	*box_planes;		// 12 for each hull
+int			box_headnode;		// of the first hull, the others follow 6 nodes apart
 cbrush_t	*box_brush;
 cleaf_t		*box_leaf;
 
+#define	CM_IsBoxHull(headnode)	((headnode) >= box_headnode)
+
 /*
 ===================
 CM_InitBoxHull
 
 Set up the planes and nodes so that the six floats of a bounding box
 can just be stored out and get a proper clipping hull structure.
+There is a hull for each thread that makes boxes.
 ===================
 */
 void CM_InitBoxHull (void)
 {
-	int			i;
+	int			i, h;
 	int			side;
 	cnode_t		*c;
 	cplane_t	*p;
 	cbrushside_t	*s;
+	cbrush_t	*brush;
+	cleaf_t		*leaf;
+	int			headnode, firstplane, firstside;
 
 	box_headnode = numnodes;
 	box_planes = &map_planes[numplanes];
-	if (numnodes+6 > MAX_MAP_NODES
-		|| numbrushes+1 > MAX_MAP_BRUSHES
-		|| numleafbrushes+1 > MAX_MAP_LEAFBRUSHES
-		|| numbrushsides+6 > MAX_MAP_BRUSHSIDES
-		|| numplanes+12 > MAX_MAP_PLANES)
-		Com_Error (ERR_DROP, "Not enough room for box tree");
-
 	box_brush = &map_brushes[numbrushes];
-	box_brush->numsides = 6;
-	box_brush->firstbrushside = numbrushsides;
-	box_brush->contents = CONTENTS_MONSTER;
-
 	box_leaf = &map_leafs[numleafs];
-	box_leaf->contents = CONTENTS_MONSTER;
-	box_leaf->firstleafbrush = numleafbrushes;
-	box_leaf->numleafbrushes = 1;
-
-	map_leafbrushes[numleafbrushes] = numbrushes;
+	if (numnodes+6*NUM_BOXHULLS > MAX_MAP_NODES
+		|| numbrushes+NUM_BOXHULLS > MAX_MAP_BRUSHES
+		|| numleafbrushes+NUM_BOXHULLS > MAX_MAP_LEAFBRUSHES
+		|| numbrushsides+6*NUM_BOXHULLS > MAX_MAP_BRUSHSIDES
+		|| numplanes+12*NUM_BOXHULLS > MAX_MAP_PLANES
+		|| numleafs+NUM_BOXHULLS > MAX_MAP_LEAFS)
+		Com_Error (ERR_DROP, "Not enough room for box tree");
 
-	for (i=0 ; i<6 ; i++)
+	for (h=0 ; h<NUM_BOXHULLS ; h++)
 	{
-		side = i&1;
-
-		// brush sides
-		s = &map_brushsides[numbrushsides+i];
-		s->plane = 	map_planes + (numplanes+i*2+side);
-		s->surface = &nullsurface;
-
-		// nodes
-		c = &map_nodes[box_headnode+i];
-		c->plane = map_planes + (numplanes+i*2);
-		c->children[side] = -1 - emptyleaf;
-		if (i != 5)
-			c->children[side^1] = box_headnode+i + 1;
-		else
-			c->children[side^1] = -1 - numleafs;
+		headnode = box_headnode + 6*h;
+		firstplane = numplanes + 12*h;
+		firstside = numbrushsides + 6*h;
+
+		brush = &box_brush[h];
+		brush->numsides = 6;
+		brush->firstbrushside = firstside;
+		brush->contents = CONTENTS_MONSTER;
+
+		leaf = &box_leaf[h];
+		leaf->contents = CONTENTS_MONSTER;
+		leaf->firstleafbrush = numleafbrushes + h;
+		leaf->numleafbrushes = 1;
 
-		// planes
-		p = &box_planes[i*2];
-		p->type = i>>1;
-		p->signbits = 0;
-		VectorClear (p->normal);
-		p->normal[i>>1] = 1;
+		map_leafbrushes[numleafbrushes + h] = numbrushes + h;
 
-		p = &box_planes[i*2+1];
-		p->type = 3 + (i>>1);
-		p->signbits = 0;
-		VectorClear (p->normal);
-		p->normal[i>>1] = -1;
-	}	
+		for (i=0 ; i<6 ; i++)
+		{
+			side = i&1;
+
+			// brush sides
+			s = &map_brushsides[firstside+i];
+			s->plane = 	map_planes + (firstplane+i*2+side);
+			s->surface = &nullsurface;
+
+			// nodes
+			c = &map_nodes[headnode+i];
+			c->plane = map_planes + (firstplane+i*2);
+			c->children[side] = -1 - emptyleaf;
+			if (i != 5)
+				c->children[side^1] = headnode+i + 1;
+			else
+				c->children[side^1] = -1 - (numleafs + h);
+
+			// planes
+			p = &map_planes[firstplane+i*2];
+			p->type = i>>1;
+			p->signbits = 0;
+			VectorClear (p->normal);
+			p->normal[i>>1] = 1;
+
+			p = &map_planes[firstplane+i*2+1];
+			p->type = 3 + (i>>1);
+			p->signbits = 0;
+			VectorClear (p->normal);
+			p->normal[i>>1] = -1;
+		}
+	}
 }
 
 
@@ -772,22 +796,30 @@ To keep everything totally uniform, bounding boxes are turned into small
 BSP trees instead of being compared directly.
 ===================
 */
-int	CM_HeadnodeForBox (vec3_t mins, vec3_t maxs)
+int	CM_HeadnodeForBoxHull (vec3_t mins, vec3_t maxs, int hull)
 {
-	box_planes[0].dist = maxs[0];
-	box_planes[1].dist = -maxs[0];
-	box_planes[2].dist = mins[0];
-	box_planes[3].dist = -mins[0];
-	box_planes[4].dist = maxs[1];
-	box_planes[5].dist = -maxs[1];
-	box_planes[6].dist = mins[1];
-	box_planes[7].dist = -mins[1];
-	box_planes[8].dist = maxs[2];
-	box_planes[9].dist = -maxs[2];
-	box_planes[10].dist = mins[2];
-	box_planes[11].dist = -mins[2];
+	cplane_t	*planes;
+
+	planes = box_planes + 12*hull;
+	planes[0].dist = maxs[0];
+	planes[1].dist = -maxs[0];
+	planes[2].dist = mins[0];
+	planes[3].dist = -mins[0];
+	planes[4].dist = maxs[1];
+	planes[5].dist = -maxs[1];
+	planes[6].dist = mins[1];
+	planes[7].dist = -mins[1];
+	planes[8].dist = maxs[2];
+	planes[9].dist = -maxs[2];
+	planes[10].dist = mins[2];
+	planes[11].dist = -mins[2];
+
+	return box_headnode + 6*hull;
+}
 
-	return box_headnode;
+int	CM_HeadnodeForBox (vec3_t mins, vec3_t maxs)
+{
+	return CM_HeadnodeForBoxHull (mins, maxs, BOXHULL_SERVER);
 }
 
 
@@ -837,14 +869,19 @@ int CM_PointLeafnum (vec3_t p)
 CM_BoxLeafnums
 
 Fills in a list of all the leafs touched
+The walk state is kept on the caller's stack, so the server
+can build client frames on several threads at once
 =============
 */
-int		leaf_count, leaf_maxcount;
-int		*leaf_list;
-float	*leaf_mins, *leaf_maxs;
-int		leaf_topnode;
+typedef struct
+{
+	int		count, maxcount;
+	int		*list;
+	float	*mins, *maxs;
+	int		topnode;
+} boxleafs_t;
 
-void CM_BoxLeafnums_r (int nodenum)
+void CM_BoxLeafnums_r (boxleafs_t *bl, int nodenum)
 {
 	cplane_t	*plane;
 	cnode_t		*node;
@@ -854,28 +891,28 @@ void CM_BoxLeafnums_r (int nodenum)
 	{
 		if (nodenum < 0)
 		{
-			if (leaf_count >= leaf_maxcount)
+			if (bl->count >= bl->maxcount)
 			{
 //				Com_Printf ("CM_BoxLeafnums_r: overflow\n");
 				return;
 			}
-			leaf_list[leaf_count++] = -1 - nodenum;
+			bl->list[bl->count++] = -1 - nodenum;
 			return;
 		}
 	
 		node = &map_nodes[nodenum];
 		plane = node->plane;
 //		s = BoxOnPlaneSide (leaf_mins, leaf_maxs, plane);
-		s = BOX_ON_PLANE_SIDE(leaf_mins, leaf_maxs, plane);
+		s = BOX_ON_PLANE_SIDE(bl->mins, bl->maxs, plane);
 		if (s == 1)
 			nodenum = node->children[0];
 		else if (s == 2)
 			nodenum = node->children[1];
 		else
 		{	// go down both
-			if (leaf_topnode == -1)
-				leaf_topnode = nodenum;
-			CM_BoxLeafnums_r (node->children[0]);
+			if (bl->topnode == -1)
+				bl->topnode = nodenum;
+			CM_BoxLeafnums_r (bl, node->children[0]);
 			nodenum = node->children[1];
 		}
 
@@ -884,20 +921,22 @@ void CM_BoxLeafnums_r (int nodenum)
 
 int	CM_BoxLeafnums_headnode (vec3_t mins, vec3_t maxs, int *list, int listsize, int headnode, int *topnode)
 {
-	leaf_list = list;
-	leaf_count = 0;
-	leaf_maxcount = listsize;
-	leaf_mins = mins;
-	leaf_maxs = maxs;
+	boxleafs_t	bl;
+
+	bl.list = list;
+	bl.count = 0;
+	bl.maxcount = listsize;
+	bl.mins = mins;
+	bl.maxs = maxs;
 
-	leaf_topnode = -1;
+	bl.topnode = -1;
 
-	CM_BoxLeafnums_r (headnode);
+	CM_BoxLeafnums_r (&bl, headnode);
 
 	if (topnode)
-		*topnode = leaf_topnode;
+		*topnode = bl.topnode;
 
-	return leaf_count;
+	return bl.count;
 }
 
 int	CM_BoxLeafnums (vec3_t mins, vec3_t maxs, int *list, int listsize, int *topnode)
@@ -945,7 +984,7 @@ int	CM_TransformedPointContents (vec3_t p, int headnode, vec3_t origin, vec3_t a
 	VectorSubtract (p, origin, p_l);
 
 	// rotate start and end into the models frame of reference
-	if (headnode != box_headnode && 
+	if (!CM_IsBoxHull(headnode) && 
 	(angles[0] || angles[1] || angles[2]) )
 	{
 		AngleVectors (angles, forward, right, up);
@@ -973,20 +1012,97 @@ BOX TRACING
 // 1/32 epsilon to keep floating point happy
 #define	DIST_EPSILON	(0.03125)
 
-vec3_t	trace_start, trace_end;
-vec3_t	trace_mins, trace_maxs;
-vec3_t	trace_extents;
+/*
+Everything a trace changes lives in a tracecontext_t, so traces on
+different contexts can run on different threads. The map is only read,
+except for the box hull CM_HeadnodeForBox rebuilds, so box traces still
+belong to the thread that made the box.
+
+A context can remember the traces of the current frame, looked up by
+everything that goes into them. The map does not move, so a repeated
+query gets the same trace back without walking the nodes.
+*/
+#define	TRACECACHE_SIZE		1024		// power of two
+
+typedef struct
+{
+	vec3_t	start, end;
+	vec3_t	mins, maxs;
+	int		headnode;
+	int		brushmask;
+	int		frame;				// cm_traceframe when stored
+	trace_t	trace;
+} tracecacheentry_t;
+
+struct tracecontext_s
+{
+	vec3_t	start, end;
+	vec3_t	mins, maxs;
+	vec3_t	extents;
+
+	trace_t	trace;
+	int		contents;
+	qboolean	ispoint;		// optimized case
+
+	int		checkcount;
+	int		brushchecks[MAX_MAP_BRUSHES];	// checkcount when each brush was last clipped
+
+	qboolean	usecache;
+	tracecacheentry_t	cache[TRACECACHE_SIZE];
+
+	int		c_traces, c_brush_traces, c_cachehits;
+};
+
+static tracecontext_t	cm_trace;		// used by CM_BoxTrace, main thread only
+static int			cm_traceframe = 1;
+
+static void CM_CaptureTrace (vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs,
+							 int headnode, int brushmask, trace_t *trace);
 
-trace_t	trace_trace;
-int		trace_contents;
-qboolean	trace_ispoint;		// optimized case
+/*
+================
+CM_AllocTraceContext
+================
+*/
+tracecontext_t *CM_AllocTraceContext (void)
+{
+	return Z_Malloc (sizeof(tracecontext_t));
+}
+
+void CM_FreeTraceContext (tracecontext_t *tc)
+{
+	Z_Free (tc);
+}
+
+void CM_SetTraceCache (tracecontext_t *tc, qboolean enable)
+{
+	tc->usecache = enable;
+}
+
+int CM_TraceCacheHits (tracecontext_t *tc)
+{
+	return tc->c_cachehits;
+}
+
+/*
+================
+CM_ClearTraceCache
+
+Forgets the traces of every context, called once a frame and
+when the map changes, never while traces are running
+================
+*/
+void CM_ClearTraceCache (void)
+{
+	cm_traceframe++;
+}
 
 /*
 ================
 CM_ClipBoxToBrush
 ================
 */
-void CM_ClipBoxToBrush (vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
+void CM_ClipBoxToBrush (tracecontext_t *tc, vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
 					  trace_t *trace, cbrush_t *brush)
 {
 	int			i, j;
@@ -1006,7 +1122,7 @@ void CM_ClipBoxToBrush (vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
 	if (!brush->numsides)
 		return;
 
-	c_brush_traces++;
+	tc->c_brush_traces++;
 
 	getout = false;
 	startout = false;
@@ -1019,7 +1135,7 @@ void CM_ClipBoxToBrush (vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
 
 		// FIXME: special case for axial
 
-		if (!trace_ispoint)
+		if (!tc->ispoint)
 		{	// general box case
 
 			// push the plane out apropriately for mins/maxs
@@ -1155,7 +1271,7 @@ void CM_TestBoxInBrush (vec3_t mins, vec3_t maxs, vec3_t p1,
 CM_TraceToLeaf
 ================
 */
-void CM_TraceToLeaf (int leafnum)
+void CM_TraceToLeaf (tracecontext_t *tc, int leafnum)
 {
 	int			k;
 	int			brushnum;
@@ -1163,21 +1279,21 @@ void CM_TraceToLeaf (int leafnum)
 	cbrush_t	*b;
 
 	leaf = &map_leafs[leafnum];
-	if ( !(leaf->contents & trace_contents))
+	if ( !(leaf->contents & tc->contents))
 		return;
 	// trace line against all brushes in the leaf
 	for (k=0 ; k<leaf->numleafbrushes ; k++)
 	{
 		brushnum = map_leafbrushes[leaf->firstleafbrush+k];
 		b = &map_brushes[brushnum];
-		if (b->checkcount == checkcount)
+		if (tc->brushchecks[brushnum] == tc->checkcount)
 			continue;	// already checked this brush in another leaf
-		b->checkcount = checkcount;
+		tc->brushchecks[brushnum] = tc->checkcount;
 
-		if ( !(b->contents & trace_contents))
+		if ( !(b->contents & tc->contents))
 			continue;
-		CM_ClipBoxToBrush (trace_mins, trace_maxs, trace_start, trace_end, &trace_trace, b);
-		if (!trace_trace.fraction)
+		CM_ClipBoxToBrush (tc, tc->mins, tc->maxs, tc->start, tc->end, &tc->trace, b);
+		if (!tc->trace.fraction)
 			return;
 	}
 
@@ -1189,7 +1305,7 @@ void CM_TraceToLeaf (int leafnum)
 CM_TestInLeaf
 ================
 */
-void CM_TestInLeaf (int leafnum)
+void CM_TestInLeaf (tracecontext_t *tc, int leafnum)
 {
 	int			k;
 	int			brushnum;
@@ -1197,21 +1313,21 @@ void CM_TestInLeaf (int leafnum)
 	cbrush_t	*b;
 
 	leaf = &map_leafs[leafnum];
-	if ( !(leaf->contents & trace_contents))
+	if ( !(leaf->contents & tc->contents))
 		return;
 	// trace line against all brushes in the leaf
 	for (k=0 ; k<leaf->numleafbrushes ; k++)
 	{
 		brushnum = map_leafbrushes[leaf->firstleafbrush+k];
 		b = &map_brushes[brushnum];
-		if (b->checkcount == checkcount)
+		if (tc->brushchecks[brushnum] == tc->checkcount)
 			continue;	// already checked this brush in another leaf
-		b->checkcount = checkcount;
+		tc->brushchecks[brushnum] = tc->checkcount;
 
-		if ( !(b->contents & trace_contents))
+		if ( !(b->contents & tc->contents))
 			continue;
-		CM_TestBoxInBrush (trace_mins, trace_maxs, trace_start, &trace_trace, b);
-		if (!trace_trace.fraction)
+		CM_TestBoxInBrush (tc->mins, tc->maxs, tc->start, &tc->trace, b);
+		if (!tc->trace.fraction)
 			return;
 	}
 
@@ -1224,7 +1340,7 @@ CM_RecursiveHullCheck
 
 ==================
 */
-void CM_RecursiveHullCheck (int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
+void CM_RecursiveHullCheck (tracecontext_t *tc, int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 {
 	cnode_t		*node;
 	cplane_t	*plane;
@@ -1236,13 +1352,13 @@ void CM_RecursiveHullCheck (int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 	int			side;
 	float		midf;
 
-	if (trace_trace.fraction <= p1f)
+	if (tc->trace.fraction <= p1f)
 		return;		// already hit something nearer
 
 	// if < 0, we are in a leaf node
 	if (num < 0)
 	{
-		CM_TraceToLeaf (-1-num);
+		CM_TraceToLeaf (tc, -1-num);
 		return;
 	}
 
@@ -1257,36 +1373,36 @@ void CM_RecursiveHullCheck (int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 	{
 		t1 = p1[plane->type] - plane->dist;
 		t2 = p2[plane->type] - plane->dist;
-		offset = trace_extents[plane->type];
+		offset = tc->extents[plane->type];
 	}
 	else
 	{
 		t1 = DotProduct (plane->normal, p1) - plane->dist;
 		t2 = DotProduct (plane->normal, p2) - plane->dist;
-		if (trace_ispoint)
+		if (tc->ispoint)
 			offset = 0;
 		else
-			offset = fabs(trace_extents[0]*plane->normal[0]) +
-				fabs(trace_extents[1]*plane->normal[1]) +
-				fabs(trace_extents[2]*plane->normal[2]);
+			offset = fabs(tc->extents[0]*plane->normal[0]) +
+				fabs(tc->extents[1]*plane->normal[1]) +
+				fabs(tc->extents[2]*plane->normal[2]);
 	}
 
 
 #if 0
-CM_RecursiveHullCheck (node->children[0], p1f, p2f, p1, p2);
-CM_RecursiveHullCheck (node->children[1], p1f, p2f, p1, p2);
+CM_RecursiveHullCheck (tc, node->children[0], p1f, p2f, p1, p2);
+CM_RecursiveHullCheck (tc, node->children[1], p1f, p2f, p1, p2);
 return;
 #endif
 
 	// see which sides we need to consider
 	if (t1 >= offset && t2 >= offset)
 	{
-		CM_RecursiveHullCheck (node->children[0], p1f, p2f, p1, p2);
+		CM_RecursiveHullCheck (tc, node->children[0], p1f, p2f, p1, p2);
 		return;
 	}
 	if (t1 < -offset && t2 < -offset)
 	{
-		CM_RecursiveHullCheck (node->children[1], p1f, p2f, p1, p2);
+		CM_RecursiveHullCheck (tc, node->children[1], p1f, p2f, p1, p2);
 		return;
 	}
 
@@ -1322,7 +1438,7 @@ return;
 	for (i=0 ; i<3 ; i++)
 		mid[i] = p1[i] + frac*(p2[i] - p1[i]);
 
-	CM_RecursiveHullCheck (node->children[side], p1f, midf, p1, mid);
+	CM_RecursiveHullCheck (tc, node->children[side], p1f, midf, p1, mid);
 
 
 	// go past the node
@@ -1335,7 +1451,7 @@ return;
 	for (i=0 ; i<3 ; i++)
 		mid[i] = p1[i] + frac2*(p2[i] - p1[i]);
 
-	CM_RecursiveHullCheck (node->children[side^1], midf, p2f, mid, p2);
+	CM_RecursiveHullCheck (tc, node->children[side^1], midf, p2f, mid, p2);
 }
 
 
@@ -1344,32 +1460,74 @@ return;
 
 /*
 ==================
-CM_BoxTrace
+CM_TraceCacheEntry
+
+The slot a query hashes to, the caller compares the key
 ==================
 */
-trace_t		CM_BoxTrace (vec3_t start, vec3_t end,
+static tracecacheentry_t *CM_TraceCacheEntry (tracecontext_t *tc, vec3_t start, vec3_t end,
+											  vec3_t mins, vec3_t maxs, int headnode, int brushmask)
+{
+	unsigned	hash;
+	int			i;
+
+	hash = headnode * 31 + brushmask;
+	for (i=0 ; i<3 ; i++)
+	{
+		hash = hash * 31 + *(unsigned *)&start[i];
+		hash = hash * 31 + *(unsigned *)&end[i];
+		hash = hash * 31 + *(unsigned *)&mins[i];
+		hash = hash * 31 + *(unsigned *)&maxs[i];
+	}
+	hash ^= hash >> 16;
+
+	return &tc->cache[hash & (TRACECACHE_SIZE-1)];
+}
+
+/*
+==================
+CM_RunBoxTrace
+==================
+*/
+static trace_t	CM_RunBoxTrace (tracecontext_t *tc, vec3_t start, vec3_t end,
 						  vec3_t mins, vec3_t maxs,
 						  int headnode, int brushmask)
 {
 	int		i;
+	tracecacheentry_t	*entry;
 
-	checkcount++;		// for multi-check avoidance
+	tc->checkcount++;		// for multi-check avoidance
 
-	c_traces++;			// for statistics, may be zeroed
+	tc->c_traces++;			// for statistics, may be zeroed
 
 	// fill in a default trace
-	memset (&trace_trace, 0, sizeof(trace_trace));
-	trace_trace.fraction = 1;
-	trace_trace.surface = &(nullsurface.c);
+	memset (&tc->trace, 0, sizeof(tc->trace));
+	tc->trace.fraction = 1;
+	tc->trace.surface = &(nullsurface.c);
 
 	if (!numnodes)	// map not loaded
-		return trace_trace;
+		return tc->trace;
+
+	// the box hull is rebuilt for every box, so its traces can't be kept
+	entry = NULL;
+	if (tc->usecache && !CM_IsBoxHull(headnode))
+	{
+		entry = CM_TraceCacheEntry (tc, start, end, mins, maxs, headnode, brushmask);
+		if (entry->frame == cm_traceframe && entry->headnode == headnode
+			&& entry->brushmask == brushmask
+			&& VectorCompare (entry->start, start) && VectorCompare (entry->end, end)
+			&& VectorCompare (entry->mins, mins) && VectorCompare (entry->maxs, maxs))
+		{
+			tc->c_cachehits++;
+			return entry->trace;
+		}
+	}
 
-	trace_contents = brushmask;
-	VectorCopy (start, trace_start);
-	VectorCopy (end, trace_end);
-	VectorCopy (mins, trace_mins);
-	VectorCopy (maxs, trace_maxs);
+	tc->contents = brushmask;
+	VectorCopy (start, tc->start);
+	VectorCopy (end, tc->end);
+	VectorCopy (mins, tc->mins);
+	VectorCopy (maxs, tc->maxs);
 
 	//
 	// check for position test special case
@@ -1392,48 +1550,99 @@ trace_t		CM_BoxTrace (vec3_t start, vec3_t end,
 		numleafs = CM_BoxLeafnums_headnode (c1, c2, leafs, 1024, headnode, &topnode);
 		for (i=0 ; i<numleafs ; i++)
 		{
-			CM_TestInLeaf (leafs[i]);
-			if (trace_trace.allsolid)
+			CM_TestInLeaf (tc, leafs[i]);
+			if (tc->trace.allsolid)
 				break;
 		}
-		VectorCopy (start, trace_trace.endpos);
-		return trace_trace;
-	}
-
-	//
-	// check for point special case
-	//
-	if (mins[0] == 0 && mins[1] == 0 && mins[2] == 0
-		&& maxs[0] == 0 && maxs[1] == 0 && maxs[2] == 0)
-	{
-		trace_ispoint = true;
-		VectorClear (trace_extents);
+		VectorCopy (start, tc->trace.endpos);
 	}
 	else
 	{
-		trace_ispoint = false;
-		trace_extents[0] = -mins[0] > maxs[0] ? -mins[0] : maxs[0];
-		trace_extents[1] = -mins[1] > maxs[1] ? -mins[1] : maxs[1];
-		trace_extents[2] = -mins[2] > maxs[2] ? -mins[2] : maxs[2];
-	}
+		//
+		// check for point special case
+		//
+		if (mins[0] == 0 && mins[1] == 0 && mins[2] == 0
+			&& maxs[0] == 0 && maxs[1] == 0 && maxs[2] == 0)
+		{
+			tc->ispoint = true;
+			VectorClear (tc->extents);
+		}
+		else
+		{
+			tc->ispoint = false;
+			tc->extents[0] = -mins[0] > maxs[0] ? -mins[0] : maxs[0];
+			tc->extents[1] = -mins[1] > maxs[1] ? -mins[1] : maxs[1];
+			tc->extents[2] = -mins[2] > maxs[2] ? -mins[2] : maxs[2];
+		}
 
-	//
-	// general sweeping through world
-	//
-	CM_RecursiveHullCheck (headnode, 0, 1, start, end);
+		//
+		// general sweeping through world
+		//
+		CM_RecursiveHullCheck (tc, headnode, 0, 1, start, end);
 
-	if (trace_trace.fraction == 1)
-	{
-		VectorCopy (end, trace_trace.endpos);
+		if (tc->trace.fraction == 1)
+		{
+			VectorCopy (end, tc->trace.endpos);
+		}
+		else
+		{
+			for (i=0 ; i<3 ; i++)
+				tc->trace.endpos[i] = start[i] + tc->trace.fraction * (end[i] - start[i]);
+		}
 	}
-	else
+
+	if (entry)
 	{
-		for (i=0 ; i<3 ; i++)
-			trace_trace.endpos[i] = start[i] + trace_trace.fraction * (end[i] - start[i]);
+		VectorCopy (start, entry->start);
+		VectorCopy (end, entry->end);
+		VectorCopy (mins, entry->mins);
+		VectorCopy (maxs, entry->maxs);
+		entry->headnode = headnode;
+		entry->brushmask = brushmask;
+		entry->frame = cm_traceframe;
+		entry->trace = tc->trace;
 	}
-	return trace_trace;
+
+	return tc->trace;
+}
+
+/*
+==================
+CM_ContextBoxTrace
+==================
+*/
+trace_t		CM_ContextBoxTrace (tracecontext_t *tc, vec3_t start, vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  int headnode, int brushmask)
+{
+	trace_t		trace;
+
+	if (tc != &cm_trace)
+		return CM_RunBoxTrace (tc, start, end, mins, maxs, headnode, brushmask);
+
+	// the main thread context feeds showtrace and tracecapture
+	c_traces++;			// for statistics, may be zeroed
+
+	tc->usecache = cm_tracecache && cm_tracecache->value;
+
+	trace = CM_RunBoxTrace (tc, start, end, mins, maxs, headnode, brushmask);
+
+	CM_CaptureTrace (start, end, mins, maxs, headnode, brushmask, &trace);
+
+	return trace;
 }
 
+/*
+==================
+CM_BoxTrace
+==================
+*/
+trace_t		CM_BoxTrace (vec3_t start, vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  int headnode, int brushmask)
+{
+	return CM_ContextBoxTrace (&cm_trace, start, end, mins, maxs, headnode, brushmask);
+}
 
 /*
 ==================
@@ -1448,7 +1657,7 @@ rotating entities
 #endif
 
 
-trace_t		CM_TransformedBoxTrace (vec3_t start, vec3_t end,
+trace_t		CM_ContextTransformedBoxTrace (tracecontext_t *tc, vec3_t start, vec3_t end,
 						  vec3_t mins, vec3_t maxs,
 						  int headnode, int brushmask,
 						  vec3_t origin, vec3_t angles)
@@ -1465,7 +1674,7 @@ trace_t		CM_TransformedBoxTrace (vec3_t start, vec3_t end,
 	VectorSubtract (end, origin, end_l);
 
 	// rotate start and end into the models frame of reference
-	if (headnode != box_headnode && 
+	if (!CM_IsBoxHull(headnode) && 
 	(angles[0] || angles[1] || angles[2]) )
 		rotated = true;
 	else
@@ -1487,7 +1696,7 @@ trace_t		CM_TransformedBoxTrace (vec3_t start, vec3_t end,
 	}
 
 	// sweep the box through the model
-	trace = CM_BoxTrace (start_l, end_l, mins, maxs, headnode, brushmask);
+	trace = CM_ContextBoxTrace (tc, start_l, end_l, mins, maxs, headnode, brushmask);
 
 	if (rotated && trace.fraction != 1.0)
 	{
@@ -1508,11 +1717,237 @@ trace_t		CM_TransformedBoxTrace (vec3_t start, vec3_t end,
 	return trace;
 }
 
+trace_t		CM_TransformedBoxTrace (vec3_t start, vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  int headnode, int brushmask,
+						  vec3_t origin, vec3_t angles)
+{
+	return CM_ContextTransformedBoxTrace (&cm_trace, start, end, mins, maxs,
+		headnode, brushmask, origin, angles);
+}
+
 #ifdef _WIN32
 #pragma optimize( "", on )
 #endif
 
 
+/*
+===============================================================================
+
+TRACE CAPTURE
+
+tracecapture records the traces the game makes through CM_BoxTrace,
+tracebench replays them on fresh contexts: one at a time, with the
+frame cache and spread over the job threads. Every replay is
+checked against the captured results.
+
+===============================================================================
+*/
+
+static boxtrace_t	*cm_capture;
+static int			cm_capturesize;
+static int			cm_capturecount;
+static char			cm_capturemap[MAX_QPATH];
+
+static void CM_CaptureTrace (vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs,
+							 int headnode, int brushmask, trace_t *trace)
+{
+	boxtrace_t	*bt;
+
+	if (cm_capturecount == cm_capturesize)
+		return;
+
+	// the box hull is gone by the time the traces are replayed
+	if (CM_IsBoxHull(headnode))
+		return;
+
+	bt = &cm_capture[cm_capturecount++];
+	VectorCopy (start, bt->start);
+	VectorCopy (end, bt->end);
+	VectorCopy (mins, bt->mins);
+	VectorCopy (maxs, bt->maxs);
+	bt->headnode = headnode;
+	bt->brushmask = brushmask;
+	bt->trace = *trace;
+}
+
+/*
+================
+CM_TraceCapture_f
+
+tracecapture [count], 0 stops capturing and keeps what was captured
+================
+*/
+void CM_TraceCapture_f (void)
+{
+	int		count;
+
+	if (Cmd_Argc () < 2)
+	{
+		Com_Printf ("%i traces captured on %s%s\n", cm_capturecount, cm_capturemap,
+			cm_capturecount < cm_capturesize ? ", capturing" : "");
+		return;
+	}
+
+	count = atoi (Cmd_Argv (1));
+	if (count <= 0)
+	{
+		cm_capturesize = cm_capturecount;
+		return;
+	}
+
+	if (!numnodes)
+	{
+		Com_Printf ("tracecapture: no map loaded\n");
+		return;
+	}
+
+	if (cm_capture)
+		Z_Free (cm_capture);
+
+	cm_capture = Z_Malloc (count * sizeof(boxtrace_t));
+	cm_capturesize = count;
+	cm_capturecount = 0;
+	strcpy (cm_capturemap, map_name);
+
+	Com_Printf ("capturing the next %i traces on %s\n", count, map_name);
+}
+
+static qboolean CM_TraceMatches (trace_t *a, trace_t *b)
+{
+	return a->fraction == b->fraction && a->allsolid == b->allsolid
+		&& a->startsolid == b->startsolid && a->contents == b->contents
+		&& a->surface == b->surface && VectorCompare (a->endpos, b->endpos)
+		&& VectorCompare (a->plane.normal, b->plane.normal) && a->plane.dist == b->plane.dist;
+}
+
+static int CM_TraceMismatches (boxtrace_t *traces)
+{
+	int		i, mismatches;
+
+	mismatches = 0;
+	for (i=0 ; i<cm_capturecount ; i++)
+		if (!CM_TraceMatches (&traces[i].trace, &cm_capture[i].trace))
+			mismatches++;
+
+	return mismatches;
+}
+
+typedef struct
+{
+	tracecontext_t	**contexts;		// one per job thread
+	boxtrace_t		*traces;
+} tracejobs_t;
+
+static void CM_TraceJob (void *data, int index, int thread)
+{
+	tracejobs_t	*jobs;
+	boxtrace_t	*bt;
+
+	jobs = (tracejobs_t *)data;
+	bt = &jobs->traces[index];
+	bt->trace = CM_ContextBoxTrace (jobs->contexts[thread], bt->start, bt->end,
+		bt->mins, bt->maxs, bt->headnode, bt->brushmask);
+}
+
+static void CM_PrintTraceBench (char *name, int msec, int passes, int mismatches)
+{
+	Com_Printf ("%-8s %5i ms, %8.1f traces/ms, %i mismatches\n", name, msec,
+		msec ? (float)cm_capturecount * passes / msec : 0.0f, mismatches);
+}
+
+/*
+================
+CM_TraceBench_f
+
+tracebench [passes]
+================
+*/
+void CM_TraceBench_f (void)
+{
+	int				passes;
+	int				i, p, start, msec;
+	int				numthreads;
+	boxtrace_t		*traces;
+	tracecontext_t	*tc;
+	tracecontext_t	**contexts;
+	tracejobs_t		jobs;
+
+	if (!cm_capturecount)
+	{
+		Com_Printf ("tracebench: nothing captured, use tracecapture first\n");
+		return;
+	}
+	if (strcmp (cm_capturemap, map_name))
+	{
+		Com_Printf ("tracebench: the traces were captured on %s\n", cm_capturemap);
+		return;
+	}
+
+	passes = Cmd_Argc () > 1 ? atoi (Cmd_Argv (1)) : 10;
+	if (passes < 1)
+		passes = 1;
+
+	// stop capturing, the replays don't go through CM_BoxTrace but the game may
+	cm_capturesize = cm_capturecount;
+
+	traces = Z_Malloc (cm_capturecount * sizeof(boxtrace_t));
+	tc = CM_AllocTraceContext ();
+
+	Com_Printf ("tracebench: %i traces on %s, %i passes\n", cm_capturecount, map_name, passes);
+
+	// one at a time, like the game does
+	memcpy (traces, cm_capture, cm_capturecount * sizeof(boxtrace_t));
+	start = Sys_Milliseconds ();
+	for (p=0 ; p<passes ; p++)
+	{
+		for (i=0 ; i<cm_capturecount ; i++)
+			traces[i].trace = CM_ContextBoxTrace (tc, traces[i].start, traces[i].end,
+				traces[i].mins, traces[i].maxs, traces[i].headnode, traces[i].brushmask);
+	}
+	msec = Sys_Milliseconds () - start;
+	CM_PrintTraceBench ("single", msec, passes, CM_TraceMismatches (traces));
+
+	// every pass is a frame, repeats within a pass come from the cache
+	CM_SetTraceCache (tc, true);
+	start = Sys_Milliseconds ();
+	for (p=0 ; p<passes ; p++)
+	{
+		CM_ClearTraceCache ();
+		for (i=0 ; i<cm_capturecount ; i++)
+			traces[i].trace = CM_ContextBoxTrace (tc, traces[i].start, traces[i].end,
+				traces[i].mins, traces[i].maxs, traces[i].headnode, traces[i].brushmask);
+	}
+	msec = Sys_Milliseconds () - start;
+	CM_PrintTraceBench ("cached", msec, passes, CM_TraceMismatches (traces));
+	Com_Printf ("%i of %i traces from the cache\n", CM_TraceCacheHits (tc), cm_capturecount * passes);
+	CM_SetTraceCache (tc, false);
+
+	// a context per job thread
+	numthreads = Sys_NumJobThreads ();
+	contexts = Z_Malloc (numthreads * sizeof(tracecontext_t *));
+	for (i=0 ; i<numthreads ; i++)
+		contexts[i] = CM_AllocTraceContext ();
+
+	jobs.contexts = contexts;
+	jobs.traces = traces;
+
+	start = Sys_Milliseconds ();
+	for (p=0 ; p<passes ; p++)
+		Sys_RunJobs (CM_TraceJob, &jobs, cm_capturecount, numthreads);
+	msec = Sys_Milliseconds () - start;
+	CM_PrintTraceBench (va("%i thread%s", numthreads, numthreads == 1 ? "" : "s"),
+		msec, passes, CM_TraceMismatches (traces));
+
+	for (i=0 ; i<numthreads ; i++)
+		CM_FreeTraceContext (contexts[i]);
+	Z_Free (contexts);
+
+	CM_FreeTraceContext (tc);
+	Z_Free (traces);
+}
+
+
 
 /*
 ===============================================================================
@@ -1569,25 +2004,171 @@ void CM_DecompressVis (byte *in, byte *out)
 	} while (out_p - out < row);
 }
 
-byte	pvsrow[MAX_MAP_LEAFS/8];
-byte	phsrow[MAX_MAP_LEAFS/8];
+/*
+===================
+Decompressed vis
+
+Rows are decompressed once instead of on every CM_ClusterPVS / CM_ClusterPHS
+call. When the numclusters * numclusters bit matrices for PVS and PHS fit in
+cm_vismatrix kilobytes every row is decompressed at load, the rows never
+change until the next map and can be read from any thread. Otherwise the
+most recently used rows are kept in a small cache, where a row stays valid
+until VISCACHE_ROWS other rows of the same kind have been decompressed.
+Rows are padded to a whole number of longs, as SV_FatPVS reads them
+===================
+*/
+#define	VISCACHE_ROWS	256
 
-byte	*CM_ClusterPVS (int cluster)
+typedef struct
 {
-	if (cluster == -1)
-		memset (pvsrow, 0, (numclusters+7)>>3);
-	else
-		CM_DecompressVis (map_visibility + map_vis->bitofs[cluster][DVIS_PVS], pvsrow);
-	return pvsrow;
+	byte	*rows;			// matrix, or VISCACHE_ROWS rows for the cache
+	int		*slotcluster;	// cache only, cluster held by each row, -1 if none
+	int		*slotused;		// cache only, use stamp of each row
+	int		*clusterslot;	// cache only, row holding each cluster, -1 if none
+	int		usestamp;
+	int		kind;			// DVIS_PVS or DVIS_PHS
+} viscache_t;
+
+static viscache_t	cm_pvscache = { NULL, NULL, NULL, NULL, 0, DVIS_PVS };
+static viscache_t	cm_phscache = { NULL, NULL, NULL, NULL, 0, DVIS_PHS };
+static qboolean		cm_vismatrixbuilt;
+static int			cm_visrowbytes;
+static byte			cm_nullrow[MAX_MAP_LEAFS/8];
+
+static void CM_FreeVisCache (viscache_t *cache)
+{
+	if (cache->rows)
+		Z_Free (cache->rows);
+	if (cache->slotcluster)
+		Z_Free (cache->slotcluster);
+	if (cache->slotused)
+		Z_Free (cache->slotused);
+	if (cache->clusterslot)
+		Z_Free (cache->clusterslot);
+
+	cache->rows = NULL;
+	cache->slotcluster = NULL;
+	cache->slotused = NULL;
+	cache->clusterslot = NULL;
+	cache->usestamp = 0;
+}
+
+static void CM_DecompressRow (viscache_t *cache, int cluster, byte *out)
+{
+	CM_DecompressVis (map_visibility + map_vis->bitofs[cluster][cache->kind], out);
+}
+
+static void CM_InitVisCache (viscache_t *cache, qboolean matrix)
+{
+	int		i;
+
+	CM_FreeVisCache (cache);
+
+	if (matrix)
+	{
+		cache->rows = Z_Malloc (numclusters * cm_visrowbytes);
+		for (i=0 ; i<numclusters ; i++)
+			CM_DecompressRow (cache, i, cache->rows + i * cm_visrowbytes);
+		return;
+	}
+
+	cache->rows = Z_Malloc (VISCACHE_ROWS * cm_visrowbytes);
+	cache->slotcluster = Z_Malloc (VISCACHE_ROWS * sizeof(int));
+	cache->slotused = Z_Malloc (VISCACHE_ROWS * sizeof(int));
+	cache->clusterslot = Z_Malloc (numclusters * sizeof(int));
+
+	for (i=0 ; i<VISCACHE_ROWS ; i++)
+		cache->slotcluster[i] = -1;
+	for (i=0 ; i<numclusters ; i++)
+		cache->clusterslot[i] = -1;
 }
 
-byte	*CM_ClusterPHS (int cluster)
+static byte *CM_VisCacheRow (viscache_t *cache, int cluster)
 {
+	int		i, slot;
+	byte	*row;
+
 	if (cluster == -1)
-		memset (phsrow, 0, (numclusters+7)>>3);
+		return cm_nullrow;
+
+	if (cm_vismatrixbuilt)
+		return cache->rows + cluster * cm_visrowbytes;
+
+	cache->usestamp++;
+
+	slot = cache->clusterslot[cluster];
+	if (slot != -1)
+	{
+		cache->slotused[slot] = cache->usestamp;
+		return cache->rows + slot * cm_visrowbytes;
+	}
+
+	// replace the least recently used row
+	slot = 0;
+	for (i=1 ; i<VISCACHE_ROWS ; i++)
+		if (cache->slotused[i] < cache->slotused[slot])
+			slot = i;
+
+	if (cache->slotcluster[slot] != -1)
+		cache->clusterslot[cache->slotcluster[slot]] = -1;
+
+	cache->slotcluster[slot] = cluster;
+	cache->slotused[slot] = cache->usestamp;
+	cache->clusterslot[cluster] = slot;
+
+	row = cache->rows + slot * cm_visrowbytes;
+	CM_DecompressRow (cache, cluster, row);
+
+	return row;
+}
+
+/*
+===================
+CM_BuildVisCache
+
+Called after the visibility lump is loaded
+===================
+*/
+void CM_BuildVisCache (void)
+{
+	int		matrixbytes;
+
+	cm_visrowbytes = ((numclusters+31)>>5)<<2;
+
+	matrixbytes = numclusters * cm_visrowbytes * 2;
+	cm_vismatrixbuilt = (!cm_vismatrix || matrixbytes <= cm_vismatrix->value * 1024);
+
+	CM_InitVisCache (&cm_pvscache, cm_vismatrixbuilt);
+	CM_InitVisCache (&cm_phscache, cm_vismatrixbuilt);
+
+	if (cm_vismatrixbuilt)
+		Com_Printf ("PVS/PHS: %i clusters, %i KB decompressed at load\n", numclusters, matrixbytes >> 10);
 	else
-		CM_DecompressVis (map_visibility + map_vis->bitofs[cluster][DVIS_PHS], phsrow);
-	return phsrow;
+		Com_Printf ("PVS/PHS: %i clusters, %i KB matrix over cm_vismatrix, %i KB row cache\n",
+			numclusters, matrixbytes >> 10, (VISCACHE_ROWS * cm_visrowbytes * 2) >> 10);
+}
+
+/*
+===================
+CM_VisRowsStable
+
+True when the rows returned by CM_ClusterPVS / CM_ClusterPHS stay valid
+until the next map, so they can be used from several threads
+===================
+*/
+qboolean CM_VisRowsStable (void)
+{
+	return cm_vismatrixbuilt;
+}
+
+const byte	*CM_ClusterPVS (int cluster)
+{
+	return CM_VisCacheRow (&cm_pvscache, cluster);
+}
+
+const byte	*CM_ClusterPHS (int cluster)
+{
+	return CM_VisCacheRow (&cm_phscache, cluster);
 }
 
 
@@ -1768,3 +2349,39 @@ qboolean CM_HeadnodeVisible (int nodenum, byte *visbits)
 	return CM_HeadnodeVisible(node->children[1], visbits);
 }
 
+/*
+=============
+CM_HeadnodeClusters
+
+Lists the clusters CM_HeadnodeVisible would test, so they can
+be tested against many vis rows without walking the nodes
+=============
+*/
+static int CM_HeadnodeClusters_r (int nodenum, int *list, int count, int listsize)
+{
+	int		cluster;
+	cnode_t	*node;
+
+	while (nodenum >= 0)
+	{
+		node = &map_nodes[nodenum];
+		count = CM_HeadnodeClusters_r (node->children[0], list, count, listsize);
+		if (count < 0)
+			return -1;
+		nodenum = node->children[1];
+	}
+
+	cluster = map_leafs[-1-nodenum].cluster;
+	if (cluster == -1)
+		return count;
+	if (count == listsize)
+		return -1;
+	list[count] = cluster;
+	return count + 1;
+}
+
+int CM_HeadnodeClusters (int headnode, int *list, int listsize)
+{
+	return CM_HeadnodeClusters_r (headnode, list, 0, listsize);
+}
+
@@ -20,6 +20,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // common.c -- misc functions used in client and server
 #include "qcommon.h"
 #include <setjmp.h>
+#include <stddef.h>
 
 #define	MAXPRINTMSG	4096
 
@@ -64,6 +65,7 @@ CLIENT / SERVER interactions
 */
 
 static int	rd_target;
+static int	rd_thread;			// only the thread that began it is redirected
 static char	*rd_buffer;
 static int	rd_buffersize;
 static void	(*rd_flush)(int target, char *buffer);
@@ -76,6 +78,7 @@ void Com_BeginRedirect (int target, char *buffer, int buffersize, void (*flush))
 	rd_buffer = buffer;
 	rd_buffersize = buffersize;
 	rd_flush = flush;
+	rd_thread = Sys_ThreadId ();
 
 	*rd_buffer = 0;
 }
@@ -85,11 +88,79 @@ void Com_EndRedirect (void)
 	rd_flush(rd_target, rd_buffer);
 
 	rd_target = 0;
+	rd_thread = 0;
 	rd_buffer = NULL;
 	rd_buffersize = 0;
 	rd_flush = NULL;
 }
 
+/*
+==============================================================================
+
+DEFERRED TEXT
+
+The server thread can't touch the console or the command buffer, so its
+prints and command text are queued here until the main thread runs
+Com_FlushDeferred.
+
+==============================================================================
+*/
+
+#define	DEFER_PRINTSIZE		0x8000
+#define	DEFER_CMDSIZE		0x2000
+
+static void	*com_deferlock;
+static char	com_deferprint[DEFER_PRINTSIZE];
+static int	com_deferprintlen;
+static char	com_defercmd[DEFER_CMDSIZE];
+static int	com_defercmdlen;
+
+static void Com_Defer (char *buffer, int *length, int size, char *text)
+{
+	int		l;
+
+	l = strlen (text);
+
+	Sys_LockMutex (com_deferlock);
+	if (*length + l < size)
+	{
+		memcpy (buffer + *length, text, l);
+		*length += l;
+		buffer[*length] = 0;
+	}
+	Sys_UnlockMutex (com_deferlock);
+}
+
+void Com_DeferCommand (char *text)
+{
+	Com_Defer (com_defercmd, &com_defercmdlen, sizeof(com_defercmd), text);
+}
+
+static void Com_PrintText (char *msg);
+
+void Com_FlushDeferred (void)
+{
+	static char	print[DEFER_PRINTSIZE];
+	static char	cmd[DEFER_CMDSIZE];
+
+	if (!com_deferprintlen && !com_defercmdlen)
+		return;
+
+	Sys_LockMutex (com_deferlock);
+	memcpy (print, com_deferprint, com_deferprintlen+1);
+	memcpy (cmd, com_defercmd, com_defercmdlen+1);
+	com_deferprintlen = com_defercmdlen = 0;
+	com_deferprint[0] = com_defercmd[0] = 0;
+	Sys_UnlockMutex (com_deferlock);
+
+	if (print[0])
+		Com_PrintText (print);
+	if (cmd[0])
+		Cbuf_AddText (cmd);
+}
+
+//============================================================================
+
 /*
 =============
 Com_Printf
@@ -107,7 +178,7 @@ void Com_Printf (char *fmt, ...)
 	vsprintf (msg,fmt,argptr);
 	va_end (argptr);
 
-	if (rd_target)
+	if (rd_target && rd_thread == Sys_ThreadId ())
 	{
 		if ((strlen (msg) + strlen(rd_buffer)) > (rd_buffersize - 1))
 		{
@@ -118,6 +189,24 @@ void Com_Printf (char *fmt, ...)
 		return;
 	}
 
+	if (!Sys_IsMainThread ())
+	{
+		Com_Defer (com_deferprint, &com_deferprintlen, sizeof(com_deferprint), msg);
+		return;
+	}
+
+	Com_PrintText (msg);
+}
+
+/*
+=============
+Com_PrintText
+
+Console, debugging console and logfile, main thread only
+=============
+*/
+static void Com_PrintText (char *msg)
+{
 	Con_Print (msg);
 		
 	// also echo to debugging console
@@ -178,16 +267,31 @@ do the apropriate things.
 void Com_Error (int code, char *fmt, ...)
 {
 	va_list		argptr;
-	static char		msg[MAXPRINTMSG];
-	static	qboolean	recursive;
+	static THREADLOCAL char		msg[MAXPRINTMSG];
+	static THREADLOCAL qboolean	recursive;
 
 	if (recursive)
 		Sys_Error ("recursive error after: %s", msg);
-	recursive = true;
 
 	va_start (argptr,fmt);
 	vsprintf (msg,fmt,argptr);
 	va_end (argptr);
+
+	// a job stops its batch, Sys_RunJobs raises the error again on
+	// the thread that ran it
+	Sys_JobError (code, msg);
+
+	recursive = true;
+
+	if (SV_IsServerThread ())
+	{
+		recursive = false;
+		SV_ThreadError (code, msg);
+	}
+
+	// any other thread has nowhere to unwind to
+	if (!Sys_IsMainThread ())
+		Sys_Error ("%s", msg);
 	
 	if (code == ERR_DISCONNECT)
 	{
@@ -198,13 +302,16 @@ void Com_Error (int code, char *fmt, ...)
 	else if (code == ERR_DROP)
 	{
 		Com_Printf ("********************\nERROR: %s\n********************\n", msg);
+		SV_Lock ();
 		SV_Shutdown (va("Server crashed: %s\n", msg), false);
+		SV_Unlock ();
 		CL_Drop ();
 		recursive = false;
 		longjmp (abortframe, -1);
 	}
 	else
 	{
+		SV_StopThread ();
 		SV_Shutdown (va("Server fatal crashed: %s\n", msg), false);
 		CL_Shutdown ();
 	}
@@ -229,6 +336,7 @@ do the apropriate things.
 */
 void Com_Quit (void)
 {
+	SV_StopThread ();
 	SV_Shutdown ("Server quit\n", false);
 	CL_Shutdown ();
 
@@ -466,22 +574,189 @@ void MSG_ReadDir (sizebuf_t *sb, vec3_t dir)
 }
 
 
+/*
+==============================================================================
+
+ENTITY DELTAS
+
+The entity_state_t is compared as words into a mask of the changed ones,
+which byte sized tables turn into the U_ bits. The fields that change
+width with their value are the only ones looked at one by one. A delta is
+at most ES_MAXBYTES, that room is checked once and the fields written
+through a pointer. Near the end of the buffer the checked MSG_Write calls
+are used so overflow is handled as before. The wire format is unchanged,
+deltabench checks it against the field by field versions kept here
+
+==============================================================================
+*/
+
+// word index of each entity_state_t field
+enum
+{
+	ES_NUMBER,
+	ES_ORIGIN,
+	ES_ANGLES = ES_ORIGIN+3,
+	ES_OLDORIGIN = ES_ANGLES+3,
+	ES_MODEL = ES_OLDORIGIN+3,
+	ES_MODEL2,
+	ES_MODEL3,
+	ES_MODEL4,
+	ES_FRAME,
+	ES_SKIN,
+	ES_EFFECTS,
+	ES_RENDERFX,
+	ES_SOLID,
+	ES_SOUND,
+	ES_EVENT,
+	ES_WORDS
+};
+
+// fails to compile if entity_state_t is no longer laid out as above
+typedef char es_layout_check[(sizeof(entity_state_t) == ES_WORDS*4
+	&& offsetof(entity_state_t, event) == ES_EVENT*4) ? 1 : -1];
+
+// bits, number, models, frame, skin, effects, renderfx, origin, angles,
+// old_origin, sound, event, solid
+#define	ES_MAXBYTES	(4 + 2 + 4 + 2 + 4 + 4 + 4 + 6 + 3 + 6 + 1 + 1 + 2)
+
+#define	ES_FLOATWORDS	(7<<ES_ORIGIN | 7<<ES_ANGLES)
+#define	ES_WIDTHWORDS	(1<<ES_FRAME | 1<<ES_SKIN | 1<<ES_EFFECTS | 1<<ES_RENDERFX)
+
+// U_ bits for each byte of the changed word mask
+static int	es_deltabits[3][256];
+
 /*
 ==================
-MSG_WriteDeltaEntity
+MSG_InitDeltaEntity
+==================
+*/
+void MSG_InitDeltaEntity (void)
+{
+	static const int	wordbits[ES_WORDS] =
+	{
+		0,
+		U_ORIGIN1, U_ORIGIN2, U_ORIGIN3,
+		U_ANGLE1, U_ANGLE2, U_ANGLE3,
+		0, 0, 0,				// old_origin is sent by U_OLDORIGIN
+		U_MODEL, U_MODEL2, U_MODEL3, U_MODEL4,
+		0, 0, 0, 0,				// ES_WIDTHWORDS
+		U_SOLID,
+		U_SOUND,
+		0						// event is only 0 compressed
+	};
+	int		i, j, w;
+
+	for (i=0 ; i<3 ; i++)
+	{
+		for (j=0 ; j<256 ; j++)
+		{
+			es_deltabits[i][j] = 0;
+			for (w=0 ; w<8 && i*8+w<ES_WORDS ; w++)
+				if (j & (1<<w))
+					es_deltabits[i][j] |= wordbits[i*8+w];
+		}
+	}
+}
 
-Writes part of a packetentities message.
-Can delta from either a baseline or a previous packet_entity
+/*
+==================
+MSG_DeltaEntityBits
+
+The U_ bits for a delta, the same as MSG_DeltaEntityBitsRef
 ==================
 */
-void MSG_WriteDeltaEntity (entity_state_t *from, entity_state_t *to, sizebuf_t *msg, qboolean force, qboolean newentity)
+static int MSG_DeltaEntityBits (entity_state_t *from, entity_state_t *to, qboolean newentity)
 {
-	int		bits;
+	const int	*f, *t;
+	unsigned	diff;
+	int			i, bits;
 
-	if (!to->number)
-		Com_Error (ERR_FATAL, "Unset entity number");
-	if (to->number >= MAX_EDICTS)
-		Com_Error (ERR_FATAL, "Entity number >= MAX_EDICTS");
+	f = (const int *)from;
+	t = (const int *)to;
+
+	diff = 0;
+	for (i=1 ; i<ES_WORDS ; i++)
+		diff |= (unsigned)(f[i] != t[i]) << i;
+
+	// the fields are compared as floats, -0 and 0 are the same
+	if (diff & ES_FLOATWORDS)
+	{
+		for (i=0 ; i<3 ; i++)
+		{
+			if (to->origin[i] == from->origin[i])
+				diff &= ~(1<<(ES_ORIGIN+i));
+			if (to->angles[i] == from->angles[i])
+				diff &= ~(1<<(ES_ANGLES+i));
+		}
+	}
+
+	bits = es_deltabits[0][diff & 255] | es_deltabits[1][(diff>>8) & 255]
+		| es_deltabits[2][diff>>16];
+
+	if (to->number >= 256)
+		bits |= U_NUMBER16;		// number8 is implicit otherwise
+
+	if (diff & ES_WIDTHWORDS)
+	{
+		if (diff & (1<<ES_SKIN))
+		{
+			if ((unsigned)to->skinnum < 256)
+				bits |= U_SKIN8;
+			else if ((unsigned)to->skinnum < 0x10000)
+				bits |= U_SKIN16;
+			else
+				bits |= (U_SKIN8|U_SKIN16);
+		}
+
+		if (diff & (1<<ES_FRAME))
+		{
+			if (to->frame < 256)
+				bits |= U_FRAME8;
+			else
+				bits |= U_FRAME16;
+		}
+
+		if (diff & (1<<ES_EFFECTS))
+		{
+			if (to->effects < 256)
+				bits |= U_EFFECTS8;
+			else if (to->effects < 0x8000)
+				bits |= U_EFFECTS16;
+			else
+				bits |= U_EFFECTS8|U_EFFECTS16;
+		}
+
+		if (diff & (1<<ES_RENDERFX))
+		{
+			if (to->renderfx < 256)
+				bits |= U_RENDERFX8;
+			else if (to->renderfx < 0x8000)
+				bits |= U_RENDERFX16;
+			else
+				bits |= U_RENDERFX8|U_RENDERFX16;
+		}
+	}
+
+	// event is not delta compressed, just 0 compressed
+	if (to->event)
+		bits |= U_EVENT;
+
+	if (newentity || (to->renderfx & RF_BEAM))
+		bits |= U_OLDORIGIN;
+
+	return bits;
+}
+
+/*
+==================
+MSG_DeltaEntityBitsRef
+
+The original field by field compare
+==================
+*/
+static int MSG_DeltaEntityBitsRef (entity_state_t *from, entity_state_t *to, qboolean newentity)
+{
+	int		bits;
 
 // send an update
 	bits = 0;
@@ -563,14 +838,18 @@ void MSG_WriteDeltaEntity (entity_state_t *from, entity_state_t *to, sizebuf_t *
 	if (newentity || (to->renderfx & RF_BEAM))
 		bits |= U_OLDORIGIN;
 
-	//
-	// write the message
-	//
-	if (!bits && !force)
-		return;		// nothing to send!
+	return bits;
+}
 
-	//----------
+/*
+==================
+MSG_WriteEntityBits
 
+Writes a delta with the checked MSG_Write calls
+==================
+*/
+static void MSG_WriteEntityBits (entity_state_t *to, sizebuf_t *msg, int bits)
+{
 	if (bits & 0xff000000)
 		bits |= U_MOREBITS3 | U_MOREBITS2 | U_MOREBITS1;
 	else if (bits & 0x00ff0000)
@@ -668,6 +947,158 @@ void MSG_WriteDeltaEntity (entity_state_t *from, entity_state_t *to, sizebuf_t *
 		MSG_WriteShort (msg, to->solid);
 }
 
+/*
+==================
+MSG_WriteEntityBitsFast
+
+Writes a delta to room the caller has checked
+==================
+*/
+#define	ES_WBYTE(c)		(*p++ = (byte)(c))
+#define	ES_WSHORT(c)	(p[0] = (c)&0xff, p[1] = ((c)>>8)&0xff, p += 2)
+#define	ES_WLONG(c)		(p[0] = (c)&0xff, p[1] = ((c)>>8)&0xff, p[2] = ((c)>>16)&0xff, p[3] = ((c)>>24)&0xff, p += 4)
+#define	ES_WCOORD(f)	ES_WSHORT((int)((f)*8))
+#define	ES_WANGLE(f)	ES_WBYTE((int)((f)*256/360) & 255)
+
+static void MSG_WriteEntityBitsFast (entity_state_t *to, sizebuf_t *msg, int bits)
+{
+	byte	*p;
+
+	p = msg->data + msg->cursize;
+
+	if (bits & 0xff000000)
+		bits |= U_MOREBITS3 | U_MOREBITS2 | U_MOREBITS1;
+	else if (bits & 0x00ff0000)
+		bits |= U_MOREBITS2 | U_MOREBITS1;
+	else if (bits & 0x0000ff00)
+		bits |= U_MOREBITS1;
+
+	ES_WBYTE (bits);
+	if (bits & U_MOREBITS1)
+		ES_WBYTE (bits>>8);
+	if (bits & U_MOREBITS2)
+		ES_WBYTE (bits>>16);
+	if (bits & U_MOREBITS3)
+		ES_WBYTE (bits>>24);
+
+	if (bits & U_NUMBER16)
+		ES_WSHORT (to->number);
+	else
+		ES_WBYTE (to->number);
+
+	if (bits & U_MODEL)
+		ES_WBYTE (to->modelindex);
+	if (bits & U_MODEL2)
+		ES_WBYTE (to->modelindex2);
+	if (bits & U_MODEL3)
+		ES_WBYTE (to->modelindex3);
+	if (bits & U_MODEL4)
+		ES_WBYTE (to->modelindex4);
+
+	if (bits & U_FRAME8)
+		ES_WBYTE (to->frame);
+	if (bits & U_FRAME16)
+		ES_WSHORT (to->frame);
+
+	if ((bits & U_SKIN8) && (bits & U_SKIN16))		//used for laser colors
+		ES_WLONG (to->skinnum);
+	else if (bits & U_SKIN8)
+		ES_WBYTE (to->skinnum);
+	else if (bits & U_SKIN16)
+		ES_WSHORT (to->skinnum);
+
+	if ( (bits & (U_EFFECTS8|U_EFFECTS16)) == (U_EFFECTS8|U_EFFECTS16) )
+		ES_WLONG (to->effects);
+	else if (bits & U_EFFECTS8)
+		ES_WBYTE (to->effects);
+	else if (bits & U_EFFECTS16)
+		ES_WSHORT (to->effects);
+
+	if ( (bits & (U_RENDERFX8|U_RENDERFX16)) == (U_RENDERFX8|U_RENDERFX16) )
+		ES_WLONG (to->renderfx);
+	else if (bits & U_RENDERFX8)
+		ES_WBYTE (to->renderfx);
+	else if (bits & U_RENDERFX16)
+		ES_WSHORT (to->renderfx);
+
+	if (bits & U_ORIGIN1)
+		ES_WCOORD (to->origin[0]);
+	if (bits & U_ORIGIN2)
+		ES_WCOORD (to->origin[1]);
+	if (bits & U_ORIGIN3)
+		ES_WCOORD (to->origin[2]);
+
+	if (bits & U_ANGLE1)
+		ES_WANGLE (to->angles[0]);
+	if (bits & U_ANGLE2)
+		ES_WANGLE (to->angles[1]);
+	if (bits & U_ANGLE3)
+		ES_WANGLE (to->angles[2]);
+
+	if (bits & U_OLDORIGIN)
+	{
+		ES_WCOORD (to->old_origin[0]);
+		ES_WCOORD (to->old_origin[1]);
+		ES_WCOORD (to->old_origin[2]);
+	}
+
+	if (bits & U_SOUND)
+		ES_WBYTE (to->sound);
+	if (bits & U_EVENT)
+		ES_WBYTE (to->event);
+	if (bits & U_SOLID)
+		ES_WSHORT (to->solid);
+
+	msg->cursize = p - msg->data;
+}
+
+/*
+==================
+MSG_WriteDeltaEntity
+
+Writes part of a packetentities message.
+Can delta from either a baseline or a previous packet_entity
+==================
+*/
+void MSG_WriteDeltaEntity (entity_state_t *from, entity_state_t *to, sizebuf_t *msg, qboolean force, qboolean newentity)
+{
+	int		bits;
+
+	if (!to->number)
+		Com_Error (ERR_FATAL, "Unset entity number");
+	if (to->number >= MAX_EDICTS)
+		Com_Error (ERR_FATAL, "Entity number >= MAX_EDICTS");
+
+	bits = MSG_DeltaEntityBits (from, to, newentity);
+
+	if (!bits && !force)
+		return;		// nothing to send!
+
+	if (msg->cursize + ES_MAXBYTES <= msg->maxsize)
+		MSG_WriteEntityBitsFast (to, msg, bits);
+	else
+		MSG_WriteEntityBits (to, msg, bits);
+}
+
+/*
+==================
+MSG_WriteDeltaEntityRef
+
+MSG_WriteDeltaEntity as it was, for deltabench
+==================
+*/
+static void MSG_WriteDeltaEntityRef (entity_state_t *from, entity_state_t *to, sizebuf_t *msg, qboolean force, qboolean newentity)
+{
+	int		bits;
+
+	bits = MSG_DeltaEntityBitsRef (from, to, newentity);
+
+	if (!bits && !force)
+		return;		// nothing to send!
+
+	MSG_WriteEntityBits (to, msg, bits);
+}
+
 
 //============================================================
 
@@ -766,7 +1197,7 @@ float MSG_ReadFloat (sizebuf_t *msg_read)
 
 char *MSG_ReadString (sizebuf_t *msg_read)
 {
-	static char	string[2048];
+	static THREADLOCAL char	string[2048];	// one per thread
 	int		l,c;
 	
 	l = 0;
@@ -786,7 +1217,7 @@ char *MSG_ReadString (sizebuf_t *msg_read)
 
 char *MSG_ReadStringLine (sizebuf_t *msg_read)
 {
-	static char	string[2048];
+	static THREADLOCAL char	string[2048];	// one per thread
 	int		l,c;
 	
 	l = 0;
@@ -873,23 +1304,522 @@ void MSG_ReadData (sizebuf_t *msg_read, void *data, int len)
 		((byte *)data)[i] = MSG_ReadByte (msg_read);
 }
 
+/*
+==================
+MSG_ReadEntityBits
 
-//===========================================================================
-
-void SZ_Init (sizebuf_t *buf, byte *data, int length)
+The bits and number ahead of a delta, CL_ParseEntityBits without the
+net profiling
+==================
+*/
+int MSG_ReadEntityBits (sizebuf_t *msg, int *bits)
 {
-	memset (buf, 0, sizeof(*buf));
-	buf->data = data;
-	buf->maxsize = length;
-}
+	int		total;
 
-void SZ_Clear (sizebuf_t *buf)
-{
-	buf->cursize = 0;
-	buf->overflowed = false;
+	total = MSG_ReadByte (msg);
+	if (total & U_MOREBITS1)
+		total |= MSG_ReadByte (msg)<<8;
+	if (total & U_MOREBITS2)
+		total |= MSG_ReadByte (msg)<<16;
+	if (total & U_MOREBITS3)
+		total |= MSG_ReadByte (msg)<<24;
+
+	*bits = total;
+
+	if (total & U_NUMBER16)
+		return MSG_ReadShort (msg);
+	return MSG_ReadByte (msg);
 }
 
-void *SZ_GetSpace (sizebuf_t *buf, int length)
+/*
+==================
+MSG_ReadDeltaEntityRef
+
+The field by field parse CL_ParseDelta did, it also reads near the end of
+a message where the MSG_Read calls handle running out
+==================
+*/
+static void MSG_ReadDeltaEntityRef (sizebuf_t *msg, entity_state_t *from, entity_state_t *to, int number, int bits)
+{
+	// set everything to the state we are delta'ing from
+	*to = *from;
+
+	VectorCopy (from->origin, to->old_origin);
+	to->number = number;
+
+	if (bits & U_MODEL)
+		to->modelindex = MSG_ReadByte (msg);
+	if (bits & U_MODEL2)
+		to->modelindex2 = MSG_ReadByte (msg);
+	if (bits & U_MODEL3)
+		to->modelindex3 = MSG_ReadByte (msg);
+	if (bits & U_MODEL4)
+		to->modelindex4 = MSG_ReadByte (msg);
+		
+	if (bits & U_FRAME8)
+		to->frame = MSG_ReadByte (msg);
+	if (bits & U_FRAME16)
+		to->frame = MSG_ReadShort (msg);
+
+	if ((bits & U_SKIN8) && (bits & U_SKIN16))		//used for laser colors
+		to->skinnum = MSG_ReadLong(msg);
+	else if (bits & U_SKIN8)
+		to->skinnum = MSG_ReadByte(msg);
+	else if (bits & U_SKIN16)
+		to->skinnum = MSG_ReadShort(msg);
+
+	if ( (bits & (U_EFFECTS8|U_EFFECTS16)) == (U_EFFECTS8|U_EFFECTS16) )
+		to->effects = MSG_ReadLong(msg);
+	else if (bits & U_EFFECTS8)
+		to->effects = MSG_ReadByte(msg);
+	else if (bits & U_EFFECTS16)
+		to->effects = MSG_ReadShort(msg);
+
+	if ( (bits & (U_RENDERFX8|U_RENDERFX16)) == (U_RENDERFX8|U_RENDERFX16) )
+		to->renderfx = MSG_ReadLong(msg);
+	else if (bits & U_RENDERFX8)
+		to->renderfx = MSG_ReadByte(msg);
+	else if (bits & U_RENDERFX16)
+		to->renderfx = MSG_ReadShort(msg);
+
+	if (bits & U_ORIGIN1)
+		to->origin[0] = MSG_ReadCoord (msg);
+	if (bits & U_ORIGIN2)
+		to->origin[1] = MSG_ReadCoord (msg);
+	if (bits & U_ORIGIN3)
+		to->origin[2] = MSG_ReadCoord (msg);
+		
+	if (bits & U_ANGLE1)
+		to->angles[0] = MSG_ReadAngle(msg);
+	if (bits & U_ANGLE2)
+		to->angles[1] = MSG_ReadAngle(msg);
+	if (bits & U_ANGLE3)
+		to->angles[2] = MSG_ReadAngle(msg);
+
+	if (bits & U_OLDORIGIN)
+		MSG_ReadPos (msg, to->old_origin);
+
+	if (bits & U_SOUND)
+		to->sound = MSG_ReadByte (msg);
+
+	if (bits & U_EVENT)
+		to->event = MSG_ReadByte (msg);
+	else
+		to->event = 0;
+
+	if (bits & U_SOLID)
+		to->solid = MSG_ReadShort (msg);
+}
+
+/*
+==================
+MSG_ReadDeltaEntity
+
+Reads the fields of a delta whose bits and number have been read.
+Can go from either a baseline or a previous packet_entity
+==================
+*/
+#define	ES_RBYTE()		(p += 1, p[-1])
+#define	ES_RSHORT()		(p += 2, (short)(p[-2] + (p[-1]<<8)))
+#define	ES_RLONG()		(p += 4, (int)(p[-4] + (p[-3]<<8) + (p[-2]<<16) + ((unsigned)p[-1]<<24)))
+#define	ES_RCOORD()		(ES_RSHORT() * (1.0/8))
+#define	ES_RANGLE()		((p += 1, (signed char)p[-1]) * (360.0/256))
+
+void MSG_ReadDeltaEntity (sizebuf_t *msg, entity_state_t *from, entity_state_t *to, int number, int bits)
+{
+	byte	*p;
+
+	if (msg->readcount + ES_MAXBYTES > msg->cursize)
+	{
+		MSG_ReadDeltaEntityRef (msg, from, to, number, bits);
+		return;
+	}
+
+	p = msg->data + msg->readcount;
+
+	// set everything to the state we are delta'ing from
+	*to = *from;
+
+	VectorCopy (from->origin, to->old_origin);
+	to->number = number;
+
+	if (bits & (U_MODEL|U_MODEL2|U_MODEL3|U_MODEL4))
+	{
+		if (bits & U_MODEL)
+			to->modelindex = ES_RBYTE ();
+		if (bits & U_MODEL2)
+			to->modelindex2 = ES_RBYTE ();
+		if (bits & U_MODEL3)
+			to->modelindex3 = ES_RBYTE ();
+		if (bits & U_MODEL4)
+			to->modelindex4 = ES_RBYTE ();
+	}
+
+	if (bits & U_FRAME8)
+		to->frame = ES_RBYTE ();
+	if (bits & U_FRAME16)
+		to->frame = ES_RSHORT ();
+
+	if ((bits & U_SKIN8) && (bits & U_SKIN16))		//used for laser colors
+		to->skinnum = ES_RLONG ();
+	else if (bits & U_SKIN8)
+		to->skinnum = ES_RBYTE ();
+	else if (bits & U_SKIN16)
+		to->skinnum = ES_RSHORT ();
+
+	if ( (bits & (U_EFFECTS8|U_EFFECTS16)) == (U_EFFECTS8|U_EFFECTS16) )
+		to->effects = ES_RLONG ();
+	else if (bits & U_EFFECTS8)
+		to->effects = ES_RBYTE ();
+	else if (bits & U_EFFECTS16)
+		to->effects = ES_RSHORT ();
+
+	if ( (bits & (U_RENDERFX8|U_RENDERFX16)) == (U_RENDERFX8|U_RENDERFX16) )
+		to->renderfx = ES_RLONG ();
+	else if (bits & U_RENDERFX8)
+		to->renderfx = ES_RBYTE ();
+	else if (bits & U_RENDERFX16)
+		to->renderfx = ES_RSHORT ();
+
+	if (bits & U_ORIGIN1)
+		to->origin[0] = ES_RCOORD ();
+	if (bits & U_ORIGIN2)
+		to->origin[1] = ES_RCOORD ();
+	if (bits & U_ORIGIN3)
+		to->origin[2] = ES_RCOORD ();
+
+	if (bits & U_ANGLE1)
+		to->angles[0] = ES_RANGLE ();
+	if (bits & U_ANGLE2)
+		to->angles[1] = ES_RANGLE ();
+	if (bits & U_ANGLE3)
+		to->angles[2] = ES_RANGLE ();
+
+	if (bits & U_OLDORIGIN)
+	{
+		to->old_origin[0] = ES_RCOORD ();
+		to->old_origin[1] = ES_RCOORD ();
+		to->old_origin[2] = ES_RCOORD ();
+	}
+
+	if (bits & U_SOUND)
+		to->sound = ES_RBYTE ();
+
+	if (bits & U_EVENT)
+		to->event = ES_RBYTE ();
+	else
+		to->event = 0;
+
+	if (bits & U_SOLID)
+		to->solid = ES_RSHORT ();
+
+	msg->readcount = p - msg->data;
+}
+
+/*
+==================
+MSG_DeltaBench_f
+
+deltabench [entities] [passes]
+
+Fuzzes random entity pairs through both encoders and both decoders. The
+bytes written must match and the states read back must match each other
+and what was sent, to the wire precision. Then times each side in
+entities per second
+==================
+*/
+static unsigned	deltabench_seed;
+
+static int MSG_DeltaBenchRand (void)
+{
+	deltabench_seed = deltabench_seed * 1103515245 + 12345;
+	return (deltabench_seed >> 8) & 0xffffff;
+}
+
+// now and then a 0 or a -0, which compare equal as floats
+static float MSG_DeltaBenchZero (float f)
+{
+	int		r;
+
+	r = MSG_DeltaBenchRand ();
+	if (r & 15)
+		return f;
+	return (r & 16) ? -0.0f : 0.0f;
+}
+
+// a value on the 1/8 grid coords are sent on
+static float MSG_DeltaBenchCoord (void)
+{
+	return MSG_DeltaBenchZero (((MSG_DeltaBenchRand () & 0xffff) - 0x8000) * (1.0f/8));
+}
+
+// a width picked so every encoding of the field gets used
+static int MSG_DeltaBenchWidth (int max)
+{
+	switch (MSG_DeltaBenchRand () & 3)
+	{
+	case 0:
+		return MSG_DeltaBenchRand () & 0xff;
+	case 1:
+		return MSG_DeltaBenchRand () & 0x7fff;
+	default:
+		return MSG_DeltaBenchRand () % max;
+	}
+}
+
+static void MSG_DeltaBenchState (entity_state_t *base, entity_state_t *es)
+{
+	int		i, keep;
+
+	// keep some of the fields, deltas are mostly a few changes
+	*es = *base;
+	keep = MSG_DeltaBenchRand ();
+	if (!(keep & 7))
+		keep = 0;
+
+	es->number = 1 + MSG_DeltaBenchRand () % (MAX_EDICTS-1);
+	for (i=0 ; i<3 ; i++)
+	{
+		if (!(keep & (1<<i)))
+			es->origin[i] = MSG_DeltaBenchCoord ();
+		if (!(keep & (8<<i)))
+			es->angles[i] = MSG_DeltaBenchZero (((MSG_DeltaBenchRand () & 0xffff) - 0x8000) * (1.0f/64));
+		es->old_origin[i] = MSG_DeltaBenchCoord ();
+	}
+	if (!(keep & 0x40))
+		es->modelindex = MSG_DeltaBenchRand () & 255;
+	if (!(keep & 0x80))
+		es->modelindex2 = MSG_DeltaBenchRand () & 255;
+	if (!(keep & 0x100))
+		es->modelindex3 = MSG_DeltaBenchRand () & 255;
+	if (!(keep & 0x200))
+		es->modelindex4 = MSG_DeltaBenchRand () & 255;
+	if (!(keep & 0x400))
+		es->frame = MSG_DeltaBenchWidth (0x8000);
+	if (!(keep & 0x800))
+	{
+		// skin16 is read back signed
+		es->skinnum = MSG_DeltaBenchWidth (0x1000000);
+		if (es->skinnum >= 0x8000 && es->skinnum < 0x10000)
+			es->skinnum |= 0x10000;
+	}
+	if (!(keep & 0x1000))
+		es->effects = MSG_DeltaBenchWidth (0x1000000);
+	if (!(keep & 0x2000))
+		es->renderfx = MSG_DeltaBenchWidth (0x1000000);
+	if (!(keep & 0x4000))
+		es->solid = MSG_DeltaBenchRand () & 0x7fff;
+	if (!(keep & 0x8000))
+		es->sound = MSG_DeltaBenchRand () & 255;
+	es->event = (keep & 0x30000) ? 0 : MSG_DeltaBenchRand () & 255;
+}
+
+// the state the client should see for a delta from base to es
+static qboolean MSG_DeltaBenchCompare (entity_state_t *base, entity_state_t *es, entity_state_t *read)
+{
+	int		i;
+	float	d;
+
+	if (read->number != es->number || read->modelindex != es->modelindex
+		|| read->modelindex2 != es->modelindex2 || read->modelindex3 != es->modelindex3
+		|| read->modelindex4 != es->modelindex4 || read->frame != es->frame
+		|| read->skinnum != es->skinnum || read->effects != es->effects
+		|| read->renderfx != es->renderfx || read->solid != es->solid
+		|| read->sound != es->sound || read->event != es->event)
+		return false;
+
+	for (i=0 ; i<3 ; i++)
+	{
+		if (read->origin[i] != es->origin[i])
+			return false;
+		// old_origin is the previous origin unless it was sent
+		if (read->old_origin[i] != es->old_origin[i] && read->old_origin[i] != base->origin[i])
+			return false;
+		// angles are truncated to 1/256 of a turn
+		d = fabs (anglemod (read->angles[i]) - anglemod (es->angles[i]));
+		if (d > 360.0/256 + 0.01 && d < 360 - 360.0/256 - 0.01)
+			return false;
+	}
+	return true;
+}
+
+void MSG_DeltaBench_f (void)
+{
+	int				numents, passes;
+	int				i, j, n, bits, number, size;
+	int				errors, first, end;
+	unsigned		start, usec[4];
+	entity_state_t	*base, *ents, *read;
+	entity_state_t	readref;
+	byte			*buf[2];
+	sizebuf_t		msg[2];
+	qboolean		force, newentity;
+	double			scale;
+
+	numents = Cmd_Argc () > 1 ? atoi (Cmd_Argv (1)) : 4096;
+	passes = Cmd_Argc () > 2 ? atoi (Cmd_Argv (2)) : 100;
+	if (numents < 1)
+		numents = 1;
+	if (passes < 1)
+		passes = 1;
+
+	base = Z_Malloc (numents * 3 * sizeof(entity_state_t));
+	ents = base + numents;
+	read = ents + numents;
+	size = (numents + 1) * (ES_MAXBYTES + 1);
+	buf[0] = Z_Malloc (size);
+	buf[1] = Z_Malloc (size);
+
+	// fuzz
+	deltabench_seed = 1;
+	memset (base, 0, sizeof(*base));
+	for (i=0 ; i<numents ; i++)
+	{
+		MSG_DeltaBenchState (i ? &ents[i-1] : base, &base[i]);
+		MSG_DeltaBenchState (&base[i], &ents[i]);
+	}
+
+	errors = 0;
+	for (i=0 ; i<numents ; i++)
+	{
+		force = (MSG_DeltaBenchRand () & 3) == 0;
+		newentity = (MSG_DeltaBenchRand () & 3) == 0;
+		if (!(MSG_DeltaBenchRand () & 15))
+			ents[i] = base[i];		// nothing changed
+
+		// the last entities are written near the end of the buffer so
+		// the checked writer and reader are fuzzed too
+		first = i >= numents - 4 ? size - ES_MAXBYTES + 1 : 0;
+
+		for (j=0 ; j<2 ; j++)
+		{
+			SZ_Init (&msg[j], buf[j], size);
+			msg[j].allowoverflow = true;
+			msg[j].cursize = first;
+		}
+
+		MSG_WriteDeltaEntityRef (&base[i], &ents[i], &msg[0], force, newentity);
+		MSG_WriteDeltaEntity (&base[i], &ents[i], &msg[1], force, newentity);
+
+		if (msg[0].cursize != msg[1].cursize || msg[0].overflowed != msg[1].overflowed
+			|| memcmp (buf[0], buf[1], msg[0].cursize))
+		{
+			if (errors++ < 4)
+				Com_Printf ("deltabench: entity %i written differently\n", i);
+			continue;
+		}
+		if (msg[0].overflowed)
+			continue;
+
+		for (j=0 ; j<2 ; j++)
+		{
+			// pad as the rest of a packet would, so the pointer reads
+			// are taken away from the end
+			end = msg[j].cursize;
+			if (!first)
+				msg[j].cursize += ES_MAXBYTES;
+			msg[j].readcount = first;
+			if (first == end)
+				break;		// not sent
+
+			number = MSG_ReadEntityBits (&msg[j], &bits);
+			if (j)
+				MSG_ReadDeltaEntity (&msg[j], &base[i], &read[i], number, bits);
+			else
+				MSG_ReadDeltaEntityRef (&msg[j], &base[i], &readref, number, bits);
+
+			if (msg[j].readcount != end)
+			{
+				if (errors++ < 4)
+					Com_Printf ("deltabench: entity %i read %i of %i bytes\n", i, msg[j].readcount - first, end - first);
+				break;
+			}
+		}
+		if (j < 2)
+			continue;
+
+		if (memcmp (&readref, &read[i], sizeof(readref)))
+		{
+			if (errors++ < 4)
+				Com_Printf ("deltabench: entity %i read differently\n", i);
+		}
+		else if (!MSG_DeltaBenchCompare (&base[i], &ents[i], &read[i]))
+		{
+			if (errors++ < 4)
+				Com_Printf ("deltabench: entity %i did not round trip\n", i);
+		}
+	}
+
+	// time whole packets of deltas, as SV_EmitPacketEntities and
+	// CL_ParsePacketEntities see them
+	memset (usec, 0, sizeof(usec));
+	for (n=0 ; n<passes ; n++)
+	{
+		for (j=0 ; j<2 ; j++)
+		{
+			SZ_Init (&msg[j], buf[j], size);
+			start = Sys_Microseconds ();
+			if (j)
+				for (i=0 ; i<numents ; i++)
+					MSG_WriteDeltaEntity (&base[i], &ents[i], &msg[j], true, false);
+			else
+				for (i=0 ; i<numents ; i++)
+					MSG_WriteDeltaEntityRef (&base[i], &ents[i], &msg[j], true, false);
+			usec[j] += Sys_Microseconds () - start;
+		}
+
+		for (j=0 ; j<2 ; j++)
+		{
+			start = Sys_Microseconds ();
+			for (i=0 ; i<numents ; i++)
+			{
+				number = MSG_ReadEntityBits (&msg[j], &bits);
+				if (j)
+					MSG_ReadDeltaEntity (&msg[j], &base[i], &read[i], number, bits);
+				else
+					MSG_ReadDeltaEntityRef (&msg[j], &base[i], &read[i], number, bits);
+			}
+			usec[2+j] += Sys_Microseconds () - start;
+		}
+	}
+
+	Z_Free (buf[1]);
+	Z_Free (buf[0]);
+	Z_Free (base);
+
+	scale = (double)numents * passes * 1000000.0;
+	for (j=0 ; j<4 ; j++)
+		if (!usec[j])
+			usec[j] = 1;
+
+	Com_Printf ("deltabench: %i entities, %i passes, %i bytes a packet\n", numents, passes, msg[1].cursize);
+	if (errors)
+		Com_Printf ("fuzz:   %i of %i entities FAILED\n", errors, numents);
+	else
+		Com_Printf ("fuzz:   %i entities round tripped\n", numents);
+	Com_Printf ("write:  %10.0f ents/s field by field, %10.0f ents/s word compare\n",
+		scale / usec[0], scale / usec[1]);
+	Com_Printf ("read:   %10.0f ents/s checked reads,  %10.0f ents/s pointer reads\n",
+		scale / usec[2], scale / usec[3]);
+}
+
+
+//===========================================================================
+
+void SZ_Init (sizebuf_t *buf, byte *data, int length)
+{
+	memset (buf, 0, sizeof(*buf));
+	buf->data = data;
+	buf->maxsize = length;
+}
+
+void SZ_Clear (sizebuf_t *buf)
+{
+	buf->cursize = 0;
+	buf->overflowed = false;
+}
+
+void *SZ_GetSpace (sizebuf_t *buf, int length)
 {
 	void	*data;
 	
@@ -1089,24 +2019,181 @@ void Info_Print (char *s)
 
 						ZONE MEMORY ALLOCATION
 
-just cleared malloc with counters now...
+Every tag has its own arena.  Blocks up to Z_MAXSMALL bytes are carved
+out of the arena's chunks in a fixed set of size classes, and freed ones
+go back on the arena's free list for their class.  Bigger blocks are
+malloced on their own and chained to the arena.  Z_FreeTags drops a whole
+arena at once without walking its small blocks, and keeps the chunks
+around for the next level.
 
 ==============================================================================
 */
 
 #define	Z_MAGIC		0x1d1d
 
+#define	Z_CHUNKSIZE			0x10000		// small blocks are carved from these
+#define	Z_MAXSMALL			8192		// anything bigger is malloced on its own
+#define	Z_NUMCLASSES		17
+#define	Z_MAXARENAS			32
+#define	Z_MAXSPARECHUNKS	64			// kept after Z_FreeTags for the next level
+#define	Z_HISTBUCKETS		24
+#define	Z_BENCHTAG			32000
 
 typedef struct zhead_s
 {
-	struct zhead_s	*prev, *next;
+	struct zhead_s	*prev, *next;	// arena chain when large, free list when small
+	struct zarena_s	*arena;
 	short	magic;
 	short	tag;			// for group free
-	int		size;
+	int		size;			// including the header, rounded up to the class
 } zhead_t;
 
-zhead_t		z_chain;
+typedef struct zchunk_s
+{
+	struct zchunk_s	*next;
+	int		used;			// bytes carved so far, including Z_CHUNKHEAD
+} zchunk_t;
+
+#define	Z_CHUNKHEAD		((sizeof(zchunk_t)+15)&~15)
+
+typedef struct zarena_s
+{
+	int			tag;
+	zchunk_t	*chunks;		// the one being carved first
+	int			numchunks;
+	zhead_t		*freelist[Z_NUMCLASSES];
+	int			freebytes;		// sitting on the free lists
+	zhead_t		large;			// chain of blocks over Z_MAXSMALL
+	int			count, bytes;
+} zarena_t;
+
+static const int z_classsize[Z_NUMCLASSES] =
+{
+	32, 48, 64, 96, 128, 192, 256, 384, 512, 768,
+	1024, 1536, 2048, 3072, 4096, 6144, 8192
+};
+static byte		z_classfor[Z_MAXSMALL/16+1];	// (size+15)/16 -> smallest class that fits
+
+static zarena_t	z_arenas[Z_MAXARENAS];
+static int		z_numarenas;
+static zarena_t	*z_lastarena;
+
+static zchunk_t	*z_sparechunks;
+static int		z_numsparechunks;
+
 int		z_count, z_bytes;
+static int		z_sizehist[Z_HISTBUCKETS];	// requested sizes, by power of two
+
+static void		*z_lock;		// the server thread allocates too
+
+/*
+========================
+Z_Init
+========================
+*/
+static void Z_Init (void)
+{
+	int		i, c;
+
+	c = 0;
+	for (i=0 ; i<=Z_MAXSMALL/16 ; i++)
+	{
+		while (z_classsize[c] < i*16)
+			c++;
+		z_classfor[i] = c;
+	}
+
+	z_lock = Sys_CreateMutex ();
+}
+
+/*
+========================
+Z_FindArena
+
+Returns the arena for tag, creating it if create is set
+========================
+*/
+static zarena_t *Z_FindArena (int tag, qboolean create)
+{
+	zarena_t	*arena;
+	int			i;
+
+	if (z_lastarena && z_lastarena->tag == tag)
+		return z_lastarena;
+
+	for (i=0, arena=z_arenas ; i<z_numarenas ; i++, arena++)
+	{
+		if (arena->tag == tag)
+		{
+			z_lastarena = arena;
+			return arena;
+		}
+	}
+
+	if (!create)
+		return NULL;
+	if (z_numarenas == Z_MAXARENAS)
+		Com_Error (ERR_FATAL, "Z_TagMalloc: more than %i tags", Z_MAXARENAS);
+
+	arena = &z_arenas[z_numarenas++];
+	memset (arena, 0, sizeof(*arena));
+	arena->tag = tag;
+	arena->large.next = arena->large.prev = &arena->large;
+	z_lastarena = arena;
+	return arena;
+}
+
+/*
+========================
+Z_CarveBlock
+
+Cuts a block of a class size from the arena's current chunk, starting a
+new chunk when it runs out.  What is left of the old chunk goes on the
+free lists.
+========================
+*/
+static zhead_t *Z_CarveBlock (zarena_t *arena, int size)
+{
+	zchunk_t	*chunk;
+	zhead_t		*z;
+	int			c;
+
+	chunk = arena->chunks;
+	if (!chunk || chunk->used + size > Z_CHUNKSIZE)
+	{
+		while (chunk && Z_CHUNKSIZE - chunk->used >= z_classsize[0])
+		{
+			for (c=Z_NUMCLASSES-1 ; z_classsize[c] > Z_CHUNKSIZE - chunk->used ; c--)
+				;
+			z = (zhead_t *)((byte *)chunk + chunk->used);
+			chunk->used += z_classsize[c];
+			z->next = arena->freelist[c];
+			arena->freelist[c] = z;
+			arena->freebytes += z_classsize[c];
+		}
+
+		if (z_sparechunks)
+		{
+			chunk = z_sparechunks;
+			z_sparechunks = chunk->next;
+			z_numsparechunks--;
+		}
+		else
+		{
+			chunk = malloc (Z_CHUNKSIZE);
+			if (!chunk)
+				Com_Error (ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes", Z_CHUNKSIZE);
+		}
+		chunk->used = Z_CHUNKHEAD;
+		chunk->next = arena->chunks;
+		arena->chunks = chunk;
+		arena->numchunks++;
+	}
+
+	z = (zhead_t *)((byte *)chunk + chunk->used);
+	chunk->used += size;
+	return z;
+}
 
 /*
 ========================
@@ -1115,19 +2202,39 @@ Z_Free
 */
 void Z_Free (void *ptr)
 {
-	zhead_t	*z;
+	zhead_t		*z;
+	zarena_t	*arena;
+	int			c;
 
 	z = ((zhead_t *)ptr) - 1;
 
 	if (z->magic != Z_MAGIC)
 		Com_Error (ERR_FATAL, "Z_Free: bad magic");
+	z->magic = 0;
 
-	z->prev->next = z->next;
-	z->next->prev = z->prev;
+	Sys_LockMutex (z_lock);
 
+	arena = z->arena;
 	z_count--;
 	z_bytes -= z->size;
-	free (z);
+	arena->count--;
+	arena->bytes -= z->size;
+
+	if (z->size > Z_MAXSMALL)
+	{
+		z->prev->next = z->next;
+		z->next->prev = z->prev;
+		Sys_UnlockMutex (z_lock);
+		free (z);
+		return;
+	}
+
+	c = z_classfor[z->size>>4];
+	z->next = arena->freelist[c];
+	arena->freelist[c] = z;
+	arena->freebytes += z->size;
+
+	Sys_UnlockMutex (z_lock);
 }
 
 
@@ -1138,7 +2245,45 @@ Z_Stats_f
 */
 void Z_Stats_f (void)
 {
+	zarena_t	*arena;
+	int			i, total;
+
+	Sys_LockMutex (z_lock);
+
 	Com_Printf ("%i bytes in %i blocks\n", z_bytes, z_count);
+
+	for (i=0, arena=z_arenas ; i<z_numarenas ; i++, arena++)
+	{
+		if (!arena->count && !arena->numchunks)
+			continue;
+		Com_Printf ("tag %5i: %8i bytes in %6i blocks, %3i chunks, %7i free\n",
+			arena->tag, arena->bytes, arena->count, arena->numchunks, arena->freebytes);
+	}
+	Com_Printf ("%i spare chunks\n", z_numsparechunks);
+
+	total = 0;
+	for (i=0 ; i<Z_HISTBUCKETS ; i++)
+		total += z_sizehist[i];
+	if (!total)
+	{
+		Sys_UnlockMutex (z_lock);
+		return;
+	}
+
+	Com_Printf ("%i allocations by size:\n", total);
+	for (i=0 ; i<Z_HISTBUCKETS ; i++)
+	{
+		if (!z_sizehist[i])
+			continue;
+		if (i == 0)
+			Com_Printf ("%9i-%-9i %8i\n", 0, 1, z_sizehist[i]);
+		else if (i == Z_HISTBUCKETS-1)
+			Com_Printf ("%9i+%-9s %8i\n", (1<<(i-1))+1, "", z_sizehist[i]);
+		else
+			Com_Printf ("%9i-%-9i %8i\n", (1<<(i-1))+1, 1<<i, z_sizehist[i]);
+	}
+
+	Sys_UnlockMutex (z_lock);
 }
 
 /*
@@ -1148,14 +2293,50 @@ Z_FreeTags
 */
 void Z_FreeTags (int tag)
 {
-	zhead_t	*z, *next;
+	zarena_t	*arena;
+	zhead_t		*z, *next;
+	zchunk_t	*chunk, *nextchunk;
+
+	Sys_LockMutex (z_lock);
 
-	for (z=z_chain.next ; z != &z_chain ; z=next)
+	arena = Z_FindArena (tag, false);
+	if (!arena)
+	{
+		Sys_UnlockMutex (z_lock);
+		return;
+	}
+
+	for (z=arena->large.next ; z != &arena->large ; z=next)
 	{
 		next = z->next;
-		if (z->tag == tag)
-			Z_Free ((void *)(z+1));
+		free (z);
+	}
+	arena->large.next = arena->large.prev = &arena->large;
+
+	for (chunk=arena->chunks ; chunk ; chunk=nextchunk)
+	{
+		nextchunk = chunk->next;
+		if (z_numsparechunks < Z_MAXSPARECHUNKS)
+		{
+			chunk->next = z_sparechunks;
+			z_sparechunks = chunk;
+			z_numsparechunks++;
+		}
+		else
+			free (chunk);
 	}
+	arena->chunks = NULL;
+	arena->numchunks = 0;
+
+	memset (arena->freelist, 0, sizeof(arena->freelist));
+	arena->freebytes = 0;
+
+	z_count -= arena->count;
+	z_bytes -= arena->bytes;
+	arena->count = 0;
+	arena->bytes = 0;
+
+	Sys_UnlockMutex (z_lock);
 }
 
 /*
@@ -1165,24 +2346,59 @@ Z_TagMalloc
 */
 void *Z_TagMalloc (int size, int tag)
 {
-	zhead_t	*z;
-	
-	size = size + sizeof(zhead_t);
-	z = malloc(size);
-	if (!z)
-		Com_Error (ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes",size);
-	memset (z, 0, size);
-	z_count++;
-	z_bytes += size;
+	zhead_t		*z;
+	zarena_t	*arena;
+	int			c, n;
+
+	if (size < 0)
+		Com_Error (ERR_FATAL, "Z_Malloc: bad size %i", size);
+
+	Sys_LockMutex (z_lock);
+
+	for (c=0 ; c<Z_HISTBUCKETS-1 && (1<<c) < size ; c++)
+		;
+	z_sizehist[c]++;
+
+	arena = Z_FindArena (tag, true);
+
+	n = size + sizeof(zhead_t);
+	if (n <= Z_MAXSMALL)
+	{
+		c = z_classfor[(n+15)>>4];
+		n = z_classsize[c];
+		z = arena->freelist[c];
+		if (z)
+		{
+			arena->freelist[c] = z->next;
+			arena->freebytes -= n;
+		}
+		else
+			z = Z_CarveBlock (arena, n);
+	}
+	else
+	{
+		z = malloc(n);
+		if (!z)
+			Com_Error (ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes",n);
+		z->next = arena->large.next;
+		z->prev = &arena->large;
+		arena->large.next->prev = z;
+		arena->large.next = z;
+	}
+
+	z->arena = arena;
 	z->magic = Z_MAGIC;
 	z->tag = tag;
-	z->size = size;
+	z->size = n;
+
+	z_count++;
+	z_bytes += n;
+	arena->count++;
+	arena->bytes += n;
 
-	z->next = z_chain.next;
-	z->prev = &z_chain;
-	z_chain.next->prev = z;
-	z_chain.next = z;
+	Sys_UnlockMutex (z_lock);
 
+	memset (z+1, 0, size);
 	return (void *)(z+1);
 }
 
@@ -1196,6 +2412,98 @@ void *Z_Malloc (int size)
 	return Z_TagMalloc (size, 0);
 }
 
+/*
+========================
+Z_Bench_f
+
+zbench [blocks] [levels]
+Plays level loads against the zone and against plain malloc: a mix of
+mostly small blocks, some of them freed one at a time, the rest dropped
+with the level.
+========================
+*/
+static unsigned	zbench_seed;
+
+static int Z_BenchSize (void)
+{
+	zbench_seed = zbench_seed * 1103515245 + 12345;
+	switch ((zbench_seed >> 16) & 15)
+	{
+	case 15:
+		return 8192 + ((zbench_seed >> 20) << 4);	// lightmaps, file buffers
+	case 13:
+	case 14:
+		return 256 + (zbench_seed >> 20) % 4096;
+	default:
+		return 8 + (zbench_seed >> 20) % 248;		// strings, edict fields
+	}
+}
+
+void Z_Bench_f (void)
+{
+	int		numblocks, levels;
+	int		i, l, size;
+	int		start, zonemsec, freemsec, mallocmsec;
+	void	**blocks;
+
+	numblocks = Cmd_Argc () > 1 ? atoi (Cmd_Argv (1)) : 20000;
+	levels = Cmd_Argc () > 2 ? atoi (Cmd_Argv (2)) : 20;
+	if (numblocks < 1)
+		numblocks = 1;
+	if (levels < 1)
+		levels = 1;
+
+	blocks = Z_Malloc (numblocks * sizeof(void *));
+
+	zonemsec = freemsec = 0;
+	zbench_seed = 1;
+	for (l=0 ; l<levels ; l++)
+	{
+		start = Sys_Milliseconds ();
+		for (i=0 ; i<numblocks ; i++)
+		{
+			blocks[i] = Z_TagMalloc (Z_BenchSize (), Z_BENCHTAG);
+			if (i & 3)
+				continue;
+			Z_Free (blocks[i/2]);
+			blocks[i/2] = Z_TagMalloc (Z_BenchSize (), Z_BENCHTAG);
+		}
+		zonemsec += Sys_Milliseconds () - start;
+
+		start = Sys_Milliseconds ();
+		Z_FreeTags (Z_BENCHTAG);
+		freemsec += Sys_Milliseconds () - start;
+	}
+
+	mallocmsec = 0;
+	zbench_seed = 1;
+	for (l=0 ; l<levels ; l++)
+	{
+		start = Sys_Milliseconds ();
+		for (i=0 ; i<numblocks ; i++)
+		{
+			size = Z_BenchSize ();
+			blocks[i] = malloc (size);
+			memset (blocks[i], 0, size);
+			if (i & 3)
+				continue;
+			free (blocks[i/2]);
+			size = Z_BenchSize ();
+			blocks[i/2] = malloc (size);
+			memset (blocks[i/2], 0, size);
+		}
+		for (i=0 ; i<numblocks ; i++)
+			free (blocks[i]);
+		mallocmsec += Sys_Milliseconds () - start;
+	}
+
+	Z_Free (blocks);
+
+	Com_Printf ("zbench: %i blocks, %i levels\n", numblocks, levels);
+	Com_Printf ("zone:   %5i ms alloc, %5i ms Z_FreeTags\n", zonemsec, freemsec);
+	Com_Printf ("malloc: %5i ms alloc and free\n", mallocmsec);
+}
+
 
 //============================================================================
 
@@ -1379,6 +2687,21 @@ float	crand(void)
 void Key_Init (void);
 void SCR_EndLoadingPlaque (void);
 
+/*
+=============
+Com_Profile_f
+
+Profiler blocks since the last profile or timedemo, the server thread's
+ServerTick included. The debug hud restarts the main thread's interval
+every second on its own
+=============
+*/
+void Com_Profile_f (void)
+{
+	Sys_PrintProfile ();
+	Sys_ResetProfile ();
+}
+
 /*
 =============
 Com_Error_f
@@ -1405,13 +2728,15 @@ void Qcommon_Init (int argc, char **argv)
 	if (setjmp (abortframe) )
 		Sys_Error ("Error during initialization");
 
-	z_chain.next = z_chain.prev = &z_chain;
+	Z_Init ();
+	com_deferlock = Sys_CreateMutex ();
 
 	// prepare enough of the subsystems to handle
 	// cvar and command buffer management
 	COM_InitArgv (argc, argv);
 
 	Swap_Init ();
+	MSG_InitDeltaEntity ();
 	Cbuf_Init ();
 
 	Cmd_Init ();
@@ -1438,7 +2763,13 @@ void Qcommon_Init (int argc, char **argv)
 	// init commands and vars
 	//
     Cmd_AddCommand ("z_stats", Z_Stats_f);
+    Cmd_AddCommand ("zbench", Z_Bench_f);
+    Cmd_AddCommand ("deltabench", MSG_DeltaBench_f);
+    Cmd_AddCommand ("netbench", Netchan_Bench_f);
     Cmd_AddCommand ("error", Com_Error_f);
+    Cmd_AddCommand ("profile", Com_Profile_f);
+    Cmd_AddCommand ("tracecapture", CM_TraceCapture_f);
+    Cmd_AddCommand ("tracebench", CM_TraceBench_f);
 
 	host_speeds = Cvar_Get ("host_speeds", "0", 0);
 	log_stats = Cvar_Get ("log_stats", "0", 0);
@@ -1497,7 +2828,10 @@ void Qcommon_Frame (int msec)
 	int		time_before, time_between, time_after;
 
 	if (setjmp (abortframe) )
+	{
+		SV_UnlockAll ();
 		return;			// an ERR_DROP was thrown
+	}
 
 	if ( log_stats->modified )
 	{
@@ -1534,15 +2868,16 @@ void Qcommon_Frame (int msec)
 
 	if (showtrace->value)
 	{
-		extern	int c_traces, c_brush_traces;
+		extern	int c_traces;
 		extern	int	c_pointcontents;
 
 		Com_Printf ("%4i traces  %4i points\n", c_traces, c_pointcontents);
 		c_traces = 0;
-		c_brush_traces = 0;
 		c_pointcontents = 0;
 	}
 
+	Com_FlushDeferred ();
+
 	do
 	{
 		s = Sys_ConsoleInput ();
@@ -1554,7 +2889,7 @@ void Qcommon_Frame (int msec)
 	if (host_speeds->value)
 		time_before = Sys_Milliseconds ();
 
-	SV_Frame (msec);
+	SV_RunFrame (msec);
 
 	if (host_speeds->value)
 		time_between = Sys_Milliseconds ();		
@@ -44,10 +44,11 @@ QUAKE FILESYSTEM
 // in memory
 //
 
-typedef struct
+typedef struct packfile_s
 {
 	char	name[MAX_QPATH];
 	int		filepos, filelen;
+	struct packfile_s	*hashnext;
 } packfile_t;
 
 typedef struct pack_s
@@ -56,6 +57,14 @@ typedef struct pack_s
 	FILE	*handle;
 	int		numfiles;
 	packfile_t	*files;
+
+	// case insensitive name lookup, hashsize is a power of two
+	int		hashsize;
+	packfile_t	**hashtable;
+
+	// read only view of the whole pak, NULL if it couldn't be mapped
+	byte	*base;
+	int		length;
 } pack_t;
 
 char	fs_gamedir[MAX_OSPATH];
@@ -83,6 +92,13 @@ typedef struct searchpath_s
 searchpath_t	*fs_searchpaths;
 searchpath_t	*fs_base_searchpaths;	// without gamedirs
 
+cvar_t	*fs_mmap;
+
+// FS_LoadStats counters
+static int	fs_loadfiles;
+static int	fs_loadcopied;
+static int	fs_loadmapped;
+
 
 /*
 
@@ -191,6 +207,47 @@ int	Developer_searchpath (int who)
 }
 
 
+/*
+================
+FS_HashFileName
+
+Case insensitive, so names hash the same way Q_strcasecmp compares them
+================
+*/
+static unsigned FS_HashFileName (const char *name)
+{
+	unsigned	hash;
+	int			c;
+
+	hash = 0;
+	while (*name)
+	{
+		c = *name++;
+		if (c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+		hash = hash * 31 + c;
+	}
+
+	return hash;
+}
+
+/*
+================
+FS_FindPackFile
+================
+*/
+static packfile_t *FS_FindPackFile (pack_t *pak, char *filename)
+{
+	packfile_t	*file;
+
+	file = pak->hashtable[FS_HashFileName (filename) & (pak->hashsize - 1)];
+	for ( ; file ; file = file->hashnext)
+		if (!Q_strcasecmp (file->name, filename))
+			return file;
+
+	return NULL;
+}
+
 /*
 ===========
 FS_FOpenFile
@@ -202,13 +259,22 @@ a seperate file.
 ===========
 */
 int file_from_pak = 0;
+
+/*
+===========
+FS_OpenFile
+
+When view is not NULL and the file is in a mapped pak, *view is pointed
+at the data and no file is opened
+===========
+*/
 #ifndef NO_ADDONS
-int FS_FOpenFile (char *filename, FILE **file)
+static int FS_OpenFile (char *filename, FILE **file, byte **view)
 {
 	searchpath_t	*search;
 	char			netpath[MAX_OSPATH];
 	pack_t			*pak;
-	int				i;
+	packfile_t		*pakfile;
 	filelink_t		*link;
 
 	file_from_pak = 0;
@@ -237,20 +303,26 @@ int FS_FOpenFile (char *filename, FILE **file)
 	// is the element a pak file?
 		if (search->pack)
 		{
-		// look through all the pak file elements
+		// look up the pak file elements
 			pak = search->pack;
-			for (i=0 ; i<pak->numfiles ; i++)
-				if (!Q_strcasecmp (pak->files[i].name, filename))
-				{	// found it!
-					file_from_pak = 1;
-					Com_DPrintf ("PackFile: %s : %s\n",pak->filename, filename);
-				// open a new file on the pakfile
-					*file = fopen (pak->filename, "rb");
-					if (!*file)
-						Com_Error (ERR_FATAL, "Couldn't reopen %s", pak->filename);	
-					fseek (*file, pak->files[i].filepos, SEEK_SET);
-					return pak->files[i].filelen;
+			pakfile = FS_FindPackFile (pak, filename);
+			if (pakfile)
+			{	// found it!
+				file_from_pak = 1;
+				Com_DPrintf ("PackFile: %s : %s\n",pak->filename, filename);
+				if (view && pak->base)
+				{
+					*file = NULL;
+					*view = pak->base + pakfile->filepos;
+					return pakfile->filelen;
 				}
+			// open a new file on the pakfile
+				*file = fopen (pak->filename, "rb");
+				if (!*file)
+					Com_Error (ERR_FATAL, "Couldn't reopen %s", pak->filename);	
+				fseek (*file, pakfile->filepos, SEEK_SET);
+				return pakfile->filelen;
+			}
 		}
 		else
 		{		
@@ -279,12 +351,12 @@ int FS_FOpenFile (char *filename, FILE **file)
 
 // this is just for demos to prevent add on hacking
 
-int FS_FOpenFile (char *filename, FILE **file)
+static int FS_OpenFile (char *filename, FILE **file, byte **view)
 {
 	searchpath_t	*search;
 	char			netpath[MAX_OSPATH];
 	pack_t			*pak;
-	int				i;
+	packfile_t		*pakfile;
 
 	file_from_pak = 0;
 
@@ -312,18 +384,24 @@ int FS_FOpenFile (char *filename, FILE **file)
 	}
 
 	pak = search->pack;
-	for (i=0 ; i<pak->numfiles ; i++)
-		if (!Q_strcasecmp (pak->files[i].name, filename))
-		{	// found it!
-			file_from_pak = 1;
-			Com_DPrintf ("PackFile: %s : %s\n",pak->filename, filename);
-		// open a new file on the pakfile
-			*file = fopen (pak->filename, "rb");
-			if (!*file)
-				Com_Error (ERR_FATAL, "Couldn't reopen %s", pak->filename);	
-			fseek (*file, pak->files[i].filepos, SEEK_SET);
-			return pak->files[i].filelen;
+	pakfile = FS_FindPackFile (pak, filename);
+	if (pakfile)
+	{	// found it!
+		file_from_pak = 1;
+		Com_DPrintf ("PackFile: %s : %s\n",pak->filename, filename);
+		if (view && pak->base)
+		{
+			*file = NULL;
+			*view = pak->base + pakfile->filepos;
+			return pakfile->filelen;
 		}
+	// open a new file on the pakfile
+		*file = fopen (pak->filename, "rb");
+		if (!*file)
+			Com_Error (ERR_FATAL, "Couldn't reopen %s", pak->filename);	
+		fseek (*file, pakfile->filepos, SEEK_SET);
+		return pakfile->filelen;
+	}
 	
 	Com_DPrintf ("FindFile: can't find %s\n", filename);
 	
@@ -333,6 +411,11 @@ int FS_FOpenFile (char *filename, FILE **file)
 
 #endif
 
+int FS_FOpenFile (char *filename, FILE **file)
+{
+	return FS_OpenFile (filename, file, NULL);
+}
+
 
 /*
 =================
@@ -421,6 +504,56 @@ int FS_LoadFile (char *path, void **buffer)
 
 	fclose (h);
 
+	fs_loadfiles++;
+	fs_loadcopied += len;
+
+	return len;
+}
+
+/*
+============
+FS_LoadFileReadOnly
+
+Files in a mapped pak are returned as a view of the mapping without
+a copy, anything else is loaded as FS_LoadFile does
+============
+*/
+int FS_LoadFileReadOnly (char *path, void **buffer)
+{
+	FILE	*h;
+	byte	*view;
+	int		len;
+
+	if (!buffer || !fs_mmap->value)
+		return FS_LoadFile (path, buffer);
+
+	view = NULL;
+	len = FS_OpenFile (path, &h, &view);
+	if (view)
+	{
+		*buffer = view;
+
+		fs_loadfiles++;
+		fs_loadmapped += len;
+
+		return len;
+	}
+
+	if (!h)
+	{
+		*buffer = NULL;
+		return -1;
+	}
+
+	*buffer = Z_Malloc(len);
+
+	FS_Read (*buffer, len, h);
+
+	fclose (h);
+
+	fs_loadfiles++;
+	fs_loadcopied += len;
+
 	return len;
 }
 
@@ -432,9 +565,50 @@ FS_FreeFile
 */
 void FS_FreeFile (void *buffer)
 {
+	searchpath_t	*search;
+	pack_t			*pak;
+
+	// views of a mapped pak go away with the pak
+	for (search = fs_searchpaths ; search ; search = search->next)
+	{
+		pak = search->pack;
+		if (pak && pak->base && (byte *)buffer >= pak->base && (byte *)buffer < pak->base + pak->length)
+			return;
+	}
+
 	Z_Free (buffer);
 }
 
+/*
+=============
+FS_LoadStats
+=============
+*/
+void FS_LoadStats (int *files, int *bytescopied, int *bytesmapped)
+{
+	*files = fs_loadfiles;
+	*bytescopied = fs_loadcopied;
+	*bytesmapped = fs_loadmapped;
+
+	fs_loadfiles = 0;
+	fs_loadcopied = 0;
+	fs_loadmapped = 0;
+}
+
+/*
+=============
+FS_FreePackFile
+=============
+*/
+static void FS_FreePackFile (pack_t *pack)
+{
+	fclose (pack->handle);
+	Sys_UnmapFile (pack->base, pack->length);
+	Z_Free (pack->hashtable);
+	Z_Free (pack->files);
+	Z_Free (pack);
+}
+
 /*
 =================
 FS_LoadPackFile
@@ -455,6 +629,9 @@ pack_t *FS_LoadPackFile (char *packfile)
 	FILE			*packhandle;
 	dpackfile_t		info[MAX_FILES_IN_PACK];
 	unsigned		checksum;
+	int				hashsize;
+	packfile_t		**hashtable;
+	unsigned		hash;
 
 	packhandle = fopen(packfile, "rb");
 	if (!packhandle)
@@ -483,12 +660,21 @@ pack_t *FS_LoadPackFile (char *packfile)
 	if (checksum != PAK0_CHECKSUM)
 		return NULL;
 #endif
-// parse the directory
-	for (i=0 ; i<numpackfiles ; i++)
+// hash the directory, about two buckets per file
+	for (hashsize = 64 ; hashsize < numpackfiles * 2 ; hashsize <<= 1)
+		;
+	hashtable = Z_Malloc (hashsize * sizeof(packfile_t *));
+
+// parse the directory, in reverse so the first of a duplicated name is found as before
+	for (i=numpackfiles-1 ; i>=0 ; i--)
 	{
 		strcpy (newfiles[i].name, info[i].name);
 		newfiles[i].filepos = LittleLong(info[i].filepos);
 		newfiles[i].filelen = LittleLong(info[i].filelen);
+
+		hash = FS_HashFileName (newfiles[i].name) & (hashsize - 1);
+		newfiles[i].hashnext = hashtable[hash];
+		hashtable[hash] = &newfiles[i];
 	}
 
 	pack = Z_Malloc (sizeof (pack_t));
@@ -496,8 +682,22 @@ pack_t *FS_LoadPackFile (char *packfile)
 	pack->handle = packhandle;
 	pack->numfiles = numpackfiles;
 	pack->files = newfiles;
+	pack->hashsize = hashsize;
+	pack->hashtable = hashtable;
+	pack->base = Sys_MapFile (packfile, &pack->length);
+
+	// a truncated pak is read through the file, as before
+	for (i=0 ; pack->base && i<numpackfiles ; i++)
+	{
+		if (newfiles[i].filepos < 0 || newfiles[i].filelen < 0 || newfiles[i].filepos + newfiles[i].filelen > pack->length)
+		{
+			Sys_UnmapFile (pack->base, pack->length);
+			pack->base = NULL;
+			pack->length = 0;
+		}
+	}
 	
-	Com_Printf ("Added packfile %s (%i files)\n", packfile, numpackfiles);
+	Com_Printf ("Added packfile %s (%i files%s)\n", packfile, numpackfiles, pack->base ? ", mapped" : "");
 	return pack;
 }
 
@@ -605,11 +805,7 @@ void FS_SetGamedir (char *dir)
 	while (fs_searchpaths != fs_base_searchpaths)
 	{
 		if (fs_searchpaths->pack)
-		{
-			fclose (fs_searchpaths->pack->handle);
-			Z_Free (fs_searchpaths->pack->files);
-			Z_Free (fs_searchpaths->pack);
-		}
+			FS_FreePackFile (fs_searchpaths->pack);
 		next = fs_searchpaths->next;
 		Z_Free (fs_searchpaths);
 		fs_searchpaths = next;
@@ -847,6 +1043,11 @@ void FS_InitFilesystem (void)
 	Cmd_AddCommand ("link", FS_Link_f);
 	Cmd_AddCommand ("dir", FS_Dir_f );
 
+	//
+	// fs_mmap 0 loads read only files by copying them out of the paks
+	//
+	fs_mmap = Cvar_Get ("fs_mmap", "1", 0);
+
 	//
 	// basedir <path>
 	// allows the game to run from outside the data tree
@@ -19,6 +19,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "qcommon.h"
+#include "lz4.h"
 
 /*
 
@@ -77,6 +78,7 @@ unacknowledged reliable
 cvar_t		*showpackets;
 cvar_t		*showdrop;
 cvar_t		*qport;
+cvar_t		*net_compress;
 
 netadr_t	net_from;
 sizebuf_t	net_message;
@@ -98,6 +100,7 @@ void Netchan_Init (void)
 	showpackets = Cvar_Get ("showpackets", "0", 0);
 	showdrop = Cvar_Get ("showdrop", "0", 0);
 	qport = Cvar_Get ("qport", va("%i", port), CVAR_NOSET);
+	net_compress = Cvar_Get ("net_compress", "1", CVAR_ARCHIVE);
 }
 
 /*
@@ -200,6 +203,264 @@ qboolean Netchan_NeedReliable (netchan_t *chan)
 	return send_reliable;
 }
 
+/*
+==============================================================================
+
+PAYLOAD COMPRESSION
+
+A client asks for a NETCOMPRESS_ mode as the 5th argument of its connect
+and the server answers with the mode it will use after client_connect.
+Older servers and clients leave the extra argument out, which is
+NETCOMPRESS_NONE, and the packets stay as they were.
+
+With compression on, every payload after the packet header starts with a
+byte saying how it is sent. Payloads are LZ4 blocks, or raw when that is
+no smaller. The receiver expands them in place, so the payload still
+follows the header in net_message and demos record it as before. The
+uncompressed payload is still limited to MAX_MSGLEN.
+
+NETCOMPRESS_DICT server payloads can also refer back into a dictionary
+both ends build from the baselines of the level, written as the signon
+wrote them. The client builds it before begin and sends its checksum
+with begin. The server only uses the dictionary once the checksum
+matches its own, until the client starts over with new.
+
+==============================================================================
+*/
+
+#define	NET_MINCOMPRESS	32			// shorter payloads are sent raw
+#define	NET_PREFIX		0x10000		// the furthest back an LZ4 match can refer
+#define	NET_MAXDICT		0x8000
+
+typedef struct
+{
+	byte		buf[NET_PREFIX + MAX_MSGLEN];	// the dictionary ends at NET_PREFIX
+	int			length;
+	unsigned	checksum;
+} netdict_t;
+
+static netdict_t	net_dicts[2];		// by netsrc_t, a listen server has both
+
+/*
+===============
+Netchan_CompressMode
+
+The mode to use with a client that asked for requested
+===============
+*/
+int Netchan_CompressMode (int requested, netadr_t adr)
+{
+	int		mode;
+
+	// nothing to save over loopback
+	if (NET_IsLocalAddress (adr))
+		return NETCOMPRESS_NONE;
+
+	mode = (int)net_compress->value;
+	if (requested < mode)
+		mode = requested;
+	if (mode < NETCOMPRESS_NONE || mode > NETCOMPRESS_DICT)
+		mode = NETCOMPRESS_NONE;
+
+	return mode;
+}
+
+/*
+===============
+Netchan_BuildDictionary
+
+stride is the distance between baselines, they can be inside a larger struct
+===============
+*/
+static void Netchan_BuildDictionary (netdict_t *dict, entity_state_t *baselines, int stride)
+{
+	sizebuf_t		buf;
+	entity_state_t	nullstate;
+	entity_state_t	*base;
+	int				i;
+
+	memset (&nullstate, 0, sizeof(nullstate));
+
+	SZ_Init (&buf, dict->buf, NET_MAXDICT);
+
+	for (i=1 ; i<MAX_EDICTS ; i++)
+	{
+		base = (entity_state_t *)((byte *)baselines + i*stride);
+		if (!base->modelindex && !base->sound && !base->effects)
+			continue;		// SV_Baselines_f doesn't send these
+		if (buf.cursize + 64 > buf.maxsize)
+			break;			// longer than any baseline
+
+		MSG_WriteByte (&buf, svc_spawnbaseline);
+		MSG_WriteDeltaEntity (&nullstate, base, &buf, true, true);
+	}
+
+	// move it up against the payload, matches can't reach below it
+	dict->length = buf.cursize;
+	memmove (dict->buf + NET_PREFIX - dict->length, dict->buf, dict->length);
+	memset (dict->buf, 0, NET_PREFIX - dict->length);
+
+	dict->checksum = Com_BlockChecksum (dict->buf + NET_PREFIX - dict->length, dict->length);
+}
+
+/*
+===============
+Netchan_SetDictionary
+
+Called with the baselines of a new level
+===============
+*/
+void Netchan_SetDictionary (netsrc_t sock, entity_state_t *baselines, int stride)
+{
+	Netchan_BuildDictionary (&net_dicts[sock], baselines, stride);
+}
+
+unsigned Netchan_DictionaryChecksum (netsrc_t sock)
+{
+	return net_dicts[sock].checksum;
+}
+
+/*
+===============
+Netchan_Compress
+
+Returns the compressed length, or 0 if it doesn't fit in maxsize
+===============
+*/
+static int Netchan_Compress (netdict_t *dict, byte *data, int length, byte *out, int maxsize)
+{
+	static char	primed[LZ4_COMPRESSBOUND(NET_MAXDICT)];
+	char		*start;
+	void		*lz4;
+	int			size;
+
+	if (!dict || !dict->length)
+		return LZ4_compress_limitedOutput ((char *)data, (char *)out, length, maxsize);
+
+	// the payload goes right after the dictionary, LZ4 r106 can't keep a
+	// primed state so the dictionary is hashed again each time
+	start = (char *)dict->buf + NET_PREFIX - dict->length;
+	memcpy (dict->buf + NET_PREFIX, data, length);
+
+	lz4 = LZ4_create (start);
+	if (!lz4)
+		return 0;
+	LZ4_compress_continue (lz4, start, primed, dict->length);
+	size = LZ4_compress_limitedOutput_continue (lz4, (char *)dict->buf + NET_PREFIX, (char *)out, length, maxsize);
+	LZ4_free (lz4);
+
+	return size;
+}
+
+/*
+===============
+Netchan_Decompress
+
+Returns the expanded length, or -1 for a bad block
+===============
+*/
+static int Netchan_Decompress (netdict_t *dict, byte *data, int length, byte *out, int maxsize)
+{
+	int		size;
+
+	if (!dict)
+		return LZ4_decompress_safe ((char *)data, (char *)out, length, maxsize);
+
+	if (!dict->length)
+		return -1;
+
+	size = LZ4_decompress_safe_withPrefix64k ((char *)data, (char *)dict->buf + NET_PREFIX, length, maxsize);
+	if (size > 0)
+		memcpy (out, dict->buf + NET_PREFIX, size);
+
+	return size;
+}
+
+/*
+===============
+Netchan_CompressPayload
+
+Rewrites the payload after header with its mode byte
+===============
+*/
+static void Netchan_CompressPayload (netchan_t *chan, sizebuf_t *send, int header)
+{
+	byte		packed[MAX_MSGLEN];
+	netdict_t	*dict;
+	int			length, size, mode;
+
+	length = send->cursize - header;
+	size = 0;
+
+	if (length >= NET_MINCOMPRESS)
+	{
+		dict = NULL;
+		mode = NETCOMPRESS_LZ4;
+		if (chan->compress == NETCOMPRESS_DICT && chan->usedict && net_dicts[chan->sock].length)
+		{
+			dict = &net_dicts[chan->sock];
+			mode = NETCOMPRESS_DICT;
+		}
+
+		// only worth it if it saves the mode byte
+		size = Netchan_Compress (dict, send->data + header, length, packed, length - 1);
+	}
+
+	if (size > 0)
+	{
+		memcpy (send->data + header + 1, packed, size);
+		length = size;
+	}
+	else
+	{
+		memmove (send->data + header + 1, send->data + header, length);
+		mode = NETCOMPRESS_NONE;
+	}
+
+	send->data[header] = mode;
+	send->cursize = header + 1 + length;
+}
+
+/*
+===============
+Netchan_DecompressPayload
+
+Expands the payload at the read position in place, false if it is bad
+===============
+*/
+static qboolean Netchan_DecompressPayload (netchan_t *chan, sizebuf_t *msg)
+{
+	byte	unpacked[MAX_MSGLEN];
+	int		header, length, size, mode;
+
+	header = msg->readcount;
+	if (header >= msg->cursize)
+		return false;		// no mode byte
+
+	mode = msg->data[header];
+	length = msg->cursize - header - 1;
+
+	if (mode == NETCOMPRESS_NONE)
+	{
+		memmove (msg->data + header, msg->data + header + 1, length);
+		msg->cursize--;
+		return true;
+	}
+
+	if (mode > chan->compress)
+		return false;
+
+	size = Netchan_Decompress (mode == NETCOMPRESS_DICT ? &net_dicts[chan->sock] : NULL,
+		msg->data + header + 1, length, unpacked, msg->maxsize - header);
+	if (size <= 0)
+		return false;
+
+	memcpy (msg->data + header, unpacked, size);
+	msg->cursize = header + size;
+
+	return true;
+}
+
 /*
 ===============
 Netchan_Transmit
@@ -216,6 +477,7 @@ void Netchan_Transmit (netchan_t *chan, int length, byte *data)
 	byte		send_buf[MAX_MSGLEN];
 	qboolean	send_reliable;
 	unsigned	w1, w2;
+	int			header;
 
 // check for message overflow
 	if (chan->message.overflowed)
@@ -237,8 +499,8 @@ void Netchan_Transmit (netchan_t *chan, int length, byte *data)
 	}
 
 
-// write the packet header
-	SZ_Init (&send, send_buf, sizeof(send_buf));
+// write the packet header, leave room for the mode byte if compressing
+	SZ_Init (&send, send_buf, chan->compress ? sizeof(send_buf)-1 : sizeof(send_buf));
 
 	w1 = ( chan->outgoing_sequence & ~(1<<31) ) | (send_reliable<<31);
 	w2 = ( chan->incoming_sequence & ~(1<<31) ) | (chan->incoming_reliable_sequence<<31);
@@ -253,6 +515,8 @@ void Netchan_Transmit (netchan_t *chan, int length, byte *data)
 	if (chan->sock == NS_CLIENT)
 		MSG_WriteShort (&send, qport->value);
 
+	header = send.cursize;
+
 // copy the reliable message to the packet first
 	if (send_reliable)
 	{
@@ -266,6 +530,9 @@ void Netchan_Transmit (netchan_t *chan, int length, byte *data)
 	else
 		Com_Printf ("Netchan_Transmit: dumped unreliable\n");
 
+	if (chan->compress)
+		Netchan_CompressPayload (chan, &send, header);
+
 // send the datagram
 	NET_SendPacket (chan->sock, send.cursize, send.data, chan->remote_address);
 
@@ -346,6 +613,15 @@ qboolean Netchan_Process (netchan_t *chan, sizebuf_t *msg)
 		return false;
 	}
 
+	if (chan->compress && !Netchan_DecompressPayload (chan, msg))
+	{
+		if (showdrop->value)
+			Com_Printf ("%s:Bad compressed packet %i\n"
+				, NET_AdrToString (chan->remote_address)
+				, sequence);
+		return false;
+	}
+
 //
 // dropped packets don't keep the message from being used
 //
@@ -385,3 +661,218 @@ qboolean Netchan_Process (netchan_t *chan, sizebuf_t *msg)
 	return true;
 }
 
+/*
+===============
+Netchan_BenchBaselines
+
+Reads the baselines out of a demo message, true once the signon is over
+===============
+*/
+static qboolean Netchan_BenchBaselines (byte *data, int length, entity_state_t *baselines)
+{
+	sizebuf_t		msg;
+	entity_state_t	nullstate;
+	int				cmd, number, bits;
+
+	memset (&nullstate, 0, sizeof(nullstate));
+
+	SZ_Init (&msg, data, length);
+	msg.cursize = length;
+
+	while (msg.readcount < msg.cursize)
+	{
+		cmd = MSG_ReadByte (&msg);
+		switch (cmd)
+		{
+		case svc_nop:
+			break;
+
+		case svc_serverdata:
+			MSG_ReadLong (&msg);
+			MSG_ReadLong (&msg);
+			MSG_ReadByte (&msg);
+			MSG_ReadString (&msg);
+			MSG_ReadShort (&msg);
+			MSG_ReadString (&msg);
+			break;
+
+		case svc_configstring:
+			MSG_ReadShort (&msg);
+			MSG_ReadString (&msg);
+			break;
+
+		case svc_spawnbaseline:
+			number = MSG_ReadEntityBits (&msg, &bits);
+			if (number < 0 || number >= MAX_EDICTS)
+				return true;
+			MSG_ReadDeltaEntity (&msg, &nullstate, &baselines[number], number, bits);
+			break;
+
+		case svc_print:
+			MSG_ReadByte (&msg);
+			// fall through
+		case svc_stufftext:
+		case svc_centerprint:
+			MSG_ReadString (&msg);
+			break;
+
+		default:
+			return true;	// a frame, the level has started
+		}
+	}
+
+	return false;
+}
+
+/*
+===============
+Netchan_Bench_f
+
+netbench <demo> [passes]
+
+Runs the server messages of a demo through the payload compression, as
+LZ4 blocks and with the dictionary built from the baselines in the demo.
+Sizes count the mode byte and the raw fallback, as Netchan_Transmit sends
+them. Times are per packet, each block is checked to expand back
+===============
+*/
+void Netchan_Bench_f (void)
+{
+	char			name[MAX_OSPATH];
+	FILE			*f;
+	byte			*data, *msg;
+	int				*offsets;
+	int				filelen, nummsgs, signon, passes;
+	int				i, m, n, pass, length, size, expanded;
+	int				raw, wire[2], errors, dictlen;
+	unsigned		start, usec[2][2];
+	entity_state_t	*baselines;
+	netdict_t		*dict, *d;
+	byte			packed[LZ4_COMPRESSBOUND(MAX_MSGLEN)];
+	byte			unpacked[MAX_MSGLEN];
+
+	if (Cmd_Argc () < 2)
+	{
+		Com_Printf ("usage: netbench <demo> [passes]\n");
+		return;
+	}
+
+	passes = Cmd_Argc () > 2 ? atoi (Cmd_Argv (2)) : 10;
+	if (passes < 1)
+		passes = 1;
+
+	Com_sprintf (name, sizeof(name), "demos/%s", Cmd_Argv (1));
+	COM_DefaultExtension (name, ".dm2");
+	filelen = FS_FOpenFile (name, &f);
+	if (!f)
+	{
+		Com_Printf ("netbench: couldn't open %s\n", name);
+		return;
+	}
+
+	data = Z_Malloc (filelen);
+	FS_Read (data, filelen, f);
+	FS_FCloseFile (f);
+
+	// each message is a length and a payload, -1 ends the demo
+	offsets = Z_Malloc ((filelen / 4 + 1) * sizeof(int));
+	nummsgs = 0;
+	for (i=0 ; i+4 <= filelen ; i+=4+length)
+	{
+		length = LittleLong (*(int *)(data + i));
+		if (length == -1)
+			break;
+		if (length < 0 || length > MAX_MSGLEN || i+4+length > filelen)
+		{
+			Com_Printf ("netbench: bad message length at %i\n", i);
+			break;
+		}
+		offsets[nummsgs++] = i;
+	}
+
+	// the baselines the client has once the signon is over, signon is
+	// the first message after it
+	baselines = Z_Malloc (MAX_EDICTS * sizeof(entity_state_t));
+	for (signon=0 ; signon<nummsgs ; signon++)
+	{
+		msg = data + offsets[signon];
+		if (Netchan_BenchBaselines (msg + 4, LittleLong (*(int *)msg), baselines))
+			break;
+	}
+
+	dict = Z_Malloc (sizeof(netdict_t));
+	Netchan_BuildDictionary (dict, baselines, sizeof(entity_state_t));
+	dictlen = dict->length;
+
+	raw = 0;
+	wire[0] = wire[1] = 0;
+	errors = 0;
+	memset (usec, 0, sizeof(usec));
+
+	for (pass=0 ; pass<passes ; pass++)
+	{
+		for (m=0 ; m<nummsgs ; m++)
+		{
+			msg = data + offsets[m];
+			length = LittleLong (*(int *)msg);
+			msg += 4;
+
+			if (!pass)
+				raw += length;
+
+			for (n=0 ; n<2 ; n++)
+			{
+				// the signon goes before the client has the dictionary
+				d = (n && m >= signon) ? dict : NULL;
+
+				size = 0;
+				if (length >= NET_MINCOMPRESS)
+				{
+					start = Sys_Microseconds ();
+					size = Netchan_Compress (d, msg, length, packed, length - 1);
+					usec[n][0] += Sys_Microseconds () - start;
+				}
+
+				if (size > 0)
+				{
+					start = Sys_Microseconds ();
+					expanded = Netchan_Decompress (d, packed, size, unpacked, MAX_MSGLEN);
+					usec[n][1] += Sys_Microseconds () - start;
+
+					if (expanded != length || memcmp (unpacked, msg, length))
+					{
+						if (!pass && errors++ < 4)
+							Com_Printf ("netbench: message %i didn't expand back\n", m);
+					}
+				}
+
+				if (!pass)
+					wire[n] += 1 + (size > 0 ? size : length);
+			}
+		}
+	}
+
+	Z_Free (dict);
+	Z_Free (baselines);
+	Z_Free (offsets);
+	Z_Free (data);
+
+	if (!nummsgs)
+	{
+		Com_Printf ("netbench: no messages in %s\n", name);
+		return;
+	}
+
+	Com_Printf ("netbench: %s, %i messages, %i signon, %i passes\n", name, nummsgs, signon, passes);
+	Com_Printf ("dictionary: %i bytes of baselines\n", dictlen);
+	Com_Printf ("raw:   %8i bytes %6.1f a packet\n", raw, (float)raw / nummsgs);
+	for (n=0 ; n<2 ; n++)
+	{
+		Com_Printf ("%s %8i bytes %6.1f a packet, %5.1f%% of raw, %5.2f us compress %5.2f us expand a packet\n",
+			n ? "dict: " : "lz4:  ", wire[n], (float)wire[n] / nummsgs, 100.0f * wire[n] / raw,
+			(float)usec[n][0] / (passes * nummsgs), (float)usec[n][1] / (passes * nummsgs));
+	}
+	if (errors)
+		Com_Printf ("%i messages FAILED to expand back\n", errors);
+}
+
@@ -105,6 +105,7 @@ void MSG_WriteAngle (sizebuf_t *sb, float f);
 void MSG_WriteAngle16 (sizebuf_t *sb, float f);
 void MSG_WriteDeltaUsercmd (sizebuf_t *sb, struct usercmd_s *from, struct usercmd_s *cmd);
 void MSG_WriteDeltaEntity (struct entity_state_s *from, struct entity_state_s *to, sizebuf_t *msg, qboolean force, qboolean newentity);
+void MSG_InitDeltaEntity (void);
 void MSG_WriteDir (sizebuf_t *sb, vec3_t vector);
 
 
@@ -123,6 +124,8 @@ void	MSG_ReadPos (sizebuf_t *sb, vec3_t pos);
 float	MSG_ReadAngle (sizebuf_t *sb);
 float	MSG_ReadAngle16 (sizebuf_t *sb);
 void	MSG_ReadDeltaUsercmd (sizebuf_t *sb, struct usercmd_s *from, struct usercmd_s *cmd);
+void	MSG_ReadDeltaEntity (sizebuf_t *sb, struct entity_state_s *from, struct entity_state_s *to, int number, int bits);
+int		MSG_ReadEntityBits (sizebuf_t *sb, int *bits);
 
 void	MSG_ReadDir (sizebuf_t *sb, vec3_t vector);
 
@@ -562,6 +565,11 @@ void		NET_Sleep(int msec);
 
 #define	MAX_LATENT	32
 
+// payload compression, agreed on at connect
+#define	NETCOMPRESS_NONE	0
+#define	NETCOMPRESS_LZ4		1		// payloads are LZ4 blocks
+#define	NETCOMPRESS_DICT	2		// server payloads can also refer into the baselines
+
 typedef struct
 {
 	qboolean	fatal_error;
@@ -576,6 +584,9 @@ typedef struct
 	netadr_t	remote_address;
 	int			qport;				// qport value to write when transmitting
 
+	int			compress;			// NETCOMPRESS_ mode both ends support
+	qboolean	usedict;			// the remote has the same baseline dictionary
+
 // sequencing variables
 	int			incoming_sequence;
 	int			incoming_acknowledged;
@@ -612,6 +623,11 @@ qboolean Netchan_Process (netchan_t *chan, sizebuf_t *msg);
 
 qboolean Netchan_CanReliable (netchan_t *chan);
 
+int Netchan_CompressMode (int requested, netadr_t adr);
+void Netchan_SetDictionary (netsrc_t sock, struct entity_state_s *baselines, int stride);
+unsigned Netchan_DictionaryChecksum (netsrc_t sock);
+void Netchan_Bench_f (void);
+
 
 /*
 ==============================================================
@@ -633,6 +649,12 @@ char		*CM_EntityString (void);
 
 // creates a clipping hull for an arbitrary box
 int			CM_HeadnodeForBox (vec3_t mins, vec3_t maxs);
+int			CM_HeadnodeForBoxHull (vec3_t mins, vec3_t maxs, int hull);
+// CM_HeadnodeForBox fills the server's hull, client prediction uses its own
+// so the two can run on different threads
+#define	BOXHULL_SERVER		0
+#define	BOXHULL_CLIENT		1
+#define	NUM_BOXHULLS		2
 
 
 // returns an ORed contents mask
@@ -647,8 +669,40 @@ trace_t		CM_TransformedBoxTrace (vec3_t start, vec3_t end,
 						  int headnode, int brushmask,
 						  vec3_t origin, vec3_t angles);
 
-byte		*CM_ClusterPVS (int cluster);
-byte		*CM_ClusterPHS (int cluster);
+// CM_BoxTrace runs on a context of the server, other threads can trace
+// on their own contexts, against anything but a box hull another thread fills
+typedef struct tracecontext_s tracecontext_t;
+
+typedef struct
+{
+	vec3_t	start, end;
+	vec3_t	mins, maxs;
+	int		headnode;
+	int		brushmask;
+	trace_t	trace;			// result
+} boxtrace_t;
+
+tracecontext_t	*CM_AllocTraceContext (void);
+void		CM_FreeTraceContext (tracecontext_t *tc);
+void		CM_SetTraceCache (tracecontext_t *tc, qboolean enable);
+int			CM_TraceCacheHits (tracecontext_t *tc);
+void		CM_ClearTraceCache (void);
+// forgets the traces of the frame, cm_tracecache turns the cache on for CM_BoxTrace
+
+trace_t		CM_ContextBoxTrace (tracecontext_t *tc, vec3_t start, vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  int headnode, int brushmask);
+trace_t		CM_ContextTransformedBoxTrace (tracecontext_t *tc, vec3_t start, vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  int headnode, int brushmask,
+						  vec3_t origin, vec3_t angles);
+
+void		CM_TraceCapture_f (void);
+void		CM_TraceBench_f (void);
+
+const byte	*CM_ClusterPVS (int cluster);
+const byte	*CM_ClusterPHS (int cluster);
+qboolean	CM_VisRowsStable (void);
 
 int			CM_PointLeafnum (vec3_t p);
 
@@ -666,6 +720,9 @@ qboolean	CM_AreasConnected (int area1, int area2);
 
 int			CM_WriteAreaBits (byte *buffer, int area);
 qboolean	CM_HeadnodeVisible (int headnode, byte *visbits);
+int			CM_HeadnodeClusters (int headnode, int *list, int listsize);
+// the clusters of the visible leafs under headnode, repeats included,
+// -1 if there are more than listsize
 
 void		CM_WritePortalState (FILE *f);
 void		CM_ReadPortalState (FILE *f);
@@ -706,6 +763,13 @@ int		FS_LoadFile (char *path, void **buffer);
 // a null buffer will just return the file length without loading
 // a -1 length is not present
 
+int		FS_LoadFileReadOnly (char *path, void **buffer);
+// same as FS_LoadFile, but the buffer may be a view of a mapped pak file
+// and must not be written to, it is still released with FS_FreeFile
+
+void	FS_LoadStats (int *files, int *bytescopied, int *bytesmapped);
+// files loaded and bytes copied or handed out as views since the last call
+
 void	FS_Read (void *buffer, int len, FILE *f);
 // properly handles partial reads
 
@@ -741,6 +805,11 @@ void 		Com_DPrintf (char *fmt, ...);
 void 		Com_Error (int code, char *fmt, ...);
 void 		Com_Quit (void);
 
+void		Com_DeferCommand (char *text);
+void		Com_FlushDeferred (void);
+// prints and command text from the server thread wait for the main
+// thread, which hands them over in Com_FlushDeferred
+
 int			Com_ServerState (void);		// this should have just been a cvar...
 void		Com_SetServerState (int state);
 
@@ -803,6 +872,50 @@ void	Sys_Quit (void);
 char	*Sys_GetClipboardData( void );
 void	Sys_CopyProtect (void);
 
+byte	*Sys_MapFile (char *path, int *length);
+void	Sys_UnmapFile (byte *base, int length);
+// read only view of a whole file, NULL if it can't be mapped
+
+typedef void (*sysjob_t) (void *data, int index, int thread);
+void	Sys_RunJobs (sysjob_t job, void *data, int count, int maxthreads);
+int		Sys_NumJobThreads (void);
+// runs job for every index below count on up to maxthreads threads, the
+// calling thread included, and returns when all are done. thread is below
+// Sys_NumJobThreads and is never shared by two jobs running at once.
+// Called off the main thread they run on a separate set of job threads.
+// A Com_Error in a job stops the batch, and the first one is raised
+// again on the calling thread once every job thread is done
+void	Sys_JobError (int code, char *msg);
+// called by Com_Error, doesn't return when the calling thread is running a job
+
+typedef void (*systhread_t) (void *data);
+void	*Sys_StartThread (systhread_t func, void *data);
+void	Sys_JoinThread (void *thread);
+qboolean	Sys_IsMainThread (void);
+int		Sys_ThreadId (void);		// unique to the calling thread, never 0
+void	Sys_Sleep (int msec);
+
+void	*Sys_CreateMutex (void);
+void	Sys_DestroyMutex (void *mutex);
+void	Sys_LockMutex (void *mutex);
+void	Sys_UnlockMutex (void *mutex);
+// mutexes are recursive, a NULL mutex is never locked
+
+int		Sys_AtomicLoad (volatile int *p);
+void	Sys_AtomicStore (volatile int *p, int value);
+// the load acquires and the store releases, so an index stored after
+// filling a buffer is never seen before the buffer
+
+unsigned	Sys_Microseconds (void);	// wraps, only use differences
+void	Sys_BeginProfile (const char *name);
+void	Sys_EndProfile (void);
+void	Sys_ResetProfile (void);		// start a new profiler interval
+void	Sys_PrintProfile (void);		// block breakdown since the last reset
+void	Sys_SetStat (const char *label, const char *value);
+// profiler blocks and debug hud lines. name must be a string constant.
+// Blocks from the server thread go to a profiler of their own, printed
+// after the main one, the rest is main thread only
+
 /*
 ==============================================================
 
@@ -821,6 +934,17 @@ void SCR_BeginLoadingPlaque (void);
 void SV_Init (void);
 void SV_Shutdown (char *finalmsg, qboolean reconnect);
 void SV_Frame (int msec);
+void SV_RunFrame (int msec);
+// runs SV_Frame here, or leaves it to the server thread when sv_thread is set
+void SV_Lock (void);
+void SV_Unlock (void);
+void SV_UnlockAll (void);
+// held by the server thread for each SV_Frame, and by the main thread
+// whenever it runs commands
+void SV_StopThread (void);
+qboolean SV_IsServerThread (void);
+void SV_ThreadError (int code, char *msg);
+// Com_Error on the server thread, doesn't return
 
 
 
@@ -64,6 +64,11 @@ typedef struct
 	// demo server information
 	FILE		*demofile;
 	qboolean	timedemo;		// don't time sync
+
+	// summed over the clients of the last SV_BuildClientMessages
+	int			ents_active;	// entities any client could be sent
+	int			ents_tested;	// PVS checks
+	int			ents_sent;
 } server_t;
 
 #define EDICT_NUM(n) ((edict_t *)((byte *)ge->edicts + ge->edict_size*(n)))
@@ -85,10 +90,21 @@ typedef struct
 	byte				areabits[MAX_MAP_AREAS/8];		// portalarea visibility bits
 	player_state_t		ps;
 	int					num_entities;
-	int					first_entity;		// into the circular sv_packet_entities[]
+	int					first_entity;		// into the client's ring segment of svs.client_entities
+	int					num_tested;			// entities that needed a PVS check
 	int					senttime;			// for ping calculations
 } client_frame_t;
 
+// every client owns CLIENT_ENTITIES consecutive entity_state_t of
+// svs.client_entities, so frames can be built without a shared cursor
+#define	CLIENT_ENTITIES		(UPDATE_BACKUP*64)
+
+#define	SV_CLIENT_ENTITY(cl,n)	(svs.client_entities[((cl)-svs.clients)*CLIENT_ENTITIES + ((n)&(CLIENT_ENTITIES-1))])
+
+// scratch space per job thread for writing one frame message,
+// big enough for MAX_EDICTS worth of entity deltas
+#define	SV_FRAMESCRATCH		0x20000
+
 #define	LATENCY_COUNTS	16
 #define	RATE_MESSAGES	10
 
@@ -121,6 +137,12 @@ typedef struct client_s
 	byte			datagram_buf[MAX_MSGLEN];
 
 	client_frame_t	frames[UPDATE_BACKUP];	// updates can be delta'd from here
+	int				next_entity;		// next entity_state_t in the client's ring segment
+
+	// the frame message is built for every client before any is sent,
+	// possibly on several threads, then transmitted in client order
+	int				framemsg_size;		// -1 if it overflowed
+	byte			framemsg_buf[MAX_MSGLEN];
 
 	byte			*download;			// file being downloaded
 	int				downloadsize;		// total bytes (can't use EOF because of paks)
@@ -166,9 +188,9 @@ typedef struct
 											// used to check late spawns
 
 	client_t	*clients;					// [maxclients->value];
-	int			num_client_entities;		// maxclients->value*UPDATE_BACKUP*MAX_PACKET_ENTITIES
-	int			next_client_entities;		// next client_entity to use
+	int			num_client_entities;		// maxclients->value*CLIENT_ENTITIES
 	entity_state_t	*client_entities;		// [num_client_entities]
+	byte		*framescratch;				// [Sys_NumJobThreads()*SV_FRAMESCRATCH]
 
 	int			last_heartbeat;
 
@@ -182,8 +204,8 @@ typedef struct
 
 //=============================================================================
 
-extern	netadr_t	net_from;
-extern	sizebuf_t	net_message;
+extern	netadr_t	sv_from;
+extern	sizebuf_t	sv_message;				// the server's own, the client reads net_message
 
 extern	netadr_t	master_adr[MAX_MASTERS];	// address of the master server
 
@@ -196,6 +218,10 @@ extern	cvar_t		*sv_noreload;			// don't reload level state when reentering
 extern	cvar_t		*sv_airaccelerate;		// don't reload level state when reentering
 											// development tool
 extern	cvar_t		*sv_enforcetime;
+extern	cvar_t		*sv_threads;			// build client frames on the job threads
+extern	cvar_t		*sv_showents;			// print the entity counts of every frame
+extern	cvar_t		*sv_areagrid;			// link edicts in the loose grid, else the area tree
+extern	cvar_t		*sv_thread;				// run SV_Frame on its own thread
 
 extern	client_t	*sv_client;
 extern	edict_t		*sv_player;
@@ -248,6 +274,8 @@ void SV_FlushRedirect (int sv_redirected, char *outputbuf);
 
 void SV_DemoCompleted (void);
 void SV_SendClientMessages (void);
+void SV_BuildClientMessages (client_t **clients, int count, int maxthreads);
+void SV_Bench_f (void);
 
 void SV_Multicast (vec3_t origin, multicast_t to);
 void SV_StartSound (vec3_t origin, edict_t *entity, int channel,
@@ -274,6 +302,7 @@ void SV_Status_f (void);
 //
 void SV_WriteFrameToClient (client_t *client, sizebuf_t *msg);
 void SV_RecordDemoMessage (void);
+int SV_CollectFrameEntities (void);
 void SV_BuildClientFrame (client_t *client);
 
 
@@ -310,6 +339,24 @@ void SV_LinkEdict (edict_t *ent);
 // sets ent->leafnums[] for pvs determination even if the entity
 // is not solid
 
+// the clusters of a linked edict as a sparse bit vector, one word of a
+// PVS row per entry, so visibility is an AND per word instead of a bit
+// test per cluster or a walk of the headnode
+#define	MAX_ENT_CLUSTERWORDS	16
+
+typedef struct
+{
+	int			num_clusters;		// ent->num_clusters when linked, stale if it differs
+	int			numwords;			// -1 if the clusters need more words than fit
+	unsigned short	wordnums[MAX_ENT_CLUSTERWORDS];
+	unsigned	words[MAX_ENT_CLUSTERWORDS];
+} entclusters_t;
+
+extern	entclusters_t	sv_entclusters[MAX_EDICTS];
+
+void SV_AreaBench_f (void);
+// areabench [edicts] [frames], link and query throughput of both indexes
+
 int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **list, int maxcount, int areatype);
 // fills in a table of edict pointers with edicts that have bounding boxes
 // that intersect the given area.  It is possible for a non-axial bmodel
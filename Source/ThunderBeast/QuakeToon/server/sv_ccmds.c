@@ -1046,5 +1046,8 @@ void SV_InitOperatorCommands (void)
 	Cmd_AddCommand ("killserver", SV_KillServer_f);
 
 	Cmd_AddCommand ("sv", SV_ServerCommand_f);
+
+	Cmd_AddCommand ("svbench", SV_Bench_f);
+	Cmd_AddCommand ("areabench", SV_AreaBench_f);
 }
 
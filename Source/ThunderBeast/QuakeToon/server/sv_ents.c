@@ -122,7 +122,7 @@ SV_EmitPacketEntities
 Writes a delta update of an entity_state_t list to the message.
 =============
 */
-void SV_EmitPacketEntities (client_frame_t *from, client_frame_t *to, sizebuf_t *msg)
+void SV_EmitPacketEntities (client_t *client, client_frame_t *from, client_frame_t *to, sizebuf_t *msg)
 {
 	entity_state_t	*oldent, *newent;
 	int		oldindex, newindex;
@@ -150,7 +150,7 @@ void SV_EmitPacketEntities (client_frame_t *from, client_frame_t *to, sizebuf_t
 			newnum = 9999;
 		else
 		{
-			newent = &svs.client_entities[(to->first_entity+newindex)%svs.num_client_entities];
+			newent = &SV_CLIENT_ENTITY(client, to->first_entity+newindex);
 			newnum = newent->number;
 		}
 
@@ -158,7 +158,7 @@ void SV_EmitPacketEntities (client_frame_t *from, client_frame_t *to, sizebuf_t
 			oldnum = 9999;
 		else
 		{
-			oldent = &svs.client_entities[(from->first_entity+oldindex)%svs.num_client_entities];
+			oldent = &SV_CLIENT_ENTITY(client, from->first_entity+oldindex);
 			oldnum = oldent->number;
 		}
 
@@ -430,6 +430,11 @@ void SV_WriteFrameToClient (client_t *client, sizebuf_t *msg)
 		oldframe = NULL;
 		lastframe = -1;
 	}
+	else if (client->next_entity - client->frames[client->lastframe & UPDATE_MASK].first_entity > CLIENT_ENTITIES)
+	{	// the entities of the frame were overwritten in the ring segment
+		oldframe = NULL;
+		lastframe = -1;
+	}
 	else
 	{	// we have a valid message to delta from
 		oldframe = &client->frames[client->lastframe & UPDATE_MASK];
@@ -450,7 +455,7 @@ void SV_WriteFrameToClient (client_t *client, sizebuf_t *msg)
 	SV_WritePlayerstateToClient (oldframe, frame, msg);
 
 	// delta encode the entities
-	SV_EmitPacketEntities (oldframe, frame, msg);
+	SV_EmitPacketEntities (client, oldframe, frame, msg);
 }
 
 
@@ -462,8 +467,6 @@ Build a client frame structure
 =============================================================================
 */
 
-byte		fatpvs[65536/8];	// 32767 is MAX_MAP_LEAFS
-
 /*
 ============
 SV_FatPVS
@@ -472,12 +475,12 @@ The client will interpolate the view position,
 so we can't use a single PVS point
 ===========
 */
-void SV_FatPVS (vec3_t org)
+void SV_FatPVS (vec3_t org, byte *fatpvs)
 {
 	int		leafs[64];
 	int		i, j, count;
 	int		longs;
-	byte	*src;
+	const byte	*src;
 	vec3_t	mins, maxs;
 
 	for (i=0 ; i<3 ; i++)
@@ -506,17 +509,101 @@ void SV_FatPVS (vec3_t org)
 			continue;		// already have the cluster we want
 		src = CM_ClusterPVS(leafs[i]);
 		for (j=0 ; j<longs ; j++)
-			((long *)fatpvs)[j] |= ((long *)src)[j];
+			((unsigned *)fatpvs)[j] |= ((const unsigned *)src)[j];
 	}
 }
 
 
+static int	sv_numframeents;
+static int	sv_frameents[MAX_EDICTS];
+
+/*
+=============
+SV_CollectFrameEntities
+
+Lists the entities with a visible model or an effect, in number order,
+so the client frames only walk those. Entity numbers are repaired here
+as the frames may be built on several threads. Returns the count.
+=============
+*/
+int SV_CollectFrameEntities (void)
+{
+	int		e;
+	edict_t	*ent;
+
+	sv_numframeents = 0;
+
+	for (e=1 ; e<ge->num_edicts ; e++)
+	{
+		ent = EDICT_NUM(e);
+
+		// ignore ents without visible models
+		if (ent->svflags & SVF_NOCLIENT)
+			continue;
+
+		// ignore ents without visible models unless they have an effect
+		if (!ent->s.modelindex && !ent->s.effects && !ent->s.sound
+			&& !ent->s.event)
+			continue;
+
+		if (ent->s.number != e)
+		{
+			Com_DPrintf ("FIXING ENT->S.NUMBER!!!\n");
+			ent->s.number = e;
+		}
+
+		sv_frameents[sv_numframeents++] = e;
+	}
+
+	return sv_numframeents;
+}
+
+/*
+=============
+SV_EntityVisible
+
+Tests an entity against a PVS row a word at a time, with the cluster
+words SV_LinkEdict made. Falls back to the clusters or the headnode if
+the entity was changed since it was linked or had too many words.
+=============
+*/
+static qboolean SV_EntityVisible (int e, edict_t *ent, const unsigned *pvs)
+{
+	entclusters_t	*ec;
+	int		i, l;
+
+	ec = &sv_entclusters[e];
+	if (ec->num_clusters == ent->num_clusters && ec->numwords != -1)
+	{
+		for (i=0 ; i<ec->numwords ; i++)
+			if (pvs[ec->wordnums[i]] & ec->words[i])
+				return true;
+		return false;
+	}
+
+	if (ent->num_clusters == -1)
+	{	// too many leafs for individual check, go by headnode
+		return CM_HeadnodeVisible (ent->headnode, (byte *)pvs);
+	}
+
+	// check individual leafs
+	for (i=0 ; i < ent->num_clusters ; i++)
+	{
+		l = ent->clusternums[i];
+		if (((const byte *)pvs)[l >> 3] & (1 << (l&7) ))
+			return true;
+	}
+	return false;
+}
+
 /*
 =============
 SV_BuildClientFrame
 
 Decides which entities are going to be visible to the client, and
 copies off the playerstat and areabits.
+Only touches the client's own frames and ring segment, so different
+clients can be built at the same time.
 =============
 */
 void SV_BuildClientFrame (client_t *client)
@@ -530,9 +617,9 @@ void SV_BuildClientFrame (client_t *client)
 	int		l;
 	int		clientarea, clientcluster;
 	int		leafnum;
-	int		c_fullsend;
-	byte	*clientphs;
-	byte	*bitvector;
+	int		n;
+	const byte	*clientphs;
+	unsigned	fatpvs[65536/32];	// 32767 is MAX_MAP_LEAFS
 
 	clent = client->edict;
 	if (!clent->client)
@@ -562,28 +649,22 @@ void SV_BuildClientFrame (client_t *client)
 	frame->ps = clent->client->ps;
 
 
-	SV_FatPVS (org);
+	SV_FatPVS (org, (byte *)fatpvs);
 	clientphs = CM_ClusterPHS (clientcluster);
 
 	// build up the list of visible entities
 	frame->num_entities = 0;
-	frame->first_entity = svs.next_client_entities;
+	frame->first_entity = client->next_entity;
 
-	c_fullsend = 0;
+	frame->num_tested = 0;
 
-	for (e=1 ; e<ge->num_edicts ; e++)
+	// SV_CollectFrameEntities has dropped the ents without visible
+	// models or effects
+	for (n=0 ; n<sv_numframeents ; n++)
 	{
+		e = sv_frameents[n];
 		ent = EDICT_NUM(e);
 
-		// ignore ents without visible models
-		if (ent->svflags & SVF_NOCLIENT)
-			continue;
-
-		// ignore ents without visible models unless they have an effect
-		if (!ent->s.modelindex && !ent->s.effects && !ent->s.sound
-			&& !ent->s.event)
-			continue;
-
 		// ignore if not touching a PV leaf
 		if (ent != clent)
 		{
@@ -596,6 +677,8 @@ void SV_BuildClientFrame (client_t *client)
 					continue;		// blocked by a door
 			}
 
+			frame->num_tested++;
+
 			// beams just check one point for PHS
 			if (ent->s.renderfx & RF_BEAM)
 			{
@@ -607,30 +690,8 @@ void SV_BuildClientFrame (client_t *client)
 			{
 				// FIXME: if an ent has a model and a sound, but isn't
 				// in the PVS, only the PHS, clear the model
-				if (ent->s.sound)
-				{
-					bitvector = fatpvs;	//clientphs;
-				}
-				else
-					bitvector = fatpvs;
-
-				if (ent->num_clusters == -1)
-				{	// too many leafs for individual check, go by headnode
-					if (!CM_HeadnodeVisible (ent->headnode, bitvector))
-						continue;
-					c_fullsend++;
-				}
-				else
-				{	// check individual leafs
-					for (i=0 ; i < ent->num_clusters ; i++)
-					{
-						l = ent->clusternums[i];
-						if (bitvector[l >> 3] & (1 << (l&7) ))
-							break;
-					}
-					if (i == ent->num_clusters)
-						continue;		// not visible
-				}
+				if (!SV_EntityVisible (e, ent, fatpvs))
+					continue;		// not visible
 
 				if (!ent->s.modelindex)
 				{	// don't send sounds if they will be attenuated away
@@ -650,20 +711,16 @@ void SV_BuildClientFrame (client_t *client)
 			continue; // added as a special projectile
 #endif
 
-		// add it to the circular client_entities array
-		state = &svs.client_entities[svs.next_client_entities%svs.num_client_entities];
-		if (ent->s.number != e)
-		{
-			Com_DPrintf ("FIXING ENT->S.NUMBER!!!\n");
-			ent->s.number = e;
-		}
+		// add it to the client's ring segment of client_entities,
+		// a frame never holds more than CLIENT_ENTITIES as MAX_EDICTS is no larger
+		state = &SV_CLIENT_ENTITY(client, client->next_entity);
 		*state = ent->s;
 
 		// don't mark players missiles as solid
 		if (ent->owner == client->edict)
 			state->solid = 0;
 
-		svs.next_client_entities++;
+		client->next_entity++;
 		frame->num_entities++;
 	}
 }
@@ -237,7 +237,7 @@ qboolean PF_inPVS (vec3_t p1, vec3_t p2)
 	int		leafnum;
 	int		cluster;
 	int		area1, area2;
-	byte	*mask;
+	const byte	*mask;
 
 	leafnum = CM_PointLeafnum (p1);
 	cluster = CM_LeafCluster (leafnum);
@@ -267,7 +267,7 @@ qboolean PF_inPHS (vec3_t p1, vec3_t p2)
 	int		leafnum;
 	int		cluster;
 	int		area1, area2;
-	byte	*mask;
+	const byte	*mask;
 
 	leafnum = CM_PointLeafnum (p1);
 	cluster = CM_LeafCluster (leafnum);
@@ -215,6 +215,7 @@ void SV_SpawnServer (char *server, char *spawnpoint, server_state_t serverstate,
 		if (svs.clients[i].state > cs_connected)
 			svs.clients[i].state = cs_connected;
 		svs.clients[i].lastframe = -1;
+		svs.clients[i].netchan.usedict = false;
 	}
 
 	sv.time = 1000;
@@ -269,6 +270,7 @@ void SV_SpawnServer (char *server, char *spawnpoint, server_state_t serverstate,
 	
 	// create a baseline for more efficient communications
 	SV_CreateBaseline ();
+	Netchan_SetDictionary (NS_SERVER, sv.baselines, sizeof(entity_state_t));
 
 	// check for a savegame
 	SV_CheckForSavegame ();
@@ -351,8 +353,9 @@ void SV_InitGame (void)
 
 	svs.spawncount = rand();
 	svs.clients = Z_Malloc (sizeof(client_t)*maxclients->value);
-	svs.num_client_entities = maxclients->value*UPDATE_BACKUP*64;
+	svs.num_client_entities = maxclients->value*CLIENT_ENTITIES;
 	svs.client_entities = Z_Malloc (sizeof(entity_state_t)*svs.num_client_entities);
+	svs.framescratch = Z_Malloc (Sys_NumJobThreads()*SV_FRAMESCRATCH);
 
 	// init network stuff
 	NET_Config ( (maxclients->value > 1) );
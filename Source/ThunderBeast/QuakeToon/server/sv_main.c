@@ -19,15 +19,24 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "server.h"
+#include <setjmp.h>
 
 netadr_t	master_adr[MAX_MASTERS];	// address of group servers
 
+netadr_t	sv_from;
+sizebuf_t	sv_message;
+byte		sv_message_buffer[MAX_MSGLEN];
+
 client_t	*sv_client;			// current client
 
 cvar_t	*sv_paused;
 cvar_t	*sv_timedemo;
 
 cvar_t	*sv_enforcetime;
+cvar_t	*sv_threads;
+cvar_t	*sv_showents;
+cvar_t	*sv_areagrid;
+cvar_t	*sv_thread;
 
 cvar_t	*timeout;				// seconds without any message
 cvar_t	*zombietime;			// seconds to sink messages after disconnect
@@ -146,7 +155,7 @@ Responds with all the info that qplug or qspy can see
 */
 void SVC_Status (void)
 {
-	Netchan_OutOfBandPrint (NS_SERVER, net_from, "print\n%s", SV_StatusString());
+	Netchan_OutOfBandPrint (NS_SERVER, sv_from, "print\n%s", SV_StatusString());
 #if 0
 	Com_BeginRedirect (RD_PACKET, sv_outputbuf, SV_OUTPUTBUF_LENGTH, SV_FlushRedirect);
 	Com_Printf (SV_StatusString());
@@ -162,7 +171,7 @@ SVC_Ack
 */
 void SVC_Ack (void)
 {
-	Com_Printf ("Ping acknowledge from %s\n", NET_AdrToString(net_from));
+	Com_Printf ("Ping acknowledge from %s\n", NET_AdrToString(sv_from));
 }
 
 /*
@@ -196,7 +205,7 @@ void SVC_Info (void)
 		Com_sprintf (string, sizeof(string), "%16s %8s %2i/%2i\n", hostname->string, sv.name, count, (int)maxclients->value);
 	}
 
-	Netchan_OutOfBandPrint (NS_SERVER, net_from, "info\n%s", string);
+	Netchan_OutOfBandPrint (NS_SERVER, sv_from, "info\n%s", string);
 }
 
 /*
@@ -208,7 +217,7 @@ Just responds with an acknowledgement
 */
 void SVC_Ping (void)
 {
-	Netchan_OutOfBandPrint (NS_SERVER, net_from, "ack");
+	Netchan_OutOfBandPrint (NS_SERVER, sv_from, "ack");
 }
 
 
@@ -235,7 +244,7 @@ void SVC_GetChallenge (void)
 	// see if we already have a challenge for this ip
 	for (i = 0 ; i < MAX_CHALLENGES ; i++)
 	{
-		if (NET_CompareBaseAdr (net_from, svs.challenges[i].adr))
+		if (NET_CompareBaseAdr (sv_from, svs.challenges[i].adr))
 			break;
 		if (svs.challenges[i].time < oldestTime)
 		{
@@ -248,13 +257,13 @@ void SVC_GetChallenge (void)
 	{
 		// overwrite the oldest
 		svs.challenges[oldest].challenge = rand() & 0x7fff;
-		svs.challenges[oldest].adr = net_from;
+		svs.challenges[oldest].adr = sv_from;
 		svs.challenges[oldest].time = curtime;
 		i = oldest;
 	}
 
 	// send it back
-	Netchan_OutOfBandPrint (NS_SERVER, net_from, "challenge %i", svs.challenges[i].challenge);
+	Netchan_OutOfBandPrint (NS_SERVER, sv_from, "challenge %i", svs.challenges[i].challenge);
 }
 
 /*
@@ -276,8 +285,9 @@ void SVC_DirectConnect (void)
 	int			version;
 	int			qport;
 	int			challenge;
+	int			compress;
 
-	adr = net_from;
+	adr = sv_from;
 
 	Com_DPrintf ("SVC_DirectConnect ()\n");
 
@@ -293,11 +303,14 @@ void SVC_DirectConnect (void)
 
 	challenge = atoi(Cmd_Argv(3));
 
+	// older clients don't ask for compression
+	compress = atoi(Cmd_Argv(5));
+
 	strncpy (userinfo, Cmd_Argv(4), sizeof(userinfo)-1);
 	userinfo[sizeof(userinfo) - 1] = 0;
 
 	// force the IP key/value pair so the game can filter based on ip
-	Info_SetValueForKey (userinfo, "ip", NET_AdrToString(net_from));
+	Info_SetValueForKey (userinfo, "ip", NET_AdrToString(sv_from));
 
 	// attractloop servers are ONLY for local clients
 	if (sv.attractloop)
@@ -315,7 +328,7 @@ void SVC_DirectConnect (void)
 	{
 		for (i=0 ; i<MAX_CHALLENGES ; i++)
 		{
-			if (NET_CompareBaseAdr (net_from, svs.challenges[i].adr))
+			if (NET_CompareBaseAdr (sv_from, svs.challenges[i].adr))
 			{
 				if (challenge == svs.challenges[i].challenge)
 					break;		// good
@@ -398,9 +411,14 @@ gotnewcl:
 	SV_UserinfoChanged (newcl);
 
 	// send the connect packet to the client
-	Netchan_OutOfBandPrint (NS_SERVER, adr, "client_connect");
+	compress = Netchan_CompressMode (compress, adr);
+	if (compress)
+		Netchan_OutOfBandPrint (NS_SERVER, adr, "client_connect %i", compress);
+	else
+		Netchan_OutOfBandPrint (NS_SERVER, adr, "client_connect");
 
 	Netchan_Setup (NS_SERVER, &newcl->netchan , adr, qport);
+	newcl->netchan.compress = compress;
 
 	newcl->state = cs_connected;
 	
@@ -438,9 +456,9 @@ void SVC_RemoteCommand (void)
 	i = Rcon_Validate ();
 
 	if (i == 0)
-		Com_Printf ("Bad rcon from %s:\n%s\n", NET_AdrToString (net_from), net_message.data+4);
+		Com_Printf ("Bad rcon from %s:\n%s\n", NET_AdrToString (sv_from), sv_message.data+4);
 	else
-		Com_Printf ("Rcon from %s:\n%s\n", NET_AdrToString (net_from), net_message.data+4);
+		Com_Printf ("Rcon from %s:\n%s\n", NET_AdrToString (sv_from), sv_message.data+4);
 
 	Com_BeginRedirect (RD_PACKET, sv_outputbuf, SV_OUTPUTBUF_LENGTH, SV_FlushRedirect);
 
@@ -458,7 +476,14 @@ void SVC_RemoteCommand (void)
 			strcat (remaining, " ");
 		}
 
-		Cmd_ExecuteString (remaining);
+		if (Sys_IsMainThread ())
+			Cmd_ExecuteString (remaining);
+		else
+		{	// commands only run on the main thread
+			strcat (remaining, "\n");
+			Cbuf_AddText (remaining);
+			Com_Printf ("Queued for the next frame.\n");
+		}
 	}
 
 	Com_EndRedirect ();
@@ -479,15 +504,15 @@ void SV_ConnectionlessPacket (void)
 	char	*s;
 	char	*c;
 
-	MSG_BeginReading (&net_message);
-	MSG_ReadLong (&net_message);		// skip the -1 marker
+	MSG_BeginReading (&sv_message);
+	MSG_ReadLong (&sv_message);		// skip the -1 marker
 
-	s = MSG_ReadStringLine (&net_message);
+	s = MSG_ReadStringLine (&sv_message);
 
 	Cmd_TokenizeString (s, false);
 
 	c = Cmd_Argv(0);
-	Com_DPrintf ("Packet %s : %s\n", NET_AdrToString(net_from), c);
+	Com_DPrintf ("Packet %s : %s\n", NET_AdrToString(sv_from), c);
 
 	if (!strcmp(c, "ping"))
 		SVC_Ping ();
@@ -505,7 +530,7 @@ void SV_ConnectionlessPacket (void)
 		SVC_RemoteCommand ();
 	else
 		Com_Printf ("bad connectionless packet from %s:\n%s\n"
-		, NET_AdrToString (net_from), s);
+		, NET_AdrToString (sv_from), s);
 }
 
 
@@ -600,10 +625,10 @@ void SV_ReadPackets (void)
 	client_t	*cl;
 	int			qport;
 
-	while (NET_GetPacket (NS_SERVER, &net_from, &net_message))
+	while (NET_GetPacket (NS_SERVER, &sv_from, &sv_message))
 	{
 		// check for connectionless packet (0xffffffff) first
-		if (*(int *)net_message.data == -1)
+		if (*(int *)sv_message.data == -1)
 		{
 			SV_ConnectionlessPacket ();
 			continue;
@@ -611,27 +636,27 @@ void SV_ReadPackets (void)
 
 		// read the qport out of the message so we can fix up
 		// stupid address translating routers
-		MSG_BeginReading (&net_message);
-		MSG_ReadLong (&net_message);		// sequence number
-		MSG_ReadLong (&net_message);		// sequence number
-		qport = MSG_ReadShort (&net_message) & 0xffff;
+		MSG_BeginReading (&sv_message);
+		MSG_ReadLong (&sv_message);		// sequence number
+		MSG_ReadLong (&sv_message);		// sequence number
+		qport = MSG_ReadShort (&sv_message) & 0xffff;
 
 		// check for packets from connected clients
 		for (i=0, cl=svs.clients ; i<maxclients->value ; i++,cl++)
 		{
 			if (cl->state == cs_free)
 				continue;
-			if (!NET_CompareBaseAdr (net_from, cl->netchan.remote_address))
+			if (!NET_CompareBaseAdr (sv_from, cl->netchan.remote_address))
 				continue;
 			if (cl->netchan.qport != qport)
 				continue;
-			if (cl->netchan.remote_address.port != net_from.port)
+			if (cl->netchan.remote_address.port != sv_from.port)
 			{
 				Com_Printf ("SV_ReadPackets: fixing up a translated port\n");
-				cl->netchan.remote_address.port = net_from.port;
+				cl->netchan.remote_address.port = sv_from.port;
 			}
 
-			if (Netchan_Process(&cl->netchan, &net_message))
+			if (Netchan_Process(&cl->netchan, &sv_message))
 			{	// this is a valid, sequenced packet, so process it
 				if (cl->state != cs_zombie)
 				{
@@ -732,6 +757,9 @@ void SV_RunGameFrame (void)
 	sv.framenum++;
 	sv.time = sv.framenum*100;
 
+	// traces are only remembered for the frame they were made in
+	CM_ClearTraceCache ();
+
 	// don't run if paused
 	if (!sv_paused->value || maxclients->value > 1)
 	{
@@ -813,6 +841,209 @@ void SV_Frame (int msec)
 
 }
 
+/*
+==============================================================================
+
+SERVER THREAD
+
+With sv_thread set, a listen server runs SV_Frame on its own thread, so
+game frames no longer add to the render frame.  The client only talks to
+it through the loopback packets.  The thread holds sv_lock for each
+SV_Frame, and the main thread takes it to run commands, which is where
+servers are started and stopped.
+
+==============================================================================
+*/
+
+static void		*sv_lock;
+static int		sv_lockdepth;			// main thread's
+static void		*sv_threadhandle;
+static int		sv_threadid;			// Sys_ThreadId of the server thread
+static volatile int	sv_threadquit;
+static volatile int	sv_threaddrop;		// ERR_DROP on the thread, CL_Drop on the main thread
+static volatile int	sv_tickmsec;		// last ten game frames
+static jmp_buf	sv_abortframe;
+
+void SV_Lock (void)
+{
+	if (!sv_lock)
+		return;
+	Sys_LockMutex (sv_lock);
+	if (Sys_IsMainThread ())
+		sv_lockdepth++;
+}
+
+void SV_Unlock (void)
+{
+	if (!sv_lock)
+		return;
+	if (Sys_IsMainThread ())
+		sv_lockdepth--;
+	Sys_UnlockMutex (sv_lock);
+}
+
+/*
+==================
+SV_UnlockAll
+
+An ERR_DROP can longjmp out of a locked command
+==================
+*/
+void SV_UnlockAll (void)
+{
+	while (sv_lockdepth > 0)
+		SV_Unlock ();
+}
+
+/*
+==================
+SV_ThreadMain
+==================
+*/
+static void SV_ThreadMain (void *data)
+{
+	int		last, now, framenum;
+	int		ticks[10], tick;
+
+	sv_threadid = Sys_ThreadId ();
+
+	memset (ticks, 0, sizeof(ticks));
+	tick = 0;
+
+	last = Sys_Milliseconds ();
+	while (!Sys_AtomicLoad (&sv_threadquit))
+	{
+		now = Sys_Milliseconds ();
+
+		SV_Lock ();
+		Sys_BeginProfile ("ServerTick");
+		if (!setjmp (sv_abortframe))
+		{
+			framenum = sv.framenum;
+			SV_Frame (now - last);
+
+			if (sv.framenum != framenum)
+			{
+				ticks[tick++ % 10] = Sys_Milliseconds () - now;
+				Sys_AtomicStore (&sv_tickmsec, ticks[0] + ticks[1] + ticks[2] + ticks[3]
+					+ ticks[4] + ticks[5] + ticks[6] + ticks[7] + ticks[8] + ticks[9]);
+			}
+		}
+		Sys_EndProfile ();
+		SV_Unlock ();
+
+		last = now;
+
+		// packets are read between game frames too, the usercmds move
+		// the players as they come in
+		Sys_Sleep (svs.initialized ? 1 : 10);
+	}
+}
+
+/*
+==================
+SV_IsServerThread
+==================
+*/
+qboolean SV_IsServerThread (void)
+{
+	return sv_threadid && Sys_ThreadId () == sv_threadid;
+}
+
+/*
+==================
+SV_ThreadError
+==================
+*/
+void SV_ThreadError (int code, char *msg)
+{
+	if (code == ERR_FATAL)
+	{
+		SV_Shutdown (va("Server fatal crashed: %s\n", msg), false);
+		Sys_Error ("%s", msg);
+	}
+
+	Com_Printf ("********************\nERROR: %s\n********************\n", msg);
+	SV_Shutdown (va("Server crashed: %s\n", msg), false);
+	Sys_AtomicStore (&sv_threaddrop, 1);
+	longjmp (sv_abortframe, -1);
+}
+
+/*
+==================
+SV_StopThread
+
+Main thread only
+==================
+*/
+void SV_StopThread (void)
+{
+	int		depth;
+
+	if (!sv_threadhandle)
+		return;
+
+	// the thread may be waiting for the lock
+	depth = sv_lockdepth;
+	SV_UnlockAll ();
+
+	Sys_AtomicStore (&sv_threadquit, 1);
+	Sys_JoinThread (sv_threadhandle);
+	sv_threadhandle = NULL;
+	sv_threadid = 0;
+
+	while (depth--)
+		SV_Lock ();
+}
+
+/*
+==================
+SV_RunFrame
+
+Called by Qcommon_Frame every frame
+==================
+*/
+void SV_RunFrame (int msec)
+{
+	qboolean	threaded;
+	int			tickmsec;
+
+	if (Sys_AtomicLoad (&sv_threaddrop))
+	{
+		Sys_AtomicStore (&sv_threaddrop, 0);
+		CL_Drop ();
+	}
+
+	// a timedemo runs the server every frame, so keep it inline where
+	// the frame times stay deterministic
+	threaded = sv_thread->value && !dedicated->value && !sv_timedemo->value;
+
+	if (threaded && !sv_threadhandle)
+	{
+		sv_threadquit = 0;
+		sv_tickmsec = 0;
+		sv_threadhandle = Sys_StartThread (SV_ThreadMain, NULL);
+		if (!sv_threadhandle)
+		{
+			Com_Printf ("SV_RunFrame: couldn't start the server thread\n");
+			Cvar_Set ("sv_thread", "0");
+		}
+	}
+	else if (!threaded && sv_threadhandle)
+		SV_StopThread ();
+
+	if (sv_threadhandle)
+	{
+		tickmsec = Sys_AtomicLoad (&sv_tickmsec);
+		Sys_SetStat ("Server tick", va("%i.%i ms", tickmsec / 10, tickmsec % 10));
+		return;
+	}
+
+	Sys_BeginProfile ("ServerTick");
+	SV_Frame (msec);
+	Sys_EndProfile ();
+}
+
 //============================================================================
 
 /*
@@ -966,6 +1197,10 @@ void SV_Init (void)
 	sv_paused = Cvar_Get ("paused", "0", 0);
 	sv_timedemo = Cvar_Get ("timedemo", "0", 0);
 	sv_enforcetime = Cvar_Get ("sv_enforcetime", "0", 0);
+	sv_threads = Cvar_Get ("sv_threads", "1", 0);
+	sv_showents = Cvar_Get ("sv_showents", "0", 0);
+	sv_areagrid = Cvar_Get ("sv_areagrid", "1", 0);
+	sv_thread = Cvar_Get ("sv_thread", "1", 0);
 	allow_download = Cvar_Get ("allow_download", "1", CVAR_ARCHIVE);
 	allow_download_players  = Cvar_Get ("allow_download_players", "0", CVAR_ARCHIVE);
 	allow_download_models = Cvar_Get ("allow_download_models", "1", CVAR_ARCHIVE);
@@ -980,7 +1215,9 @@ void SV_Init (void)
 
 	sv_reconnect_limit = Cvar_Get ("sv_reconnect_limit", "3", CVAR_ARCHIVE);
 
-	SZ_Init (&net_message, net_message_buffer, sizeof(net_message_buffer));
+	SZ_Init (&sv_message, sv_message_buffer, sizeof(sv_message_buffer));
+
+	sv_lock = Sys_CreateMutex ();
 }
 
 /*
@@ -998,28 +1235,28 @@ void SV_FinalMessage (char *message, qboolean reconnect)
 	int			i;
 	client_t	*cl;
 	
-	SZ_Clear (&net_message);
-	MSG_WriteByte (&net_message, svc_print);
-	MSG_WriteByte (&net_message, PRINT_HIGH);
-	MSG_WriteString (&net_message, message);
+	SZ_Clear (&sv_message);
+	MSG_WriteByte (&sv_message, svc_print);
+	MSG_WriteByte (&sv_message, PRINT_HIGH);
+	MSG_WriteString (&sv_message, message);
 
 	if (reconnect)
-		MSG_WriteByte (&net_message, svc_reconnect);
+		MSG_WriteByte (&sv_message, svc_reconnect);
 	else
-		MSG_WriteByte (&net_message, svc_disconnect);
+		MSG_WriteByte (&sv_message, svc_disconnect);
 
 	// send it twice
 	// stagger the packets to crutch operating system limited buffers
 
 	for (i=0, cl = svs.clients ; i<maxclients->value ; i++, cl++)
 		if (cl->state >= cs_connected)
-			Netchan_Transmit (&cl->netchan, net_message.cursize
-			, net_message.data);
+			Netchan_Transmit (&cl->netchan, sv_message.cursize
+			, sv_message.data);
 
 	for (i=0, cl = svs.clients ; i<maxclients->value ; i++, cl++)
 		if (cl->state >= cs_connected)
-			Netchan_Transmit (&cl->netchan, net_message.cursize
-			, net_message.data);
+			Netchan_Transmit (&cl->netchan, sv_message.cursize
+			, sv_message.data);
 }
 
 
@@ -1051,6 +1288,8 @@ void SV_Shutdown (char *finalmsg, qboolean reconnect)
 		Z_Free (svs.clients);
 	if (svs.client_entities)
 		Z_Free (svs.client_entities);
+	if (svs.framescratch)
+		Z_Free (svs.framescratch);
 	if (svs.demofile)
 		fclose (svs.demofile);
 	memset (&svs, 0, sizeof(svs));
@@ -35,7 +35,7 @@ void SV_FlushRedirect (int sv_redirected, char *outputbuf)
 {
 	if (sv_redirected == RD_PACKET)
 	{
-		Netchan_OutOfBandPrint (NS_SERVER, net_from, "print\n%s", outputbuf);
+		Netchan_OutOfBandPrint (NS_SERVER, sv_from, "print\n%s", outputbuf);
 	}
 	else if (sv_redirected == RD_CLIENT)
 	{
@@ -161,7 +161,7 @@ MULTICAST_PHS	send to clients potentially hearable from org
 void SV_Multicast (vec3_t origin, multicast_t to)
 {
 	client_t	*client;
-	byte		*mask;
+	const byte	*mask;
 	int			leafnum, cluster;
 	int			j;
 	qboolean	reliable;
@@ -387,19 +387,29 @@ FRAME UPDATES
 
 
 
+// fewer spawned clients than this are built on the calling thread
+#define	SV_MIN_JOB_CLIENTS	4
+
 /*
 =======================
-SV_SendClientDatagram
+SV_BuildClientMessage
+
+Builds the frame of one client and writes it, followed by the client's
+datagram, to framemsg_buf. Runs as a job, so nothing here may print
+or touch another client.
 =======================
 */
-qboolean SV_SendClientDatagram (client_t *client)
+static void SV_BuildClientMessage (void *data, int index, int thread)
 {
-	byte		msg_buf[MAX_MSGLEN];
+	client_t	*client;
 	sizebuf_t	msg;
 
+	client = ((client_t **)data)[index];
+
 	SV_BuildClientFrame (client);
 
-	SZ_Init (&msg, msg_buf, sizeof(msg_buf));
+	// the scratch space can't overflow, larger than MAX_MSGLEN is checked below
+	SZ_Init (&msg, svs.framescratch + thread*SV_FRAMESCRATCH, SV_FRAMESCRATCH);
 	msg.allowoverflow = true;
 
 	// send over all the relevant entity_state_t
@@ -410,23 +420,80 @@ qboolean SV_SendClientDatagram (client_t *client)
 	// for this client out to the message
 	// it is necessary for this to be after the WriteEntities
 	// so that entity references will be current
+	if (!client->datagram.overflowed)
+		SZ_Write (&msg, client->datagram.data, client->datagram.cursize);
+
+	if (msg.overflowed || msg.cursize > MAX_MSGLEN)
+	{
+		client->framemsg_size = -1;
+		return;
+	}
+
+	memcpy (client->framemsg_buf, msg.data, msg.cursize);
+	client->framemsg_size = msg.cursize;
+}
+
+/*
+=======================
+SV_BuildClientMessages
+
+Builds the frame messages of the clients, on up to maxthreads job threads
+when the vis rows can be shared
+=======================
+*/
+void SV_BuildClientMessages (client_t **clients, int count, int maxthreads)
+{
+	int		i, active;
+	client_frame_t	*frame;
+
+	active = SV_CollectFrameEntities ();
+
+	if (maxthreads > 1 && !CM_VisRowsStable ())
+		maxthreads = 1;
+
+	if (maxthreads <= 1)
+	{
+		for (i=0 ; i<count ; i++)
+			SV_BuildClientMessage (clients, i, 0);
+	}
+	else
+		Sys_RunJobs (SV_BuildClientMessage, clients, count, maxthreads);
+
+	sv.ents_active = active * count;
+	sv.ents_tested = 0;
+	sv.ents_sent = 0;
+	for (i=0 ; i<count ; i++)
+	{
+		frame = &clients[i]->frames[sv.framenum & UPDATE_MASK];
+		sv.ents_tested += frame->num_tested;
+		sv.ents_sent += frame->num_entities;
+	}
+}
+
+/*
+=======================
+SV_SendClientDatagram
+
+Sends the message SV_BuildClientMessages left for the client
+=======================
+*/
+qboolean SV_SendClientDatagram (client_t *client)
+{
 	if (client->datagram.overflowed)
 		Com_Printf ("WARNING: datagram overflowed for %s\n", client->name);
-	else
-		SZ_Write (&msg, client->datagram.data, client->datagram.cursize);
 	SZ_Clear (&client->datagram);
 
-	if (msg.overflowed)
+	if (client->framemsg_size < 0)
 	{	// must have room left for the packet header
 		Com_Printf ("WARNING: msg overflowed for %s\n", client->name);
-		SZ_Clear (&msg);
+		client->framemsg_size = 0;
 	}
 
 	// send the datagram
-	Netchan_Transmit (&client->netchan, msg.cursize, msg.data);
+	Netchan_Transmit (&client->netchan, client->framemsg_size, client->framemsg_buf);
 
 	// record the size for rate estimation
-	client->message_size[sv.framenum % RATE_MESSAGES] = msg.cursize;
+	client->message_size[sv.framenum % RATE_MESSAGES] = client->framemsg_size;
 
 	return true;
 }
@@ -494,8 +561,11 @@ void SV_SendClientMessages (void)
 	int			msglen;
 	byte		msgbuf[MAX_MSGLEN];
 	int			r;
+	client_t	*sendclients[MAX_CLIENTS];
+	int			numsend;
 
 	msglen = 0;
+	numsend = 0;
 
 	// read the next demo message if needed
 	if (sv.state == ss_demo && sv.demofile)
@@ -554,7 +624,7 @@ void SV_SendClientMessages (void)
 			if (SV_RateDrop (c))
 				continue;
 
-			SV_SendClientDatagram (c);
+			sendclients[numsend++] = c;
 		}
 		else
 		{
@@ -563,5 +633,186 @@ void SV_SendClientMessages (void)
 				Netchan_Transmit (&c->netchan, 0, NULL);
 		}
 	}
+
+	if (!numsend)
+		return;
+
+	// every frame is built before any is sent, the transmits stay in client order
+	SV_BuildClientMessages (sendclients, numsend,
+		(sv_threads->value && numsend >= SV_MIN_JOB_CLIENTS) ? Sys_NumJobThreads () : 1);
+
+	for (i=0 ; i<numsend ; i++)
+		SV_SendClientDatagram (sendclients[i]);
+
+	if (sv_showents->value)
+		Com_Printf ("%i clients: %i active, %i tested, %i sent\n",
+			numsend, sv.ents_active, sv.ents_tested, sv.ents_sent);
+}
+
+
+/*
+=======================
+SV_Bench_f
+
+svbench [clients] [frames]
+
+Builds and delta encodes frames of the running map for simulated
+clients, standing on the entities of the level, once for every job
+thread count. Nothing is sent, the real clients are left alone.
+=======================
+*/
+#define	SV_BENCH_CLIENTS	64
+#define	SV_BENCH_FRAMES		100
+
+void SV_Bench_f (void)
+{
+	int			numclients, numframes;
+	int			i, e, f, k;
+	int			numspots;
+	int			threads, maxthreads;
+	int			start, msec, bytes;
+	unsigned	checksum, serialchecksum;
+	client_t	*clients;
+	edict_t		*edicts;
+	gclient_t	*gclients;
+	entity_state_t	*entities;
+	client_t	*benchclients[MAX_CLIENTS];
+	client_t	*saveclients;
+	entity_state_t	*saveentities;
+	int			savenumentities;
+	int			saveframenum;
+	edict_t		*ent;
+
+	if (sv.state != ss_game)
+	{
+		Com_Printf ("svbench: no map running\n");
+		return;
+	}
+
+	numclients = Cmd_Argc () > 1 ? atoi (Cmd_Argv (1)) : SV_BENCH_CLIENTS;
+	if (numclients < 1)
+		numclients = 1;
+	if (numclients > MAX_CLIENTS)
+		numclients = MAX_CLIENTS;
+
+	numframes = Cmd_Argc () > 2 ? atoi (Cmd_Argv (2)) : SV_BENCH_FRAMES;
+	if (numframes < 1)
+		numframes = 1;
+
+	clients = Z_Malloc (sizeof(client_t)*numclients);
+	edicts = Z_Malloc (sizeof(edict_t)*numclients);
+	gclients = Z_Malloc (sizeof(gclient_t)*numclients);
+	entities = Z_Malloc (sizeof(entity_state_t)*numclients*CLIENT_ENTITIES);
+
+	// put the clients on the entities with models, round robin
+	numspots = 0;
+	for (e=1 ; e<ge->num_edicts ; e++)
+	{
+		ent = EDICT_NUM(e);
+		if (ent->inuse && ent->s.modelindex)
+			numspots++;
+	}
+
+	for (i=0, e=1 ; i<numclients ; i++)
+	{
+		if (numspots)
+		{
+			for ( ; ; e = (e+1 < ge->num_edicts) ? e+1 : 1)
+			{
+				ent = EDICT_NUM(e);
+				if (ent->inuse && ent->s.modelindex)
+					break;
+			}
+			e = (e+1 < ge->num_edicts) ? e+1 : 1;
+			for (k=0 ; k<3 ; k++)
+				gclients[i].ps.pmove.origin[k] = ent->s.origin[k]*8;
+		}
+		gclients[i].ps.viewoffset[2] = 22;
+
+		edicts[i].client = &gclients[i];
+		edicts[i].inuse = true;
+
+		clients[i].state = cs_spawned;
+		clients[i].edict = &edicts[i];
+		clients[i].lastframe = -1;
+		Com_sprintf (clients[i].name, sizeof(clients[i].name), "bench%i", i);
+		SZ_Init (&clients[i].datagram, clients[i].datagram_buf, sizeof(clients[i].datagram_buf));
+		clients[i].datagram.allowoverflow = true;
+
+		benchclients[i] = &clients[i];
+	}
+
+	saveclients = svs.clients;
+	saveentities = svs.client_entities;
+	savenumentities = svs.num_client_entities;
+	saveframenum = sv.framenum;
+
+	svs.clients = clients;
+	svs.client_entities = entities;
+	svs.num_client_entities = numclients*CLIENT_ENTITIES;
+
+	Com_Printf ("svbench: %i clients, %i frames, %i edicts, %i spots\n",
+		numclients, numframes, ge->num_edicts, numspots);
+	if (!CM_VisRowsStable ())
+		Com_Printf ("svbench: vis rows are cached, raise cm_vismatrix to build on several threads\n");
+
+	maxthreads = Sys_NumJobThreads ();
+	serialchecksum = 0;
+
+	for (threads = 1 ; ; threads = (threads*2 < maxthreads) ? threads*2 : maxthreads)
+	{
+		// every run starts with a full update and deltas from the previous frame after it
+		for (i=0 ; i<numclients ; i++)
+		{
+			clients[i].lastframe = -1;
+			clients[i].next_entity = 0;
+		}
+
+		sv.framenum = saveframenum;
+		bytes = 0;
+		checksum = 0;
+
+		start = Sys_Milliseconds ();
+		for (f=0 ; f<numframes ; f++)
+		{
+			sv.framenum++;
+
+			SV_BuildClientMessages (benchclients, numclients, threads);
+
+			for (i=0 ; i<numclients ; i++)
+			{
+				clients[i].lastframe = sv.framenum;
+				if (clients[i].framemsg_size > 0)
+				{
+					bytes += clients[i].framemsg_size;
+					checksum += Com_BlockChecksum (clients[i].framemsg_buf, clients[i].framemsg_size);
+				}
+			}
+		}
+		msec = Sys_Milliseconds () - start;
+
+		if (threads == 1)
+			serialchecksum = checksum;
+
+		Com_Printf ("%3i threads: %7.3f ms/frame, %i bytes/frame%s\n", threads,
+			(float)msec / numframes, bytes / numframes,
+			checksum == serialchecksum ? "" : ", MISMATCH");
+		if (threads == 1)
+			Com_Printf ("entities per frame: %i active, %i tested, %i sent\n",
+				sv.ents_active, sv.ents_tested, sv.ents_sent);
+
+		if (threads == maxthreads)
+			break;
+	}
+
+	svs.clients = saveclients;
+	svs.client_entities = saveentities;
+	svs.num_client_entities = savenumentities;
+	sv.framenum = saveframenum;
+
+	Z_Free (entities);
+	Z_Free (gclients);
+	Z_Free (edicts);
+	Z_Free (clients);
 }
 
@@ -69,6 +69,9 @@ void SV_New_f (void)
 		return;
 	}
 
+	// until begin shows the client has this level's dictionary
+	sv_client->netchan.usedict = false;
+
 	// demo servers just dump the file message
 	if (sv.state == ss_demo)
 	{
@@ -248,6 +251,10 @@ void SV_Begin_f (void)
 	}
 
 	sv_client->state = cs_spawned;
+
+	// the client built its dictionary from the baselines it was sent
+	sv_client->netchan.usedict = sv_client->netchan.compress == NETCOMPRESS_DICT && Cmd_Argc() > 2
+		&& (unsigned)strtoul (Cmd_Argv(2), NULL, 10) == Netchan_DictionaryChecksum (NS_SERVER);
 	
 	// call the game begin function
 	ge->ClientBegin (sv_player);
@@ -527,7 +534,7 @@ void SV_ClientThink (client_t *cl, usercmd_t *cmd)
 ===================
 SV_ExecuteClientMessage
 
-The current net_message is parsed for the given client
+The current sv_message is parsed for the given client
 ===================
 */
 void SV_ExecuteClientMessage (client_t *cl)
@@ -553,14 +560,14 @@ void SV_ExecuteClientMessage (client_t *cl)
 
 	while (1)
 	{
-		if (net_message.readcount > net_message.cursize)
+		if (sv_message.readcount > sv_message.cursize)
 		{
 			Com_Printf ("SV_ReadClientMessage: badread\n");
 			SV_DropClient (cl);
 			return;
 		}	
 
-		c = MSG_ReadByte (&net_message);
+		c = MSG_ReadByte (&sv_message);
 		if (c == -1)
 			break;
 				
@@ -575,7 +582,7 @@ void SV_ExecuteClientMessage (client_t *cl)
 			break;
 
 		case clc_userinfo:
-			strncpy (cl->userinfo, MSG_ReadString (&net_message), sizeof(cl->userinfo)-1);
+			strncpy (cl->userinfo, MSG_ReadString (&sv_message), sizeof(cl->userinfo)-1);
 			SV_UserinfoChanged (cl);
 			break;
 
@@ -584,9 +591,9 @@ void SV_ExecuteClientMessage (client_t *cl)
 				return;		// someone is trying to cheat...
 
 			move_issued = true;
-			checksumIndex = net_message.readcount;
-			checksum = MSG_ReadByte (&net_message);
-			lastframe = MSG_ReadLong (&net_message);
+			checksumIndex = sv_message.readcount;
+			checksum = MSG_ReadByte (&sv_message);
+			lastframe = MSG_ReadLong (&sv_message);
 			if (lastframe != cl->lastframe) {
 				cl->lastframe = lastframe;
 				if (cl->lastframe > 0) {
@@ -596,9 +603,9 @@ void SV_ExecuteClientMessage (client_t *cl)
 			}
 
 			memset (&nullcmd, 0, sizeof(nullcmd));
-			MSG_ReadDeltaUsercmd (&net_message, &nullcmd, &oldest);
-			MSG_ReadDeltaUsercmd (&net_message, &oldest, &oldcmd);
-			MSG_ReadDeltaUsercmd (&net_message, &oldcmd, &newcmd);
+			MSG_ReadDeltaUsercmd (&sv_message, &nullcmd, &oldest);
+			MSG_ReadDeltaUsercmd (&sv_message, &oldest, &oldcmd);
+			MSG_ReadDeltaUsercmd (&sv_message, &oldcmd, &newcmd);
 
 			if ( cl->state != cs_spawned )
 			{
@@ -608,8 +615,8 @@ void SV_ExecuteClientMessage (client_t *cl)
 
 			// if the checksum fails, ignore the rest of the packet
 			calculatedChecksum = COM_BlockSequenceCRCByte (
-				net_message.data + checksumIndex + 1,
-				net_message.readcount - checksumIndex - 1,
+				sv_message.data + checksumIndex + 1,
+				sv_message.readcount - checksumIndex - 1,
 				cl->netchan.incoming_sequence);
 
 			if (calculatedChecksum != checksum)
@@ -649,7 +656,7 @@ void SV_ExecuteClientMessage (client_t *cl)
 			break;
 
 		case clc_stringcmd:	
-			s = MSG_ReadString (&net_message);
+			s = MSG_ReadString (&sv_message);
 
 			// malicious users may try using too many string commands
 			if (++stringCmdCount < MAX_STRINGCMDS)
@@ -37,6 +37,30 @@ FIXME: this use of "area" is different from the bsp file use
 
 #define	EDICT_FROM_AREA(l) STRUCT_FROM_LINK(l,edict_t,area)
 
+/*
+The linked edicts are kept in one of two indexes behind SV_LinkEdict,
+SV_UnlinkEdict and SV_AreaEdicts, picked by sv_areagrid when the world
+is cleared. Both keep the edicts on link_t lists, so unlinking is the
+same for both and ent->area.prev still tells if an edict is linked.
+
+The area tree splits the world a fixed number of times and links an
+edict at the first node it crosses, so edicts on a split pile up high
+in the tree and get tested by every query below it.
+
+The loose grid puts an edict in the cell holding the center of its
+box. Cells are loosened by half their size on every side, so any edict
+no bigger than a cell fits the loose bounds of its cell, and a query
+only visits the cells its box loosened the same way overlaps. Bigger
+edicts go on a list of their own that every query walks.
+*/
+typedef struct
+{
+	char	*name;
+	void	(*clear) (vec3_t mins, vec3_t maxs);
+	void	(*link) (edict_t *ent);			// absmin and absmax are set, not solid_not
+	void	(*areaedicts) (void);			// fills area_list from the area_* query
+} areaindex_t;
+
 typedef struct areanode_s
 {
 	int		axis;		// -1 = leaf node
@@ -52,6 +76,30 @@ typedef struct areanode_s
 areanode_t	sv_areanodes[AREA_NODES];
 int			sv_numareanodes;
 
+#define	AREAGRID_CELLS		64		// per axis, x and y
+#define	AREAGRID_MINCELL	64		// smallest cell size
+
+typedef struct
+{
+	link_t	trigger_edicts;
+	link_t	solid_edicts;
+} areacell_t;
+
+typedef struct
+{
+	vec3_t		origin;
+	float		cellsize;
+	float		scale;				// 1 / cellsize
+	int			cells[2];
+	areacell_t	grid[AREAGRID_CELLS*AREAGRID_CELLS];
+	areacell_t	large;				// edicts bigger than a cell
+} areagrid_t;
+
+areagrid_t	sv_loosegrid;
+
+areaindex_t	*sv_areaindex;
+extern	areaindex_t	sv_areatreeindex, sv_areagridindex;
+
 float	*area_mins, *area_maxs;
 edict_t	**area_list;
 int		area_count, area_maxcount;
@@ -59,6 +107,8 @@ int		area_type;
 
 int SV_HullForEntity (edict_t *ent);
 
+entclusters_t	sv_entclusters[MAX_EDICTS];
+
 
 // ClearLink is used for new headnodes
 void ClearLink (link_t *l)
@@ -128,15 +178,153 @@ areanode_t *SV_CreateAreaNode (int depth, vec3_t mins, vec3_t maxs)
 
 /*
 ===============
-SV_ClearWorld
+SV_AreaTreeClear
 
 ===============
 */
-void SV_ClearWorld (void)
+void SV_AreaTreeClear (vec3_t mins, vec3_t maxs)
 {
 	memset (sv_areanodes, 0, sizeof(sv_areanodes));
 	sv_numareanodes = 0;
-	SV_CreateAreaNode (0, sv.models[1]->mins, sv.models[1]->maxs);
+	SV_CreateAreaNode (0, mins, maxs);
+}
+
+/*
+===============
+SV_AreaTreeLink
+
+===============
+*/
+void SV_AreaTreeLink (edict_t *ent)
+{
+	areanode_t	*node;
+
+// find the first node that the ent's box crosses
+	node = sv_areanodes;
+	while (1)
+	{
+		if (node->axis == -1)
+			break;
+		if (ent->absmin[node->axis] > node->dist)
+			node = node->children[0];
+		else if (ent->absmax[node->axis] < node->dist)
+			node = node->children[1];
+		else
+			break;		// crosses the node
+	}
+	
+	// link it in	
+	if (ent->solid == SOLID_TRIGGER)
+		InsertLinkBefore (&ent->area, &node->trigger_edicts);
+	else
+		InsertLinkBefore (&ent->area, &node->solid_edicts);
+}
+
+/*
+===============
+SV_AreaGridClear
+
+Sizes the cells so the larger of x and y is split AREAGRID_CELLS times
+===============
+*/
+void SV_AreaGridClear (vec3_t mins, vec3_t maxs)
+{
+	areagrid_t	*g;
+	float		size;
+	int			i;
+
+	g = &sv_loosegrid;
+
+	size = maxs[0] - mins[0];
+	if (maxs[1] - mins[1] > size)
+		size = maxs[1] - mins[1];
+
+	g->cellsize = size / AREAGRID_CELLS;
+	if (g->cellsize < AREAGRID_MINCELL)
+		g->cellsize = AREAGRID_MINCELL;
+	g->scale = 1.0 / g->cellsize;
+	VectorCopy (mins, g->origin);
+
+	for (i=0 ; i<2 ; i++)
+	{
+		g->cells[i] = (int)((maxs[i] - mins[i]) * g->scale) + 1;
+		if (g->cells[i] > AREAGRID_CELLS)
+			g->cells[i] = AREAGRID_CELLS;
+	}
+
+	for (i=0 ; i<AREAGRID_CELLS*AREAGRID_CELLS ; i++)
+	{
+		ClearLink (&g->grid[i].trigger_edicts);
+		ClearLink (&g->grid[i].solid_edicts);
+	}
+	ClearLink (&g->large.trigger_edicts);
+	ClearLink (&g->large.solid_edicts);
+}
+
+/*
+===============
+SV_AreaGridCell
+
+The cell along axis holding v, edicts and queries outside
+the world are clamped to the edge cells
+===============
+*/
+int SV_AreaGridCell (float v, int axis)
+{
+	float	f;
+
+	f = (v - sv_loosegrid.origin[axis]) * sv_loosegrid.scale;
+	if (f < 0)
+		return 0;
+	if (f >= sv_loosegrid.cells[axis])
+		return sv_loosegrid.cells[axis] - 1;
+	return (int)f;
+}
+
+/*
+===============
+SV_AreaGridLink
+
+===============
+*/
+void SV_AreaGridLink (edict_t *ent)
+{
+	areagrid_t	*g;
+	areacell_t	*cell;
+	int			x, y;
+
+	g = &sv_loosegrid;
+
+	if (ent->absmax[0] - ent->absmin[0] > g->cellsize
+		|| ent->absmax[1] - ent->absmin[1] > g->cellsize)
+	{	// wouldn't fit the loose bounds of a cell
+		cell = &g->large;
+	}
+	else
+	{
+		x = SV_AreaGridCell ((ent->absmin[0] + ent->absmax[0]) * 0.5, 0);
+		y = SV_AreaGridCell ((ent->absmin[1] + ent->absmax[1]) * 0.5, 1);
+		cell = &g->grid[y*AREAGRID_CELLS + x];
+	}
+
+	if (ent->solid == SOLID_TRIGGER)
+		InsertLinkBefore (&ent->area, &cell->trigger_edicts);
+	else
+		InsertLinkBefore (&ent->area, &cell->solid_edicts);
+}
+
+/*
+===============
+SV_ClearWorld
+
+===============
+*/
+void SV_ClearWorld (void)
+{
+	memset (sv_entclusters, 0, sizeof(sv_entclusters));
+
+	sv_areaindex = sv_areagrid->value ? &sv_areagridindex : &sv_areatreeindex;
+	sv_areaindex->clear (sv.models[1]->mins, sv.models[1]->maxs);
 }
 
 
@@ -155,16 +343,73 @@ void SV_UnlinkEdict (edict_t *ent)
 }
 
 
+#define MAX_TOTAL_ENT_LEAFS		128
+
+/*
+===============
+SV_LinkEdictClusters
+
+Folds the clusters of the edict into words of a PVS row,
+keeping the byte order of the row
+===============
+*/
+void SV_LinkEdictClusters (edict_t *ent)
+{
+	entclusters_t	*ec;
+	int			clusters[MAX_TOTAL_ENT_LEAFS];
+	int			num_clusters;
+	int			i, j, c, w;
+
+	ec = &sv_entclusters[NUM_FOR_EDICT(ent)];
+	ec->num_clusters = ent->num_clusters;
+	ec->numwords = 0;
+
+	if (ent->num_clusters == -1)
+	{
+		num_clusters = CM_HeadnodeClusters (ent->headnode, clusters, MAX_TOTAL_ENT_LEAFS);
+		if (num_clusters == -1)
+		{
+			ec->numwords = -1;
+			return;
+		}
+	}
+	else
+	{
+		num_clusters = ent->num_clusters;
+		for (i=0 ; i<num_clusters ; i++)
+			clusters[i] = ent->clusternums[i];
+	}
+
+	for (i=0 ; i<num_clusters ; i++)
+	{
+		c = clusters[i];
+		w = c >> 5;
+		for (j=0 ; j<ec->numwords ; j++)
+			if (ec->wordnums[j] == w)
+				break;
+		if (j == ec->numwords)
+		{
+			if (j == MAX_ENT_CLUSTERWORDS)
+			{
+				ec->numwords = -1;
+				return;
+			}
+			ec->wordnums[j] = w;
+			ec->words[j] = 0;
+			ec->numwords++;
+		}
+		((byte *)&ec->words[j])[(c>>3)&3] |= 1<<(c&7);
+	}
+}
+
 /*
 ===============
 SV_LinkEdict
 
 ===============
 */
-#define MAX_TOTAL_ENT_LEAFS		128
 void SV_LinkEdict (edict_t *ent)
 {
-	areanode_t	*node;
 	int			leafs[MAX_TOTAL_ENT_LEAFS];
 	int			clusters[MAX_TOTAL_ENT_LEAFS];
 	int			num_leafs;
@@ -312,6 +557,8 @@ void SV_LinkEdict (edict_t *ent)
 		}
 	}
 
+	SV_LinkEdictClusters (ent);
+
 	// if first time, make sure old_origin is valid
 	if (!ent->linkcount)
 	{
@@ -322,48 +569,22 @@ void SV_LinkEdict (edict_t *ent)
 	if (ent->solid == SOLID_NOT)
 		return;
 
-// find the first node that the ent's box crosses
-	node = sv_areanodes;
-	while (1)
-	{
-		if (node->axis == -1)
-			break;
-		if (ent->absmin[node->axis] > node->dist)
-			node = node->children[0];
-		else if (ent->absmax[node->axis] < node->dist)
-			node = node->children[1];
-		else
-			break;		// crosses the node
-	}
-	
-	// link it in	
-	if (ent->solid == SOLID_TRIGGER)
-		InsertLinkBefore (&ent->area, &node->trigger_edicts);
-	else
-		InsertLinkBefore (&ent->area, &node->solid_edicts);
-
+	sv_areaindex->link (ent);
 }
 
 
 /*
 ====================
-SV_AreaEdicts_r
+SV_AreaEdictsInList
 
+Adds the edicts of the list touching the area,
+false if area_list is full
 ====================
 */
-void SV_AreaEdicts_r (areanode_t *node)
+qboolean SV_AreaEdictsInList (link_t *start)
 {
-	link_t		*l, *next, *start;
+	link_t		*l, *next;
 	edict_t		*check;
-	int			count;
-
-	count = 0;
-
-	// touch linked edicts
-	if (area_type == AREA_SOLID)
-		start = &node->solid_edicts;
-	else
-		start = &node->trigger_edicts;
 
 	for (l=start->next  ; l != start ; l = next)
 	{
@@ -383,12 +604,27 @@ void SV_AreaEdicts_r (areanode_t *node)
 		if (area_count == area_maxcount)
 		{
 			Com_Printf ("SV_AreaEdicts: MAXCOUNT\n");
-			return;
+			return false;
 		}
 
 		area_list[area_count] = check;
 		area_count++;
 	}
+
+	return true;
+}
+
+/*
+====================
+SV_AreaEdicts_r
+
+====================
+*/
+void SV_AreaEdicts_r (areanode_t *node)
+{
+	// touch linked edicts
+	if (!SV_AreaEdictsInList (area_type == AREA_SOLID ? &node->solid_edicts : &node->trigger_edicts))
+		return;
 	
 	if (node->axis == -1)
 		return;		// terminal node
@@ -400,6 +636,51 @@ void SV_AreaEdicts_r (areanode_t *node)
 		SV_AreaEdicts_r ( node->children[1] );
 }
 
+void SV_AreaTreeEdicts (void)
+{
+	SV_AreaEdicts_r (sv_areanodes);
+}
+
+/*
+====================
+SV_AreaGridEdicts
+
+====================
+*/
+void SV_AreaGridEdicts (void)
+{
+	areagrid_t	*g;
+	areacell_t	*cell;
+	float		margin;
+	int			x, y, x0, x1, y0, y1;
+
+	g = &sv_loosegrid;
+
+	if (!SV_AreaEdictsInList (area_type == AREA_SOLID ? &g->large.solid_edicts : &g->large.trigger_edicts))
+		return;
+
+	// an edict touching the area has its center within half a cell of it,
+	// one more unit keeps the rounding of the centers on the safe side
+	margin = g->cellsize * 0.5 + 1;
+	x0 = SV_AreaGridCell (area_mins[0] - margin, 0);
+	x1 = SV_AreaGridCell (area_maxs[0] + margin, 0);
+	y0 = SV_AreaGridCell (area_mins[1] - margin, 1);
+	y1 = SV_AreaGridCell (area_maxs[1] + margin, 1);
+
+	for (y=y0 ; y<=y1 ; y++)
+	{
+		cell = &g->grid[y*AREAGRID_CELLS + x0];
+		for (x=x0 ; x<=x1 ; x++, cell++)
+		{
+			if (!SV_AreaEdictsInList (area_type == AREA_SOLID ? &cell->solid_edicts : &cell->trigger_edicts))
+				return;
+		}
+	}
+}
+
+areaindex_t	sv_areatreeindex = { "area tree", SV_AreaTreeClear, SV_AreaTreeLink, SV_AreaTreeEdicts };
+areaindex_t	sv_areagridindex = { "loose grid", SV_AreaGridClear, SV_AreaGridLink, SV_AreaGridEdicts };
+
 /*
 ================
 SV_AreaEdicts
@@ -415,11 +696,188 @@ int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **list,
 	area_maxcount = maxcount;
 	area_type = areatype;
 
-	SV_AreaEdicts_r (sv_areanodes);
+	sv_areaindex->areaedicts ();
 
 	return area_count;
 }
 
+/*
+================
+SV_AreaBench_f
+
+areabench [edicts] [frames]
+
+Links a crowd of moving edicts of all sizes into each index and moves
+them around for a number of 100 msec frames. Every frame relinks every
+edict and queries the solids and triggers around it, as moving things
+do. The edicts of a running map are put back in the index afterwards.
+================
+*/
+#define	AREABENCH_EDICTS	1000
+#define	AREABENCH_FRAMES	100
+
+static unsigned	areabench_seed;
+
+static float SV_AreaBenchRandom (void)
+{
+	areabench_seed = areabench_seed * 1103515245 + 12345;
+	return ((areabench_seed >> 8) & 0xffff) / 65535.0;
+}
+
+void SV_AreaBench_f (void)
+{
+	areaindex_t	*indexes[2];
+	areaindex_t	*saveindex;
+	int			numedicts, numframes;
+	int			numrelink;
+	int			b, e, f, i, n;
+	int			start, linkmsec, querymsec;
+	int			found[2];
+	float		size;
+	vec3_t		wmins, wmaxs;
+	vec3_t		qmins, qmaxs;
+	vec3_t		*velocity;
+	edict_t		*edicts, *ent;
+	edict_t		**touch, **relink;
+
+	numedicts = Cmd_Argc () > 1 ? atoi (Cmd_Argv (1)) : AREABENCH_EDICTS;
+	if (numedicts < 1)
+		numedicts = 1;
+	numframes = Cmd_Argc () > 2 ? atoi (Cmd_Argv (2)) : AREABENCH_FRAMES;
+	if (numframes < 1)
+		numframes = 1;
+
+	// the edicts of a running map are unhooked from the index by the clears
+	numrelink = 0;
+	relink = Z_Malloc (MAX_EDICTS * sizeof(edict_t *));
+	if (sv.state != ss_dead && sv_areaindex && ge)
+	{
+		for (e=1 ; e<ge->num_edicts ; e++)
+		{
+			ent = EDICT_NUM(e);
+			if (ent->area.prev)
+				relink[numrelink++] = ent;
+		}
+		VectorCopy (sv.models[1]->mins, wmins);
+		VectorCopy (sv.models[1]->maxs, wmaxs);
+	}
+	else
+	{
+		VectorSet (wmins, -2048, -2048, -2048);
+		VectorSet (wmaxs, 2048, 2048, 2048);
+	}
+
+	edicts = Z_Malloc (numedicts * sizeof(edict_t));
+	velocity = Z_Malloc (numedicts * sizeof(vec3_t));
+	touch = Z_Malloc (MAX_EDICTS * sizeof(edict_t *));
+
+	indexes[0] = &sv_areatreeindex;
+	indexes[1] = &sv_areagridindex;
+	saveindex = sv_areaindex;
+
+	Com_Printf ("areabench: %i edicts, %i frames\n", numedicts, numframes);
+
+	for (b=0 ; b<2 ; b++)
+	{
+		sv_areaindex = indexes[b];
+		sv_areaindex->clear (wmins, wmaxs);
+
+		// same crowd for both: mostly players and monsters, projectiles,
+		// a few triggers and some big movers
+		areabench_seed = numedicts;
+		for (i=0 ; i<numedicts ; i++)
+		{
+			ent = &edicts[i];
+			memset (ent, 0, sizeof(*ent));
+			ent->inuse = true;
+
+			if (i % 3 == 0)
+				size = 0;
+			else if (i % 25 == 0)
+				size = 128 + 256 * SV_AreaBenchRandom ();
+			else
+				size = 16;
+			VectorSet (ent->mins, -size, -size, -size);
+			VectorSet (ent->maxs, size, size, size);
+
+			ent->solid = (i % 10 == 0) ? SOLID_TRIGGER : SOLID_BBOX;
+
+			for (n=0 ; n<3 ; n++)
+			{
+				ent->s.origin[n] = wmins[n] + (wmaxs[n] - wmins[n]) * SV_AreaBenchRandom ();
+				velocity[i][n] = (i % 3 == 0 ? 1000 : 300) * (SV_AreaBenchRandom () * 2 - 1);
+			}
+		}
+
+		found[b] = 0;
+		linkmsec = 0;
+		querymsec = 0;
+
+		for (f=0 ; f<numframes ; f++)
+		{
+			start = Sys_Milliseconds ();
+			for (i=0 ; i<numedicts ; i++)
+			{
+				ent = &edicts[i];
+				for (n=0 ; n<3 ; n++)
+				{
+					ent->s.origin[n] += velocity[i][n] * 0.1;
+					if (ent->s.origin[n] < wmins[n] || ent->s.origin[n] > wmaxs[n])
+					{
+						velocity[i][n] = -velocity[i][n];
+						ent->s.origin[n] += velocity[i][n] * 0.2;
+					}
+				}
+				VectorAdd (ent->s.origin, ent->mins, ent->absmin);
+				VectorAdd (ent->s.origin, ent->maxs, ent->absmax);
+
+				SV_UnlinkEdict (ent);
+				sv_areaindex->link (ent);
+			}
+			linkmsec += Sys_Milliseconds () - start;
+
+			start = Sys_Milliseconds ();
+			for (i=0 ; i<numedicts ; i++)
+			{
+				ent = &edicts[i];
+				for (n=0 ; n<3 ; n++)
+				{	// the move bounds of a frame
+					qmins[n] = ent->absmin[n] - 32;
+					qmaxs[n] = ent->absmax[n] + 32;
+				}
+				found[b] += SV_AreaEdicts (qmins, qmaxs, touch, MAX_EDICTS, AREA_SOLID);
+				found[b] += SV_AreaEdicts (qmins, qmaxs, touch, MAX_EDICTS, AREA_TRIGGERS);
+			}
+			querymsec += Sys_Milliseconds () - start;
+		}
+
+		for (i=0 ; i<numedicts ; i++)
+			SV_UnlinkEdict (&edicts[i]);
+
+		Com_Printf ("%-10s %5i ms link, %8.1f links/ms, %5i ms query, %8.1f queries/ms, %.1f edicts/query\n",
+			sv_areaindex->name,
+			linkmsec, linkmsec ? (float)numedicts * numframes / linkmsec : 0.0f,
+			querymsec, querymsec ? (float)numedicts * numframes * 2 / querymsec : 0.0f,
+			(float)found[b] / (numedicts * numframes * 2));
+	}
+
+	if (found[0] != found[1])
+		Com_Printf ("areabench: MISMATCH, the indexes found different edicts\n");
+
+	sv_areaindex = saveindex;
+	if (numrelink)
+	{
+		sv_areaindex->clear (sv.models[1]->mins, sv.models[1]->maxs);
+		for (i=0 ; i<numrelink ; i++)
+			sv_areaindex->link (relink[i]);
+	}
+
+	Z_Free (touch);
+	Z_Free (velocity);
+	Z_Free (edicts);
+	Z_Free (relink);
+}
+
 
 //===========================================================================
 